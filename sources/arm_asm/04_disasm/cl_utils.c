@@ -1,27 +1,85 @@
 #include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 
-static char buf[100*1024];
+/*
+Output of buffer mode.
+Each cl_printf result is stored NUL terminated, and its start is kept in
+line_offsets, so that cl_get_result does not need to scan the buffer.
+Both arrays grow as needed.
+*/
+static char *buf = NULL;
+static int buf_size = 0;
+static int pos = 0;
+
+static int *line_offsets = NULL;
+static int line_capacity = 0;
+static int line_num = 0;
 
 static int to_buffer = 0;
-static int pos = 0;
+
+/*
+Stream mode keeps output in buf without index and NUL,
+and writes it to stream_fd once CL_STREAM_FLUSH_SIZE bytes are collected.
+*/
+#define CL_STREAM_FLUSH_SIZE (1024*1024)
+
+static int to_stream = 0;
+static int stream_fd = -1;
+
+#define CL_INITIAL_BUF_SIZE (100*1024)
+#define CL_INITIAL_LINE_CAPACITY 1024
+
+static void cl_reserve(int len) {
+    int new_size;
+
+    if(pos + len <= buf_size)
+        return;
+    new_size = buf_size > 0 ? buf_size : CL_INITIAL_BUF_SIZE;
+    while(new_size < pos + len)
+        new_size *= 2;
+    buf = realloc(buf, new_size);
+    if(buf == NULL) {
+        fprintf(stderr, "cl_printf: out of memory (%d bytes)\n", new_size);
+        exit(1);
+    }
+    buf_size = new_size;
+}
+
+static void cl_add_line(int offset) {
+    if(line_num == line_capacity) {
+        line_capacity = line_capacity > 0 ? line_capacity*2 : CL_INITIAL_LINE_CAPACITY;
+        line_offsets = realloc(line_offsets, sizeof(int)*line_capacity);
+        if(line_offsets == NULL) {
+            fprintf(stderr, "cl_printf: out of memory (%d lines)\n", line_capacity);
+            exit(1);
+        }
+    }
+    line_offsets[line_num++] = offset;
+}
 
 void cl_clear_output() {
+    cl_reserve(1);
     pos = 0;
     buf[0] = '\0';
+    line_num = 0;
 }
 
 
+/*
+Return the output of num-th cl_printf since cl_clear_output.
+*/
 char *cl_get_result(int num) {
-    int null_count=0;
-    int i=0;
-    while (null_count != num) {
-        if (buf[i] == '\0') {
-            null_count++;
-        }
-        i++;
-    }
-    return &buf[i];
+    if(num < 0 || num >= line_num)
+        return NULL;
+    return &buf[line_offsets[num]];
+}
+
+int cl_get_result_num() {
+    return line_num;
 }
 
 void cl_enable_buffer_mode() {
@@ -33,12 +91,82 @@ void cl_disable_buffer_mode() {
 }
 
 
+/*
+Write all pending output of stream mode in one write.
+Outside stream mode there is no fd, and buf belongs to buffer mode.
+*/
+void cl_flush_output() {
+    int written = 0;
+
+    if(!to_stream)
+        return;
+
+    while(written < pos) {
+        int res = write(stream_fd, &buf[written], pos - written);
+        if(res < 0) {
+            perror("cl_flush_output");
+            exit(1);
+        }
+        written += res;
+    }
+    pos = 0;
+}
+
+/*
+Results of buffer mode not cleared yet are kept in buf without their NULs,
+so they are written before the stream output, and the buffer is reused.
+*/
+void cl_enable_stream_mode(int fd) {
+    int i, len = 0;
+
+    for(i = 0; i < line_num; i++) {
+        int line_len = strlen(&buf[line_offsets[i]]);
+        memmove(&buf[len], &buf[line_offsets[i]], line_len);
+        len += line_len;
+    }
+    line_num = 0;
+    pos = len;
+    to_stream = 1;
+    stream_fd = fd;
+}
+
+void cl_disable_stream_mode() {
+    cl_flush_output();
+    to_stream = 0;
+    stream_fd = -1;
+}
+
+
+/*
+Format at the end of buf. Retry once with exact size if it did not fit.
+Return the length without NUL.
+*/
+static int cl_format(char *fmt, va_list arg_ptr) {
+    va_list retry_ptr;
+    int len;
+
+    cl_reserve(256);
+    va_copy(retry_ptr, arg_ptr);
+    len = vsnprintf(&buf[pos], buf_size - pos, fmt, arg_ptr);
+    if(len >= buf_size - pos) {
+        cl_reserve(len + 1);
+        vsnprintf(&buf[pos], buf_size - pos, fmt, retry_ptr);
+    }
+    va_end(retry_ptr);
+    return len;
+}
+
 void cl_printf(char *fmt, ...) {
     va_list arg_ptr;
     va_start(arg_ptr, fmt);
 
-    if(to_buffer) {
-        pos += vsprintf(&buf[pos], fmt, arg_ptr);
+    if(to_stream) {
+        pos += cl_format(fmt, arg_ptr);
+        if(pos >= CL_STREAM_FLUSH_SIZE)
+            cl_flush_output();
+    } else if(to_buffer) {
+        cl_add_line(pos);
+        pos += cl_format(fmt, arg_ptr);
         pos++;
     } else {
         vprintf(fmt, arg_ptr);
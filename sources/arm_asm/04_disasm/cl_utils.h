@@ -0,0 +1,21 @@
+/*
+Output helpers for unit tests. See arm_asm.md chapter 04.
+
+In buffer mode each cl_printf call becomes one result,
+which can be read by cl_get_result in the order of calls.
+*/
+void cl_printf(char *fmt, ...);
+
+void cl_enable_buffer_mode();
+void cl_disable_buffer_mode();
+char *cl_get_result(int num);
+int cl_get_result_num();
+void cl_clear_output();
+
+/*
+Collect output and write it to fd in large batches.
+Results of buffer mode not cleared yet are written first.
+*/
+void cl_enable_stream_mode(int fd);
+void cl_disable_stream_mode();
+void cl_flush_output();
@@ -0,0 +1,973 @@
+/*
+Simple ARM disassembler.
+
+gcc -O2 -pthread disasm.c cl_utils.c -o disasm
+./disasm                # run unit tests
+./disasm hello.bin      # disassemble
+./disasm -j4 large.bin  # disassemble on 4 threads, -j0 for all cores
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cl_utils.h"
+#include "disasm.h"
+
+#define BITS(word, hi, lo) (((unsigned int)(word) >> (lo)) & ((1u << ((hi)-(lo)+1)) - 1))
+
+static char *cond_names[16] = {
+    "eq", "ne", "cs", "cc", "mi", "pl", "vs", "vc",
+    "hi", "ls", "ge", "lt", "gt", "le", "", ""
+};
+
+static char *dp_names[16] = {
+    "and", "eor", "sub", "rsb", "add", "adc", "sbc", "rsc",
+    "tst", "teq", "cmp", "cmn", "orr", "mov", "bic", "mvn"
+};
+
+static char *shift_names[4] = {"lsl", "lsr", "asr", "ror"};
+
+/* P and U bits of ldm/stm */
+static char *ldm_mode_names[4] = {"da", "ia", "db", "ib"};
+
+enum {
+    DP_TST = 0x8,
+    DP_CMN = 0xb,
+    DP_MOV = 0xd,
+    DP_MVN = 0xf
+};
+
+#define SHIFT_LSL 0
+#define SHIFT_ROR 3
+
+
+/*
+Small writers used instead of sprintf, which is most of the decode time.
+Each returns the position after the written text.
+*/
+static char *put_str(char *p, char *str) {
+    while(*str)
+        *p++ = *str++;
+    return p;
+}
+
+static char *put_reg(char *p, int reg) {
+    *p++ = 'r';
+    if(reg >= 10) {
+        *p++ = '1';
+        reg -= 10;
+    }
+    *p++ = '0' + reg;
+    return p;
+}
+
+static char *put_dec(char *p, int val) {
+    if(val >= 10)
+        *p++ = '0' + val/10;
+    *p++ = '0' + val%10;
+    return p;
+}
+
+/* #0x1f, #-0x8 */
+static char *put_imm(char *p, int is_negative, unsigned int val) {
+    static char digits[] = "0123456789abcdef";
+    int shift = 28;
+
+    *p++ = '#';
+    if(is_negative)
+        *p++ = '-';
+    *p++ = '0';
+    *p++ = 'x';
+    while(shift > 0 && (val >> shift) == 0)
+        shift -= 4;
+    for(; shift >= 0; shift -= 4)
+        *p++ = digits[(val >> shift) & 0xf];
+    return p;
+}
+
+/* mnemonic, s and condition, then a space. */
+static char *put_mnemonic(char *p, char *name, char *suffix, int word) {
+    p = put_str(p, name);
+    p = put_str(p, suffix);
+    p = put_str(p, cond_names[BITS(word, 31, 28)]);
+    *p++ = ' ';
+    return p;
+}
+
+static char *put_sep(char *p) {
+    *p++ = ',';
+    *p++ = ' ';
+    return p;
+}
+
+/* ", lsl #2" or nothing */
+static char *put_imm_shift(char *p, int word) {
+    int type = BITS(word, 6, 5);
+    int amount = BITS(word, 11, 7);
+
+    if(type == SHIFT_LSL && amount == 0)
+        return p;
+    p = put_sep(p);
+    if(type == SHIFT_ROR && amount == 0)
+        return put_str(p, "rrx");
+    p = put_str(p, shift_names[type]);
+    p = put_str(p, " #");
+    return put_dec(p, amount == 0 ? 32 : amount);
+}
+
+
+/*
+Decoders of each instruction class.
+They only check the bits which are not used for the table lookup.
+*/
+/*
+imm8 rotated right by rot*2, see "即値をちゃんと表示しよう".
+The & 31 makes rot 0 shift left by 0, and OR of the same value keeps it,
+so there is no branch.
+*/
+static unsigned int rotated_imm(int word) {
+    unsigned int imm8 = BITS(word, 7, 0);
+    int rot = BITS(word, 11, 8)*2;
+    return (imm8 >> rot) | (imm8 << ((32 - rot) & 31));
+}
+
+static char *s_suffix(int word) {
+    return BITS(word, 20, 20) ? "s" : "";
+}
+
+/*
+Write "op rd, rn, " part. Return NULL if should-be-zero register is not zero.
+*/
+static char *put_dp_head(char *p, int word) {
+    int op = BITS(word, 24, 21);
+    int rn = BITS(word, 19, 16);
+    int rd = BITS(word, 15, 12);
+
+    if(op >= DP_TST && op <= DP_CMN) {
+        if(rd != 0)
+            return NULL;
+        p = put_mnemonic(p, dp_names[op], "", word);
+        return put_sep(put_reg(p, rn));
+    }
+    if(op == DP_MOV || op == DP_MVN) {
+        if(rn != 0)
+            return NULL;
+        p = put_mnemonic(p, dp_names[op], s_suffix(word), word);
+        return put_sep(put_reg(p, rd));
+    }
+    p = put_mnemonic(p, dp_names[op], s_suffix(word), word);
+    p = put_sep(put_reg(p, rd));
+    return put_sep(put_reg(p, rn));
+}
+
+/*
+mov with shift is written as the shift, like "lsr r3, r1, #28".
+*/
+static char *put_shift_head(char *p, int word, int type) {
+    if(BITS(word, 19, 16) != 0)
+        return NULL;
+    p = put_mnemonic(p, shift_names[type], s_suffix(word), word);
+    p = put_sep(put_reg(p, BITS(word, 15, 12)));
+    return put_sep(put_reg(p, BITS(word, 3, 0)));
+}
+
+/* add r1, r1, #0x1 */
+static int decode_dp_imm(int word, char *out) {
+    char *p = put_dp_head(out, word);
+
+    if(p == NULL)
+        return 0;
+    p = put_imm(p, 0, rotated_imm(word));
+    *p = '\0';
+    return 1;
+}
+
+/* add r1, r2, r3, lsl #2 / lsr r3, r1, #28 */
+static int decode_dp_reg(int word, char *out) {
+    int type = BITS(word, 6, 5);
+    int amount = BITS(word, 11, 7);
+    char *p;
+
+    if(BITS(word, 24, 21) == DP_MOV && (type != SHIFT_LSL || amount != 0)) {
+        if(type == SHIFT_ROR && amount == 0) {
+            if(BITS(word, 19, 16) != 0)
+                return 0;
+            p = put_mnemonic(out, "rrx", s_suffix(word), word);
+            p = put_sep(put_reg(p, BITS(word, 15, 12)));
+            p = put_reg(p, BITS(word, 3, 0));
+        } else {
+            p = put_shift_head(out, word, type);
+            if(p == NULL)
+                return 0;
+            *p++ = '#';
+            p = put_dec(p, amount == 0 ? 32 : amount);
+        }
+        *p = '\0';
+        return 1;
+    }
+
+    p = put_dp_head(out, word);
+    if(p == NULL)
+        return 0;
+    p = put_reg(p, BITS(word, 3, 0));
+    p = put_imm_shift(p, word);
+    *p = '\0';
+    return 1;
+}
+
+/* add r1, r2, r3, lsl r4 / lsl r1, r2, r3 */
+static int decode_dp_reg_shift(int word, char *out) {
+    int type = BITS(word, 6, 5);
+    char *p;
+
+    if(BITS(word, 24, 21) == DP_MOV) {
+        p = put_shift_head(out, word, type);
+    } else {
+        p = put_dp_head(out, word);
+        if(p != NULL) {
+            p = put_sep(put_reg(p, BITS(word, 3, 0)));
+            p = put_str(p, shift_names[type]);
+            *p++ = ' ';
+        }
+    }
+    if(p == NULL)
+        return 0;
+    p = put_reg(p, BITS(word, 11, 8));
+    *p = '\0';
+    return 1;
+}
+
+/* mul r0, r1, r2 */
+static int decode_mul(int word, char *out) {
+    char *p;
+
+    if(BITS(word, 15, 12) != 0)
+        return 0;
+    p = put_mnemonic(out, "mul", s_suffix(word), word);
+    p = put_sep(put_reg(p, BITS(word, 19, 16)));
+    p = put_sep(put_reg(p, BITS(word, 3, 0)));
+    p = put_reg(p, BITS(word, 11, 8));
+    *p = '\0';
+    return 1;
+}
+
+/* bx r14 / blx r12 */
+static int decode_bx(int word, char *out) {
+    char *p;
+
+    if(BITS(word, 19, 8) != 0xfff)
+        return 0;
+    p = put_mnemonic(out, BITS(word, 5, 5) ? "blx" : "bx", "", word);
+    p = put_reg(p, BITS(word, 3, 0));
+    *p = '\0';
+    return 1;
+}
+
+/*
+ldr r0, [r1] / [r1, #0x4] / [r1, #-0x4]! / [r1], #0x4 / [r1, -r2, lsl #2]
+*/
+static int decode_ldr_str(int word, char *out) {
+    int pre = BITS(word, 24, 24);
+    int up = BITS(word, 23, 23);
+    int writeback = BITS(word, 21, 21);
+    int is_reg = BITS(word, 25, 25);
+    char *p;
+
+    // post index with W is ldrt/strt.
+    if(!pre && writeback)
+        return 0;
+
+    p = put_mnemonic(out, BITS(word, 20, 20) ? "ldr" : "str", BITS(word, 22, 22) ? "b" : "", word);
+    p = put_sep(put_reg(p, BITS(word, 15, 12)));
+    *p++ = '[';
+    p = put_reg(p, BITS(word, 19, 16));
+    if(pre && !writeback && !is_reg && up && BITS(word, 11, 0) == 0) {
+        *p++ = ']';
+        *p = '\0';
+        return 1;
+    }
+    if(!pre)
+        *p++ = ']';
+    p = put_sep(p);
+    if(is_reg) {
+        if(!up)
+            *p++ = '-';
+        p = put_reg(p, BITS(word, 3, 0));
+        p = put_imm_shift(p, word);
+    } else {
+        p = put_imm(p, !up, BITS(word, 11, 0));
+    }
+    if(pre) {
+        *p++ = ']';
+        if(writeback)
+            *p++ = '!';
+    }
+    *p = '\0';
+    return 1;
+}
+
+/*
+stmdb r13!, {r1, r14}
+Always written as ldmia/stmdb style, not ldmfd (see "他のファイルもやっていこう").
+*/
+static int decode_ldm_stm(int word, char *out) {
+    int list = BITS(word, 15, 0);
+    int reg;
+    char *p;
+
+    // user mode registers are not used in lessons.
+    if(BITS(word, 22, 22) || list == 0)
+        return 0;
+
+    p = put_str(out, BITS(word, 20, 20) ? "ldm" : "stm");
+    p = put_mnemonic(p, ldm_mode_names[BITS(word, 24, 23)], "", word);
+    p = put_reg(p, BITS(word, 19, 16));
+    if(BITS(word, 21, 21))
+        *p++ = '!';
+    p = put_str(put_sep(p), "{");
+    for(reg = 0; reg < 16; reg++) {
+        if(list & (1 << reg)) {
+            if(p[-1] != '{')
+                p = put_sep(p);
+            p = put_reg(p, reg);
+        }
+    }
+    *p++ = '}';
+    *p = '\0';
+    return 1;
+}
+
+/* b [r15, #-0x8] */
+static int decode_branch(int word, char *out) {
+    int offset = (int)((unsigned int)word << 8) >> 6;
+    char *p;
+
+    p = put_mnemonic(out, BITS(word, 24, 24) ? "bl" : "b", "", word);
+    p = put_str(p, "[r15, ");
+    p = put_imm(p, offset < 0, offset < 0 ? -offset : offset);
+    *p++ = ']';
+    *p = '\0';
+    return 1;
+}
+
+
+
+/*
+Decode table
+
+Bits [27:20] and [7:4] of the word decide the instruction class.
+They are joined into a 12bit key, and the class of each key is
+resolved once into decode_table. One byte per key keeps the table in L1.
+*/
+#define DECODE_TABLE_SIZE 4096
+
+enum DecodeClass {
+    CLASS_UNKNOWN,
+    CLASS_DP_IMM,
+    CLASS_DP_REG,
+    CLASS_DP_REG_SHIFT,
+    CLASS_MUL,
+    CLASS_BX,
+    CLASS_LDR_STR,
+    CLASS_LDM_STM,
+    CLASS_BRANCH
+};
+
+static unsigned char decode_table[DECODE_TABLE_SIZE];
+static int decode_table_ready = 0;
+
+static int decode_key(int word) {
+    return (BITS(word, 27, 20) << 4) | BITS(word, 7, 4);
+}
+
+/*
+op8: bits [27:20], lo4: bits [7:4].
+*/
+static int classify(int op8, int lo4) {
+    // tst, teq, cmp, cmn without S are msr/mrs/bx and others.
+    int is_misc = (op8 & 0xd9) == 0x10;
+
+    switch(op8 >> 5) {
+        case 0:
+            if((lo4 & 1) == 0)
+                return is_misc ? CLASS_UNKNOWN : CLASS_DP_REG;
+            if((lo4 & 8) == 0) {
+                if(is_misc)
+                    return op8 == 0x12 && (lo4 == 1 || lo4 == 3) ? CLASS_BX : CLASS_UNKNOWN;
+                return CLASS_DP_REG_SHIFT;
+            }
+            // multiply and extra load/store. only mul is supported.
+            return (op8 & 0xfe) == 0 && lo4 == 9 ? CLASS_MUL : CLASS_UNKNOWN;
+        case 1:
+            return is_misc ? CLASS_UNKNOWN : CLASS_DP_IMM;
+        case 2:
+            return CLASS_LDR_STR;
+        case 3:
+            return (lo4 & 1) ? CLASS_UNKNOWN : CLASS_LDR_STR;
+        case 4:
+            return CLASS_LDM_STM;
+        case 5:
+            return CLASS_BRANCH;
+    }
+    return CLASS_UNKNOWN;
+}
+
+void disasm_init() {
+    int key;
+
+    if(decode_table_ready)
+        return;
+    for(key = 0; key < DECODE_TABLE_SIZE; key++)
+        decode_table[key] = classify(key >> 4, key & 0xf);
+    decode_table_ready = 1;
+}
+
+int disasm_word(int word, char *out) {
+    if(!decode_table_ready)
+        disasm_init();
+    // unconditional instructions are not used in lessons.
+    if(BITS(word, 31, 28) == 0xf)
+        return 0;
+
+    switch(decode_table[decode_key(word)]) {
+        case CLASS_DP_IMM:
+            return decode_dp_imm(word, out);
+        case CLASS_DP_REG:
+            return decode_dp_reg(word, out);
+        case CLASS_DP_REG_SHIFT:
+            return decode_dp_reg_shift(word, out);
+        case CLASS_MUL:
+            return decode_mul(word, out);
+        case CLASS_BX:
+            return decode_bx(word, out);
+        case CLASS_LDR_STR:
+            return decode_ldr_str(word, out);
+        case CLASS_LDM_STM:
+            return decode_ldm_stm(word, out);
+        case CLASS_BRANCH:
+            return decode_branch(word, out);
+    }
+    return 0;
+}
+
+/*
+Mask and compare checks in the order of chapter 04.
+*/
+int disasm_word_chain(int word, char *out) {
+    unsigned int w = (unsigned int)word;
+
+    if((w >> 28) == 0xf)
+        return 0;
+    if((w & 0x0ff000d0) == 0x01200010)
+        return decode_bx(word, out);
+    if((w & 0x0fe000f0) == 0x00000090)
+        return decode_mul(word, out);
+    if((w & 0x0e000000) == 0x0a000000)
+        return decode_branch(word, out);
+    if((w & 0x0e000000) == 0x08000000)
+        return decode_ldm_stm(word, out);
+    if((w & 0x0e000000) == 0x04000000)
+        return decode_ldr_str(word, out);
+    if((w & 0x0e000010) == 0x06000000)
+        return decode_ldr_str(word, out);
+    if((w & 0x0d900000) == 0x01000000)
+        return 0;
+    if((w & 0x0e000000) == 0x02000000)
+        return decode_dp_imm(word, out);
+    if((w & 0x0e000010) == 0x00000000)
+        return decode_dp_reg(word, out);
+    if((w & 0x0e000090) == 0x00000010)
+        return decode_dp_reg_shift(word, out);
+    return 0;
+}
+
+int print_asm(int word) {
+    char line[DISASM_LINE_MAX];
+
+    if(!disasm_word(word, line))
+        return 0;
+    cl_printf("%s\n", line);
+    return 1;
+}
+
+
+/*
+File
+*/
+
+static int read_word(unsigned char *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+/* "0x00010000  " */
+static char *put_addr(char *p, int pos) {
+    static char digits[] = "0123456789abcdef";
+    unsigned int addr = DISASM_BASE_ADDR + pos;
+    int shift;
+
+    *p++ = '0';
+    *p++ = 'x';
+    for(shift = 28; shift >= 0; shift -= 4)
+        *p++ = digits[(addr >> shift) & 0xf];
+    *p++ = ' ';
+    *p++ = ' ';
+    return p;
+}
+
+/*
+One line of the word at pos, with newline.
+Return NULL if it is not a known instruction.
+*/
+static char *put_code_line(char *p, unsigned char *image, int pos, int size) {
+    char *text = put_addr(p, pos);
+
+    if(pos + 4 > size || !disasm_word(read_word(&image[pos]), text))
+        return NULL;
+    p = text + strlen(text);
+    *p++ = '\n';
+    return p;
+}
+
+/*
+Bytes are shown in file order, like binary editors.
+*/
+static char *put_hex_line(char *p, unsigned char *image, int pos, int size) {
+    static char digits[] = "0123456789ABCDEF";
+    int i;
+
+    p = put_addr(p, pos);
+    for(i = pos; i < pos + 4 && i < size; i++) {
+        if(i != pos)
+            *p++ = ' ';
+        *p++ = digits[image[i] >> 4];
+        *p++ = digits[image[i] & 0xf];
+    }
+    *p++ = '\n';
+    return p;
+}
+
+/* address, instruction and newline */
+#define DISASM_OUT_LINE_MAX (DISASM_LINE_MAX + 16)
+
+void disasm_image(unsigned char *image, int size) {
+    char line[DISASM_OUT_LINE_MAX];
+    char *end;
+    int pos;
+
+    for(pos = 0; pos < size; pos += 4) {
+        end = put_code_line(line, image, pos, size);
+        if(end == NULL)
+            break;
+        *end = '\0';
+        cl_printf("%s", line);
+    }
+    for(; pos < size; pos += 4) {
+        end = put_hex_line(line, image, pos, size);
+        *end = '\0';
+        cl_printf("%s", line);
+    }
+}
+
+
+/*
+Parallel mode
+
+The image is split into chunks of whole words, and each chunk is
+disassembled into its own text buffer by worker threads.
+A chunk switches to hex dump at its own first unknown word.
+Then, in file order, every chunk after the first one which saw an unknown word
+is redone as hex dump. This is cheap and gives the same text as disasm_image.
+*/
+struct DisasmChunk {
+    int begin;      /* byte offset */
+    int end;
+    char *text;
+    int len;
+    int capacity;
+    int has_unknown;
+};
+
+struct DisasmJobs {
+    unsigned char *image;
+    int size;
+    struct DisasmChunk *chunks;
+    int chunk_num;
+    int next_chunk;
+};
+
+static void chunk_reserve(struct DisasmChunk *chunk) {
+    if(chunk->len + DISASM_OUT_LINE_MAX <= chunk->capacity)
+        return;
+    chunk->capacity = chunk->capacity > 0 ? chunk->capacity*2 : 64*1024;
+    chunk->text = realloc(chunk->text, chunk->capacity);
+    if(chunk->text == NULL) {
+        fprintf(stderr, "disasm: out of memory\n");
+        exit(1);
+    }
+}
+
+static void disasm_chunk(unsigned char *image, int size, struct DisasmChunk *chunk, int force_hex) {
+    int is_hex = force_hex;
+    int pos;
+
+    chunk->len = 0;
+    for(pos = chunk->begin; pos < chunk->end; pos += 4) {
+        char *p;
+
+        chunk_reserve(chunk);
+        p = is_hex ? NULL : put_code_line(&chunk->text[chunk->len], image, pos, size);
+        if(p == NULL) {
+            is_hex = 1;
+            p = put_hex_line(&chunk->text[chunk->len], image, pos, size);
+        }
+        chunk->len = p - chunk->text;
+    }
+    chunk->has_unknown = is_hex;
+}
+
+static void *disasm_worker(void *arg) {
+    struct DisasmJobs *jobs = arg;
+
+    while(1) {
+        int idx = __sync_fetch_and_add(&jobs->next_chunk, 1);
+        if(idx >= jobs->chunk_num)
+            break;
+        disasm_chunk(jobs->image, jobs->size, &jobs->chunks[idx], 0);
+    }
+    return NULL;
+}
+
+static void write_all(int fd, char *buf, int len) {
+    while(len > 0) {
+        int res = write(fd, buf, len);
+        if(res < 0) {
+            perror("disasm: write");
+            exit(1);
+        }
+        buf += res;
+        len -= res;
+    }
+}
+
+void disasm_image_parallel(unsigned char *image, int size, int fd, int thread_num, int chunk_words) {
+    struct DisasmJobs jobs;
+    pthread_t *threads;
+    int chunk_bytes = chunk_words*4;
+    int i, seen_unknown = 0;
+
+    if(thread_num <= 0)
+        thread_num = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    disasm_init();
+
+    jobs.image = image;
+    jobs.size = size;
+    jobs.chunk_num = (size + chunk_bytes - 1)/chunk_bytes;
+    jobs.chunks = calloc(jobs.chunk_num > 0 ? jobs.chunk_num : 1, sizeof(struct DisasmChunk));
+    jobs.next_chunk = 0;
+    for(i = 0; i < jobs.chunk_num; i++) {
+        jobs.chunks[i].begin = i*chunk_bytes;
+        jobs.chunks[i].end = size - i*chunk_bytes < chunk_bytes ? size : (i+1)*chunk_bytes;
+    }
+
+    threads = malloc(sizeof(pthread_t)*thread_num);
+    for(i = 0; i < thread_num; i++)
+        pthread_create(&threads[i], NULL, disasm_worker, &jobs);
+    for(i = 0; i < thread_num; i++)
+        pthread_join(threads[i], NULL);
+    free(threads);
+
+    for(i = 0; i < jobs.chunk_num; i++) {
+        struct DisasmChunk *chunk = &jobs.chunks[i];
+        if(seen_unknown)
+            disasm_chunk(image, size, chunk, 1);
+        seen_unknown |= chunk->has_unknown;
+        write_all(fd, chunk->text, chunk->len);
+        free(chunk->text);
+    }
+    free(jobs.chunks);
+}
+
+/*
+mmap path and disassemble it to fd.
+thread_num 1 is the serial disasm_image, written through stream mode.
+*/
+void disasm_file(char *path, int fd, int thread_num) {
+    struct stat st;
+    unsigned char *image;
+    int file;
+
+    file = open(path, O_RDONLY);
+    if(file < 0 || fstat(file, &st) < 0) {
+        perror(path);
+        exit(1);
+    }
+    if(st.st_size == 0) {
+        close(file);
+        return;
+    }
+    image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    if(image == MAP_FAILED) {
+        perror(path);
+        exit(1);
+    }
+    close(file);
+
+    if(thread_num == 1) {
+        cl_enable_stream_mode(fd);
+        disasm_image(image, (int)st.st_size);
+        cl_disable_stream_mode();
+    } else {
+        disasm_image_parallel(image, (int)st.st_size, fd, thread_num, DISASM_CHUNK_WORDS);
+    }
+    munmap(image, st.st_size);
+}
+
+#ifndef DISASM_NO_MAIN
+
+/*
+test code
+*/
+
+static void assert_true(int boolflag) {
+    if(!boolflag) {
+        printf("assert fail\n");
+    }
+}
+
+static void assert_str_eq(char *expect, char *actual) {
+    if(actual == NULL || strcmp(expect, actual) != 0) {
+        printf("assert fail, expect \"%s\", actual \"%s\"\n", expect, actual ? actual : "(null)");
+    }
+}
+
+static void assert_disasm(char *expect, int word) {
+    char line[DISASM_LINE_MAX];
+    assert_true(disasm_word(word, line));
+    assert_str_eq(expect, line);
+}
+
+static void test_print_asm_mov() {
+    cl_clear_output();
+    assert_true(print_asm(0xE3A01068));
+    assert_str_eq("mov r1, #0x68\n", cl_get_result(0));
+    cl_clear_output();
+}
+
+static void test_print_asm_unknown() {
+    cl_clear_output();
+    assert_true(!print_asm(0x64646464));
+    assert_true(cl_get_result_num() == 0);
+}
+
+static void test_disasm_lesson_instructions() {
+    assert_disasm("ldr r1, [r15, #0x24]", 0xe59f1024);
+    assert_disasm("str r1, [r0]", 0xe5801000);
+    assert_disasm("ldrb r3, [r1]", 0xe5d13000);
+    assert_disasm("add r1, r1, #0x1", 0xe2811001);
+    assert_disasm("cmp r3, #0x0", 0xe3530000);
+    assert_disasm("bne [r15, #-0x14]", 0x1afffffb);
+    assert_disasm("b [r15, #-0x8]", 0xeafffffe);
+    assert_disasm("bl [r15, #0x4]", 0xeb000001);
+    assert_disasm("mov r15, r14", 0xe1a0f00e);
+    assert_disasm("stmdb r13!, {r1, r14}", 0xe92d4002);
+    assert_disasm("ldmia r13!, {r1, r14}", 0xe8bd4002);
+    assert_disasm("lsr r3, r1, #28", 0xe1a03e21);
+    assert_disasm("and r3, r3, #0xf", 0xe203300f);
+    assert_disasm("sub r2, r2, #0x4", 0xe2422004);
+    assert_disasm("mul r0, r1, r2", 0xe0000291);
+    assert_disasm("bx r14", 0xe12fff1e);
+    assert_disasm("ldr r0, [r1, -r2, lsl #2]!", 0xe7310102);
+    assert_disasm("str r0, [r1], #0x4", 0xe4810004);
+}
+
+static void test_disasm_rotated_imm() {
+    assert_disasm("mov r13, #0x8000", 0xe3a0d902);
+    assert_disasm("mov r0, #0xff000000", 0xe3a004ff);
+    assert_disasm("mov r0, #0x8000000", 0xe3a00302);
+    assert_disasm("mvn r1, #0x0", 0xe3e01000);
+}
+
+static void test_disasm_strict() {
+    char line[DISASM_LINE_MAX];
+    // cmp with rd, mov with rn, mrs, ldrt, unconditional.
+    assert_true(!disasm_word(0xe3531000, line));
+    assert_true(!disasm_word(0xe3a11000, line));
+    assert_true(!disasm_word(0xe10f0000, line));
+    assert_true(!disasm_word(0xe4b10004, line));
+    assert_true(!disasm_word(0xfa000000, line));
+}
+
+static void test_disasm_table_matches_chain() {
+    char line1[DISASM_LINE_MAX], line2[DISASM_LINE_MAX];
+    int i;
+
+    srand(1);
+    for(i = 0; i < 100000; i++) {
+        int word = (int)(((unsigned int)rand() << 16) ^ rand());
+        int known = disasm_word(word, line1);
+        assert_true(known == disasm_word_chain(word, line2));
+        if(known)
+            assert_str_eq(line2, line1);
+    }
+}
+
+static void test_disasm_image() {
+    // mov r1, #0x68; b self; then "hello".
+    unsigned char image[] = {
+        0x68, 0x10, 0xa0, 0xe3,
+        0xfe, 0xff, 0xff, 0xea,
+        0x68, 0x65, 0x6c, 0x6c,
+        0xe1, 0xa0, 0xf0, 0x0e,
+        0x6f, 0x00
+    };
+
+    cl_clear_output();
+    disasm_image(image, sizeof(image));
+    assert_str_eq("0x00010000  mov r1, #0x68\n", cl_get_result(0));
+    assert_str_eq("0x00010004  b [r15, #-0x8]\n", cl_get_result(1));
+    assert_str_eq("0x00010008  68 65 6C 6C\n", cl_get_result(2));
+    // known word after unknown one is dumped too.
+    assert_str_eq("0x0001000c  E1 A0 F0 0E\n", cl_get_result(3));
+    assert_str_eq("0x00010010  6F 00\n", cl_get_result(4));
+    assert_true(cl_get_result_num() == 5);
+    cl_clear_output();
+}
+
+/*
+Text of disasm_image in buffer mode, concatenated.
+*/
+static char *serial_text(unsigned char *image, int size) {
+    char *text;
+    int i, len = 0;
+
+    cl_clear_output();
+    disasm_image(image, size);
+    for(i = 0; i < cl_get_result_num(); i++)
+        len += strlen(cl_get_result(i));
+    text = malloc(len + 1);
+    text[0] = '\0';
+    for(i = 0, len = 0; i < cl_get_result_num(); i++)
+        len += sprintf(&text[len], "%s", cl_get_result(i));
+    cl_clear_output();
+    return text;
+}
+
+static char *parallel_text(unsigned char *image, int size, int thread_num, int chunk_words) {
+    FILE *fp = tmpfile();
+    char *text;
+    long len;
+
+    disasm_image_parallel(image, size, fileno(fp), thread_num, chunk_words);
+    len = lseek(fileno(fp), 0, SEEK_END);
+    text = malloc(len + 1);
+    lseek(fileno(fp), 0, SEEK_SET);
+    text[read(fileno(fp), text, len)] = '\0';
+    fclose(fp);
+    return text;
+}
+
+static void assert_parallel_same_as_serial(unsigned char *image, int size) {
+    char *expect = serial_text(image, size);
+    char *actual = parallel_text(image, size, 4, 16);
+
+    assert_true(strcmp(expect, actual) == 0);
+    free(expect);
+    free(actual);
+}
+
+static void test_disasm_image_parallel() {
+    int word_num = 1000;
+    unsigned char *image = malloc(word_num*4 + 2);
+    int i;
+
+    for(i = 0; i < word_num; i++) {
+        int word = 0xe2811000 | (i & 0xff);   // add r1, r1, #i
+        image[i*4] = word & 0xff;
+        image[i*4+1] = (word >> 8) & 0xff;
+        image[i*4+2] = (word >> 16) & 0xff;
+        image[i*4+3] = (word >> 24) & 0xff;
+    }
+    image[word_num*4] = 0x68;
+    image[word_num*4+1] = 0x00;
+
+    // only the trailing bytes are dumped.
+    assert_parallel_same_as_serial(image, word_num*4 + 2);
+
+    // unknown word in the middle of a chunk, later chunks are all dumped.
+    memset(&image[500*4 + 8], 0xff, 4);
+    assert_parallel_same_as_serial(image, word_num*4 + 2);
+
+    // unknown word at a chunk boundary.
+    memset(&image[16*4*10], 0xff, 4);
+    assert_parallel_same_as_serial(image, word_num*4);
+
+    assert_parallel_same_as_serial(image, 0);
+    free(image);
+}
+
+static void test_cl_stream_after_buffer() {
+    FILE *fp = tmpfile();
+    char text[16];
+    int len;
+
+    cl_clear_output();
+    cl_printf("a\n");
+    cl_printf("b\n");
+    // no stream yet, nothing to write.
+    cl_flush_output();
+    assert_true(cl_get_result_num() == 2);
+
+    cl_enable_stream_mode(fileno(fp));
+    assert_true(cl_get_result_num() == 0);
+    cl_printf("c\n");
+    cl_disable_stream_mode();
+
+    lseek(fileno(fp), 0, SEEK_SET);
+    len = read(fileno(fp), text, sizeof(text) - 1);
+    text[len > 0 ? len : 0] = '\0';
+    assert_true(strcmp("a\nb\nc\n", text) == 0);
+    fclose(fp);
+    cl_clear_output();
+}
+
+static void run_unit_tests() {
+    cl_enable_buffer_mode();
+
+    test_print_asm_mov();
+    test_print_asm_unknown();
+    test_disasm_lesson_instructions();
+    test_disasm_rotated_imm();
+    test_disasm_strict();
+    test_disasm_table_matches_chain();
+    test_disasm_image();
+    test_disasm_image_parallel();
+    test_cl_stream_after_buffer();
+
+    cl_disable_buffer_mode();
+    printf("all test done\n");
+}
+
+
+int main(int argc, char **argv) {
+    int thread_num = 1;
+
+    if(argc >= 3 && strncmp(argv[1], "-j", 2) == 0) {
+        thread_num = atoi(argv[1] + 2);
+        argv++;
+        argc--;
+    }
+    if(argc < 2) {
+        run_unit_tests();
+        return 0;
+    }
+
+    disasm_file(argv[1], 1, thread_num);
+    return 0;
+}
+
+#endif
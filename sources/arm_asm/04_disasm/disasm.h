@@ -0,0 +1,54 @@
+/*
+Simple ARM disassembler of arm_asm.md chapter 04.
+
+Only the instructions used in the lessons are accepted:
+data processing, mul, ldr/str(b), ldm/stm, b/bl and bx/blx.
+Everything else is treated as unknown, so that the file driver
+switches to hex dump.
+*/
+#define DISASM_LINE_MAX 128
+#define DISASM_BASE_ADDR 0x00010000
+/* 1MB of input per job of parallel mode */
+#define DISASM_CHUNK_WORDS (256*1024)
+
+/*
+Build the decode table. disasm_word does it on first use,
+call it once before using the disassembler from several threads.
+*/
+void disasm_init();
+
+/*
+Write the disassembly of word into out (without newline).
+Return 1 if word is a known instruction, 0 otherwise.
+*/
+int disasm_word(int word, char *out);
+
+/*
+Same result as disasm_word, classified by trying mask checks one by one.
+Kept as the reference of the table.
+*/
+int disasm_word_chain(int word, char *out);
+
+/*
+cl_printf the disassembly of word with newline.
+Return 1 if printed, 0 if unknown.
+*/
+int print_asm(int word);
+
+/*
+cl_printf the whole image, one line per word starting at DISASM_BASE_ADDR.
+After the first unknown word everything is hex dumped.
+*/
+void disasm_image(unsigned char *image, int size);
+
+/*
+Write the same text as disasm_image to fd, decoding chunk_words words
+per job on thread_num threads (0 for all cores).
+*/
+void disasm_image_parallel(unsigned char *image, int size, int fd, int thread_num, int chunk_words);
+
+/*
+mmap path and write its disassembly to fd.
+thread_num 1 runs disasm_image in stream mode, others run disasm_image_parallel.
+*/
+void disasm_file(char *path, int fd, int thread_num);
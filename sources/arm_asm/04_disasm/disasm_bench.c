@@ -0,0 +1,103 @@
+/*
+Decode throughput, table lookup vs mask check chain.
+
+gcc -O2 -DDISASM_NO_MAIN disasm_bench.c disasm.c cl_utils.c -o disasm_bench
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "disasm.h"
+
+#define IMAGE_WORDS (16*1024*1024)
+#define REPEAT 3
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+/*
+Instruction mix of the lesson programs with random registers and immediates.
+*/
+static int random_word() {
+    static int templates[] = {
+        0xe3a00000,   /* mov rd, #imm */
+        0xe2800000,   /* add rd, rn, #imm */
+        0xe3500000,   /* cmp rn, #imm */
+        0xe2000000,   /* and rd, rn, #imm */
+        0xe1a00000,   /* mov rd, rm, shift */
+        0xe5900000,   /* ldr rd, [rn, #imm] */
+        0xe5800000,   /* str rd, [rn, #imm] */
+        0xe5d00000,   /* ldrb rd, [rn, #imm] */
+        0x1a000000,   /* bne */
+        0xeb000000,   /* bl */
+        0xe92d0000,   /* stmdb r13!, {...} */
+        0xe8bd0000    /* ldmia r13!, {...} */
+    };
+    int kind = rand() % 12;
+    int word = templates[kind];
+    int r = rand();
+
+    switch(kind) {
+        case 0:
+            return word | (r & 0xf000) | (r & 0xfff);
+        case 1:
+        case 3:
+            return word | (r & 0xff000) | ((r >> 8) & 0xfff);
+        case 2:
+            return word | (r & 0xf0000) | (r & 0xfff);
+        case 4:
+            return word | (r & 0xf000) | (r & 0xfe0) | ((r >> 16) & 0xf);
+        case 5:
+        case 6:
+        case 7:
+            return word | (r & 0xff000) | ((r >> 4) & 0xfff);
+        case 8:
+        case 9:
+            return word | (r & 0xffffff);
+    }
+    return word | (r & 0x7ffe) | 0x4000;
+}
+
+static double bench(int (*decode)(int, char*), int *image, int *out_known) {
+    char line[DISASM_LINE_MAX];
+    double begin, elapsed, best = 0;
+    int i, j, known = 0;
+
+    for(j = 0; j < REPEAT; j++) {
+        begin = now_sec();
+        known = 0;
+        for(i = 0; i < IMAGE_WORDS; i++)
+            known += decode(image[i], line);
+        elapsed = now_sec() - begin;
+        if(j == 0 || elapsed < best)
+            best = elapsed;
+    }
+    *out_known = known;
+    return IMAGE_WORDS/best;
+}
+
+int main() {
+    int *image = malloc(sizeof(int)*IMAGE_WORDS);
+    double table_rate, chain_rate;
+    int i, known_table, known_chain;
+
+    srand(1);
+    for(i = 0; i < IMAGE_WORDS; i++)
+        image[i] = random_word();
+
+    disasm_init();
+    chain_rate = bench(disasm_word_chain, image, &known_chain);
+    table_rate = bench(disasm_word, image, &known_table);
+
+    printf("%d words (%d MB)\n", IMAGE_WORDS, IMAGE_WORDS*4/1024/1024);
+    printf("chain: %6.1f M instructions/sec\n", chain_rate/1e6);
+    printf("table: %6.1f M instructions/sec (%.2fx)\n", table_rate/1e6, table_rate/chain_rate);
+    if(known_table != known_chain)
+        printf("mismatch: table %d, chain %d known words\n", known_table, known_chain);
+
+    free(image);
+    return 0;
+}
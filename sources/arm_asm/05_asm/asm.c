@@ -0,0 +1,1651 @@
+/*
+Assembler of arm_asm.md chapter 05.
+
+gcc asm.c -o asm
+./asm               # run unit tests
+./asm hello.ks hello.bin
+./asm -stat hello.ks hello.bin     # with size statistics
+
+Mnemonics are looked up in the generated perfect hash (mnemonic_table.h),
+the binary tree is used only for user labels.
+*/
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "asm.h"
+#include "mnemonic.h"
+#include "mnemonic_table.h"
+
+#define PARSE_FAIL -1
+
+
+/*
+errors
+*/
+
+static int asm_error(struct Assembler *as, const char *fmt, ...) {
+    va_list ap;
+
+    fprintf(as->err, "%s:%d: ", as->file_name, as->line_no);
+    va_start(ap, fmt);
+    vfprintf(as->err, fmt, ap);
+    va_end(ap);
+    fprintf(as->err, "\n");
+    as->error_num++;
+    return 0;
+}
+
+
+/*
+code buffer, labels and fixups
+*/
+
+void asm_init(struct Assembler *as, char *file_name) {
+    memset(as, 0, sizeof(*as));
+    as->file_name = file_name;
+    as->next_label_id = LABEL_ID_FIRST;
+    as->fixup_free = -1;
+    as->err = stderr;
+}
+
+void asm_set_output(struct Assembler *as, FILE *out) {
+    as->out = out;
+}
+
+void asm_set_error_output(struct Assembler *as, FILE *err) {
+    as->err = err;
+}
+
+static void free_tree(struct Node *node) {
+    if(node == NULL)
+        return;
+    free_tree(node->left);
+    free_tree(node->right);
+    free(node->name);
+    free(node);
+}
+
+void asm_free(struct Assembler *as) {
+    int i;
+
+    for(i = 0; i < as->next_label_id - LABEL_ID_FIRST; i++)
+        free(as->labels[i].name);
+    free(as->code);
+    free(as->block_pending);
+    free_tree(as->label_root);
+    free(as->labels);
+    free(as->fixups);
+    free(as->literals);
+    memset(as, 0, sizeof(*as));
+}
+
+void asm_write_words(FILE *fp, int *words, int num) {
+    int i;
+
+    for(i = 0; i < num; i++) {
+        unsigned int w = (unsigned int)words[i];
+        unsigned char bytes[4] = {w & 0xff, (w >> 8) & 0xff, (w >> 16) & 0xff, w >> 24};
+        fwrite(bytes, 1, 4, fp);
+    }
+}
+
+/*
+Write out the leading complete blocks which no fixup points into.
+*/
+static void flush_blocks(struct Assembler *as) {
+    int buffered = as->pos - as->code_base;
+    int block_num = (buffered + ASM_BLOCK_WORDS - 1) / ASM_BLOCK_WORDS;
+    int n = 0, words;
+
+    while((n+1)*ASM_BLOCK_WORDS <= buffered && as->block_pending[n] == 0)
+        n++;
+    if(n == 0)
+        return;
+
+    words = n*ASM_BLOCK_WORDS;
+    asm_write_words(as->out, as->code, words);
+    memmove(as->code, as->code + words, sizeof(int)*(buffered - words));
+    memmove(as->block_pending, as->block_pending + n, sizeof(int)*(block_num - n));
+    memset(as->block_pending + block_num - n, 0, sizeof(int)*n);
+    as->code_base += words;
+}
+
+static void emit_word(struct Assembler *as, int word) {
+    int buffered = as->pos - as->code_base;
+
+    /*
+    Flush before the store, not after, so the word of the current
+    instruction stays until its fixup is registered.
+    */
+    if(as->out != NULL && buffered > 0 && buffered % ASM_BLOCK_WORDS == 0) {
+        flush_blocks(as);
+        buffered = as->pos - as->code_base;
+    }
+    if(buffered == as->capacity) {
+        int old_blocks = as->capacity / ASM_BLOCK_WORDS;
+        as->capacity = as->capacity ? as->capacity*2 : ASM_BLOCK_WORDS;
+        as->code = realloc(as->code, sizeof(int)*as->capacity);
+        as->block_pending = realloc(as->block_pending, sizeof(int)*(as->capacity / ASM_BLOCK_WORDS));
+        memset(as->block_pending + old_blocks, 0, sizeof(int)*(as->capacity / ASM_BLOCK_WORDS - old_blocks));
+    }
+    as->code[buffered] = word;
+    as->pos++;
+}
+
+static void patch_word(struct Assembler *as, int at, int bits) {
+    as->code[at - as->code_base] |= bits;
+}
+
+int to_symbol(struct Node **root, int *next_id, char *str, int len) {
+    struct Node **cur = root;
+
+    while(*cur != NULL) {
+        int cmp = strncmp(str, (*cur)->name, len);
+        if(cmp == 0 && (*cur)->name[len] != '\0')
+            cmp = -1;
+        if(cmp == 0)
+            return (*cur)->value;
+        cur = cmp < 0 ? &(*cur)->left : &(*cur)->right;
+    }
+
+    *cur = malloc(sizeof(struct Node));
+    (*cur)->name = malloc(len + 1);
+    memcpy((*cur)->name, str, len);
+    (*cur)->name[len] = '\0';
+    (*cur)->value = (*next_id)++;
+    (*cur)->left = NULL;
+    (*cur)->right = NULL;
+    return (*cur)->value;
+}
+
+static struct Label *label_of(struct Assembler *as, int id) {
+    return &as->labels[id - LABEL_ID_FIRST];
+}
+
+static int label_symbol(struct Assembler *as, struct Substring *name) {
+    int new_id = as->next_label_id;
+    int id = to_symbol(&as->label_root, &as->next_label_id, name->str, name->len);
+    int index = id - LABEL_ID_FIRST;
+
+    if(id != new_id)
+        return id;
+    if(index == as->label_capacity) {
+        as->label_capacity = as->label_capacity ? as->label_capacity*2 : 64;
+        as->labels = realloc(as->labels, sizeof(struct Label)*as->label_capacity);
+    }
+    as->labels[index].name = strndup(name->str, name->len);
+    as->labels[index].pos = -1;
+    as->labels[index].fixup_head = -1;
+    as->labels[index].literal = -1;
+    return id;
+}
+
+
+/*
+fixups
+
+A reference to a defined label is patched at once.
+A forward reference is added to the list of the label and patched at its definition,
+and keeps its block from being written until then.
+*/
+
+static int new_fixup(struct Assembler *as, int kind, int label, int at, int next) {
+    struct Fixup *f;
+    int index;
+
+    if(as->fixup_free < 0) {
+        int i, old = as->fixup_capacity;
+        as->fixup_capacity = old ? old*2 : 256;
+        as->fixups = realloc(as->fixups, sizeof(struct Fixup)*as->fixup_capacity);
+        for(i = as->fixup_capacity - 1; i >= old; i--) {
+            as->fixups[i].next = as->fixup_free;
+            as->fixup_free = i;
+        }
+    }
+    index = as->fixup_free;
+    f = &as->fixups[index];
+    as->fixup_free = f->next;
+
+    f->kind = kind;
+    f->label = label;
+    f->at = at;
+    f->line_no = as->line_no;
+    f->next = next;
+    as->block_pending[(at - as->code_base) / ASM_BLOCK_WORDS]++;
+    return index;
+}
+
+static void release_fixup(struct Assembler *as, int index) {
+    struct Fixup *f = &as->fixups[index];
+
+    as->block_pending[(f->at - as->code_base) / ASM_BLOCK_WORDS]--;
+    f->next = as->fixup_free;
+    as->fixup_free = index;
+}
+
+static void fixup_error(struct Assembler *as, struct Fixup *f, const char *message) {
+    char *name = f->label >= 0 ? label_of(as, f->label)->name : "constant";
+    fprintf(as->err, "%s:%d: %s %s\n", as->file_name, f->line_no, message, name);
+    as->error_num++;
+}
+
+/*
+Patch f, whose target is now known to be the word at target.
+*/
+static void resolve_fixup(struct Assembler *as, struct Fixup *f, int target) {
+    int offset;
+
+    switch(f->kind) {
+        case FIXUP_BRANCH:
+            offset = target - (f->at + 2);
+            if(offset < -(1 << 23) || offset >= (1 << 23)) {
+                fixup_error(as, f, "branch out of range to");
+                return;
+            }
+            patch_word(as, f->at, offset & 0xffffff);
+            return;
+        case FIXUP_ADDRESS:
+            patch_word(as, f->at, ASM_BASE_ADDR + target*4);
+            return;
+    }
+
+    offset = (target - (f->at + 2))*4;
+    if(offset < -4095 || offset > 4095) {
+        fixup_error(as, f, f->kind == FIXUP_LOAD ? "load out of range to" : "literal out of range for");
+        return;
+    }
+    if(offset >= 0)
+        patch_word(as, f->at, (1 << 23) | offset);
+    else
+        patch_word(as, f->at, -offset);
+}
+
+/*
+The word at "at" refers to label id.
+*/
+static void reference_label(struct Assembler *as, int kind, int id, int at) {
+    struct Label *label = label_of(as, id);
+
+    if(label->pos >= 0) {
+        struct Fixup f = {kind, id, at, as->line_no, -1};
+        resolve_fixup(as, &f, label->pos);
+        return;
+    }
+    label->fixup_head = new_fixup(as, kind, id, at, label->fixup_head);
+}
+
+static int define_label(struct Assembler *as, int id) {
+    struct Label *label = label_of(as, id);
+    int i, next;
+
+    if(label->pos >= 0)
+        return asm_error(as, "label %s is already defined", label->name);
+    label->pos = as->pos;
+
+    for(i = label->fixup_head; i >= 0; i = next) {
+        next = as->fixups[i].next;
+        resolve_fixup(as, &as->fixups[i], label->pos);
+        release_fixup(as, i);
+    }
+    label->fixup_head = -1;
+    return 1;
+}
+
+/*
+ldr at "at" loads the literal of x, the address of label id, or value if id is -1.
+Literals are shared in a pool, by label or by value.
+*/
+static void reference_literal(struct Assembler *as, int id, int value, int at) {
+    struct Literal *lit;
+    int index = -1, i;
+
+    if(id >= 0) {
+        index = label_of(as, id)->literal;
+    } else {
+        for(i = 0; i < as->literal_num; i++) {
+            if(as->literals[i].label < 0 && as->literals[i].value == value) {
+                index = i;
+                break;
+            }
+        }
+    }
+
+    if(index < 0) {
+        if(as->literal_num == as->literal_capacity) {
+            as->literal_capacity = as->literal_capacity ? as->literal_capacity*2 : 64;
+            as->literals = realloc(as->literals, sizeof(struct Literal)*as->literal_capacity);
+        }
+        if(as->literal_num == 0)
+            as->literal_first_at = at;
+        index = as->literal_num++;
+        as->literals[index].label = id;
+        as->literals[index].value = value;
+        as->literals[index].fixup_head = -1;
+        if(id >= 0)
+            label_of(as, id)->literal = index;
+    } else {
+        as->stat.literal_shared++;
+    }
+    lit = &as->literals[index];
+    lit->fixup_head = new_fixup(as, FIXUP_LITERAL, id, at, lit->fixup_head);
+    as->stat.literal_loads++;
+}
+
+/*
+Emit all pending literals here and patch the ldr instructions using them.
+*/
+static void place_literal_pool(struct Assembler *as) {
+    int i, j, next;
+
+    if(as->literal_num == 0)
+        return;
+    for(i = 0; i < as->literal_num; i++) {
+        struct Literal *lit = &as->literals[i];
+        int at = as->pos;
+
+        if(lit->label >= 0) {
+            emit_word(as, 0);
+            reference_label(as, FIXUP_ADDRESS, lit->label, at);
+            label_of(as, lit->label)->literal = -1;
+        } else {
+            emit_word(as, lit->value);
+        }
+        for(j = lit->fixup_head; j >= 0; j = next) {
+            next = as->fixups[j].next;
+            resolve_fixup(as, &as->fixups[j], at);
+            release_fixup(as, j);
+        }
+    }
+    as->stat.literal_words += as->literal_num;
+    as->stat.pool_num++;
+    as->literal_num = 0;
+}
+
+/*
+Called before next_words words are emitted.
+If the pool placed after them could be out of range of its first ldr,
+place it here and jump over it.
+The extra word is for a literal which the next instruction may add.
+*/
+static void keep_pool_in_range(struct Assembler *as, int next_words) {
+    int pool_end;
+
+    if(as->literal_num == 0)
+        return;
+    pool_end = as->pos + next_words + 1 + as->literal_num + 1;
+    if(pool_end - as->literal_first_at <= LITERAL_RANGE_WORDS)
+        return;
+
+    /* b to the word after the pool */
+    emit_word(as, 0xea000000 | (as->literal_num - 1));
+    as->stat.pool_jumps++;
+    place_literal_pool(as);
+}
+
+
+/*
+mnemonics
+*/
+
+const struct Mnemonic *mnemonic_lookup(char *str, int len) {
+    unsigned long long h = mnemonic_hash(str, len);
+    unsigned int d = mnemonic_displace[h % MNEMONIC_BUCKET_NUM];
+    const struct Mnemonic *m = &mnemonic_table[mnemonic_slot(h, d, MNEMONIC_TABLE_SIZE)];
+
+    if(m->name == NULL || strncmp(m->name, str, len) != 0 || m->name[len] != '\0')
+        return NULL;
+    return m;
+}
+
+
+/*
+parsers
+
+Each parser skips leading spaces and returns the read length, or PARSE_FAIL.
+*/
+
+static int is_word_start(int ch) {
+    return isalpha(ch) || ch == '_' || ch == '.';
+}
+
+static int is_word_char(int ch) {
+    return isalnum(ch) || ch == '_' || ch == '.';
+}
+
+static int skip_space(char *str) {
+    int i = 0;
+    while(str[i] == ' ' || str[i] == '\t' || str[i] == '\r' || str[i] == '\n')
+        i++;
+    return i;
+}
+
+static int is_line_end(char *str) {
+    str += skip_space(str);
+    return *str == '\0' || (str[0] == '/' && str[1] == '/');
+}
+
+/*
+One word like "mov", "loop" or ".raw".
+out->len is 0 when the line has no more words.
+*/
+static int parse_one(char *str, struct Substring *out) {
+    int i = skip_space(str);
+    int start = i;
+
+    out->str = str + i;
+    out->len = 0;
+    if(is_line_end(str))
+        return i;
+    if(!is_word_start(str[i]))
+        return PARSE_FAIL;
+    while(is_word_char(str[i]))
+        i++;
+    out->len = i - start;
+    return i;
+}
+
+static int parse_register(char *str, int *out_reg) {
+    int i = skip_space(str);
+    int reg;
+
+    if(strncmp(str + i, "sp", 2) == 0) {
+        reg = 13;
+        i += 2;
+    } else if(strncmp(str + i, "lr", 2) == 0) {
+        reg = 14;
+        i += 2;
+    } else if(strncmp(str + i, "pc", 2) == 0) {
+        reg = 15;
+        i += 2;
+    } else if(str[i] == 'r' && isdigit(str[i+1])) {
+        reg = str[i+1] - '0';
+        i += 2;
+        if(isdigit(str[i]) && reg != 0) {
+            reg = reg*10 + str[i] - '0';
+            i++;
+        }
+        if(reg > 15)
+            return PARSE_FAIL;
+    } else {
+        return PARSE_FAIL;
+    }
+    if(is_word_char(str[i]))
+        return PARSE_FAIL;
+    *out_reg = reg;
+    return i;
+}
+
+static int skip_char(char *str, int ch) {
+    int i = skip_space(str);
+    if(str[i] != ch)
+        return PARSE_FAIL;
+    return i + 1;
+}
+
+static int skip_comma(char *str) {
+    return skip_char(str, ',');
+}
+
+/*
+Decimal or 0x hex with optional minus sign.
+*/
+static int parse_number(char *str, int *out_value) {
+    int i = skip_space(str);
+    int sign = 1, start;
+    unsigned int value = 0;
+
+    if(str[i] == '-') {
+        sign = -1;
+        i++;
+    }
+    start = i;
+    if(str[i] == '0' && (str[i+1] == 'x' || str[i+1] == 'X')) {
+        i += 2;
+        start = i;
+        while(isxdigit(str[i])) {
+            int ch = tolower(str[i]);
+            value = value*16 + (isdigit(ch) ? ch - '0' : ch - 'a' + 10);
+            i++;
+        }
+    } else {
+        while(isdigit(str[i])) {
+            value = value*10 + str[i] - '0';
+            i++;
+        }
+    }
+    if(i == start || is_word_char(str[i]))
+        return PARSE_FAIL;
+    *out_value = (int)(value * (unsigned int)sign);
+    return i;
+}
+
+static int parse_immediate(char *str, int *out_value) {
+    int i = skip_char(str, '#');
+    int len;
+
+    if(i == PARSE_FAIL)
+        return PARSE_FAIL;
+    len = parse_number(str + i, out_value);
+    if(len == PARSE_FAIL)
+        return PARSE_FAIL;
+    return i + len;
+}
+
+/*
+Double quoted string with \n, \" and \\ escapes.
+out is set to the text between the quotes, still escaped and pointing into str.
+Escapes are only checked here, string_next decodes them when the bytes are used.
+*/
+static int parse_string(char *str, struct Substring *out) {
+    enum { STR_OUT, STR_IN, STR_ESCAPE } state = STR_OUT;
+    int i = skip_space(str);
+
+    for(; str[i] != '\0'; i++) {
+        int ch = str[i];
+        switch(state) {
+            case STR_OUT:
+                if(ch != '"')
+                    return PARSE_FAIL;
+                out->str = str + i + 1;
+                state = STR_IN;
+                break;
+            case STR_IN:
+                if(ch == '"') {
+                    out->len = (int)(str + i - out->str);
+                    return i + 1;
+                }
+                if(ch == '\\')
+                    state = STR_ESCAPE;
+                break;
+            case STR_ESCAPE:
+                if(ch != 'n' && ch != '"' && ch != '\\')
+                    return PARSE_FAIL;
+                state = STR_IN;
+                break;
+        }
+    }
+    return PARSE_FAIL;
+}
+
+/*
+Decode one char of the string text from parse_string at *pos, and advance *pos.
+*/
+static int string_next(struct Substring *text, int *pos) {
+    int ch = text->str[(*pos)++];
+
+    if(ch != '\\')
+        return ch;
+    ch = text->str[(*pos)++];
+    return ch == 'n' ? '\n' : ch;
+}
+
+/*
+{r1, r4-r6, lr}
+*/
+static int parse_register_list(char *str, int *out_list) {
+    int i = skip_char(str, '{');
+    int list = 0;
+
+    if(i == PARSE_FAIL)
+        return PARSE_FAIL;
+    for(;;) {
+        int first, last, len;
+
+        len = parse_register(str + i, &first);
+        if(len == PARSE_FAIL)
+            return PARSE_FAIL;
+        i += len;
+        last = first;
+        len = skip_char(str + i, '-');
+        if(len != PARSE_FAIL) {
+            i += len;
+            len = parse_register(str + i, &last);
+            if(len == PARSE_FAIL || last < first)
+                return PARSE_FAIL;
+            i += len;
+        }
+        for(; first <= last; first++)
+            list |= 1 << first;
+
+        len = skip_comma(str + i);
+        if(len == PARSE_FAIL)
+            break;
+        i += len;
+    }
+    if(skip_char(str + i, '}') == PARSE_FAIL)
+        return PARSE_FAIL;
+    *out_list = list;
+    return i + skip_char(str + i, '}');
+}
+
+
+/*
+encoders
+*/
+
+/*
+imm8 rotated right by rot*2, or -1.
+*/
+static int encode_rotated_imm(int value) {
+    unsigned int v = (unsigned int)value;
+    int rot;
+
+    for(rot = 0; rot < 16; rot++) {
+        /* rotate left by rot*2 undoes the rotate right of the encoding */
+        unsigned int imm = rot == 0 ? v : (v << (rot*2)) | (v >> (32 - rot*2));
+        if(imm <= 0xff)
+            return (rot << 8) | imm;
+    }
+    return -1;
+}
+
+static int cond_bits(const struct Mnemonic *m) {
+    return (int)((unsigned int)m->cond << 28);
+}
+
+/*
+The same operation with the other form of the immediate,
+like mov rd, #-1 as mvn rd, #0 or add rd, rn, #-4 as sub rd, rn, #4.
+Return the opcode, or -1.
+*/
+static int alternative_opcode(int opcode, int value, int *out_value) {
+    switch(opcode) {
+        case OP_MOV - OP_AND: *out_value = ~value; return OP_MVN - OP_AND;
+        case OP_MVN - OP_AND: *out_value = ~value; return OP_MOV - OP_AND;
+        case OP_AND - OP_AND: *out_value = ~value; return OP_BIC - OP_AND;
+        case OP_BIC - OP_AND: *out_value = ~value; return OP_AND - OP_AND;
+        case OP_ADC - OP_AND: *out_value = ~value; return OP_SBC - OP_AND;
+        case OP_SBC - OP_AND: *out_value = ~value; return OP_ADC - OP_AND;
+        case OP_ADD - OP_AND: *out_value = (int)(0u - (unsigned int)value); return OP_SUB - OP_AND;
+        case OP_SUB - OP_AND: *out_value = (int)(0u - (unsigned int)value); return OP_ADD - OP_AND;
+        case OP_CMP - OP_AND: *out_value = (int)(0u - (unsigned int)value); return OP_CMN - OP_AND;
+        case OP_CMN - OP_AND: *out_value = (int)(0u - (unsigned int)value); return OP_CMP - OP_AND;
+    }
+    return -1;
+}
+
+/*
+"rm", "rm, lsl #n", "rm, lsl rs" or "#imm".
+An immediate which can not be encoded may change *opcode to its alternative.
+*/
+static int parse_operand2(struct Assembler *as, char *str, int *opcode, int *out_op2) {
+    struct Substring shift;
+    const struct Mnemonic *m;
+    int i, len, rm, value;
+
+    len = parse_immediate(str, &value);
+    if(len != PARSE_FAIL) {
+        int imm = encode_rotated_imm(value);
+        if(imm < 0) {
+            int other_value;
+            int other = alternative_opcode(*opcode, value, &other_value);
+            if(other >= 0 && (imm = encode_rotated_imm(other_value)) >= 0)
+                *opcode = other;
+        }
+        if(imm < 0) {
+            asm_error(as, "immediate 0x%x can not be encoded", value);
+            return PARSE_FAIL;
+        }
+        *out_op2 = (1 << 25) | imm;
+        return len;
+    }
+
+    i = parse_register(str, &rm);
+    if(i == PARSE_FAIL) {
+        asm_error(as, "register or immediate expected");
+        return PARSE_FAIL;
+    }
+    len = skip_comma(str + i);
+    if(len == PARSE_FAIL) {
+        *out_op2 = rm;
+        return i;
+    }
+    i += len;
+
+    len = parse_one(str + i, &shift);
+    m = len == PARSE_FAIL || shift.len == 0 ? NULL : mnemonic_lookup(shift.str, shift.len);
+    if(m == NULL || m->op < OP_LSL || m->op > OP_ROR || m->cond != COND_AL || m->set_flags) {
+        asm_error(as, "shift expected");
+        return PARSE_FAIL;
+    }
+    i += len;
+
+    len = parse_immediate(str + i, &value);
+    if(len != PARSE_FAIL) {
+        if(value < 0 || value > 32 || (value == 32 && (m->op == OP_LSL || m->op == OP_ROR))) {
+            asm_error(as, "shift amount %d out of range", value);
+            return PARSE_FAIL;
+        }
+        /* amount 0 of lsr, asr and ror encodes lsr #32, asr #32 and rrx, no shift is plain rm. */
+        if(value == 0)
+            *out_op2 = rm;
+        else
+            *out_op2 = ((value & 31) << 7) | ((m->op - OP_LSL) << 5) | rm;
+        return i + len;
+    } else {
+        int rs;
+        len = parse_register(str + i, &rs);
+        if(len == PARSE_FAIL) {
+            asm_error(as, "shift amount expected");
+            return PARSE_FAIL;
+        }
+        *out_op2 = (rs << 8) | ((m->op - OP_LSL) << 5) | 0x10 | rm;
+        return i + len;
+    }
+}
+
+static int expect_end(struct Assembler *as, char *str) {
+    if(!is_line_end(str))
+        return asm_error(as, "garbage at end of line: %s", str + skip_space(str));
+    return 1;
+}
+
+#define EXPECT(len, message) do { if((len) == PARSE_FAIL) return asm_error(as, message); } while(0)
+
+
+/*
+instructions
+*/
+
+static int asm_dp(struct Assembler *as, const struct Mnemonic *m, char *str) {
+    int opcode = OP_DP_OPCODE(m->op);
+    int rd = 0, rn = 0, op2, len;
+    int set_flags = m->set_flags;
+
+    switch(m->op) {
+        case OP_MOV:
+        case OP_MVN:
+            EXPECT(len = parse_register(str, &rd), "register expected");
+            str += len;
+            break;
+        case OP_TST:
+        case OP_TEQ:
+        case OP_CMP:
+        case OP_CMN:
+            set_flags = 1;
+            EXPECT(len = parse_register(str, &rn), "register expected");
+            str += len;
+            break;
+        default:
+            EXPECT(len = parse_register(str, &rd), "register expected");
+            str += len;
+            EXPECT(len = skip_comma(str), "comma expected");
+            str += len;
+            EXPECT(len = parse_register(str, &rn), "register expected");
+            str += len;
+            break;
+    }
+    EXPECT(len = skip_comma(str), "comma expected");
+    str += len;
+    len = parse_operand2(as, str, &opcode, &op2);
+    if(len == PARSE_FAIL)
+        return 0;
+    str += len;
+    if(!expect_end(as, str))
+        return 0;
+
+    emit_word(as, cond_bits(m) | (opcode << 21) | (set_flags << 20) | (rn << 16) | (rd << 12) | op2);
+    return 1;
+}
+
+/*
+lsl rd, rm, #n / lsl rd, rm, rs is mov rd, rm, lsl ...
+*/
+static int asm_shift(struct Assembler *as, const struct Mnemonic *m, char *str) {
+    int type = m->op - OP_LSL;
+    int rd, rm, value, len, op2;
+
+    EXPECT(len = parse_register(str, &rd), "register expected");
+    str += len;
+    EXPECT(len = skip_comma(str), "comma expected");
+    str += len;
+    EXPECT(len = parse_register(str, &rm), "register expected");
+    str += len;
+    EXPECT(len = skip_comma(str), "comma expected");
+    str += len;
+
+    len = parse_immediate(str, &value);
+    if(len != PARSE_FAIL) {
+        if(value < 1 || value > 32 || (value == 32 && (m->op == OP_LSL || m->op == OP_ROR)))
+            return asm_error(as, "shift amount %d out of range", value);
+        op2 = ((value & 31) << 7) | (type << 5) | rm;
+    } else {
+        int rs;
+        EXPECT(len = parse_register(str, &rs), "shift amount expected");
+        op2 = (rs << 8) | (type << 5) | 0x10 | rm;
+    }
+    str += len;
+    if(!expect_end(as, str))
+        return 0;
+
+    emit_word(as, cond_bits(m) | (OP_DP_OPCODE(OP_MOV) << 21) | (m->set_flags << 20) | (rd << 12) | op2);
+    return 1;
+}
+
+static int asm_mul(struct Assembler *as, const struct Mnemonic *m, char *str) {
+    int rd, rm, rs, len;
+
+    EXPECT(len = parse_register(str, &rd), "register expected");
+    str += len;
+    EXPECT(len = skip_comma(str), "comma expected");
+    str += len;
+    EXPECT(len = parse_register(str, &rm), "register expected");
+    str += len;
+    EXPECT(len = skip_comma(str), "comma expected");
+    str += len;
+    EXPECT(len = parse_register(str, &rs), "register expected");
+    str += len;
+    if(!expect_end(as, str))
+        return 0;
+
+    emit_word(as, cond_bits(m) | (m->set_flags << 20) | (rd << 16) | (rs << 8) | 0x90 | rm);
+    return 1;
+}
+
+/*
+ldr rd, =value is mov or mvn when the value can be encoded, otherwise a literal load.
+*/
+static int emit_load_constant(struct Assembler *as, const struct Mnemonic *m, int rd, int value) {
+    int imm = encode_rotated_imm(value);
+
+    if(imm >= 0) {
+        emit_word(as, cond_bits(m) | (1 << 25) | (OP_DP_OPCODE(OP_MOV) << 21) | (rd << 12) | imm);
+        as->stat.imm_inline++;
+        return 1;
+    }
+    imm = encode_rotated_imm(~value);
+    if(imm >= 0) {
+        emit_word(as, cond_bits(m) | (1 << 25) | (OP_DP_OPCODE(OP_MVN) << 21) | (rd << 12) | imm);
+        as->stat.imm_inline++;
+        return 1;
+    }
+    emit_word(as, cond_bits(m) | 0x051f0000 | (rd << 12));
+    reference_literal(as, -1, value, as->pos - 1);
+    return 1;
+}
+
+/*
+ldr rd, [rn]
+ldr rd, [rn, #imm]
+ldr rd, [rn, #imm]!
+ldr rd, [rn], #imm
+ldr rd, label
+ldr rd, =label
+ldr rd, =value
+*/
+static int asm_mem(struct Assembler *as, const struct Mnemonic *m, char *str) {
+    int is_load = m->op == OP_LDR || m->op == OP_LDRB;
+    int is_byte = m->op == OP_LDRB || m->op == OP_STRB;
+    int pre = 1, writeback = 0, offset = 0;
+    int rd, rn, len, word, value;
+
+    EXPECT(len = parse_register(str, &rd), "register expected");
+    str += len;
+    EXPECT(len = skip_comma(str), "comma expected");
+    str += len;
+
+    word = cond_bits(m) | (1 << 26) | (is_byte << 22) | (is_load << 20) | (rd << 12);
+
+    len = skip_char(str, '[');
+    if(len == PARSE_FAIL) {
+        struct Substring label;
+        int kind = FIXUP_LOAD;
+
+        if(!is_load || is_byte)
+            return asm_error(as, "[ expected");
+        len = skip_char(str, '=');
+        if(len != PARSE_FAIL) {
+            str += len;
+            len = parse_number(str, &value);
+            if(len != PARSE_FAIL) {
+                str += len;
+                if(!expect_end(as, str))
+                    return 0;
+                return emit_load_constant(as, m, rd, value);
+            }
+            kind = FIXUP_LITERAL;
+        }
+        len = parse_one(str, &label);
+        if(len == PARSE_FAIL || label.len == 0)
+            return asm_error(as, "label expected");
+        str += len;
+        if(!expect_end(as, str))
+            return 0;
+        /* pc relative, the offset is patched when known */
+        emit_word(as, word | (1 << 24) | (15 << 16));
+        if(kind == FIXUP_LITERAL)
+            reference_literal(as, label_symbol(as, &label), 0, as->pos - 1);
+        else
+            reference_label(as, kind, label_symbol(as, &label), as->pos - 1);
+        return 1;
+    }
+    str += len;
+
+    EXPECT(len = parse_register(str, &rn), "register expected");
+    str += len;
+    len = skip_char(str, ']');
+    if(len == PARSE_FAIL) {
+        EXPECT(len = skip_comma(str), "comma or ] expected");
+        str += len;
+        EXPECT(len = parse_immediate(str, &offset), "immediate expected");
+        str += len;
+        EXPECT(len = skip_char(str, ']'), "] expected");
+        str += len;
+        len = skip_char(str, '!');
+        if(len != PARSE_FAIL) {
+            writeback = 1;
+            str += len;
+        }
+    } else {
+        str += len;
+        len = skip_comma(str);
+        if(len != PARSE_FAIL) {
+            pre = 0;
+            str += len;
+            EXPECT(len = parse_immediate(str, &offset), "immediate expected");
+            str += len;
+        }
+    }
+    if(!expect_end(as, str))
+        return 0;
+    if(offset < -4095 || offset > 4095)
+        return asm_error(as, "offset %d out of range", offset);
+
+    word |= (pre << 24) | (writeback << 21) | (rn << 16);
+    if(offset >= 0)
+        word |= (1 << 23) | offset;
+    else
+        word |= -offset;
+    emit_word(as, word);
+    return 1;
+}
+
+/*
+ldmia rn!, {list} / stmdb rn!, {list} / push {list} / pop {list}
+*/
+static int asm_multi(struct Assembler *as, const struct Mnemonic *m, char *str) {
+    int rn = 13, writeback = 1, list, len, word;
+
+    if(m->op == OP_LDMIA || m->op == OP_STMDB) {
+        EXPECT(len = parse_register(str, &rn), "register expected");
+        str += len;
+        len = skip_char(str, '!');
+        if(len == PARSE_FAIL)
+            writeback = 0;
+        else
+            str += len;
+        EXPECT(len = skip_comma(str), "comma expected");
+        str += len;
+    }
+    EXPECT(len = parse_register_list(str, &list), "register list expected");
+    str += len;
+    if(!expect_end(as, str))
+        return 0;
+    if(list == 0)
+        return asm_error(as, "empty register list");
+
+    word = (m->op == OP_LDMIA || m->op == OP_POP) ? 0x08900000 : 0x09000000;
+    emit_word(as, cond_bits(m) | word | (writeback << 21) | (rn << 16) | list);
+    return 1;
+}
+
+/*
+b label
+b [r15, #-0x8]     offset from pc, as chapter 04 disassembles it
+*/
+static int asm_branch(struct Assembler *as, const struct Mnemonic *m, char *str) {
+    struct Substring label;
+    int word = cond_bits(m) | 0x0a000000 | ((m->op == OP_BL) << 24);
+    int len, reg, offset;
+
+    len = skip_char(str, '[');
+    if(len != PARSE_FAIL) {
+        str += len;
+        len = parse_register(str, &reg);
+        if(len == PARSE_FAIL || reg != 15)
+            return asm_error(as, "r15 expected");
+        str += len;
+        EXPECT(len = skip_comma(str), "comma expected");
+        str += len;
+        EXPECT(len = parse_immediate(str, &offset), "immediate expected");
+        str += len;
+        EXPECT(len = skip_char(str, ']'), "] expected");
+        str += len;
+        if(!expect_end(as, str))
+            return 0;
+        if(offset % 4 != 0 || offset < -(1 << 25) || offset >= (1 << 25))
+            return asm_error(as, "branch offset %d out of range", offset);
+        emit_word(as, word | ((offset / 4) & 0xffffff));
+        return 1;
+    }
+
+    len = parse_one(str, &label);
+    if(len == PARSE_FAIL || label.len == 0)
+        return asm_error(as, "label expected");
+    str += len;
+    if(!expect_end(as, str))
+        return 0;
+
+    emit_word(as, word);
+    reference_label(as, FIXUP_BRANCH, label_symbol(as, &label), as->pos - 1);
+    return 1;
+}
+
+static int asm_bx(struct Assembler *as, const struct Mnemonic *m, char *str) {
+    int rm, len;
+
+    EXPECT(len = parse_register(str, &rm), "register expected");
+    str += len;
+    if(!expect_end(as, str))
+        return 0;
+
+    emit_word(as, cond_bits(m) | (m->op == OP_BX ? 0x012fff10 : 0x012fff30) | rm);
+    return 1;
+}
+
+/*
+.raw 0x12345678
+.raw "hello\n"     padded with 0 to the word boundary
+*/
+static int asm_raw(struct Assembler *as, char *str) {
+    struct Substring text;
+    int value, len;
+    int pos = 0, str_len = 0;
+
+    len = parse_number(str, &value);
+    if(len != PARSE_FAIL) {
+        str += len;
+        if(!expect_end(as, str))
+            return 0;
+        emit_word(as, value);
+        return 1;
+    }
+
+    len = parse_string(str, &text);
+    if(len == PARSE_FAIL)
+        return asm_error(as, "number or string expected");
+    str += len;
+    if(!expect_end(as, str))
+        return 0;
+    while(pos < text.len) {
+        unsigned int word = 0;
+        int j;
+        for(j = 0; j < 4 && pos < text.len; j++, str_len++)
+            word |= (unsigned int)(unsigned char)string_next(&text, &pos) << (j*8);
+        emit_word(as, (int)word);
+    }
+    if(str_len % 4 == 0)
+        emit_word(as, 0);
+    return 1;
+}
+
+static int asm_instruction(struct Assembler *as, const struct Mnemonic *m, char *str) {
+    if(OP_IS_DP(m->op))
+        return asm_dp(as, m, str);
+    switch(m->op) {
+        case OP_LSL:
+        case OP_LSR:
+        case OP_ASR:
+        case OP_ROR:
+            return asm_shift(as, m, str);
+        case OP_MUL:
+            return asm_mul(as, m, str);
+        case OP_LDR:
+        case OP_LDRB:
+        case OP_STR:
+        case OP_STRB:
+            return asm_mem(as, m, str);
+        case OP_LDMIA:
+        case OP_STMDB:
+        case OP_PUSH:
+        case OP_POP:
+            return asm_multi(as, m, str);
+        case OP_B:
+        case OP_BL:
+            return asm_branch(as, m, str);
+        case OP_BX:
+        case OP_BLX:
+            return asm_bx(as, m, str);
+        case OP_RAW:
+            return asm_raw(as, str);
+    }
+    return asm_error(as, "unknown mnemonic %s", m->name);
+}
+
+/*
+Execution never goes to the next word: b, bx, and writes to pc by mov, ldr or ldmia.
+*/
+static int is_unconditional_jump(int word) {
+    if(((unsigned int)word >> 28) != COND_AL)
+        return 0;
+    return (word & 0x0f000000) == 0x0a000000
+        || (word & 0x0ffffff0) == 0x012fff10
+        || (word & 0x0de0f000) == 0x01a0f000
+        || (word & 0x0c50f000) == 0x0410f000
+        || (word & 0x0e108000) == 0x08108000;
+}
+
+int asm_one(struct Assembler *as, char *line) {
+    struct Substring word, label;
+    const struct Mnemonic *m;
+    char *str = line;
+    int len;
+
+    as->line_no++;
+
+    len = parse_one(str, &word);
+    if(len == PARSE_FAIL)
+        return asm_error(as, "syntax error: %s", str + skip_space(str));
+    str += len;
+
+    label.len = 0;
+    if(word.len > 0 && *str == ':') {
+        label = word;
+        str++;
+        len = parse_one(str, &word);
+        if(len == PARSE_FAIL)
+            return asm_error(as, "syntax error: %s", str + skip_space(str));
+        str += len;
+    }
+
+    m = NULL;
+    if(word.len > 0) {
+        m = mnemonic_lookup(word.str, word.len);
+        if(m == NULL)
+            return asm_error(as, "unknown mnemonic %.*s", word.len, word.str);
+        /* before the label, so that the label is after the pool */
+        keep_pool_in_range(as, m->op == OP_RAW ? (int)strlen(str)/4 + 1 : 1);
+    }
+    if(label.len > 0 && !define_label(as, label_symbol(as, &label)))
+        return 0;
+    if(m == NULL)
+        return 1;
+
+    if(!asm_instruction(as, m, str))
+        return 0;
+    if(m->op != OP_RAW && is_unconditional_jump(as->code[as->pos - 1 - as->code_base]))
+        place_literal_pool(as);
+    return 1;
+}
+
+void asm_file(struct Assembler *as, FILE *fp) {
+    char *line = NULL;
+    size_t capacity = 0;
+
+    while(getline(&line, &capacity, fp) != -1)
+        asm_one(as, line);
+    free(line);
+}
+
+
+/*
+end of the source
+*/
+
+int *asm_finish(struct Assembler *as, int *out_word_num) {
+    int i, j;
+
+    place_literal_pool(as);
+
+    for(i = 0; i < as->next_label_id - LABEL_ID_FIRST; i++) {
+        for(j = as->labels[i].fixup_head; j >= 0; j = as->fixups[j].next)
+            fixup_error(as, &as->fixups[j], "undefined label");
+    }
+
+    if(as->out != NULL) {
+        asm_write_words(as->out, as->code, as->pos - as->code_base);
+        as->code_base = as->pos;
+    }
+    *out_word_num = as->pos;
+    if(as->error_num > 0)
+        return NULL;
+    return as->code;
+}
+
+#ifndef ASM_NO_MAIN
+
+/*
+test code
+*/
+
+static void assert_true(int boolflag) {
+    if(!boolflag) {
+        printf("assert fail\n");
+    }
+}
+
+static void assert_int_eq(int expect, int actual) {
+    if(expect != actual) {
+        printf("assert fail, expect 0x%08x, actual 0x%08x\n", expect, actual);
+    }
+}
+
+/*
+Assemble lines and compare all words.
+*/
+static void assert_asm(char **lines, int *expect, int expect_num) {
+    struct Assembler as;
+    int *code, word_num, i;
+
+    asm_init(&as, "test");
+    for(i = 0; lines[i] != NULL; i++) {
+        char buf[256];
+        strcpy(buf, lines[i]);
+        asm_one(&as, buf);
+    }
+    code = asm_finish(&as, &word_num);
+    assert_true(code != NULL);
+    assert_int_eq(expect_num, word_num);
+    for(i = 0; code != NULL && i < expect_num && i < word_num; i++)
+        assert_int_eq(expect[i], code[i]);
+    asm_free(&as);
+}
+
+static void assert_asm_one(char *line, int expect) {
+    char *lines[] = {line, NULL};
+    assert_asm(lines, &expect, 1);
+}
+
+static int count_errors(char **lines) {
+    struct Assembler as;
+    int word_num, i, errors;
+    FILE *null_fp = fopen("/dev/null", "w");
+
+    /* errors are expected, keep the test output clean */
+    asm_init(&as, "test");
+    asm_set_error_output(&as, null_fp);
+    for(i = 0; lines[i] != NULL; i++) {
+        char buf[256];
+        strcpy(buf, lines[i]);
+        asm_one(&as, buf);
+    }
+    asm_finish(&as, &word_num);
+    errors = as.error_num;
+    asm_free(&as);
+    fclose(null_fp);
+    return errors;
+}
+
+static void test_mnemonic_lookup() {
+    const struct Mnemonic *m;
+
+    m = mnemonic_lookup("mov", 3);
+    assert_true(m != NULL && m->op == OP_MOV && m->cond == COND_AL && !m->set_flags);
+    m = mnemonic_lookup("addseq", 6);
+    assert_true(m != NULL && m->op == OP_ADD && m->cond == 0 && m->set_flags);
+    m = mnemonic_lookup("bne", 3);
+    assert_true(m != NULL && m->op == OP_B && m->cond == 1);
+    m = mnemonic_lookup(".raw", 4);
+    assert_true(m != NULL && m->op == OP_RAW);
+    /* prefix of a longer line */
+    m = mnemonic_lookup("ldrb r3, [r1]", 4);
+    assert_true(m != NULL && m->op == OP_LDRB);
+
+    assert_true(mnemonic_lookup("mo", 2) == NULL);
+    assert_true(mnemonic_lookup("movv", 4) == NULL);
+    assert_true(mnemonic_lookup("cmps", 4) == NULL);
+    assert_true(mnemonic_lookup("loop", 4) == NULL);
+}
+
+static void test_to_symbol() {
+    struct Node *root = NULL;
+    int next_id = LABEL_ID_FIRST;
+
+    assert_int_eq(10000, to_symbol(&root, &next_id, "loop", 4));
+    assert_int_eq(10001, to_symbol(&root, &next_id, "end", 3));
+    assert_int_eq(10002, to_symbol(&root, &next_id, "lo", 2));
+    assert_int_eq(10000, to_symbol(&root, &next_id, "loop:", 4));
+    assert_int_eq(10002, to_symbol(&root, &next_id, "lo", 2));
+    free_tree(root);
+}
+
+static void test_asm_instructions() {
+    assert_asm_one("mov r1, r2", 0xe1a01002);
+    assert_asm_one("mov r1, #0x68", 0xe3a01068);
+    assert_asm_one("  mov r15, lr  // return", 0xe1a0f00e);
+    assert_asm_one("mov r0, #0xff000000", 0xe3a004ff);
+    assert_asm_one("mvn r0, #0", 0xe3e00000);
+    assert_asm_one("add r1, r1, #1", 0xe2811001);
+    assert_asm_one("sub r2, r2, #4", 0xe2422004);
+    assert_asm_one("and r3, r3, #0xf", 0xe203300f);
+    assert_asm_one("adds r0, r0, r1, lsl #2", 0xe0900101);
+    assert_asm_one("orr r0, r0, r1, lsl r2", 0xe1800211);
+    assert_asm_one("mov r0, r1, lsr #0", 0xe1a00001);
+    assert_asm_one("add r0, r0, r1, asr #0", 0xe0800001);
+    assert_asm_one("add r0, r0, r1, ror #0", 0xe0800001);
+    assert_asm_one("mov r0, r1, lsr #32", 0xe1a00021);
+    assert_asm_one("cmp r3, #0", 0xe3530000);
+    assert_asm_one("tst r0, r1", 0xe1100001);
+    assert_asm_one("lsr r3, r1, #28", 0xe1a03e21);
+    assert_asm_one("lsl r0, r0, r2", 0xe1a00210);
+    assert_asm_one("mul r0, r1, r2", 0xe0000291);
+    assert_asm_one("ldr r1, [r15, #0x30]", 0xe59f1030);
+    assert_asm_one("ldr r1, [r15, #-0x30]", 0xe51f1030);
+    assert_asm_one("ldr r1, [pc]", 0xe59f1000);
+    assert_asm_one("str r1, [r0]", 0xe5801000);
+    assert_asm_one("ldrb r3, [r1]", 0xe5d13000);
+    assert_asm_one("ldr r0, [r1, #4]!", 0xe5b10004);
+    assert_asm_one("ldr r0, [r1], #4", 0xe4910004);
+    assert_asm_one("stmdb r13!, {r1, r14}", 0xe92d4002);
+    assert_asm_one("ldmia sp!, {r1, lr}", 0xe8bd4002);
+    assert_asm_one("push {r4-r6, lr}", 0xe92d4070);
+    assert_asm_one("pop {r4-r6, pc}", 0xe8bd8070);
+    assert_asm_one("bx r14", 0xe12fff1e);
+    assert_asm_one("blx r3", 0xe12fff33);
+    assert_asm_one("moveq r0, #1", 0x03a00001);
+    assert_asm_one(".raw 0x12345678", 0x12345678);
+    assert_asm_one("end: b end", 0xeafffffe);
+    assert_asm_one("b [r15, #-0x8]", 0xeafffffe);
+    assert_asm_one("blne [r15, #0x4]", 0x1b000001);
+}
+
+static void test_asm_raw_string() {
+    char *lines[] = {".raw \"a\\\"b\\\\\\n\"", ".raw \"abcd\"", NULL};
+    int expect[] = {0x5c622261, 0x0000000a, 0x64636261, 0};
+    assert_asm(lines, expect, 4);
+}
+
+static void test_asm_raw_string_escape_at_word_end() {
+    char *lines[] = {".raw \"abc\\n\"", ".raw \"\"", NULL};
+    int expect[] = {0x0a636261, 0, 0};
+    assert_asm(lines, expect, 3);
+}
+
+static void test_asm_program() {
+    char *lines[] = {
+        "    ldr r0, uart",
+        "    ldr r1, =message",
+        "    ldrb r3, [r1]",
+        "loop:",
+        "    str r3, [r0]",
+        "    add r1, r1, #1",
+        "    ldrb r3, [r1]",
+        "    cmp r3, #0",
+        "    bne loop",
+        "end:",
+        "    b end",
+        "uart:",
+        "    .raw 0x101f1000",
+        "message:",
+        "    .raw \"hello, world\\n\"",
+        NULL
+    };
+    /* the literal pool goes after "b end" */
+    int expect[] = {
+        0xe59f0020, 0xe59f1018, 0xe5d13000,
+        0xe5803000, 0xe2811001, 0xe5d13000, 0xe3530000, 0x1afffffa,
+        0xeafffffe,
+        0x0001002c,
+        0x101f1000,
+        0x6c6c6568, 0x77202c6f, 0x646c726f, 0x0000000a
+    };
+    assert_asm(lines, expect, 15);
+}
+
+static void test_asm_literal_shared() {
+    char *lines[] = {"ldr r0, =a", "ldr r1, =a", "a: .raw 1", NULL};
+    int expect[] = {0xe59f0004, 0xe59f1000, 1, 0x00010008};
+    assert_asm(lines, expect, 4);
+}
+
+static void test_asm_alternative_immediate() {
+    assert_asm_one("mov r0, #-1", 0xe3e00000);
+    assert_asm_one("mvn r0, #0xffffff00", 0xe3a000ff);
+    assert_asm_one("add r0, r0, #-4", 0xe2400004);
+    assert_asm_one("subs r1, r1, #-1", 0xe2911001);
+    assert_asm_one("cmp r0, #-1", 0xe3700001);
+    assert_asm_one("and r0, r0, #0xffffff00", 0xe3c000ff);
+    assert_asm_one("adc r0, r0, #-2", 0xe2c00001);
+}
+
+static void test_asm_load_constant() {
+    char *lines[] = {
+        "ldr r0, =0x101f1000",
+        "ldr r1, =0x101f1000",
+        "ldr r2, =0x12345678",
+        NULL
+    };
+    int expect[] = {0xe59f0004, 0xe59f1000, 0xe59f2000, 0x101f1000, 0x12345678};
+
+    assert_asm_one("ldr r0, =0x68", 0xe3a00068);
+    assert_asm_one("ldr r0, =0xff000000", 0xe3a004ff);
+    assert_asm_one("ldr r0, =0xffffffff", 0xe3e00000);
+    assert_asm_one("ldreq r0, =-256", 0x03e000ff);
+    assert_asm(lines, expect, 5);
+}
+
+static void test_asm_pool_after_jump() {
+    char *lines[] = {
+        "ldr r0, =0x12345678",
+        "b skip",
+        "skip: ldr r1, =0x12345678",
+        "mov pc, lr",
+        "ldr r2, =0x12345678",
+        NULL
+    };
+    int expect[] = {
+        0xe59f0000, 0xea000000, 0x12345678,
+        0xe59f1000, 0xe1a0f00e, 0x12345678,
+        0xe51f2004, 0x12345678
+    };
+    assert_asm(lines, expect, 8);
+}
+
+/*
+A long run of code after the first use forces a pool with a jump over it,
+and a label on the next line stays on its own line, after the pool.
+*/
+static void test_asm_pool_in_range() {
+    struct Assembler as;
+    char line[64];
+    int *code, word_num, i, lit, msg;
+
+    asm_init(&as, "test");
+    strcpy(line, "ldr r0, =message");
+    asm_one(&as, line);
+    strcpy(line, "ldr r1, =0x12345678");
+    asm_one(&as, line);
+    for(i = 0; i < 1100; i++) {
+        strcpy(line, "mov r0, r0");
+        asm_one(&as, line);
+    }
+    strcpy(line, "message: .raw \"hi\"");
+    asm_one(&as, line);
+    code = asm_finish(&as, &word_num);
+    assert_true(code != NULL);
+    assert_int_eq(1, as.stat.pool_jumps);
+    assert_int_eq(1, as.stat.pool_num);
+
+    lit = (code[0] & 0xfff)/4 + 2;
+    assert_true(lit < word_num);
+    assert_int_eq(0xea000001, code[lit - 1]);
+    assert_int_eq(0x12345678, code[(code[1] & 0xfff)/4 + 3]);
+    msg = (code[lit] - ASM_BASE_ADDR)/4;
+    assert_int_eq(word_num - 1, msg);
+    assert_int_eq(0x00006968, code[msg]);
+    asm_free(&as);
+}
+
+static void test_asm_errors() {
+    char *unknown[] = {"movx r0, r1", NULL};
+    char *bad_reg[] = {"mov r16, r1", NULL};
+    char *bad_imm[] = {"mov r0, #0x101", NULL};
+    char *garbage[] = {"mov r0, r1 r2", NULL};
+    char *undefined[] = {"b nowhere", NULL};
+    char *twice[] = {"a:", "a:", NULL};
+    char *two_errors[] = {"foo", "mov r0", "mov r0, r1", NULL};
+    char *bad_escape[] = {".raw \"a\\q\"", NULL};
+    char *unclosed[] = {".raw \"abc\\\"", NULL};
+
+    assert_int_eq(1, count_errors(unknown));
+    assert_int_eq(1, count_errors(bad_reg));
+    assert_int_eq(1, count_errors(bad_imm));
+    assert_int_eq(1, count_errors(garbage));
+    assert_int_eq(1, count_errors(undefined));
+    assert_int_eq(1, count_errors(twice));
+    assert_int_eq(2, count_errors(two_errors));
+    assert_int_eq(1, count_errors(bad_escape));
+    assert_int_eq(1, count_errors(unclosed));
+}
+
+/*
+Many blocks of short forward and backward branches.
+*/
+static void assemble_branches(struct Assembler *as, int num) {
+    char buf[64];
+    int i;
+
+    for(i = 0; i < num; i++) {
+        sprintf(buf, "l%d: bne l%d", i, i % 3 == 0 ? i + 5 : i / 2);
+        asm_one(as, buf);
+    }
+    for(i = num; i < num + 5; i++) {
+        sprintf(buf, "l%d: .raw %d", i, i);
+        asm_one(as, buf);
+    }
+    asm_one(as, "ldr r0, =l0");
+}
+
+static void test_asm_stream() {
+    struct Assembler mem, stream;
+    FILE *fp = tmpfile();
+    int *code, *expect, mem_num, stream_num, i;
+    long size;
+
+    asm_init(&mem, "test");
+    assemble_branches(&mem, 5000);
+    expect = asm_finish(&mem, &mem_num);
+
+    asm_init(&stream, "test");
+    asm_set_output(&stream, fp);
+    assemble_branches(&stream, 5000);
+    assert_true(asm_finish(&stream, &stream_num) != NULL);
+    assert_int_eq(mem_num, stream_num);
+    /* only the unresolved window was kept */
+    assert_true(stream.capacity <= 4*ASM_BLOCK_WORDS);
+
+    size = ftell(fp);
+    assert_int_eq(mem_num*4, (int)size);
+    code = malloc(size);
+    rewind(fp);
+    assert_int_eq(mem_num, (int)fread(code, 4, mem_num, fp));
+    for(i = 0; i < mem_num; i++) {
+        if(code[i] != expect[i]) {
+            assert_int_eq(expect[i], code[i]);
+            break;
+        }
+    }
+    free(code);
+    fclose(fp);
+    asm_free(&mem);
+    asm_free(&stream);
+}
+
+static void test_asm_stream_pending() {
+    struct Assembler as;
+    FILE *fp = tmpfile();
+    int word_num, i;
+
+    /* a forward reference keeps its block and everything after it */
+    asm_init(&as, "test");
+    asm_set_output(&as, fp);
+    asm_one(&as, "b far");
+    for(i = 0; i < 3*ASM_BLOCK_WORDS; i++)
+        asm_one(&as, "mov r0, r0");
+    assert_int_eq(0, (int)ftell(fp));
+    asm_one(&as, "far: b far");
+    /* written at the next block boundary */
+    for(i = 0; i < ASM_BLOCK_WORDS; i++)
+        asm_one(&as, "mov r0, r0");
+    assert_int_eq(4*ASM_BLOCK_WORDS*4, (int)ftell(fp));
+    assert_true(asm_finish(&as, &word_num) != NULL);
+    assert_int_eq((4*ASM_BLOCK_WORDS + 2)*4, (int)ftell(fp));
+
+    rewind(fp);
+    assert_int_eq(1, (int)fread(&i, 4, 1, fp));
+    assert_int_eq(0xea000000 | (3*ASM_BLOCK_WORDS - 1), i);
+    fclose(fp);
+    asm_free(&as);
+}
+
+static void run_unit_tests() {
+    test_mnemonic_lookup();
+    test_to_symbol();
+    test_asm_instructions();
+    test_asm_raw_string();
+    test_asm_raw_string_escape_at_word_end();
+    test_asm_program();
+    test_asm_literal_shared();
+    test_asm_alternative_immediate();
+    test_asm_load_constant();
+    test_asm_pool_after_jump();
+    test_asm_pool_in_range();
+    test_asm_errors();
+    test_asm_stream();
+    test_asm_stream_pending();
+
+    printf("all test done\n");
+}
+
+/*
+Sizes, and what they would be if every ldr rd, =x had its own literal load.
+*/
+static void print_stat(struct Assembler *as) {
+    struct AsmStat *st = &as->stat;
+    int naive_words = as->pos - st->pool_jumps + st->imm_inline + st->literal_shared;
+    int naive_loads = st->literal_loads + st->imm_inline;
+
+    printf("%s: %d words (literal %d in %d pools, %d jumps over pools)\n",
+           as->file_name, as->pos, st->literal_words, st->pool_num, st->pool_jumps);
+    printf("  ldr =x: %d as mov/mvn, %d shared literals\n", st->imm_inline, st->literal_shared);
+    printf("  without them: %d words, %d literal loads -> %d words, %d literal loads\n",
+           naive_words, naive_loads, as->pos, st->literal_loads);
+}
+
+int main(int argc, char **argv) {
+    struct Assembler as;
+    FILE *fp, *out;
+    int *code, word_num;
+    int stat = 0;
+
+    if(argc >= 2 && strcmp(argv[1], "-stat") == 0) {
+        stat = 1;
+        argv++;
+        argc--;
+    }
+    if(argc < 3) {
+        run_unit_tests();
+        return 0;
+    }
+
+    fp = fopen(argv[1], "r");
+    if(fp == NULL) {
+        fprintf(stderr, "can't open %s\n", argv[1]);
+        exit(1);
+    }
+    out = fopen(argv[2], "wb");
+    if(out == NULL) {
+        fprintf(stderr, "can't open %s\n", argv[2]);
+        exit(1);
+    }
+    asm_init(&as, argv[1]);
+    asm_set_output(&as, out);
+    asm_file(&as, fp);
+    fclose(fp);
+
+    code = asm_finish(&as, &word_num);
+    fclose(out);
+    if(code == NULL) {
+        fprintf(stderr, "%d errors\n", as.error_num);
+        remove(argv[2]);
+        exit(1);
+    }
+    if(stat)
+        print_stat(&as);
+    asm_free(&as);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,166 @@
+/*
+Simple ARM assembler of arm_asm.md chapter 05.
+
+Code is placed at ASM_BASE_ADDR, there is no relocation.
+Source is given one line at a time to asm_one.
+Errors are printed as "file:line: message" and counted in error_num.
+*/
+#include <stdio.h>
+
+#define ASM_BASE_ADDR 0x00010000
+
+/*
+Part of the key of the asm_batch cache.
+Change this when the same source can be assembled to different words.
+*/
+#define ASM_VERSION "05_asm-4"
+
+/* ids of user labels start here, see "ニ分木でシンボルを実装しよう". */
+#define LABEL_ID_FIRST 10000
+
+struct Substring {
+    char *str;
+    int len;
+};
+
+struct Node {
+    char *name;
+    int value;
+    struct Node *left;
+    struct Node *right;
+};
+
+/*
+Output is kept in blocks of ASM_BLOCK_WORDS words.
+With asm_set_output, a block is written out as soon as no pending fixup points into it.
+*/
+#define ASM_BLOCK_WORDS 1024
+
+enum FixupKind {
+    FIXUP_BRANCH,   /* b, bl: 24bit word offset */
+    FIXUP_LOAD,     /* ldr rd, label: 12bit offset to the label */
+    FIXUP_LITERAL,  /* ldr rd, =x: 12bit offset to the literal of x */
+    FIXUP_ADDRESS   /* literal word: absolute address of the label */
+};
+
+struct Label {
+    char *name;
+    int pos;        /* word index, -1 until defined */
+    int fixup_head; /* fixups waiting for this label, -1 terminated */
+    int literal;    /* index in literals of the pending "=label", or -1 */
+};
+
+/*
+Fixups are pooled in Assembler.fixups and chained by next,
+either in the list of a label, the list of a literal or the free list.
+*/
+struct Fixup {
+    int kind;
+    int label;
+    int at;         /* word index of the instruction */
+    int line_no;
+    int next;
+};
+
+/*
+ldr reaches 4095 bytes forward, the last literal of a pool must be
+at most this many words after the first ldr using the pool.
+*/
+#define LITERAL_RANGE_WORDS (4095/4 + 2)
+
+struct Literal {
+    int label;      /* address of label, or -1 for value */
+    int value;
+    int fixup_head; /* ldr instructions using this literal */
+};
+
+/*
+Size statistics, see asm -stat.
+*/
+struct AsmStat {
+    int literal_words;  /* words of literal pools */
+    int pool_num;
+    int pool_jumps;     /* b over a pool placed in the middle of code */
+    int literal_loads;  /* ldr from literal pools */
+    int literal_shared; /* ldr rd, =x reusing the literal of an earlier one */
+    int imm_inline;     /* ldr rd, =x done by mov or mvn */
+};
+
+struct Assembler {
+    char *file_name;
+    int line_no;
+    int error_num;
+    FILE *err;      /* diagnostics, stderr by default */
+
+    /* code[0] is the word at code_base, pos is the next word index */
+    int *code;
+    int code_base;
+    int pos;
+    int capacity;
+    /* pending fixups in each block of code */
+    int *block_pending;
+    FILE *out;
+
+    struct Node *label_root;
+    int next_label_id;
+    /* indexed by id - LABEL_ID_FIRST */
+    struct Label *labels;
+    int label_capacity;
+
+    struct Fixup *fixups;
+    int fixup_capacity;
+    int fixup_free;
+
+    /* literals of "ldr rd, =x" not placed yet */
+    struct Literal *literals;
+    int literal_num;
+    int literal_capacity;
+    int literal_first_at;
+
+    struct AsmStat stat;
+};
+
+void asm_init(struct Assembler *as, char *file_name);
+void asm_free(struct Assembler *as);
+
+/*
+Stream the code to out instead of keeping all of it.
+Memory is then bounded by the blocks which still have unresolved forward references.
+*/
+void asm_set_output(struct Assembler *as, FILE *out);
+
+void asm_set_error_output(struct Assembler *as, FILE *err);
+
+/*
+Write words to fp in little endian.
+*/
+void asm_write_words(FILE *fp, int *words, int num);
+
+/*
+Assemble one line. line may be modified.
+Return 1 on success, 0 on error.
+*/
+int asm_one(struct Assembler *as, char *line);
+
+/*
+Assemble all lines of fp.
+*/
+void asm_file(struct Assembler *as, FILE *fp);
+
+/*
+Place the remaining literals of "ldr rd, =x" and check undefined labels.
+Return the code, or NULL if there were errors.
+With asm_set_output all words are already written and only NULL or not matters.
+*/
+int *asm_finish(struct Assembler *as, int *out_word_num);
+
+/*
+Symbol of str in the tree, added with (*next_id)++ if not found.
+*/
+int to_symbol(struct Node **root, int *next_id, char *str, int len);
+
+/*
+Mnemonic of str, or NULL.
+*/
+struct Mnemonic;
+const struct Mnemonic *mnemonic_lookup(char *str, int len);
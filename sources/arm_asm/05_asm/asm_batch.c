@@ -0,0 +1,427 @@
+/*
+Assemble many .ks files in parallel, skipping unchanged ones through a cache.
+
+gcc -O2 -pthread -DASM_NO_MAIN asm_batch.c asm.c -o asm_batch
+./asm_batch                                   # run unit tests
+./asm_batch [-jN] [-cache dir] [-list file] a.ks b.ks ...
+
+Each x.ks is assembled to x.bin.
+The cache keeps the binary of each success under the hash of ASM_VERSION and the source,
+so an unchanged source is not assembled again, and its .bin is not touched if it is up to date.
+Diagnostics are printed in the order of the sources, whatever order the threads finish in.
+*/
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "asm.h"
+
+#define BATCH_CACHE_DIR ".asm_cache"
+#define BATCH_PATH_MAX 4096
+
+struct BatchJob {
+    char *src;
+    char out[BATCH_PATH_MAX];
+    unsigned long long key;
+    int cached;
+    int ok;
+    int word_num;
+    double elapsed;
+    /* diagnostics of this source */
+    char *diag;
+    size_t diag_len;
+};
+
+struct Batch {
+    struct BatchJob *jobs;
+    int job_num;
+    int next_job;
+    char *cache_dir;
+};
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+/*
+FNV-1a, continued from h.
+*/
+static unsigned long long hash_bytes(unsigned long long h, const char *buf, size_t len) {
+    size_t i;
+
+    for(i = 0; i < len; i++) {
+        h ^= (unsigned char)buf[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static unsigned long long source_key(const char *src, size_t len) {
+    unsigned long long h = 0xcbf29ce484222325ULL;
+    h = hash_bytes(h, ASM_VERSION, strlen(ASM_VERSION) + 1);
+    return hash_bytes(h, src, len);
+}
+
+/*
+Whole file, NUL terminated. NULL if it can't be read.
+*/
+static char *read_file(char *path, size_t *out_len) {
+    FILE *fp = fopen(path, "rb");
+    char *buf = NULL;
+    size_t len = 0, capacity = 0, n;
+
+    if(fp == NULL)
+        return NULL;
+    do {
+        if(len + 4096 + 1 > capacity) {
+            capacity = capacity ? capacity*2 : 8192;
+            buf = realloc(buf, capacity);
+        }
+        n = fread(buf + len, 1, capacity - len - 1, fp);
+        len += n;
+    } while(n > 0);
+    fclose(fp);
+    buf[len] = '\0';
+    *out_len = len;
+    return buf;
+}
+
+static int write_file(char *path, char *buf, size_t len) {
+    FILE *fp = fopen(path, "wb");
+
+    if(fp == NULL)
+        return 0;
+    if(fwrite(buf, 1, len, fp) != len) {
+        fclose(fp);
+        return 0;
+    }
+    return fclose(fp) == 0;
+}
+
+/*
+Write through a temporary file and rename,
+so that other batches never see a half written cache entry.
+*/
+static int write_file_atomic(char *path, char *buf, size_t len) {
+    char tmp[BATCH_PATH_MAX + 32];
+
+    snprintf(tmp, sizeof(tmp), "%s.%ld.%lx.tmp", path, (long)getpid(), (unsigned long)pthread_self());
+    if(!write_file(tmp, buf, len)) {
+        remove(tmp);
+        return 0;
+    }
+    return rename(tmp, path) == 0;
+}
+
+static void set_out_path(struct BatchJob *job) {
+    int len = strlen(job->src);
+
+    if(len >= 3 && strcmp(job->src + len - 3, ".ks") == 0)
+        len -= 3;
+    snprintf(job->out, sizeof(job->out), "%.*s.bin", len, job->src);
+}
+
+/*
+Copy the cached binary to out, unless out already has the same bytes.
+*/
+static int restore_cached(struct BatchJob *job, char *cache_path) {
+    size_t bin_len, out_len;
+    char *bin = read_file(cache_path, &bin_len);
+    char *out;
+    int ok = 1;
+
+    if(bin == NULL)
+        return 0;
+    out = read_file(job->out, &out_len);
+    if(out == NULL || out_len != bin_len || memcmp(out, bin, bin_len) != 0)
+        ok = write_file(job->out, bin, bin_len);
+    job->word_num = bin_len/4;
+    free(out);
+    free(bin);
+    return ok;
+}
+
+static void assemble_job(struct Batch *batch, struct BatchJob *job) {
+    char cache_path[BATCH_PATH_MAX];
+    struct Assembler as;
+    FILE *src_fp, *err_fp, *bin_fp;
+    char *src, *bin;
+    size_t src_len, bin_len;
+    int *code;
+
+    err_fp = open_memstream(&job->diag, &job->diag_len);
+    src = read_file(job->src, &src_len);
+    if(src == NULL) {
+        fprintf(err_fp, "%s: %s\n", job->src, strerror(errno));
+        fclose(err_fp);
+        return;
+    }
+
+    job->key = source_key(src, src_len);
+    snprintf(cache_path, sizeof(cache_path), "%s/%016llx.bin", batch->cache_dir, job->key);
+    if(restore_cached(job, cache_path)) {
+        job->cached = 1;
+        job->ok = 1;
+        free(src);
+        fclose(err_fp);
+        return;
+    }
+
+    src_fp = fmemopen(src, src_len, "r");
+    asm_init(&as, job->src);
+    asm_set_error_output(&as, err_fp);
+    if(src_len > 0)
+        asm_file(&as, src_fp);
+    code = asm_finish(&as, &job->word_num);
+    fclose(src_fp);
+
+    if(code != NULL) {
+        bin_fp = open_memstream(&bin, &bin_len);
+        asm_write_words(bin_fp, code, job->word_num);
+        fclose(bin_fp);
+        job->ok = write_file(job->out, bin, bin_len);
+        if(!job->ok)
+            fprintf(err_fp, "%s: %s\n", job->out, strerror(errno));
+        else
+            write_file_atomic(cache_path, bin, bin_len);
+        free(bin);
+    } else {
+        /* a .bin of an earlier build would look up to date, like asm.c main. */
+        remove(job->out);
+    }
+    asm_free(&as);
+    free(src);
+    fclose(err_fp);
+}
+
+static void *batch_worker(void *arg) {
+    struct Batch *batch = arg;
+
+    while(1) {
+        int idx = __sync_fetch_and_add(&batch->next_job, 1);
+        struct BatchJob *job;
+        double begin;
+
+        if(idx >= batch->job_num)
+            break;
+        job = &batch->jobs[idx];
+        begin = now_sec();
+        assemble_job(batch, job);
+        job->elapsed = now_sec() - begin;
+    }
+    return NULL;
+}
+
+/*
+Assemble all sources with thread_num threads (0 for the number of cpus).
+Diagnostics go to diag, and timings to stdout if verbose.
+Return the number of failed sources.
+*/
+static int batch_run(char **sources, int source_num, char *cache_dir, int thread_num, FILE *diag, int verbose) {
+    struct Batch batch;
+    pthread_t *threads;
+    double begin = now_sec(), wall;
+    int i, failed = 0, cached = 0;
+
+    if(thread_num <= 0)
+        thread_num = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if(thread_num > source_num)
+        thread_num = source_num > 0 ? source_num : 1;
+    if(mkdir(cache_dir, 0755) != 0 && errno != EEXIST) {
+        perror(cache_dir);
+        exit(1);
+    }
+
+    batch.jobs = calloc(source_num > 0 ? source_num : 1, sizeof(struct BatchJob));
+    batch.job_num = source_num;
+    batch.next_job = 0;
+    batch.cache_dir = cache_dir;
+    for(i = 0; i < source_num; i++) {
+        batch.jobs[i].src = sources[i];
+        set_out_path(&batch.jobs[i]);
+    }
+
+    threads = malloc(sizeof(pthread_t)*thread_num);
+    for(i = 0; i < thread_num; i++)
+        pthread_create(&threads[i], NULL, batch_worker, &batch);
+    for(i = 0; i < thread_num; i++)
+        pthread_join(threads[i], NULL);
+    free(threads);
+    wall = now_sec() - begin;
+
+    for(i = 0; i < source_num; i++) {
+        struct BatchJob *job = &batch.jobs[i];
+
+        fwrite(job->diag, 1, job->diag_len, diag);
+        if(verbose)
+            printf("%8.3f ms  %6d words  %s%s\n", job->elapsed*1e3, job->word_num, job->src,
+                   job->cached ? " (cached)" : job->ok ? "" : " (failed)");
+        failed += !job->ok;
+        cached += job->cached;
+        free(job->diag);
+    }
+    if(verbose)
+        printf("%d files, %d cached, %d failed, %.3f ms with %d threads\n",
+               source_num, cached, failed, wall*1e3, thread_num);
+    free(batch.jobs);
+    return failed;
+}
+
+/*
+Paths, one per line, appended to *sources.
+*/
+static void read_list(char *path, char ***sources, int *source_num, int *capacity) {
+    FILE *fp = fopen(path, "r");
+    char *line = NULL;
+    size_t line_capacity = 0;
+    ssize_t len;
+
+    if(fp == NULL) {
+        perror(path);
+        exit(1);
+    }
+    while((len = getline(&line, &line_capacity, fp)) != -1) {
+        while(len > 0 && (line[len-1] == '\n' || line[len-1] == '\r'))
+            line[--len] = '\0';
+        if(len == 0)
+            continue;
+        if(*source_num == *capacity) {
+            *capacity = *capacity ? *capacity*2 : 64;
+            *sources = realloc(*sources, sizeof(char*)*(*capacity));
+        }
+        (*sources)[(*source_num)++] = strdup(line);
+    }
+    free(line);
+    fclose(fp);
+}
+
+
+/*
+test code
+*/
+
+static void assert_true(int boolflag) {
+    if(!boolflag) {
+        printf("assert fail\n");
+    }
+}
+
+static void assert_file_eq(char *expect_path, char *actual_path) {
+    size_t expect_len, actual_len;
+    char *expect = read_file(expect_path, &expect_len);
+    char *actual = read_file(actual_path, &actual_len);
+
+    if(expect == NULL || actual == NULL || expect_len != actual_len || memcmp(expect, actual, expect_len) != 0)
+        printf("assert fail, %s and %s differ\n", expect_path, actual_path);
+    free(expect);
+    free(actual);
+}
+
+static void test_source_key() {
+    assert_true(source_key("mov r0, r1\n", 11) == source_key("mov r0, r1\n", 11));
+    assert_true(source_key("mov r0, r1\n", 11) != source_key("mov r0, r2\n", 11));
+    assert_true(source_key("", 0) != 0xcbf29ce484222325ULL);
+}
+
+static void test_set_out_path() {
+    struct BatchJob job;
+
+    job.src = "dir/hello.ks";
+    set_out_path(&job);
+    assert_true(strcmp(job.out, "dir/hello.bin") == 0);
+    job.src = "hello.s";
+    set_out_path(&job);
+    assert_true(strcmp(job.out, "hello.s.bin") == 0);
+}
+
+static void test_batch_run() {
+    char dir[] = "/tmp/asm_batch_testXXXXXX";
+    char cache[64], good[64], bad[64], good_bin[64], bad_bin[64], first_bin[64];
+    char *sources[2];
+    struct stat st1, st2;
+    /* the error of bad.ks is expected, keep the test output clean */
+    FILE *diag = fopen("/dev/null", "w");
+
+    assert_true(mkdtemp(dir) != NULL);
+    snprintf(cache, sizeof(cache), "%s/cache", dir);
+    snprintf(good, sizeof(good), "%s/good.ks", dir);
+    snprintf(bad, sizeof(bad), "%s/bad.ks", dir);
+    snprintf(good_bin, sizeof(good_bin), "%s/good.bin", dir);
+    snprintf(bad_bin, sizeof(bad_bin), "%s/bad.bin", dir);
+    snprintf(first_bin, sizeof(first_bin), "%s/first.bin", dir);
+    write_file(good, "loop: b loop\nldr r0, =0x12345678\n", 34);
+    write_file(bad, "movx r0, r1\n", 12);
+    /* output of an earlier successful build of bad.ks */
+    write_file(bad_bin, "old", 3);
+    sources[0] = good;
+    sources[1] = bad;
+
+    assert_true(batch_run(sources, 2, cache, 2, diag, 0) == 1);
+    assert_true(access(bad_bin, F_OK) != 0);
+    rename(good_bin, first_bin);
+    assert_true(batch_run(sources, 2, cache, 2, diag, 0) == 1);
+    fclose(diag);
+
+    /* restored from the cache, the same bytes */
+    assert_file_eq(first_bin, good_bin);
+    /* up to date output is not written again */
+    stat(good_bin, &st1);
+    assert_true(batch_run(sources, 1, cache, 1, stderr, 0) == 0);
+    stat(good_bin, &st2);
+    assert_true(st1.st_mtim.tv_sec == st2.st_mtim.tv_sec && st1.st_mtim.tv_nsec == st2.st_mtim.tv_nsec);
+
+    {
+        char cmd[128];
+        snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+        assert_true(system(cmd) == 0);
+    }
+}
+
+static void run_unit_tests() {
+    test_source_key();
+    test_set_out_path();
+    test_batch_run();
+
+    printf("all test done\n");
+}
+
+int main(int argc, char **argv) {
+    char *cache_dir = BATCH_CACHE_DIR;
+    char **sources = NULL;
+    int source_num = 0, capacity = 0;
+    int thread_num = 0;
+    int i;
+
+    if(argc < 2) {
+        run_unit_tests();
+        return 0;
+    }
+
+    for(i = 1; i < argc; i++) {
+        if(strncmp(argv[i], "-j", 2) == 0) {
+            thread_num = atoi(argv[i] + 2);
+        } else if(strcmp(argv[i], "-cache") == 0 && i + 1 < argc) {
+            cache_dir = argv[++i];
+        } else if(strcmp(argv[i], "-list") == 0 && i + 1 < argc) {
+            read_list(argv[++i], &sources, &source_num, &capacity);
+        } else {
+            if(source_num == capacity) {
+                capacity = capacity ? capacity*2 : 64;
+                sources = realloc(sources, sizeof(char*)*capacity);
+            }
+            sources[source_num++] = strdup(argv[i]);
+        }
+    }
+
+    i = batch_run(sources, source_num, cache_dir, thread_num, stderr, 1);
+    while(source_num > 0)
+        free(sources[--source_num]);
+    free(sources);
+    return i > 0 ? 1 : 0;
+}
@@ -0,0 +1,207 @@
+/*
+Line throughput of the assembler on a large generated .ks file,
+and mnemonic lookup, perfect hash vs binary tree of all spellings.
+
+gcc -O2 -DASM_NO_MAIN asm_bench.c asm.c -o asm_bench
+./asm_bench [out.ks]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "asm.h"
+#include "mnemonic.h"
+#include "mnemonic_table.h"
+
+#define LINE_NUM (2*1024*1024)
+#define LINES_PER_LABEL 16
+#define REPEAT 3
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+/*
+Instruction mix of the lesson programs with random registers and immediates.
+Branches go to the previous label so that every label is defined.
+*/
+static void write_line(FILE *fp, int line_no) {
+    static char *conds[] = {"", "", "", "eq", "ne", "ge", "lt"};
+    int label = line_no / LINES_PER_LABEL;
+    int r = rand();
+    int rd = r & 7, rn = (r >> 3) & 7, rm = (r >> 6) & 7;
+    int imm = (r >> 9) & 0xff;
+
+    if(line_no % LINES_PER_LABEL == 0) {
+        fprintf(fp, "label%d:\n", label);
+        return;
+    }
+    switch((r >> 17) % 13) {
+        case 0: fprintf(fp, "    mov%s r%d, #0x%x\n", conds[(r >> 21) % 7], rd, imm); break;
+        case 1: fprintf(fp, "    add r%d, r%d, #%d\n", rd, rn, imm); break;
+        case 2: fprintf(fp, "    cmp r%d, #%d\n", rn, imm); break;
+        case 3: fprintf(fp, "    and r%d, r%d, #0x%x\n", rd, rn, imm); break;
+        case 4: fprintf(fp, "    lsr r%d, r%d, #%d\n", rd, rm, imm % 31 + 1); break;
+        case 5: fprintf(fp, "    ldr r%d, [r%d, #0x%x]\n", rd, rn, imm*4); break;
+        case 6: fprintf(fp, "    str r%d, [r%d]\n", rd, rn); break;
+        case 7: fprintf(fp, "    ldrb r%d, [r%d]  // byte\n", rd, rn); break;
+        case 8: fprintf(fp, "    b%s label%d\n", conds[(r >> 21) % 7], label); break;
+        case 9: fprintf(fp, "    bl label%d\n", label); break;
+        case 10: fprintf(fp, "    stmdb r13!, {r%d, r14}\n", rd); break;
+        case 11: fprintf(fp, "    ldr r%d, =0x%x\n", rd, (r & 1 ? 0x101f0000 : 0x100) + imm); break;
+        default: fprintf(fp, "    ldmia r13!, {r%d, r14}\n", rd); break;
+    }
+}
+
+static long generate(char *path) {
+    FILE *fp = fopen(path, "w");
+    long size;
+    int i;
+
+    if(fp == NULL) {
+        fprintf(stderr, "can't open %s\n", path);
+        exit(1);
+    }
+    srand(1);
+    for(i = 0; i < LINE_NUM; i++)
+        write_line(fp, i);
+    size = ftell(fp);
+    fclose(fp);
+    return size;
+}
+
+/*
+out is NULL for in memory, or the stream to write.
+*/
+static double bench_asm(char *path, FILE *out, int *out_words, int *out_capacity) {
+    double begin, elapsed, best = 0;
+    int j;
+
+    for(j = 0; j < REPEAT; j++) {
+        struct Assembler as;
+        FILE *fp = fopen(path, "r");
+
+        begin = now_sec();
+        asm_init(&as, path);
+        if(out != NULL) {
+            rewind(out);
+            asm_set_output(&as, out);
+        }
+        asm_file(&as, fp);
+        if(asm_finish(&as, out_words) == NULL) {
+            fprintf(stderr, "%d errors\n", as.error_num);
+            exit(1);
+        }
+        elapsed = now_sec() - begin;
+        *out_capacity = as.capacity;
+        asm_free(&as);
+        fclose(fp);
+        if(j == 0 || elapsed < best)
+            best = elapsed;
+    }
+    return best;
+}
+
+
+/*
+lookup only
+*/
+
+#define LOOKUP_NUM (16*1024*1024)
+
+static struct Substring *collect_mnemonics(char *path, int *out_num) {
+    struct Substring *words = malloc(sizeof(struct Substring)*LOOKUP_NUM);
+    FILE *fp = fopen(path, "r");
+    char *line = NULL;
+    size_t capacity = 0;
+    int num = 0;
+
+    while(num < LOOKUP_NUM && getline(&line, &capacity, fp) != -1) {
+        char *p = line;
+        int len = 0;
+        while(*p == ' ')
+            p++;
+        while(p[len] != ' ' && p[len] != '\n' && p[len] != ':')
+            len++;
+        if(p[len] == ':')
+            continue;
+        words[num].str = strndup(p, len);
+        words[num].len = len;
+        num++;
+    }
+    free(line);
+    fclose(fp);
+    *out_num = num;
+    return words;
+}
+
+static double bench_lookup_hash(struct Substring *words, int num, long *out_sum) {
+    double begin = now_sec();
+    long sum = 0;
+    int i;
+
+    for(i = 0; i < num; i++)
+        sum += mnemonic_lookup(words[i].str, words[i].len)->op;
+    *out_sum = sum;
+    return now_sec() - begin;
+}
+
+/*
+What the chapter did before: every spelling is a symbol in the tree,
+and the symbol indexes the mnemonic.
+*/
+static double bench_lookup_tree(struct Substring *words, int num, long *out_sum) {
+    struct Node *root = NULL;
+    const struct Mnemonic *by_id[MNEMONIC_TABLE_SIZE];
+    int next_id = 0;
+    double begin;
+    long sum = 0;
+    int i;
+
+    for(i = 0; i < MNEMONIC_TABLE_SIZE; i++) {
+        const struct Mnemonic *m = &mnemonic_table[i];
+        if(m->name != NULL)
+            by_id[to_symbol(&root, &next_id, (char*)m->name, strlen(m->name))] = m;
+    }
+
+    begin = now_sec();
+    for(i = 0; i < num; i++)
+        sum += by_id[to_symbol(&root, &next_id, words[i].str, words[i].len)]->op;
+    *out_sum = sum;
+    return now_sec() - begin;
+}
+
+int main(int argc, char **argv) {
+    char *path = argc > 1 ? argv[1] : "asm_bench.ks";
+    struct Substring *words;
+    FILE *out = fopen("/dev/null", "wb");
+    double elapsed, hash_time, tree_time;
+    long size, hash_sum, tree_sum;
+    int word_num, capacity, num, i;
+
+    size = generate(path);
+    elapsed = bench_asm(path, NULL, &word_num, &capacity);
+    printf("%d lines (%ld MB) to %d words\n", LINE_NUM, size/1024/1024, word_num);
+    printf("assemble: %6.1f M lines/sec, %6.1f MB/sec, %d words buffered\n",
+           LINE_NUM/elapsed/1e6, size/elapsed/1024/1024, capacity);
+    elapsed = bench_asm(path, out, &word_num, &capacity);
+    printf("stream:   %6.1f M lines/sec, %6.1f MB/sec, %d words buffered\n",
+           LINE_NUM/elapsed/1e6, size/elapsed/1024/1024, capacity);
+    fclose(out);
+
+    words = collect_mnemonics(path, &num);
+    tree_time = bench_lookup_tree(words, num, &tree_sum);
+    hash_time = bench_lookup_hash(words, num, &hash_sum);
+    printf("lookup tree: %6.1f M/sec\n", num/tree_time/1e6);
+    printf("lookup hash: %6.1f M/sec (%.2fx)\n", num/hash_time/1e6, tree_time/hash_time);
+    if(hash_sum != tree_sum)
+        printf("mismatch: hash %ld, tree %ld\n", hash_sum, tree_sum);
+
+    for(i = 0; i < num; i++)
+        free(words[i].str);
+    free(words);
+    return 0;
+}
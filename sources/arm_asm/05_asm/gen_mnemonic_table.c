@@ -0,0 +1,183 @@
+/*
+Generate mnemonic_table.h, the perfect hash of all mnemonic spellings.
+
+gcc gen_mnemonic_table.c -o gen_mnemonic_table && ./gen_mnemonic_table > mnemonic_table.h
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mnemonic.h"
+
+#define KEY_MAX 1024
+#define TABLE_SIZE 1024
+#define BUCKET_NUM 256
+
+static char *cond_names[15] = {
+    "eq", "ne", "cs", "cc", "mi", "pl", "vs", "vc",
+    "hi", "ls", "ge", "lt", "gt", "le", ""
+};
+
+/*
+Base names and whether they take s suffix.
+*/
+static struct {
+    char *name;
+    int op;
+    int has_s;
+} bases[] = {
+    {"and", OP_AND, 1}, {"eor", OP_EOR, 1}, {"sub", OP_SUB, 1}, {"rsb", OP_RSB, 1},
+    {"add", OP_ADD, 1}, {"adc", OP_ADC, 1}, {"sbc", OP_SBC, 1}, {"rsc", OP_RSC, 1},
+    {"tst", OP_TST, 0}, {"teq", OP_TEQ, 0}, {"cmp", OP_CMP, 0}, {"cmn", OP_CMN, 0},
+    {"orr", OP_ORR, 1}, {"mov", OP_MOV, 1}, {"bic", OP_BIC, 1}, {"mvn", OP_MVN, 1},
+    {"lsl", OP_LSL, 1}, {"lsr", OP_LSR, 1}, {"asr", OP_ASR, 1}, {"ror", OP_ROR, 1},
+    {"mul", OP_MUL, 1},
+    {"ldr", OP_LDR, 0}, {"ldrb", OP_LDRB, 0}, {"str", OP_STR, 0}, {"strb", OP_STRB, 0},
+    {"ldmia", OP_LDMIA, 0}, {"stmdb", OP_STMDB, 0}, {"push", OP_PUSH, 0}, {"pop", OP_POP, 0},
+    {"b", OP_B, 0}, {"bl", OP_BL, 0}, {"bx", OP_BX, 0}, {"blx", OP_BLX, 0}
+};
+
+static char *directives[] = {".raw"};
+
+struct Key {
+    char name[16];
+    int op;
+    int cond;
+    int set_flags;
+    unsigned long long hash;
+};
+
+static struct Key keys[KEY_MAX];
+static int key_num = 0;
+
+static void add_key(char *name, int op, int cond, int set_flags) {
+    int i;
+
+    for(i = 0; i < key_num; i++) {
+        if(strcmp(keys[i].name, name) == 0) {
+            fprintf(stderr, "duplicated mnemonic %s\n", name);
+            exit(1);
+        }
+    }
+    if(key_num == KEY_MAX) {
+        fprintf(stderr, "too many mnemonics\n");
+        exit(1);
+    }
+    strcpy(keys[key_num].name, name);
+    keys[key_num].op = op;
+    keys[key_num].cond = cond;
+    keys[key_num].set_flags = set_flags;
+    keys[key_num].hash = mnemonic_hash(name, strlen(name));
+    key_num++;
+}
+
+static void collect_keys() {
+    char name[16];
+    int i, cond, s;
+
+    for(i = 0; i < (int)(sizeof(bases)/sizeof(bases[0])); i++) {
+        for(cond = 0; cond <= COND_AL; cond++) {
+            for(s = 0; s <= bases[i].has_s; s++) {
+                sprintf(name, "%s%s%s", bases[i].name, s ? "s" : "", cond_names[cond]);
+                add_key(name, bases[i].op, cond, s);
+            }
+        }
+    }
+    add_key(directives[0], OP_RAW, COND_AL, 0);
+}
+
+
+/*
+Hash and displace.
+Place larger buckets first, and for each bucket search the displacement
+which puts all of its keys into free slots.
+*/
+static int bucket_keys[BUCKET_NUM][KEY_MAX];
+static int bucket_size[BUCKET_NUM];
+static int bucket_order[BUCKET_NUM];
+static unsigned int displace[BUCKET_NUM];
+static int slot_key[TABLE_SIZE];
+
+static int compare_bucket(const void *a, const void *b) {
+    return bucket_size[*(int*)b] - bucket_size[*(int*)a];
+}
+
+static int try_displace(int bucket, unsigned int d) {
+    unsigned int slots[KEY_MAX];
+    int i, j;
+
+    for(i = 0; i < bucket_size[bucket]; i++) {
+        slots[i] = mnemonic_slot(keys[bucket_keys[bucket][i]].hash, d, TABLE_SIZE);
+        if(slot_key[slots[i]] >= 0)
+            return 0;
+        for(j = 0; j < i; j++) {
+            if(slots[j] == slots[i])
+                return 0;
+        }
+    }
+    for(i = 0; i < bucket_size[bucket]; i++)
+        slot_key[slots[i]] = bucket_keys[bucket][i];
+    return 1;
+}
+
+static void build_table() {
+    int i;
+
+    for(i = 0; i < key_num; i++) {
+        int b = keys[i].hash % BUCKET_NUM;
+        bucket_keys[b][bucket_size[b]++] = i;
+    }
+    for(i = 0; i < BUCKET_NUM; i++)
+        bucket_order[i] = i;
+    qsort(bucket_order, BUCKET_NUM, sizeof(int), compare_bucket);
+    memset(slot_key, -1, sizeof(slot_key));
+
+    for(i = 0; i < BUCKET_NUM; i++) {
+        int b = bucket_order[i];
+        unsigned int d;
+
+        if(bucket_size[b] == 0)
+            break;
+        for(d = 0; d < TABLE_SIZE*TABLE_SIZE; d++) {
+            if(try_displace(b, d))
+                break;
+        }
+        if(d == TABLE_SIZE*TABLE_SIZE) {
+            fprintf(stderr, "no displacement for bucket %d\n", b);
+            exit(1);
+        }
+        displace[b] = d;
+    }
+}
+
+static void print_table() {
+    int i;
+
+    printf("/* Generated by gen_mnemonic_table.c, do not edit. %d keys. */\n", key_num);
+    printf("#define MNEMONIC_TABLE_SIZE %d\n", TABLE_SIZE);
+    printf("#define MNEMONIC_BUCKET_NUM %d\n\n", BUCKET_NUM);
+
+    printf("static const unsigned int mnemonic_displace[MNEMONIC_BUCKET_NUM] = {");
+    for(i = 0; i < BUCKET_NUM; i++)
+        printf("%s%u", i == 0 ? "\n    " : i % 8 == 0 ? ",\n    " : ", ", displace[i]);
+    printf("\n};\n\n");
+
+    printf("static const struct Mnemonic mnemonic_table[MNEMONIC_TABLE_SIZE] = {\n");
+    for(i = 0; i < TABLE_SIZE; i++) {
+        struct Key *k;
+        if(slot_key[i] < 0) {
+            printf("    {0, 0, 0, 0},\n");
+            continue;
+        }
+        k = &keys[slot_key[i]];
+        printf("    {\"%s\", %d, %d, %d},\n", k->name, k->op, k->cond, k->set_flags);
+    }
+    printf("};\n");
+}
+
+int main() {
+    collect_keys();
+    build_table();
+    print_table();
+    return 0;
+}
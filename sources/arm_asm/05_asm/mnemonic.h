@@ -0,0 +1,69 @@
+/*
+Mnemonics and directives of the assembler.
+
+Every spelling, including condition and s suffix like "bne" or "addseq",
+is one key of a perfect hash table in mnemonic_table.h.
+That file is generated by gen_mnemonic_table.c, do not edit it by hand.
+
+gcc gen_mnemonic_table.c -o gen_mnemonic_table && ./gen_mnemonic_table > mnemonic_table.h
+*/
+enum AsmOp {
+    OP_NONE,
+
+    /* data processing, in the order of the opcode field */
+    OP_AND, OP_EOR, OP_SUB, OP_RSB, OP_ADD, OP_ADC, OP_SBC, OP_RSC,
+    OP_TST, OP_TEQ, OP_CMP, OP_CMN, OP_ORR, OP_MOV, OP_BIC, OP_MVN,
+
+    /* mov with shift */
+    OP_LSL, OP_LSR, OP_ASR, OP_ROR,
+
+    OP_MUL,
+    OP_LDR, OP_LDRB, OP_STR, OP_STRB,
+    OP_LDMIA, OP_STMDB, OP_PUSH, OP_POP,
+    OP_B, OP_BL, OP_BX, OP_BLX,
+
+    /* directives */
+    OP_RAW
+};
+
+#define OP_DP_OPCODE(op) ((op) - OP_AND)
+#define OP_IS_DP(op) ((op) >= OP_AND && (op) <= OP_MVN)
+
+#define COND_AL 14
+
+struct Mnemonic {
+    const char *name;
+    unsigned char op;
+    unsigned char cond;
+    unsigned char set_flags;
+};
+
+/*
+FNV-1a followed by a 64bit finalizer.
+The generator and the lookup must use the same function.
+*/
+static inline unsigned long long mnemonic_hash(const char *str, int len) {
+    unsigned long long h = 0xcbf29ce484222325ULL;
+    int i;
+
+    for(i = 0; i < len; i++) {
+        h ^= (unsigned char)str[i];
+        h *= 0x100000001b3ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/*
+Hash and displace: the bucket of the key gives displacement d,
+and the slot is (f1 + d0*f2 + d1) % table_size where d = d0*table_size + d1.
+*/
+static inline unsigned int mnemonic_slot(unsigned long long h, unsigned int displace, unsigned int table_size) {
+    unsigned long long f1 = (h >> 20) % table_size;
+    unsigned long long f2 = (h >> 40) % table_size;
+    unsigned long long d0 = displace / table_size;
+    unsigned long long d1 = displace % table_size;
+    return (unsigned int)((f1 + d0*f2 + d1) % table_size);
+}
@@ -0,0 +1,1065 @@
+/* Generated by gen_mnemonic_table.c, do not edit. 751 keys. */
+#define MNEMONIC_TABLE_SIZE 1024
+#define MNEMONIC_BUCKET_NUM 256
+
+static const unsigned int mnemonic_displace[MNEMONIC_BUCKET_NUM] = {
+    2, 3, 4, 0, 5, 0, 11, 0,
+    9, 13, 1, 28, 0, 0, 0, 1,
+    1, 1, 0, 1, 14, 1, 0, 0,
+    7, 1, 38, 0, 0, 9, 15, 3,
+    0, 1, 8, 0, 0, 4, 5, 1,
+    0, 9, 6, 0, 12, 14, 2, 6,
+    3, 0, 13, 0, 1, 9, 6, 2,
+    1, 0, 3, 0, 1, 1, 2, 2,
+    0, 2, 1, 3, 1, 3, 0, 0,
+    0, 0, 4, 14, 1, 0, 10, 23,
+    1, 0, 0, 10, 22, 0, 14, 0,
+    6, 9, 7, 2, 2, 0, 3, 18,
+    0, 0, 6, 2, 15, 6, 14, 3,
+    4, 3, 2, 1, 3, 1, 1, 0,
+    3, 0, 0, 6, 0, 2, 0, 17,
+    6, 2, 12, 0, 2, 0, 1, 2,
+    0, 14, 0, 16, 0, 3, 5, 0,
+    3, 2, 3, 0, 3, 8, 0, 4,
+    1, 0, 11, 6, 0, 22, 3, 13,
+    1, 1, 5, 0, 1, 1, 2, 5,
+    9, 2, 54, 0, 5, 13, 15, 14,
+    6, 1, 25, 3, 5, 7, 0, 0,
+    0, 14, 9, 6, 20, 1, 0, 6,
+    14, 0, 0, 0, 17, 14, 1, 12,
+    12, 1, 9, 1, 4, 2, 1, 0,
+    16, 0, 9, 24, 12, 4, 0, 12,
+    2, 5, 0, 1, 27, 0, 6, 16,
+    26, 0, 1, 4, 0, 9, 8, 0,
+    3, 0, 0, 10, 1, 25, 1, 10,
+    11, 0, 0, 23, 9, 3, 7, 0,
+    7, 5, 0, 32, 1, 53, 2, 2,
+    1, 12, 0, 10, 5, 9, 15, 1
+};
+
+static const struct Mnemonic mnemonic_table[MNEMONIC_TABLE_SIZE] = {
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"mulcs", 21, 2, 0},
+    {"movseq", 14, 0, 1},
+    {0, 0, 0, 0},
+    {"tstvc", 9, 7, 0},
+    {"lslsne", 17, 1, 1},
+    {0, 0, 0, 0},
+    {"lslshi", 17, 8, 1},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"sbcscs", 7, 2, 1},
+    {"orrshi", 13, 8, 1},
+    {"subsvc", 3, 7, 1},
+    {0, 0, 0, 0},
+    {"orrsls", 13, 9, 1},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"popvc", 29, 7, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"mvnsle", 16, 13, 1},
+    {"rscseq", 8, 0, 1},
+    {"rorsvs", 20, 6, 1},
+    {"orrscc", 13, 3, 1},
+    {"tstle", 9, 13, 0},
+    {"mulcc", 21, 3, 0},
+    {"pushgt", 28, 12, 0},
+    {"rsbsvc", 4, 7, 1},
+    {"adcseq", 6, 0, 1},
+    {"mulsvs", 21, 6, 1},
+    {"eorshi", 2, 8, 1},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"adcshi", 6, 8, 1},
+    {0, 0, 0, 0},
+    {"orrscs", 13, 2, 1},
+    {0, 0, 0, 0},
+    {"movle", 14, 13, 0},
+    {"stmdbmi", 27, 4, 0},
+    {"asrcs", 19, 2, 0},
+    {"bcc", 30, 3, 0},
+    {"blxls", 33, 9, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"sbcsge", 7, 10, 1},
+    {"eorne", 2, 1, 0},
+    {"eorlt", 2, 11, 0},
+    {"ldrbhi", 23, 8, 0},
+    {"eorsmi", 2, 4, 1},
+    {"lslspl", 17, 5, 1},
+    {"subls", 3, 9, 0},
+    {"ldmiami", 26, 4, 0},
+    {"bicsne", 15, 1, 1},
+    {"cmpcc", 11, 3, 0},
+    {"mulspl", 21, 5, 1},
+    {"asrpl", 19, 5, 0},
+    {"asrmi", 19, 4, 0},
+    {"andsle", 1, 13, 1},
+    {"lsrlt", 18, 11, 0},
+    {"tstvs", 9, 6, 0},
+    {"mulhi", 21, 8, 0},
+    {"cmnge", 12, 10, 0},
+    {"eorle", 2, 13, 0},
+    {"cmn", 12, 14, 0},
+    {"mulsge", 21, 10, 1},
+    {"eorls", 2, 9, 0},
+    {"andsne", 1, 1, 1},
+    {"cmpvc", 11, 7, 0},
+    {"rsbscc", 4, 3, 1},
+    {"cmnle", 12, 13, 0},
+    {"submi", 3, 4, 0},
+    {0, 0, 0, 0},
+    {"ldrbcs", 23, 2, 0},
+    {"asrspl", 19, 5, 1},
+    {"ldrbmi", 23, 4, 0},
+    {"orrcc", 13, 3, 0},
+    {"asreq", 19, 0, 0},
+    {"rscvs", 8, 6, 0},
+    {"addle", 5, 13, 0},
+    {"blvs", 31, 6, 0},
+    {"blxlt", 33, 11, 0},
+    {"cmplt", 11, 11, 0},
+    {"adcsvc", 6, 7, 1},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"orrs", 13, 14, 1},
+    {"rorpl", 20, 5, 0},
+    {0, 0, 0, 0},
+    {"rscge", 8, 10, 0},
+    {"poplt", 29, 11, 0},
+    {"sbcsle", 7, 13, 1},
+    {"rscsls", 8, 9, 1},
+    {"lsrpl", 18, 5, 0},
+    {"cmnvc", 12, 7, 0},
+    {"rsbsge", 4, 10, 1},
+    {"popgt", 29, 12, 0},
+    {"ldrbcc", 23, 3, 0},
+    {"blmi", 31, 4, 0},
+    {"lslgt", 17, 12, 0},
+    {"mulseq", 21, 0, 1},
+    {0, 0, 0, 0},
+    {"biceq", 15, 0, 0},
+    {"strbls", 25, 9, 0},
+    {"bge", 30, 10, 0},
+    {"adcsgt", 6, 12, 1},
+    {0, 0, 0, 0},
+    {"lslls", 17, 9, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"eorgt", 2, 12, 0},
+    {"eorvs", 2, 6, 0},
+    {"rorgt", 20, 12, 0},
+    {"orrcs", 13, 2, 0},
+    {"movsgt", 14, 12, 1},
+    {0, 0, 0, 0},
+    {"ldmiale", 26, 13, 0},
+    {"strlt", 24, 11, 0},
+    {"movcs", 14, 2, 0},
+    {0, 0, 0, 0},
+    {"lslsmi", 17, 4, 1},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"asrvs", 19, 6, 0},
+    {"mulslt", 21, 11, 1},
+    {"rsccc", 8, 3, 0},
+    {"subshi", 3, 8, 1},
+    {"adcsne", 6, 1, 1},
+    {"rscslt", 8, 11, 1},
+    {"poppl", 29, 5, 0},
+    {"pophi", 29, 8, 0},
+    {0, 0, 0, 0},
+    {"lsrgt", 18, 12, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"strbgt", 25, 12, 0},
+    {0, 0, 0, 0},
+    {"strbge", 25, 10, 0},
+    {"rsccs", 8, 2, 0},
+    {"rsbcc", 4, 3, 0},
+    {"ldmiapl", 26, 5, 0},
+    {"addsvc", 5, 7, 1},
+    {"movvs", 14, 6, 0},
+    {"rorsvc", 20, 7, 1},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"adcgt", 6, 12, 0},
+    {"orrsge", 13, 10, 1},
+    {"addls", 5, 9, 0},
+    {"andls", 1, 9, 0},
+    {"bx", 32, 14, 0},
+    {0, 0, 0, 0},
+    {"mvnhi", 16, 8, 0},
+    {"movs", 14, 14, 1},
+    {"andgt", 1, 12, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"rorsle", 20, 13, 1},
+    {"mvnsmi", 16, 4, 1},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"and", 1, 14, 0},
+    {"cmnlt", 12, 11, 0},
+    {"ror", 20, 14, 0},
+    {"mvnsls", 16, 9, 1},
+    {"bicslt", 15, 11, 1},
+    {"cmpeq", 11, 0, 0},
+    {0, 0, 0, 0},
+    {"subeq", 3, 0, 0},
+    {0, 0, 0, 0},
+    {"andvc", 1, 7, 0},
+    {"rscls", 8, 9, 0},
+    {"ldrbvs", 23, 6, 0},
+    {"asrcc", 19, 3, 0},
+    {"popcs", 29, 2, 0},
+    {"mvnvc", 16, 7, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"adcsmi", 6, 4, 1},
+    {"rorlt", 20, 11, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"rorle", 20, 13, 0},
+    {0, 0, 0, 0},
+    {"mvnge", 16, 10, 0},
+    {"bxvs", 32, 6, 0},
+    {0, 0, 0, 0},
+    {"bxle", 32, 13, 0},
+    {"lslcs", 17, 2, 0},
+    {"orr", 13, 14, 0},
+    {"ldrbgt", 23, 12, 0},
+    {"addslt", 5, 11, 1},
+    {"asrls", 19, 9, 0},
+    {0, 0, 0, 0},
+    {"asrscc", 19, 3, 1},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"movls", 14, 9, 0},
+    {"lslne", 17, 1, 0},
+    {"adcslt", 6, 11, 1},
+    {"rorscc", 20, 3, 1},
+    {0, 0, 0, 0},
+    {"lsrsge", 18, 10, 1},
+    {"lsrslt", 18, 11, 1},
+    {"strpl", 24, 5, 0},
+    {"andslt", 1, 11, 1},
+    {"rscgt", 8, 12, 0},
+    {"andsvc", 1, 7, 1},
+    {"mvnsge", 16, 10, 1},
+    {"rscscs", 8, 2, 1},
+    {"andmi", 1, 4, 0},
+    {"ldrbpl", 23, 5, 0},
+    {"andsmi", 1, 4, 1},
+    {"rscscc", 8, 3, 1},
+    {"sbc", 7, 14, 0},
+    {"ldmiahi", 26, 8, 0},
+    {"rsbsle", 4, 13, 1},
+    {"rsb", 4, 14, 0},
+    {0, 0, 0, 0},
+    {"bicscs", 15, 2, 1},
+    {"orrsgt", 13, 12, 1},
+    {"mulge", 21, 10, 0},
+    {0, 0, 0, 0},
+    {"orrmi", 13, 4, 0},
+    {"adcmi", 6, 4, 0},
+    {"eorsne", 2, 1, 1},
+    {"sbcshi", 7, 8, 1},
+    {"tstgt", 9, 12, 0},
+    {"lsreq", 18, 0, 0},
+    {"rormi", 20, 4, 0},
+    {"strgt", 24, 12, 0},
+    {"blxmi", 33, 4, 0},
+    {"lslsls", 17, 9, 1},
+    {"asrsge", 19, 10, 1},
+    {"bicsls", 15, 9, 1},
+    {"rorcs", 20, 2, 0},
+    {"strhi", 24, 8, 0},
+    {"rorspl", 20, 5, 1},
+    {"rsbslt", 4, 11, 1},
+    {"mvns", 16, 14, 1},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"beq", 30, 0, 0},
+    {"andvs", 1, 6, 0},
+    {0, 0, 0, 0},
+    {"rsbseq", 4, 0, 1},
+    {"lsrge", 18, 10, 0},
+    {"eorsle", 2, 13, 1},
+    {"andsls", 1, 9, 1},
+    {0, 0, 0, 0},
+    {"tstcs", 9, 2, 0},
+    {"lslvc", 17, 7, 0},
+    {"add", 5, 14, 0},
+    {0, 0, 0, 0},
+    {"orrlt", 13, 11, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"movsge", 14, 10, 1},
+    {"bxmi", 32, 4, 0},
+    {"lsrmi", 18, 4, 0},
+    {"lslhi", 17, 8, 0},
+    {0, 0, 0, 0},
+    {"mvnpl", 16, 5, 0},
+    {0, 0, 0, 0},
+    {"addsne", 5, 1, 1},
+    {"bmi", 30, 4, 0},
+    {"blpl", 31, 5, 0},
+    {0, 0, 0, 0},
+    {"mulgt", 21, 12, 0},
+    {"teqne", 10, 1, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"cmnpl", 12, 5, 0},
+    {0, 0, 0, 0},
+    {"teq", 10, 14, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"blcc", 31, 3, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"movsmi", 14, 4, 1},
+    {"ldrls", 22, 9, 0},
+    {"eorsge", 2, 10, 1},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"lslscs", 17, 2, 1},
+    {"orrle", 13, 13, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"lsrsvs", 18, 6, 1},
+    {"ldrmi", 22, 4, 0},
+    {"sbccc", 7, 3, 0},
+    {0, 0, 0, 0},
+    {"adcvc", 6, 7, 0},
+    {"stmdbeq", 27, 0, 0},
+    {0, 0, 0, 0},
+    {"mulsvc", 21, 7, 1},
+    {"lsrsvc", 18, 7, 1},
+    {"cmnvs", 12, 6, 0},
+    {"teqls", 10, 9, 0},
+    {"mvnslt", 16, 11, 1},
+    {"rscsne", 8, 1, 1},
+    {"rscs", 8, 14, 1},
+    {"andne", 1, 1, 0},
+    {"ble", 30, 13, 0},
+    {0, 0, 0, 0},
+    {"orrsvc", 13, 7, 1},
+    {"mulvc", 21, 7, 0},
+    {0, 0, 0, 0},
+    {"blge", 31, 10, 0},
+    {"bls", 30, 9, 0},
+    {0, 0, 0, 0},
+    {"movscc", 14, 3, 1},
+    {0, 0, 0, 0},
+    {"orrslt", 13, 11, 1},
+    {"mulsgt", 21, 12, 1},
+    {"rsbsls", 4, 9, 1},
+    {"strne", 24, 1, 0},
+    {"stmdbcc", 27, 3, 0},
+    {"str", 24, 14, 0},
+    {"ldreq", 22, 0, 0},
+    {"addsgt", 5, 12, 1},
+    {"movsvs", 14, 6, 1},
+    {"subge", 3, 10, 0},
+    {"popne", 29, 1, 0},
+    {"andge", 1, 10, 0},
+    {"pusheq", 28, 0, 0},
+    {0, 0, 0, 0},
+    {"lslvs", 17, 6, 0},
+    {"eorspl", 2, 5, 1},
+    {"subcc", 3, 3, 0},
+    {".raw", 34, 14, 0},
+    {"teqvc", 10, 7, 0},
+    {"asrseq", 19, 0, 1},
+    {"rscspl", 8, 5, 1},
+    {0, 0, 0, 0},
+    {"andshi", 1, 8, 1},
+    {"bicseq", 15, 0, 1},
+    {"strls", 24, 9, 0},
+    {"lsl", 17, 14, 0},
+    {"ldrble", 23, 13, 0},
+    {"tstmi", 9, 4, 0},
+    {"eorslt", 2, 11, 1},
+    {"eorpl", 2, 5, 0},
+    {"eorscc", 2, 3, 1},
+    {"andcs", 1, 2, 0},
+    {"asrsgt", 19, 12, 1},
+    {"lslseq", 17, 0, 1},
+    {"subsle", 3, 13, 1},
+    {"eorge", 2, 10, 0},
+    {"orrhi", 13, 8, 0},
+    {"ldmiavs", 26, 6, 0},
+    {"asrsne", 19, 1, 1},
+    {"orrne", 13, 1, 0},
+    {"pushcs", 28, 2, 0},
+    {"lsrsle", 18, 13, 1},
+    {"rorvc", 20, 7, 0},
+    {"adcscc", 6, 3, 1},
+    {"bicscc", 15, 3, 1},
+    {"ldr", 22, 14, 0},
+    {"subsgt", 3, 12, 1},
+    {"blxne", 33, 1, 0},
+    {"eorcs", 2, 2, 0},
+    {"popge", 29, 10, 0},
+    {"sbcsmi", 7, 4, 1},
+    {"rorge", 20, 10, 0},
+    {"rsbcs", 4, 2, 0},
+    {"adcpl", 6, 5, 0},
+    {"pushvc", 28, 7, 0},
+    {"andseq", 1, 0, 1},
+    {"eorvc", 2, 7, 0},
+    {"bicsgt", 15, 12, 1},
+    {"bicspl", 15, 5, 1},
+    {"mulsls", 21, 9, 1},
+    {"adccs", 6, 2, 0},
+    {"eorsgt", 2, 12, 1},
+    {"addmi", 5, 4, 0},
+    {"bne", 30, 1, 0},
+    {"ldmiacc", 26, 3, 0},
+    {"subsmi", 3, 4, 1},
+    {"mulscs", 21, 2, 1},
+    {"blxeq", 33, 0, 0},
+    {"movslt", 14, 11, 1},
+    {"teqhi", 10, 8, 0},
+    {"lsllt", 17, 11, 0},
+    {"adcscs", 6, 2, 1},
+    {"movpl", 14, 5, 0},
+    {"asrsls", 19, 9, 1},
+    {"teqgt", 10, 12, 0},
+    {"orrls", 13, 9, 0},
+    {0, 0, 0, 0},
+    {"ldrbne", 23, 1, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"addseq", 5, 0, 1},
+    {0, 0, 0, 0},
+    {"lsrshi", 18, 8, 1},
+    {"orrsmi", 13, 4, 1},
+    {0, 0, 0, 0},
+    {"tstne", 9, 1, 0},
+    {"teqle", 10, 13, 0},
+    {"mvnsne", 16, 1, 1},
+    {"stmdbhi", 27, 8, 0},
+    {"rorscs", 20, 2, 1},
+    {"stmdbcs", 27, 2, 0},
+    {"andpl", 1, 5, 0},
+    {"adc", 6, 14, 0},
+    {"rscsvc", 8, 7, 1},
+    {"rscle", 8, 13, 0},
+    {"rscsge", 8, 10, 1},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"rsbmi", 4, 4, 0},
+    {"lslge", 17, 10, 0},
+    {"mvncs", 16, 2, 0},
+    {"lsrle", 18, 13, 0},
+    {"teqmi", 10, 4, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"mvnscc", 16, 3, 1},
+    {"sbceq", 7, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"tstlt", 9, 11, 0},
+    {0, 0, 0, 0},
+    {"subscs", 3, 2, 1},
+    {"ldmiavc", 26, 7, 0},
+    {0, 0, 0, 0},
+    {"cmpne", 11, 1, 0},
+    {0, 0, 0, 0},
+    {"ldrvs", 22, 6, 0},
+    {"tsthi", 9, 8, 0},
+    {"lsrhi", 18, 8, 0},
+    {"pushhi", 28, 8, 0},
+    {"rsbgt", 4, 12, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"rsbhi", 4, 8, 0},
+    {"adcls", 6, 9, 0},
+    {"lslmi", 17, 4, 0},
+    {"mulls", 21, 9, 0},
+    {"lsleq", 17, 0, 0},
+    {"teqeq", 10, 0, 0},
+    {"biccc", 15, 3, 0},
+    {"moveq", 14, 0, 0},
+    {"lsrscc", 18, 3, 1},
+    {"rscsmi", 8, 4, 1},
+    {"blxvc", 33, 7, 0},
+    {"blcs", 31, 2, 0},
+    {"cmpgt", 11, 12, 0},
+    {"asrsle", 19, 13, 1},
+    {"asrsvs", 19, 6, 1},
+    {0, 0, 0, 0},
+    {"cmple", 11, 13, 0},
+    {"mvnscs", 16, 2, 1},
+    {"ldmialt", 26, 11, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"lsrsls", 18, 9, 1},
+    {"addlt", 5, 11, 0},
+    {"bleq", 31, 0, 0},
+    {"biccs", 15, 2, 0},
+    {"ldrvc", 22, 7, 0},
+    {"blne", 31, 1, 0},
+    {"cmphi", 11, 8, 0},
+    {"sbcle", 7, 13, 0},
+    {"teqlt", 10, 11, 0},
+    {"mulscc", 21, 3, 1},
+    {"sbcspl", 7, 5, 1},
+    {0, 0, 0, 0},
+    {"adcs", 6, 14, 1},
+    {0, 0, 0, 0},
+    {"eorsvs", 2, 6, 1},
+    {"cmncc", 12, 3, 0},
+    {"stmdble", 27, 13, 0},
+    {"mvnsgt", 16, 12, 1},
+    {"adcsls", 6, 9, 1},
+    {"rsbsne", 4, 1, 1},
+    {0, 0, 0, 0},
+    {"lsrspl", 18, 5, 1},
+    {"mulle", 21, 13, 0},
+    {"tst", 9, 14, 0},
+    {"rorslt", 20, 11, 1},
+    {"mulshi", 21, 8, 1},
+    {"subsne", 3, 1, 1},
+    {"mvnsvs", 16, 6, 1},
+    {"bicvc", 15, 7, 0},
+    {0, 0, 0, 0},
+    {"andsgt", 1, 12, 1},
+    {"strbhi", 25, 8, 0},
+    {"rsblt", 4, 11, 0},
+    {"blxpl", 33, 5, 0},
+    {"orrge", 13, 10, 0},
+    {"sbcseq", 7, 0, 1},
+    {"strvs", 24, 6, 0},
+    {"b", 30, 14, 0},
+    {"subvc", 3, 7, 0},
+    {"lslsgt", 17, 12, 1},
+    {"andcc", 1, 3, 0},
+    {"movsvc", 14, 7, 1},
+    {0, 0, 0, 0},
+    {"pushle", 28, 13, 0},
+    {0, 0, 0, 0},
+    {"lsrvc", 18, 7, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"lslscc", 17, 3, 1},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"bicvs", 15, 6, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"rsbscs", 4, 2, 1},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"andsvs", 1, 6, 1},
+    {"blls", 31, 9, 0},
+    {"sbcsvc", 7, 7, 1},
+    {"bgt", 30, 12, 0},
+    {"asrsmi", 19, 4, 1},
+    {"ldrpl", 22, 5, 0},
+    {"subcs", 3, 2, 0},
+    {0, 0, 0, 0},
+    {"popmi", 29, 4, 0},
+    {"stmdbge", 27, 10, 0},
+    {"pople", 29, 13, 0},
+    {"bicsvs", 15, 6, 1},
+    {"ldmiage", 26, 10, 0},
+    {"ldrbge", 23, 10, 0},
+    {"blle", 31, 13, 0},
+    {"asrsvc", 19, 7, 1},
+    {"eorscs", 2, 2, 1},
+    {"lslsge", 17, 10, 1},
+    {"biclt", 15, 11, 0},
+    {"adcvs", 6, 6, 0},
+    {"blxcc", 33, 3, 0},
+    {0, 0, 0, 0},
+    {"rorvs", 20, 6, 0},
+    {"stmdbgt", 27, 12, 0},
+    {"asrhi", 19, 8, 0},
+    {"lsrsmi", 18, 4, 1},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"lsrne", 18, 1, 0},
+    {"bpl", 30, 5, 0},
+    {"pushmi", 28, 4, 0},
+    {"bic", 15, 14, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"addcc", 5, 3, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"ldrbls", 23, 9, 0},
+    {"bicsle", 15, 13, 1},
+    {"bicge", 15, 10, 0},
+    {"ldrle", 22, 13, 0},
+    {"adcspl", 6, 5, 1},
+    {"movsle", 14, 13, 1},
+    {"addsls", 5, 9, 1},
+    {"eorhi", 2, 8, 0},
+    {"asr", 19, 14, 0},
+    {"lsrscs", 18, 2, 1},
+    {"adchi", 6, 8, 0},
+    {"sbcsne", 7, 1, 1},
+    {"ldrge", 22, 10, 0},
+    {"bicgt", 15, 12, 0},
+    {0, 0, 0, 0},
+    {"stmdblt", 27, 11, 0},
+    {"sbchi", 7, 8, 0},
+    {"rsbls", 4, 9, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"strbne", 25, 1, 0},
+    {0, 0, 0, 0},
+    {"mvncc", 16, 3, 0},
+    {"bicsge", 15, 10, 1},
+    {"bxpl", 32, 5, 0},
+    {"bxhi", 32, 8, 0},
+    {"sbcs", 7, 14, 1},
+    {0, 0, 0, 0},
+    {"mvnvs", 16, 6, 0},
+    {"rschi", 8, 8, 0},
+    {"addsge", 5, 10, 1},
+    {"bxeq", 32, 0, 0},
+    {"ldmia", 26, 14, 0},
+    {0, 0, 0, 0},
+    {"strcs", 24, 2, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"teqvs", 10, 6, 0},
+    {0, 0, 0, 0},
+    {"andspl", 1, 5, 1},
+    {"strge", 24, 10, 0},
+    {"sublt", 3, 11, 0},
+    {"sbcge", 7, 10, 0},
+    {"rors", 20, 14, 1},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"blxgt", 33, 12, 0},
+    {"ldmiacs", 26, 2, 0},
+    {"lslsvc", 17, 7, 1},
+    {"addscc", 5, 3, 1},
+    {"rsbs", 4, 14, 1},
+    {"rsbshi", 4, 8, 1},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"bllt", 31, 11, 0},
+    {0, 0, 0, 0},
+    {"rsbvc", 4, 7, 0},
+    {"rsbpl", 4, 5, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"addne", 5, 1, 0},
+    {"asrgt", 19, 12, 0},
+    {0, 0, 0, 0},
+    {"subspl", 3, 5, 1},
+    {"rorshi", 20, 8, 1},
+    {"ands", 1, 14, 1},
+    {"strblt", 25, 11, 0},
+    {"bicshi", 15, 8, 1},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"andeq", 1, 0, 0},
+    {"lslsle", 17, 13, 1},
+    {0, 0, 0, 0},
+    {"rsceq", 8, 0, 0},
+    {0, 0, 0, 0},
+    {"addhi", 5, 8, 0},
+    {"ldmiagt", 26, 12, 0},
+    {"rsbsmi", 4, 4, 1},
+    {"lsrcc", 18, 3, 0},
+    {"bxge", 32, 10, 0},
+    {"rsbspl", 4, 5, 1},
+    {"sbcscc", 7, 3, 1},
+    {"ldmiaeq", 26, 0, 0},
+    {"bcs", 30, 2, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"lslpl", 17, 5, 0},
+    {0, 0, 0, 0},
+    {"movge", 14, 10, 0},
+    {0, 0, 0, 0},
+    {"ldrcs", 22, 2, 0},
+    {"orrspl", 13, 5, 1},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"rsc", 8, 14, 0},
+    {"teqcc", 10, 3, 0},
+    {0, 0, 0, 0},
+    {"rsbsvs", 4, 6, 1},
+    {"asrlt", 19, 11, 0},
+    {0, 0, 0, 0},
+    {"lsrsne", 18, 1, 1},
+    {"movspl", 14, 5, 1},
+    {"eors", 2, 14, 1},
+    {"movgt", 14, 12, 0},
+    {"eorsls", 2, 9, 1},
+    {"cmpge", 11, 10, 0},
+    {"rscsvs", 8, 6, 1},
+    {"blx", 33, 14, 0},
+    {"pushge", 28, 10, 0},
+    {"subslt", 3, 11, 1},
+    {"orrgt", 13, 12, 0},
+    {"sbcsls", 7, 9, 1},
+    {"mul", 21, 14, 0},
+    {"eorsvc", 2, 7, 1},
+    {"subsge", 3, 10, 1},
+    {"movsne", 14, 1, 1},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"sbcsgt", 7, 12, 1},
+    {"rsbge", 4, 10, 0},
+    {"popcc", 29, 3, 0},
+    {"blhi", 31, 8, 0},
+    {"asrscs", 19, 2, 1},
+    {"movsls", 14, 9, 1},
+    {"adccc", 6, 3, 0},
+    {"rsclt", 8, 11, 0},
+    {"addsmi", 5, 4, 1},
+    {"movmi", 14, 4, 0},
+    {0, 0, 0, 0},
+    {"rorsgt", 20, 12, 1},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"pushpl", 28, 5, 0},
+    {"mvnsvc", 16, 7, 1},
+    {"ldrhi", 22, 8, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"rscsgt", 8, 12, 1},
+    {"sbcgt", 7, 12, 0},
+    {0, 0, 0, 0},
+    {"bl", 31, 14, 0},
+    {"sbcslt", 7, 11, 1},
+    {0, 0, 0, 0},
+    {"stmdbpl", 27, 5, 0},
+    {"movcc", 14, 3, 0},
+    {"rscvc", 8, 7, 0},
+    {"popls", 29, 9, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"mov", 14, 14, 0},
+    {"blxle", 33, 13, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"bicne", 15, 1, 0},
+    {"blxvs", 33, 6, 0},
+    {"rsbsgt", 4, 12, 1},
+    {"asrge", 19, 10, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"strb", 25, 14, 0},
+    {"mvn", 16, 14, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"ldrbeq", 23, 0, 0},
+    {"rorls", 20, 9, 0},
+    {"tstpl", 9, 5, 0},
+    {0, 0, 0, 0},
+    {"bics", 15, 14, 1},
+    {0, 0, 0, 0},
+    {"lslslt", 17, 11, 1},
+    {"lsrs", 18, 14, 1},
+    {"addspl", 5, 5, 1},
+    {"blt", 30, 11, 0},
+    {"addvs", 5, 6, 0},
+    {0, 0, 0, 0},
+    {"sbcne", 7, 1, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"bvs", 30, 6, 0},
+    {"pop", 29, 14, 0},
+    {"strbmi", 25, 4, 0},
+    {"pushne", 28, 1, 0},
+    {"andle", 1, 13, 0},
+    {"mvnlt", 16, 11, 0},
+    {"bxgt", 32, 12, 0},
+    {"rsbeq", 4, 0, 0},
+    {"bhi", 30, 8, 0},
+    {"rorhi", 20, 8, 0},
+    {"rorsmi", 20, 4, 1},
+    {"sbcpl", 7, 5, 0},
+    {"pushvs", 28, 6, 0},
+    {"lsrls", 18, 9, 0},
+    {"mvneq", 16, 0, 0},
+    {"sbcvs", 7, 6, 0},
+    {"addgt", 5, 12, 0},
+    {"mvngt", 16, 12, 0},
+    {"movvc", 14, 7, 0},
+    {"orrvs", 13, 6, 0},
+    {"cmnmi", 12, 4, 0},
+    {"bxvc", 32, 7, 0},
+    {"asrle", 19, 13, 0},
+    {"asrvc", 19, 7, 0},
+    {"ldrb", 23, 14, 0},
+    {"orrpl", 13, 5, 0},
+    {"cmppl", 11, 5, 0},
+    {0, 0, 0, 0},
+    {"pushcc", 28, 3, 0},
+    {"eormi", 2, 4, 0},
+    {"addsle", 5, 13, 1},
+    {0, 0, 0, 0},
+    {"ldrblt", 23, 11, 0},
+    {"ldrgt", 22, 12, 0},
+    {"muls", 21, 14, 1},
+    {"blxhi", 33, 8, 0},
+    {"andscs", 1, 2, 1},
+    {"asrne", 19, 1, 0},
+    {"bicsvc", 15, 7, 1},
+    {"adcle", 6, 13, 0},
+    {"bxcc", 32, 3, 0},
+    {"mulne", 21, 1, 0},
+    {"stmdbvs", 27, 6, 0},
+    {"lsls", 17, 14, 1},
+    {0, 0, 0, 0},
+    {"rscsle", 8, 13, 1},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"strvc", 24, 7, 0},
+    {"adceq", 6, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"strbeq", 25, 0, 0},
+    {"adcsge", 6, 10, 1},
+    {"movhi", 14, 8, 0},
+    {"addcs", 5, 2, 0},
+    {"teqge", 10, 10, 0},
+    {"eoreq", 2, 0, 0},
+    {"addpl", 5, 5, 0},
+    {"cmnls", 12, 9, 0},
+    {"cmp", 11, 14, 0},
+    {"andlt", 1, 11, 0},
+    {"orrsvs", 13, 6, 1},
+    {"ldrne", 22, 1, 0},
+    {"movne", 14, 1, 0},
+    {"bvc", 30, 7, 0},
+    {"blgt", 31, 12, 0},
+    {"cmpcs", 11, 2, 0},
+    {"adcsvs", 6, 6, 1},
+    {"tsteq", 9, 0, 0},
+    {"tstge", 9, 10, 0},
+    {0, 0, 0, 0},
+    {"bicpl", 15, 5, 0},
+    {"mulmi", 21, 4, 0},
+    {"strble", 25, 13, 0},
+    {"adds", 5, 14, 1},
+    {0, 0, 0, 0},
+    {"cmngt", 12, 12, 0},
+    {"mulsne", 21, 1, 1},
+    {"bicmi", 15, 4, 0},
+    {"mullt", 21, 11, 0},
+    {"asrs", 19, 14, 1},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"lsrvs", 18, 6, 0},
+    {"blvc", 31, 7, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"popvs", 29, 6, 0},
+    {"sbcvc", 7, 7, 0},
+    {0, 0, 0, 0},
+    {"cmncs", 12, 2, 0},
+    {"sbcsvs", 7, 6, 1},
+    {0, 0, 0, 0},
+    {"stmdbls", 27, 9, 0},
+    {"streq", 24, 0, 0},
+    {"orrvc", 13, 7, 0},
+    {"lslcc", 17, 3, 0},
+    {"adcge", 6, 10, 0},
+    {"bicsmi", 15, 4, 1},
+    {"addge", 5, 10, 0},
+    {"addsvs", 5, 6, 1},
+    {"mulsmi", 21, 4, 1},
+    {"mvnle", 16, 13, 0},
+    {"mulvs", 21, 6, 0},
+    {"adcsle", 6, 13, 1},
+    {"mvnls", 16, 9, 0},
+    {"andsge", 1, 10, 1},
+    {"strmi", 24, 4, 0},
+    {"teqpl", 10, 5, 0},
+    {"subscc", 3, 3, 1},
+    {"sbcls", 7, 9, 0},
+    {"mvnne", 16, 1, 0},
+    {"rscpl", 8, 5, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"bxls", 32, 9, 0},
+    {"movshi", 14, 8, 1},
+    {0, 0, 0, 0},
+    {"subhi", 3, 8, 0},
+    {"rorcc", 20, 3, 0},
+    {"rsbne", 4, 1, 0},
+    {"mvnshi", 16, 8, 1},
+    {"strcc", 24, 3, 0},
+    {"lsr", 18, 14, 0},
+    {"strle", 24, 13, 0},
+    {"bxlt", 32, 11, 0},
+    {"cmneq", 12, 0, 0},
+    {"subs", 3, 14, 1},
+    {"subvs", 3, 6, 0},
+    {"addvc", 5, 7, 0},
+    {"subne", 3, 1, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"addscs", 5, 2, 1},
+    {"rscne", 8, 1, 0},
+    {"eor", 2, 14, 0},
+    {0, 0, 0, 0},
+    {"pushls", 28, 9, 0},
+    {"mvnspl", 16, 5, 1},
+    {"orrsne", 13, 1, 1},
+    {"cmnhi", 12, 8, 0},
+    {"muleq", 21, 0, 0},
+    {"cmnne", 12, 1, 0},
+    {"popeq", 29, 0, 0},
+    {0, 0, 0, 0},
+    {"movscs", 14, 2, 1},
+    {"bicls", 15, 9, 0},
+    {"lsrsgt", 18, 12, 1},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"mulsle", 21, 13, 1},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"lslsvs", 17, 6, 1},
+    {"sbccs", 7, 2, 0},
+    {0, 0, 0, 0},
+    {"lsrcs", 18, 2, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"orreq", 13, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"strbvc", 25, 7, 0},
+    {0, 0, 0, 0},
+    {"addeq", 5, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"sub", 3, 14, 0},
+    {"blxge", 33, 10, 0},
+    {"strbcc", 25, 3, 0},
+    {"strbpl", 25, 5, 0},
+    {"orrsle", 13, 13, 1},
+    {"sbclt", 7, 11, 0},
+    {"rorseq", 20, 0, 1},
+    {0, 0, 0, 0},
+    {"andscc", 1, 3, 1},
+    {0, 0, 0, 0},
+    {"cmpmi", 11, 4, 0},
+    {"stmdbne", 27, 1, 0},
+    {"stmdb", 27, 14, 0},
+    {"mulpl", 21, 5, 0},
+    {"teqcs", 10, 2, 0},
+    {0, 0, 0, 0},
+    {"subseq", 3, 0, 1},
+    {0, 0, 0, 0},
+    {"orrseq", 13, 0, 1},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"ldmiane", 26, 1, 0},
+    {"addshi", 5, 8, 1},
+    {0, 0, 0, 0},
+    {"bxcs", 32, 2, 0},
+    {"sbcmi", 7, 4, 0},
+    {"rorsge", 20, 10, 1},
+    {"asrshi", 19, 8, 1},
+    {"subsvs", 3, 6, 1},
+    {"cmpvs", 11, 6, 0},
+    {"lsrseq", 18, 0, 1},
+    {"movlt", 14, 11, 0},
+    {"rscmi", 8, 4, 0},
+    {0, 0, 0, 0},
+    {"ldrlt", 22, 11, 0},
+    {0, 0, 0, 0},
+    {"bicle", 15, 13, 0},
+    {"roreq", 20, 0, 0},
+    {"push", 28, 14, 0},
+    {0, 0, 0, 0},
+    {"blxcs", 33, 2, 0},
+    {"stmdbvc", 27, 7, 0},
+    {"adclt", 6, 11, 0},
+    {"rsble", 4, 13, 0},
+    {0, 0, 0, 0},
+    {"ldrcc", 22, 3, 0},
+    {"subsls", 3, 9, 1},
+    {"adcne", 6, 1, 0},
+    {0, 0, 0, 0},
+    {"bichi", 15, 8, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"bxne", 32, 1, 0},
+    {0, 0, 0, 0},
+    {"subgt", 3, 12, 0},
+    {"rsbvs", 4, 6, 0},
+    {"suble", 3, 13, 0},
+    {"subpl", 3, 5, 0},
+    {"tstls", 9, 9, 0},
+    {"strbvs", 25, 6, 0},
+    {"tstcc", 9, 3, 0},
+    {"pushlt", 28, 11, 0},
+    {"strbcs", 25, 2, 0},
+    {"cmpls", 11, 9, 0},
+    {"eorseq", 2, 0, 1},
+    {0, 0, 0, 0},
+    {"rorsne", 20, 1, 1},
+    {0, 0, 0, 0},
+    {"andhi", 1, 8, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"asrslt", 19, 11, 1},
+    {"rorne", 20, 1, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"rscshi", 8, 8, 1},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {0, 0, 0, 0},
+    {"mvnmi", 16, 4, 0},
+    {"ldmials", 26, 9, 0},
+    {"ldrbvc", 23, 7, 0},
+    {"eorcc", 2, 3, 0},
+    {"lslle", 17, 13, 0},
+    {"rorsls", 20, 9, 1},
+    {"mvnseq", 16, 0, 1},
+};
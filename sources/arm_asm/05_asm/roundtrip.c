@@ -0,0 +1,222 @@
+/*
+Round trip of random instruction streams: disassemble, assemble and compare.
+
+gcc -O2 -pthread -DASM_NO_MAIN -DDISASM_NO_MAIN -I../04_disasm roundtrip.c asm.c ../04_disasm/disasm.c ../04_disasm/cl_utils.c -o roundtrip
+./roundtrip [word_num] [seed]
+
+Words are valid instructions of the subset both sides support:
+data processing with rotated immediates, ldr/str/ldrb/strb with immediate offsets, b and bl.
+Any word which does not come back the same is a correctness failure, and the exit status is 1.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "asm.h"
+#include "disasm.h"
+
+#define DEFAULT_WORD_NUM (4*1024*1024)
+#define REPORT_MAX 10
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+/*
+xorshift, so that the corpus of a seed is the same on every libc.
+*/
+static unsigned int rand_state;
+
+static unsigned int next_rand() {
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    return rand_state;
+}
+
+static int cond_bits(int cond) {
+    return (int)((unsigned int)cond << 28);
+}
+
+/*
+The encoding the assembler picks for ror(imm8, rot*2): the smallest rotation.
+Other rotations of the same value are valid, but can't round trip through text.
+*/
+static int canonical_imm(unsigned int imm8, int rot) {
+    unsigned int value = rot == 0 ? imm8 : (imm8 >> (rot*2)) | (imm8 << (32 - rot*2));
+    int r;
+
+    for(r = 0; r < 16; r++) {
+        unsigned int v = r == 0 ? value : (value << (r*2)) | (value >> (32 - r*2));
+        if(v <= 0xff)
+            return (r << 8) | v;
+    }
+    return imm8;
+}
+
+static int random_dp_imm(unsigned int r, int cond) {
+    int op = (r >> 4) & 0xf;
+    int set_flags = (r >> 8) & 1;
+    int rn = (r >> 9) & 0xf;
+    int rd = (r >> 13) & 0xf;
+    unsigned int r2 = next_rand();
+
+    if(op >= 8 && op <= 11) {       /* tst, teq, cmp, cmn */
+        set_flags = 1;
+        rd = 0;
+    } else if(op == 13 || op == 15) {   /* mov, mvn */
+        rn = 0;
+    }
+    return cond_bits(cond) | (1 << 25) | (op << 21) | (set_flags << 20) | (rn << 16) | (rd << 12)
+        | canonical_imm(r2 & 0xff, (r2 >> 8) & 0xf);
+}
+
+static int random_ldr_str(unsigned int r, int cond) {
+    int load = (r >> 4) & 1;
+    int byte = (r >> 5) & 1;
+    int rn = (r >> 6) & 0xf;
+    int rd = (r >> 10) & 0xf;
+    int offset = (r >> 14) & 0xfff;
+    int up = (r >> 26) & 1;
+    int form = (r >> 27) & 3;
+    int pre = 1, writeback = 0;
+
+    switch(form) {
+        case 0:                 /* [rn, #imm] */
+            break;
+        case 1:                 /* [rn, #imm]! */
+            writeback = 1;
+            break;
+        case 2:                 /* [rn], #imm */
+            pre = 0;
+            break;
+        default:                /* [rn] */
+            offset = 0;
+            up = 1;
+            break;
+    }
+    /* #-0x0 comes back as #0x0 */
+    if(offset == 0)
+        up = 1;
+    return cond_bits(cond) | (1 << 26) | (pre << 24) | (up << 23) | (byte << 22) | (writeback << 21)
+        | (load << 20) | (rn << 16) | (rd << 12) | offset;
+}
+
+static int random_branch(unsigned int r, int cond) {
+    int link = (r >> 4) & 1;
+    return cond_bits(cond) | 0x0a000000 | (link << 24) | (next_rand() & 0xffffff);
+}
+
+static int random_word() {
+    unsigned int r = next_rand();
+    int cond = (r & 0xf) == 15 ? 14 : r & 0xf;
+
+    switch((r >> 30) & 3) {
+        case 0:
+        case 1:
+            return random_dp_imm(r, cond);
+        case 2:
+            return random_ldr_str(r, cond);
+    }
+    return random_branch(r, cond);
+}
+
+/*
+Lines are NUL terminated, one after another.
+*/
+static char *disassemble_all(int *image, int word_num, long *out_len) {
+    char *text = malloc((size_t)word_num*DISASM_LINE_MAX);
+    char *p = text;
+    int i;
+
+    for(i = 0; i < word_num; i++) {
+        if(!disasm_word(image[i], p)) {
+            sprintf(p, "// unknown 0x%08x", image[i]);
+        }
+        p += strlen(p) + 1;
+    }
+    *out_len = p - text;
+    return text;
+}
+
+static int *assemble_all(struct Assembler *as, char *text, long len, int *out_word_num) {
+    char *p = text;
+
+    asm_init(as, "roundtrip");
+    while(p < text + len) {
+        char *next = p + strlen(p) + 1;
+        asm_one(as, p);
+        p = next;
+    }
+    return asm_finish(as, out_word_num);
+}
+
+static int report_mismatches(int *image, int word_num, char *text, int *code, int code_num) {
+    char *line = text;
+    int i, mismatch = 0;
+
+    if(code == NULL || code_num != word_num) {
+        printf("FAIL: %d words in, %d words out\n", word_num, code_num);
+        return 1;
+    }
+    for(i = 0; i < word_num; i++, line += strlen(line) + 1) {
+        if(image[i] == code[i])
+            continue;
+        if(mismatch < REPORT_MAX)
+            printf("FAIL: word %d 0x%08x -> \"%s\" -> 0x%08x\n", i, image[i], line, code[i]);
+        mismatch++;
+    }
+    if(mismatch > 0)
+        printf("%d mismatches\n", mismatch);
+    return mismatch;
+}
+
+int main(int argc, char **argv) {
+    int word_num = argc > 1 ? atoi(argv[1]) : DEFAULT_WORD_NUM;
+    int *image, *code, code_num, i, failed;
+    struct Assembler as;
+    double begin, disasm_time, asm_time;
+    double image_mb;
+    char *text;
+    long text_len;
+
+    if(word_num <= 0) {
+        fprintf(stderr, "usage: roundtrip [word_num] [seed]\n");
+        exit(1);
+    }
+    rand_state = argc > 2 ? (unsigned int)strtoul(argv[2], NULL, 0) : 1;
+    if(rand_state == 0)
+        rand_state = 1;
+
+    image = malloc(sizeof(int)*word_num);
+    for(i = 0; i < word_num; i++)
+        image[i] = random_word();
+    disasm_init();
+
+    begin = now_sec();
+    text = disassemble_all(image, word_num, &text_len);
+    disasm_time = now_sec() - begin;
+
+    begin = now_sec();
+    code = assemble_all(&as, text, text_len, &code_num);
+    asm_time = now_sec() - begin;
+
+    image_mb = word_num*4.0/1024/1024;
+    printf("%d words (%.1f MB binary, %.1f MB text)\n", word_num, image_mb, text_len/1024.0/1024);
+    printf("disassemble: %7.1f MB/sec binary, %6.1f M lines/sec\n",
+           image_mb/disasm_time, word_num/disasm_time/1e6);
+    printf("assemble:    %7.1f MB/sec text,   %6.1f M lines/sec\n",
+           text_len/1024.0/1024/asm_time, word_num/asm_time/1e6);
+
+    failed = report_mismatches(image, word_num, text, code, code_num);
+    if(!failed)
+        printf("round trip ok\n");
+
+    asm_free(&as);
+    free(text);
+    free(image);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,1295 @@
+/*
+Translator of ARM32 basic blocks to x86-64 code, the fast path of emu.c.
+
+gcc -O2 -DASM_NO_MAIN -DEMU_NO_MAIN -I../05_asm dbt.c emu.c ../05_asm/asm.c -o dbt
+./dbt                       # run unit tests, each program is compared with emu.c
+./dbt hello.bin             # run until "end: b end", UART to stdout
+./dbt -compare loop.bin     # run on emu.c and dbt, compare the results and the time
+
+Only for x86-64 hosts with System V calling convention (Linux, BSD, macOS).
+
+ARM registers and flags stay in struct Emu, translated code addresses them from rbx.
+Host registers while in translated code:
+  rbx  struct Dbt (struct Emu is its first member)
+  r12  RAM
+  r13  code_pages of struct Emu
+  r15  instructions left before EXIT_LIMIT
+
+Data processing, mul, ldr/str(b) with immediate offsets and branches are translated.
+Everything else, and the slow paths of memory (UART, unaligned, writes into code),
+call emu_exec_block for that one instruction.
+Blocks jumping to a known pc are chained: the exit is patched to a jmp to the next block.
+*/
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include "emu.h"
+
+#define DBT_CODE_SIZE (16*1024*1024)
+/* room for the largest translation of a block, the buffer is flushed before it runs out */
+#define DBT_BLOCK_CODE_MAX (EMU_BLOCK_MAX*256)
+#define DBT_TABLE_SIZE 4096
+
+/* return values of translated code, larger values are the address of a chain exit */
+enum DbtExit {
+    EXIT_INDIRECT = 1,  /* r[15] is set, look it up */
+    EXIT_HALT,
+    EXIT_LIMIT,
+    EXIT_STATUS,        /* emu_exec_block stopped with a status */
+    EXIT_INVALIDATE,    /* code was written */
+    EXIT_CODE_MAX = 16
+};
+
+struct DbtBlock {
+    unsigned int pc;
+    unsigned char *code;
+    struct DbtBlock *next;
+};
+
+struct DbtStat {
+    int blocks_translated;
+    int chains;
+    int fallbacks;          /* instructions calling emu_exec_block, always or on their slow path */
+    int flushes;
+    long long dispatches;   /* returns from translated code */
+};
+
+struct Dbt {
+    struct Emu emu;         /* must be first, rbx points to both */
+    long long budget;
+
+    unsigned char *code;
+    unsigned char *code_pos;
+    unsigned char *exit_stub;
+    unsigned char *exit_status_stub;
+    unsigned char *exit_indirect_stub;
+    unsigned char *exit_invalidate_stub;
+    unsigned long (*enter)(struct Dbt *dbt, unsigned char *ram, unsigned char *code_pages,
+                           long long budget, unsigned char *code);
+
+    struct DbtBlock *table[DBT_TABLE_SIZE];
+    /* one instruction blocks of emu_exec_block, linked by next */
+    struct EmuBlock *fallbacks;
+    struct DbtStat stat;
+};
+
+/* x86 registers */
+#define EAX 0
+#define ECX 1
+#define EDX 2
+
+/* x86 condition codes */
+#define CC_O 0x0
+#define CC_C 0x2
+#define CC_NC 0x3
+#define CC_Z 0x4
+#define CC_NZ 0x5
+#define CC_A 0x7
+#define CC_S 0x8
+
+#define OFF_R(i) ((int)offsetof(struct Emu, r) + 4*(i))
+#define OFF_N ((int)offsetof(struct Emu, n))
+#define OFF_Z ((int)offsetof(struct Emu, z))
+#define OFF_C ((int)offsetof(struct Emu, c))
+#define OFF_V ((int)offsetof(struct Emu, v))
+#define OFF_STATUS ((int)offsetof(struct Emu, status))
+#define OFF_INVALIDATE ((int)offsetof(struct Emu, invalidate))
+#define OFF_BUDGET ((int)offsetof(struct Dbt, budget))
+
+/* same numbering as emu.c */
+#define DP_AND 0
+#define DP_EOR 1
+#define DP_SUB 2
+#define DP_RSB 3
+#define DP_ADD 4
+#define DP_ADC 5
+#define DP_SBC 6
+#define DP_RSC 7
+#define DP_TST 8
+#define DP_TEQ 9
+#define DP_CMP 10
+#define DP_CMN 11
+#define DP_ORR 12
+#define DP_MOV 13
+#define DP_BIC 14
+#define DP_MVN 15
+#define DP_IS_TEST(op) ((op) >= DP_TST && (op) <= DP_CMN)
+#define DP_IS_LOGICAL(op) ((op) <= DP_EOR || (op) == DP_TST || (op) == DP_TEQ || (op) >= DP_ORR)
+
+#define MEM_P 0x10
+#define MEM_U 0x08
+#define MEM_B 0x04
+#define MEM_W 0x02
+#define MEM_L 0x01
+
+#define SHIFT_LSL 0
+#define SHIFT_LSR 1
+#define SHIFT_ASR 2
+#define SHIFT_ROR 3
+
+
+/*
+x86-64 emitter
+*/
+
+static unsigned char *pos;
+
+static void emit8(int byte) {
+    *pos++ = (unsigned char)byte;
+}
+
+static void emit32(unsigned int value) {
+    memcpy(pos, &value, 4);
+    pos += 4;
+}
+
+static void emit64(unsigned long value) {
+    memcpy(pos, &value, 8);
+    pos += 8;
+}
+
+/* ModRM of [rbx + disp] */
+static void emit_modrm_rbx(int reg, int disp) {
+    if(disp >= -128 && disp <= 127) {
+        emit8(0x40 | (reg << 3) | 3);
+        emit8(disp);
+    } else {
+        emit8(0x80 | (reg << 3) | 3);
+        emit32(disp);
+    }
+}
+
+/* Return the place of rel32 to patch. */
+static unsigned char *emit_jcc(int cc) {
+    emit8(0x0f);
+    emit8(0x80 | cc);
+    emit32(0);
+    return pos - 4;
+}
+
+static unsigned char *emit_jmp() {
+    emit8(0xe9);
+    emit32(0);
+    return pos - 4;
+}
+
+static void patch_rel32(unsigned char *at, unsigned char *target) {
+    unsigned int rel = (unsigned int)(target - (at + 4));
+    memcpy(at, &rel, 4);
+}
+
+static void emit_jmp_to(unsigned char *target) {
+    patch_rel32(emit_jmp(), target);
+}
+
+/* mov reg, imm32 */
+static void emit_mov_imm(int reg, unsigned int value) {
+    emit8(0xb8 + reg);
+    emit32(value);
+}
+
+/* mov reg, arm register; pc reads as a constant */
+static void emit_load_reg(int reg, int arm_reg, unsigned int pc_value) {
+    if(arm_reg == 15) {
+        emit_mov_imm(reg, pc_value);
+        return;
+    }
+    emit8(0x8b);
+    emit_modrm_rbx(reg, OFF_R(arm_reg));
+}
+
+/* mov arm register, reg */
+static void emit_store_reg(int arm_reg, int reg) {
+    emit8(0x89);
+    emit_modrm_rbx(reg, OFF_R(arm_reg));
+}
+
+/* mov dword [rbx + disp], imm32 */
+static void emit_store_imm(int disp, unsigned int value) {
+    emit8(0xc7);
+    emit_modrm_rbx(0, disp);
+    emit32(value);
+}
+
+/* setcc byte [rbx + disp], flags are 0 or 1 so the upper bytes stay 0 */
+static void emit_setcc(int cc, int disp) {
+    emit8(0x0f);
+    emit8(0x90 | cc);
+    emit_modrm_rbx(0, disp);
+}
+
+/* cmp dword [rbx + disp], 0 */
+static void emit_cmp_zero(int disp) {
+    emit8(0x83);
+    emit_modrm_rbx(7, disp);
+    emit8(0);
+}
+
+/* bt dword [rbx + OFF_C], 0: the ARM carry to CF */
+static void emit_load_carry() {
+    emit8(0x0f);
+    emit8(0xba);
+    emit_modrm_rbx(4, OFF_C);
+    emit8(0);
+}
+
+/* op eax, ecx with the opcode byte of "op r/m32, r32" */
+static void emit_alu(int opcode, int dst, int src) {
+    emit8(opcode);
+    emit8(0xc0 | (src << 3) | dst);
+}
+
+#define ALU_ADD 0x01
+#define ALU_OR 0x09
+#define ALU_ADC 0x11
+#define ALU_SBB 0x19
+#define ALU_AND 0x21
+#define ALU_SUB 0x29
+#define ALU_XOR 0x31
+#define ALU_CMP 0x39
+#define ALU_TEST 0x85
+#define ALU_MOV 0x89
+
+static void emit_not(int reg) {
+    emit8(0xf7);
+    emit8(0xd0 | reg);
+}
+
+static void emit_set_nz() {
+    emit_alu(ALU_TEST, EAX, EAX);
+    emit_setcc(CC_S, OFF_N);
+    emit_setcc(CC_Z, OFF_Z);
+}
+
+/*
+Jump when cond fails, return the place of the rel32.
+*/
+static unsigned char *emit_cond_fail(int cond) {
+    static const int flag_offsets[4] = {OFF_Z, OFF_C, OFF_N, OFF_V};
+    int cond_bits = 0, nzcv;
+
+    if(cond < 8) {
+        emit_cmp_zero(flag_offsets[cond / 2]);
+        return emit_jcc(cond % 2 == 0 ? CC_Z : CC_NZ);
+    }
+    for(nzcv = 0; nzcv < 16; nzcv++)
+        cond_bits |= emu_cond_pass(cond, nzcv) << nzcv;
+
+    /* eax = n<<3 | z<<2 | c<<1 | v, then bt cond_bits, eax */
+    emit8(0x8b);            /* mov eax, n */
+    emit_modrm_rbx(EAX, OFF_N);
+    emit8(0xd1);            /* shl eax, 1 */
+    emit8(0xe0);
+    emit8(0x0b);            /* or eax, z */
+    emit_modrm_rbx(EAX, OFF_Z);
+    emit8(0xd1);
+    emit8(0xe0);
+    emit8(0x0b);
+    emit_modrm_rbx(EAX, OFF_C);
+    emit8(0xd1);
+    emit8(0xe0);
+    emit8(0x0b);
+    emit_modrm_rbx(EAX, OFF_V);
+    emit_mov_imm(ECX, cond_bits);
+    emit8(0x0f);            /* bt ecx, eax */
+    emit8(0xa3);
+    emit8(0xc1);
+    return emit_jcc(CC_NC);
+}
+
+
+/*
+exits
+*/
+
+/* mov eax, reason; jmp exit_stub */
+static void emit_exit(struct Dbt *dbt, int reason) {
+    emit_mov_imm(EAX, reason);
+    emit_jmp_to(dbt->exit_stub);
+}
+
+static void emit_exit_at(struct Dbt *dbt, int reason, unsigned int pc) {
+    emit_store_imm(OFF_R(15), pc);
+    emit_exit(dbt, reason);
+}
+
+/*
+Exit to pc, returning the address of the exit itself.
+The dispatcher overwrites its first 5 bytes with a jmp to the block of pc.
+*/
+static void emit_chain_exit(struct Dbt *dbt, unsigned int pc) {
+    unsigned char *site = pos;
+
+    emit_store_imm(OFF_R(15), pc);
+    /* lea rax, [rip - (pos - site)] */
+    emit8(0x48);
+    emit8(0x8d);
+    emit8(0x05);
+    emit32((unsigned int)(site - (pos + 4)));
+    emit_jmp_to(dbt->exit_stub);
+}
+
+static void emit_trampolines(struct Dbt *dbt) {
+    pos = dbt->code;
+    dbt->enter = (void*)pos;
+    emit8(0x53);                                /* push rbx */
+    emit8(0x41); emit8(0x54);                   /* push r12 */
+    emit8(0x41); emit8(0x55);                   /* push r13 */
+    emit8(0x41); emit8(0x56);                   /* push r14, keeps rsp 16 byte aligned */
+    emit8(0x41); emit8(0x57);                   /* push r15 */
+    emit8(0x48); emit8(0x89); emit8(0xfb);      /* mov rbx, rdi */
+    emit8(0x49); emit8(0x89); emit8(0xf4);      /* mov r12, rsi */
+    emit8(0x49); emit8(0x89); emit8(0xd5);      /* mov r13, rdx */
+    emit8(0x49); emit8(0x89); emit8(0xcf);      /* mov r15, rcx */
+    emit8(0x41); emit8(0xff); emit8(0xe0);      /* jmp r8 */
+
+    dbt->exit_stub = pos;
+    emit8(0x4c);                                /* mov [rbx + budget], r15 */
+    emit8(0x89);
+    emit_modrm_rbx(7, OFF_BUDGET);
+    emit8(0x41); emit8(0x5f);                   /* pop r15 */
+    emit8(0x41); emit8(0x5e);                   /* pop r14 */
+    emit8(0x41); emit8(0x5d);                   /* pop r13 */
+    emit8(0x41); emit8(0x5c);                   /* pop r12 */
+    emit8(0x5b);                                /* pop rbx */
+    emit8(0xc3);                                /* ret */
+
+    dbt->exit_status_stub = pos;
+    emit_exit(dbt, EXIT_STATUS);
+    dbt->exit_indirect_stub = pos;
+    emit_exit(dbt, EXIT_INDIRECT);
+    dbt->exit_invalidate_stub = pos;
+    emit_exit(dbt, EXIT_INVALIDATE);
+    dbt->code_pos = pos;
+}
+
+
+/*
+translation of one instruction
+*/
+
+/* add r15, count: give back the instructions which didn't run */
+static void emit_refund(int count) {
+    emit8(0x49);
+    emit8(0x83);
+    emit8(0xc7);
+    emit8(count);
+}
+
+/*
+Call emu_exec_block for the single instruction in, which checks its condition itself.
+rest is the number of instructions after in in the block.
+*/
+static void emit_fallback(struct Dbt *dbt, struct EmuInsn *in, unsigned int addr, int rest) {
+    unsigned char *ok;
+    struct EmuBlock *block = malloc(sizeof(struct EmuBlock) + sizeof(struct EmuInsn));
+
+    memset(block, 0, sizeof(struct EmuBlock));
+    block->pc = addr;
+    block->insn_num = 1;
+    block->insns[0] = *in;
+    block->next = dbt->fallbacks;
+    dbt->fallbacks = block;
+    dbt->stat.fallbacks++;
+
+    emit8(0x48); emit8(0x89); emit8(0xdf);      /* mov rdi, rbx */
+    emit8(0x48); emit8(0xbe);                   /* mov rsi, block */
+    emit64((unsigned long)block);
+    emit8(0x48); emit8(0xb8);                   /* mov rax, emu_exec_block */
+    emit64((unsigned long)emu_exec_block);
+    emit8(0xff); emit8(0xd0);                   /* call rax */
+    /* a stopped instruction doesn't count, like emu_run */
+    emit_cmp_zero(OFF_STATUS);
+    ok = emit_jcc(CC_Z);
+    emit_refund(rest + 1);
+    emit_jmp_to(dbt->exit_status_stub);
+    patch_rel32(ok, pos);
+    emit_cmp_zero(OFF_INVALIDATE);
+    ok = emit_jcc(CC_Z);
+    if(rest > 0)
+        emit_refund(rest);
+    emit_jmp_to(dbt->exit_invalidate_stub);
+    patch_rel32(ok, pos);
+    if(in->writes_pc || in->kind >= EK_B)
+        emit_jmp_to(dbt->exit_indirect_stub);
+}
+
+/*
+Operand 2 to ecx. With set_carry the shifter carry is stored to c,
+which the logical operations with s need.
+Return 0 if the form is left to the interpreter.
+*/
+static int emit_operand2(struct EmuInsn *in, unsigned int pc_value, int set_carry) {
+    static const int shift_ext[4] = {4, 5, 7, 1};    /* shl, shr, sar, ror */
+
+    switch(in->kind) {
+        case EK_DP_IMM:
+            emit_mov_imm(ECX, in->imm);
+            if(set_carry && in->imm_carry)
+                emit_store_imm(OFF_C, in->imm >> 31);
+            return 1;
+        case EK_DP_REG:
+            emit_load_reg(ECX, in->rm, pc_value);
+            return 1;
+        case EK_DP_SHIFT_IMM:
+            /* amount 0 is lsr/asr #32 or rrx */
+            if(in->shift_amount == 0)
+                return 0;
+            emit_load_reg(ECX, in->rm, pc_value);
+            emit8(0xc1);
+            emit8(0xc0 | (shift_ext[in->shift] << 3) | ECX);
+            emit8(in->shift_amount);
+            if(set_carry)
+                emit_setcc(CC_C, OFF_C);
+            return 1;
+    }
+    return 0;
+}
+
+static int emit_dp(struct EmuInsn *in, unsigned int addr) {
+    unsigned int pc_value = addr + 8;
+    int op = in->op, s = in->set_flags;
+
+    if(in->rd == 15 && !DP_IS_TEST(op))
+        return 0;
+    if(!emit_operand2(in, pc_value, s && DP_IS_LOGICAL(op)))
+        return 0;
+    if(op != DP_MOV && op != DP_MVN)
+        emit_load_reg(EAX, in->rn, pc_value);
+
+    switch(op) {
+        case DP_AND: case DP_TST: emit_alu(ALU_AND, EAX, ECX); break;
+        case DP_EOR: case DP_TEQ: emit_alu(ALU_XOR, EAX, ECX); break;
+        case DP_ORR: emit_alu(ALU_OR, EAX, ECX); break;
+        case DP_MOV: emit_alu(ALU_MOV, EAX, ECX); break;
+        case DP_BIC: emit_not(ECX); emit_alu(ALU_AND, EAX, ECX); break;
+        case DP_MVN: emit_alu(ALU_MOV, EAX, ECX); emit_not(EAX); break;
+        case DP_ADD: case DP_CMN: emit_alu(ALU_ADD, EAX, ECX); break;
+        case DP_SUB: emit_alu(ALU_SUB, EAX, ECX); break;
+        case DP_CMP: emit_alu(ALU_CMP, EAX, ECX); break;
+        case DP_RSB: emit_alu(ALU_SUB, ECX, EAX); emit_alu(ALU_MOV, EAX, ECX); break;
+        case DP_ADC: emit_load_carry(); emit_alu(ALU_ADC, EAX, ECX); break;
+        /* ARM subtracts not carry, x86 subtracts CF */
+        case DP_SBC: emit_load_carry(); emit8(0xf5); emit_alu(ALU_SBB, EAX, ECX); break;
+        case DP_RSC: emit_load_carry(); emit8(0xf5); emit_alu(ALU_SBB, ECX, EAX); emit_alu(ALU_MOV, EAX, ECX); break;
+    }
+
+    if(s) {
+        if(DP_IS_LOGICAL(op)) {
+            emit_set_nz();
+        } else {
+            int borrow = op == DP_SUB || op == DP_CMP || op == DP_RSB || op == DP_SBC || op == DP_RSC;
+            /* x86 CF is a borrow after sub, ARM c is not borrow */
+            emit_setcc(borrow ? CC_NC : CC_C, OFF_C);
+            emit_setcc(CC_O, OFF_V);
+            emit_setcc(CC_S, OFF_N);
+            emit_setcc(CC_Z, OFF_Z);
+        }
+    }
+    /* cmp only compares */
+    if(!DP_IS_TEST(op))
+        emit_store_reg(in->rd, EAX);
+    return 1;
+}
+
+static int emit_mul(struct EmuInsn *in, unsigned int addr) {
+    if(in->rd == 15)
+        return 0;
+    emit_load_reg(EAX, in->rm, addr + 8);
+    emit_load_reg(ECX, in->rs, addr + 8);
+    emit8(0x0f);            /* imul eax, ecx */
+    emit8(0xaf);
+    emit8(0xc1);
+    if(in->set_flags)
+        emit_set_nz();
+    emit_store_reg(in->rd, EAX);
+    return 1;
+}
+
+/*
+ldr rd, [pc, #imm] of a literal pool.
+Stores to the page of the literal flush the translations, so the value can be folded.
+*/
+static int emit_literal_load(struct Dbt *dbt, struct EmuInsn *in, unsigned int addr) {
+    unsigned int literal_addr = in->op & MEM_U ? addr + 8 + in->imm : addr + 8 - in->imm;
+    unsigned int value;
+
+    if((in->op & MEM_B) || (literal_addr & 3) || literal_addr > EMU_RAM_SIZE - 4)
+        return 0;
+    memcpy(&value, dbt->emu.ram + literal_addr, 4);
+    dbt->emu.code_pages[literal_addr >> EMU_PAGE_SHIFT] = 1;
+    emit_store_imm(OFF_R(in->rd), value);
+    return 1;
+}
+
+/*
+ldr/str(b) with immediate offset: inline when the address is in the RAM
+(and aligned and not in code for word stores), emu_exec_block otherwise.
+*/
+static int emit_mem_imm(struct Dbt *dbt, struct EmuInsn *in, unsigned int addr, int rest) {
+    unsigned int pc_value = addr + 8;
+    int load = in->op & MEM_L, byte = in->op & MEM_B;
+    int writeback = !(in->op & MEM_P) || (in->op & MEM_W);
+    unsigned char *slow[3];
+    unsigned char *done;
+    int slow_num = 0, i;
+
+    if(load && in->rd == 15)
+        return 0;
+    if(load && in->rn == 15 && !writeback)
+        return emit_literal_load(dbt, in, addr);
+
+    /* eax = address of the access */
+    emit_load_reg(EAX, in->rn, pc_value);
+    if((in->op & MEM_P) && in->imm != 0) {
+        emit8(in->op & MEM_U ? 0x05 : 0x2d);    /* add/sub eax, imm32 */
+        emit32(in->imm);
+    }
+    emit8(0x3d);                                /* cmp eax, last address */
+    emit32(byte ? EMU_RAM_SIZE - 1 : EMU_RAM_SIZE - 4);
+    slow[slow_num++] = emit_jcc(CC_A);
+    if(!byte) {
+        emit8(0xa8);                            /* test al, 3 */
+        emit8(0x03);
+        slow[slow_num++] = emit_jcc(CC_NZ);
+    }
+
+    if(load) {
+        if(byte) {
+            emit8(0x41); emit8(0x0f); emit8(0xb6); emit8(0x0c); emit8(0x04);   /* movzx ecx, byte [r12 + rax] */
+        } else {
+            emit8(0x41); emit8(0x8b); emit8(0x0c); emit8(0x04);                /* mov ecx, [r12 + rax] */
+        }
+    } else {
+        emit_alu(ALU_MOV, EDX, EAX);                                            /* mov edx, eax */
+        emit8(0xc1); emit8(0xea); emit8(EMU_PAGE_SHIFT);                        /* shr edx, page shift */
+        emit8(0x41); emit8(0x80); emit8(0x7c); emit8(0x15); emit8(0); emit8(0); /* cmp byte [r13 + rdx], 0 */
+        slow[slow_num++] = emit_jcc(CC_NZ);
+        emit_load_reg(ECX, in->rd, pc_value);
+        if(byte) {
+            emit8(0x41); emit8(0x88); emit8(0x0c); emit8(0x04);                /* mov [r12 + rax], cl */
+        } else {
+            emit8(0x41); emit8(0x89); emit8(0x0c); emit8(0x04);                /* mov [r12 + rax], ecx */
+        }
+    }
+
+    /* the loaded value wins over the writeback of the same register */
+    if(writeback) {
+        if(!(in->op & MEM_P) && in->imm != 0) {
+            emit8(in->op & MEM_U ? 0x05 : 0x2d);
+            emit32(in->imm);
+        }
+        emit_store_reg(in->rn, EAX);
+    }
+    if(load)
+        emit_store_reg(in->rd, ECX);
+    done = emit_jmp();
+
+    for(i = 0; i < slow_num; i++)
+        patch_rel32(slow[i], pos);
+    emit_fallback(dbt, in, addr, rest);
+    patch_rel32(done, pos);
+    return 1;
+}
+
+/*
+Translate in, followed by rest instructions in the block.
+Return 1 if it ended the block with its own exits.
+*/
+static int emit_insn(struct Dbt *dbt, struct EmuInsn *in, unsigned int addr, int rest) {
+    unsigned char *skip = NULL;
+    unsigned char *body = pos;
+    int ok = 0;
+
+    switch(in->kind) {
+        case EK_B:
+        case EK_BL:
+            if(in->cond != 14)
+                skip = emit_cond_fail(in->cond);
+            if(in->kind == EK_BL)
+                emit_store_imm(OFF_R(14), addr + 4);
+            emit_chain_exit(dbt, in->imm);
+            if(skip != NULL) {
+                patch_rel32(skip, pos);
+                emit_chain_exit(dbt, addr + 4);
+            }
+            return 1;
+        case EK_BX:
+        case EK_BLX:
+            if(in->cond != 14)
+                skip = emit_cond_fail(in->cond);
+            emit_load_reg(EAX, in->rm, addr + 8);
+            emit8(0x25);                        /* and eax, ~1 */
+            emit32(~1u);
+            if(in->kind == EK_BLX)
+                emit_store_imm(OFF_R(14), addr + 4);
+            emit_store_reg(15, EAX);
+            emit_jmp_to(dbt->exit_indirect_stub);
+            if(skip != NULL) {
+                patch_rel32(skip, pos);
+                emit_chain_exit(dbt, addr + 4);
+            }
+            return 1;
+        case EK_HALT:
+            emit_exit_at(dbt, EXIT_HALT, addr);
+            return 1;
+    }
+
+    if(in->kind <= EK_MEM_IMM) {
+        if(in->cond != 14)
+            skip = emit_cond_fail(in->cond);
+        if(in->kind == EK_MUL)
+            ok = emit_mul(in, addr);
+        else if(in->kind == EK_MEM_IMM)
+            ok = emit_mem_imm(dbt, in, addr, rest);
+        else
+            ok = emit_dp(in, addr);
+        if(ok) {
+            if(skip != NULL)
+                patch_rel32(skip, pos);
+            return 0;
+        }
+        pos = body;
+    }
+    emit_fallback(dbt, in, addr, rest);
+    return in->writes_pc || in->kind >= EK_B;
+}
+
+
+/*
+blocks
+*/
+
+static unsigned int table_index(unsigned int pc) {
+    return (pc >> 2) & (DBT_TABLE_SIZE - 1);
+}
+
+static void dbt_flush(struct Dbt *dbt) {
+    int i;
+
+    for(i = 0; i < DBT_TABLE_SIZE; i++) {
+        struct DbtBlock *block = dbt->table[i];
+        while(block != NULL) {
+            struct DbtBlock *next = block->next;
+            free(block);
+            block = next;
+        }
+        dbt->table[i] = NULL;
+    }
+    while(dbt->fallbacks != NULL) {
+        struct EmuBlock *next = dbt->fallbacks->next;
+        free(dbt->fallbacks);
+        dbt->fallbacks = next;
+    }
+    /* clears code_pages and the invalidate request */
+    emu_flush_cache(&dbt->emu);
+    pos = dbt->code;
+    emit_trampolines(dbt);
+    dbt->stat.flushes++;
+}
+
+static struct DbtBlock *translate(struct Dbt *dbt, unsigned int pc) {
+    struct EmuInsn insns[EMU_BLOCK_MAX];
+    struct DbtBlock *block;
+    unsigned char *limit;
+    unsigned int addr = pc;
+    int num = 0, i, ended = 0;
+
+    if(dbt->code_pos + DBT_BLOCK_CODE_MAX > dbt->code + DBT_CODE_SIZE)
+        dbt_flush(dbt);
+
+    do {
+        unsigned int word;
+        memcpy(&word, dbt->emu.ram + addr, 4);
+        emu_decode(word, addr, &insns[num]);
+        num++;
+        addr += 4;
+    } while(num < EMU_BLOCK_MAX && addr <= EMU_RAM_SIZE - 4
+            && !insns[num-1].writes_pc && insns[num-1].kind < EK_B);
+    dbt->emu.code_pages[pc >> EMU_PAGE_SHIFT] = 1;
+    dbt->emu.code_pages[(addr - 1) >> EMU_PAGE_SHIFT] = 1;
+
+    block = malloc(sizeof(struct DbtBlock));
+    block->pc = pc;
+    block->code = dbt->code_pos;
+    pos = dbt->code_pos;
+
+    /* sub r15, num; js limit */
+    emit8(0x49); emit8(0x83); emit8(0xef); emit8(num);
+    limit = emit_jcc(CC_S);
+
+    for(i = 0, addr = pc; i < num && !ended; i++, addr += 4)
+        ended = emit_insn(dbt, &insns[i], addr, num - 1 - i);
+    if(!ended)
+        emit_chain_exit(dbt, addr);
+
+    /* exit before the block */
+    patch_rel32(limit, pos);
+    emit_refund(num);
+    emit_exit_at(dbt, EXIT_LIMIT, pc);
+
+    dbt->code_pos = pos;
+    block->next = dbt->table[table_index(pc)];
+    dbt->table[table_index(pc)] = block;
+    dbt->stat.blocks_translated++;
+    return block;
+}
+
+static struct DbtBlock *find_block(struct Dbt *dbt, unsigned int pc) {
+    struct DbtBlock *block;
+
+    if(pc > EMU_RAM_SIZE - 4 || (pc & 3)) {
+        dbt->emu.status = EMU_FAULT;
+        dbt->emu.fault_addr = pc;
+        return NULL;
+    }
+    for(block = dbt->table[table_index(pc)]; block != NULL; block = block->next) {
+        if(block->pc == pc)
+            return block;
+    }
+    return translate(dbt, pc);
+}
+
+
+/*
+setup and run
+*/
+
+void dbt_init(struct Dbt *dbt) {
+    memset(dbt, 0, sizeof(*dbt));
+    emu_init(&dbt->emu);
+    dbt->code = mmap(NULL, DBT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(dbt->code == MAP_FAILED) {
+        fprintf(stderr, "can't allocate the translation cache\n");
+        exit(1);
+    }
+    emit_trampolines(dbt);
+}
+
+void dbt_free(struct Dbt *dbt) {
+    dbt_flush(dbt);
+    munmap(dbt->code, DBT_CODE_SIZE);
+    emu_free(&dbt->emu);
+}
+
+void dbt_load(struct Dbt *dbt, unsigned char *image, int size) {
+    emu_load(&dbt->emu, image, size);
+    dbt_flush(dbt);
+}
+
+/*
+Same as emu_run, but stops before a block which would exceed max_insns.
+*/
+int dbt_run(struct Dbt *dbt, long long max_insns) {
+    struct Emu *emu = &dbt->emu;
+    long long budget = max_insns > 0 ? max_insns : 0x7fffffffffffffffLL;
+    struct DbtBlock *block;
+
+    emu->status = EMU_RUNNING;
+    block = find_block(dbt, emu->r[15]);
+    while(block != NULL) {
+        unsigned long ret = dbt->enter(dbt, emu->ram, emu->code_pages, budget, block->code);
+        int flushes = dbt->stat.flushes;
+
+        emu->stat.executed += budget - dbt->budget;
+        budget = dbt->budget;
+        dbt->stat.dispatches++;
+        if(ret >= EXIT_CODE_MAX) {
+            /* chain the exit at ret unless the buffer was flushed meanwhile */
+            block = find_block(dbt, emu->r[15]);
+            if(block != NULL && dbt->stat.flushes == flushes) {
+                unsigned char *site = (unsigned char*)ret;
+                site[0] = 0xe9;
+                patch_rel32(site + 1, block->code);
+                dbt->stat.chains++;
+            }
+            continue;
+        }
+        switch(ret) {
+            case EXIT_INVALIDATE:
+                dbt_flush(dbt);
+                /* fall through */
+            case EXIT_INDIRECT:
+                block = find_block(dbt, emu->r[15] & ~3u);
+                break;
+            case EXIT_HALT:
+                emu->status = EMU_HALTED;
+                block = NULL;
+                break;
+            case EXIT_LIMIT:
+                emu->status = EMU_LIMIT;
+                block = NULL;
+                break;
+            default:
+                block = NULL;
+                break;
+        }
+    }
+    return emu->status;
+}
+
+#ifndef DBT_NO_MAIN
+
+#include "asm.h"
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+/*
+Result of one run on either side.
+*/
+struct RunResult {
+    int status;
+    unsigned int r[16];
+    unsigned int nzcv;
+    long long executed;
+    char *uart;
+    size_t uart_len;
+    double elapsed;
+};
+
+static void run_emu(unsigned char *image, int size, long long limit, struct RunResult *res) {
+    static struct Emu emu;
+    FILE *uart = open_memstream(&res->uart, &res->uart_len);
+    double begin = now_sec();
+
+    emu_init(&emu);
+    emu_set_uart(&emu, uart);
+    emu_load(&emu, image, size);
+    res->status = emu_run(&emu, limit);
+    fclose(uart);
+    res->elapsed = now_sec() - begin;
+    memcpy(res->r, emu.r, sizeof(res->r));
+    res->nzcv = (emu.n << 3) | (emu.z << 2) | (emu.c << 1) | emu.v;
+    res->executed = emu.stat.executed;
+    emu_free(&emu);
+}
+
+static void run_dbt(unsigned char *image, int size, long long limit, struct RunResult *res,
+                    struct DbtStat *stat) {
+    static struct Dbt dbt;
+    FILE *uart = open_memstream(&res->uart, &res->uart_len);
+    double begin = now_sec();
+
+    dbt_init(&dbt);
+    emu_set_uart(&dbt.emu, uart);
+    dbt_load(&dbt, image, size);
+    res->status = dbt_run(&dbt, limit);
+    fclose(uart);
+    res->elapsed = now_sec() - begin;
+    memcpy(res->r, dbt.emu.r, sizeof(res->r));
+    res->nzcv = (dbt.emu.n << 3) | (dbt.emu.z << 2) | (dbt.emu.c << 1) | dbt.emu.v;
+    res->executed = dbt.emu.stat.executed;
+    if(stat != NULL)
+        *stat = dbt.stat;
+    dbt_free(&dbt);
+}
+
+/*
+Print the differences of the two runs, return the number of them.
+Only the counts of executed instructions differ at the limit, dbt stops at a block boundary.
+*/
+static int compare_results(struct RunResult *expect, struct RunResult *actual) {
+    int diff = 0, i;
+
+    if(expect->status != actual->status) {
+        printf("status: emu %s, dbt %s\n", emu_status_name(expect->status), emu_status_name(actual->status));
+        diff++;
+    }
+    if(expect->uart_len != actual->uart_len || memcmp(expect->uart, actual->uart, expect->uart_len) != 0) {
+        printf("uart: emu \"%.*s\", dbt \"%.*s\"\n", (int)expect->uart_len, expect->uart,
+               (int)actual->uart_len, actual->uart);
+        diff++;
+    }
+    for(i = 0; i < 16; i++) {
+        if(expect->r[i] != actual->r[i]) {
+            printf("r%d: emu 0x%08x, dbt 0x%08x\n", i, expect->r[i], actual->r[i]);
+            diff++;
+        }
+    }
+    if(expect->nzcv != actual->nzcv) {
+        printf("nzcv: emu %x, dbt %x\n", expect->nzcv, actual->nzcv);
+        diff++;
+    }
+    if(expect->status != EMU_LIMIT && expect->executed != actual->executed) {
+        printf("executed: emu %lld, dbt %lld\n", expect->executed, actual->executed);
+        diff++;
+    }
+    return diff;
+}
+
+
+/*
+test code
+*/
+
+static void assert_true(int boolflag) {
+    if(!boolflag) {
+        printf("assert fail\n");
+    }
+}
+
+static void assert_int_eq(int expect, int actual) {
+    if(expect != actual) {
+        printf("assert fail, expect 0x%08x, actual 0x%08x\n", expect, actual);
+    }
+}
+
+/*
+Assemble lines with 05_asm, run them on both sides and compare.
+*/
+static void assert_same(char **lines, char *expect_uart, int expect_status) {
+    struct Assembler as;
+    struct RunResult expect, actual;
+    int *code, word_num, i;
+
+    asm_init(&as, "test");
+    for(i = 0; lines[i] != NULL; i++) {
+        char buf[256];
+        strcpy(buf, lines[i]);
+        asm_one(&as, buf);
+    }
+    code = asm_finish(&as, &word_num);
+    assert_true(code != NULL);
+    if(code == NULL) {
+        asm_free(&as);
+        return;
+    }
+    run_emu((unsigned char*)code, word_num*4, 100000, &expect);
+    run_dbt((unsigned char*)code, word_num*4, 100000, &actual, NULL);
+    assert_int_eq(0, compare_results(&expect, &actual));
+    assert_int_eq(expect_status, actual.status);
+    assert_true(actual.uart_len == strlen(expect_uart) && memcmp(actual.uart, expect_uart, actual.uart_len) == 0);
+    free(expect.uart);
+    free(actual.uart);
+    asm_free(&as);
+}
+
+static void test_samples() {
+    char *print_loop[] = {
+        "ldr r0, =0x101f1000",
+        "ldr r1, =message",
+        "ldrb r3, [r1]",
+        "loop:",
+        "str r3, [r0]",
+        "add r1, r1, #1",
+        "ldrb r3, [r1]",
+        "cmp r3, #0",
+        "bne loop",
+        "end:",
+        "b end",
+        "message:",
+        ".raw \"Hello World\\n\"",
+        NULL};
+    char *print_hex[] = {
+        "ldr r1, =0xdeadbeaf",
+        "ldr r0, =0x101f1000",
+        "mov r2, #28",
+        "loop:",
+        "lsr r3, r1, r2",
+        "and r3, r3, #0xf",
+        "cmp r3, #10",
+        "addge r3, r3, #0x57",
+        "addlt r3, r3, #0x30",
+        "str r3, [r0]",
+        "subs r2, r2, #4",
+        "bge loop",
+        "mov r3, #0x0a",
+        "str r3, [r0]",
+        "end:",
+        "b end",
+        NULL};
+    char *putchar_mem[] = {
+        "ldr r13, =0x08000000",
+        "ldr r0, =msg1",
+        "bl print",
+        "ldr r0, =msg2",
+        "bl print",
+        "end:",
+        "b end",
+        "putchar:",
+        "ldr r1, =0x101f1000",
+        "str r0, [r1]",
+        "mov r15, r14",
+        "print:",
+        "stmdb r13!, {r4, r14}",
+        "mov r4, r0",
+        "ldrb r0, [r4]",
+        "print_loop:",
+        "bl putchar",
+        "add r4, r4, #1",
+        "ldrb r0, [r4]",
+        "cmp r0, #0",
+        "bne print_loop",
+        "ldmia r13!, {r4, r14}",
+        "mov r15, r14",
+        "msg1:",
+        ".raw \"First text.\\n\"",
+        "msg2:",
+        ".raw \"Second text!\\n\"",
+        NULL};
+
+    assert_same(print_loop, "Hello World\n", EMU_HALTED);
+    assert_same(print_hex, "deadbeaf\n", EMU_HALTED);
+    assert_same(putchar_mem, "First text.\nSecond text!\n", EMU_HALTED);
+}
+
+/*
+Every opcode with s, and the conditions after them.
+*/
+static void test_flags() {
+    char *lines[] = {
+        "ldr r0, =0x80000000",
+        "adds r1, r0, r0",
+        "moveq r2, #1",
+        "movcs r3, #1",
+        "movvs r4, #1",
+        "mov r5, #1",
+        "subs r6, r5, #2",
+        "movmi r7, #1",
+        "movcc r8, #1",
+        "cmp r5, #1",
+        "movhi r9, #1",
+        "movls r10, #1",
+        "adcs r11, r5, r0",
+        "sbcs r12, r0, r5",
+        "rsbs r1, r5, #0",
+        "rscs r2, r5, #3",
+        "movgt r3, #2",
+        "movle r4, #2",
+        "cmn r0, r0",
+        "movge r6, #3",
+        "movlt r7, #3",
+        "ands r8, r0, #0x80000000",
+        "orrs r9, r5, r0",
+        "eors r10, r0, r0",
+        "bics r11, r0, #0xf0000000",
+        "mvns r12, r5",
+        "tst r5, #2",
+        "teq r0, r0",
+        "end:",
+        "b end",
+        NULL};
+
+    assert_same(lines, "", EMU_HALTED);
+}
+
+static void test_shift_mul_mem() {
+    char *lines[] = {
+        "ldr r0, =0x80000010",
+        "asr r1, r0, #4",
+        "lsrs r2, r0, #5",
+        "movcs r3, #1",
+        "rors r4, r0, #5",
+        "lsls r5, r0, #1",
+        "mov r6, #7",
+        "mov r7, #6",
+        "muls r8, r6, r7",
+        "mov r9, #36",
+        "lsl r10, r6, r9",
+        "ldr r13, =0x08000000",
+        "stmdb r13!, {r0-r2}",
+        "mov r12, r13",
+        "ldmia r13!, {r4-r6}",
+        "ldr r7, [r12, #4]",
+        "str r7, [r12, #-4]!",
+        "ldr r8, [r12], #8",
+        "strb r0, [r12, #1]",
+        "ldrb r9, [r12, #1]",
+        "ldr r10, [r12, #1]",      // unaligned, rotated
+        "end:",
+        "b end",
+        NULL};
+
+    assert_same(lines, "", EMU_HALTED);
+}
+
+static void test_branches() {
+    char *lines[] = {
+        "ldr r0, =func",
+        "blx r0",
+        "add r1, r1, #1",
+        "mov r2, #10",
+        "loop:",
+        "subs r2, r2, #1",
+        "blne count",
+        "bne loop",
+        "end:",
+        "b end",
+        "func:",
+        "mov r1, #10",
+        "bx r14",
+        "count:",
+        "add r3, r3, #1",
+        "mov r15, r14",
+        NULL};
+
+    assert_same(lines, "", EMU_HALTED);
+}
+
+static void test_self_modifying() {
+    char *lines[] = {
+        "ldr r0, =patch",
+        "ldr r1, =0xe3a02007",  // mov r2, #7
+        "mov r3, #0",
+        "patch:",
+        "mov r2, #1",
+        "add r3, r3, r2",
+        "str r1, [r0]",
+        "cmp r3, #1",
+        "beq patch",
+        "end:",
+        "b end",
+        NULL};
+
+    assert_same(lines, "", EMU_HALTED);
+}
+
+static void test_stop() {
+    char *fault_lines[] = {
+        "ldr r0, =0x20000000",
+        "ldr r1, [r0]",
+        "end:",
+        "b end",
+        NULL};
+    char *loop_lines[] = {
+        "loop:",
+        "add r0, r0, #1",
+        "b loop",
+        NULL};
+    char *undefined_lines[] = {
+        "mov r0, #1",
+        ".raw 0xe7f000f0",
+        NULL};
+    struct Assembler as;
+    struct RunResult res;
+    int *code, word_num, i;
+
+    assert_same(fault_lines, "", EMU_FAULT);
+    assert_same(undefined_lines, "", EMU_UNDEFINED);
+
+    /* stops at the block boundary, so r0 differs from emu */
+    asm_init(&as, "test");
+    for(i = 0; loop_lines[i] != NULL; i++) {
+        char buf[256];
+        strcpy(buf, loop_lines[i]);
+        asm_one(&as, buf);
+    }
+    code = asm_finish(&as, &word_num);
+    run_dbt((unsigned char*)code, word_num*4, 1001, &res, NULL);
+    assert_int_eq(EMU_LIMIT, res.status);
+    assert_int_eq(1000, res.executed);
+    assert_int_eq(500, res.r[0]);
+    free(res.uart);
+    asm_free(&as);
+}
+
+static void run_unit_tests() {
+    test_samples();
+    test_flags();
+    test_shift_mul_mem();
+    test_branches();
+    test_self_modifying();
+    test_stop();
+}
+
+static unsigned char *read_file(char *path, int *out_size) {
+    FILE *fp = fopen(path, "rb");
+    unsigned char *buf;
+    long size;
+
+    if(fp == NULL) {
+        fprintf(stderr, "can't open %s\n", path);
+        exit(1);
+    }
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    rewind(fp);
+    buf = malloc(size > 0 ? size : 1);
+    if(fread(buf, 1, size, fp) != (size_t)size) {
+        fprintf(stderr, "can't read %s\n", path);
+        exit(1);
+    }
+    fclose(fp);
+    *out_size = (int)size;
+    return buf;
+}
+
+/*
+Run path on both sides, print the differences and the speedup.
+*/
+static int compare_file(char *path, long long limit) {
+    struct RunResult expect, actual;
+    struct DbtStat stat;
+    unsigned char *image;
+    int size, diff;
+
+    image = read_file(path, &size);
+    run_emu(image, size, limit, &expect);
+    run_dbt(image, size, limit, &actual, &stat);
+    diff = compare_results(&expect, &actual);
+
+    printf("%s: %s, %lld instructions\n", path, emu_status_name(actual.status), actual.executed);
+    printf("  emu: %10.1f usec, %7.1f MIPS\n", expect.elapsed*1e6, expect.executed/expect.elapsed/1e6);
+    printf("  dbt: %10.1f usec, %7.1f MIPS (%.2fx)\n", actual.elapsed*1e6,
+           actual.executed/actual.elapsed/1e6, expect.elapsed/actual.elapsed);
+    printf("  %d blocks, %d chained, %d instructions with emu paths, %lld dispatches\n",
+           stat.blocks_translated, stat.chains, stat.fallbacks, stat.dispatches);
+    if(diff == 0)
+        printf("  same result\n");
+
+    free(expect.uart);
+    free(actual.uart);
+    free(image);
+    return diff;
+}
+
+int main(int argc, char **argv) {
+    static struct Dbt dbt;
+    unsigned char *image;
+    long long limit = 0;
+    int size, status, compare = 0;
+
+    while(argc >= 2 && argv[1][0] == '-') {
+        if(strcmp(argv[1], "-compare") == 0) {
+            compare = 1;
+        } else if(strcmp(argv[1], "-limit") == 0 && argc >= 3) {
+            limit = atoll(argv[2]);
+            argv++;
+            argc--;
+        } else {
+            fprintf(stderr, "usage: dbt [-compare] [-limit N] prog.bin\n");
+            exit(1);
+        }
+        argv++;
+        argc--;
+    }
+    if(argc < 2) {
+        run_unit_tests();
+        return 0;
+    }
+    if(compare)
+        return compare_file(argv[1], limit) == 0 ? 0 : 1;
+
+    image = read_file(argv[1], &size);
+    dbt_init(&dbt);
+    dbt_load(&dbt, image, size);
+    status = dbt_run(&dbt, limit);
+    fflush(stdout);
+    if(status == EMU_FAULT || status == EMU_UNDEFINED) {
+        fprintf(stderr, "%s at 0x%08x (pc 0x%08x)\n", emu_status_name(status), dbt.emu.fault_addr, dbt.emu.r[15]);
+        exit(1);
+    }
+    dbt_free(&dbt);
+    free(image);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,1393 @@
+/*
+ARM32 interpreter of arm_asm.md chapter 06.
+
+gcc -O2 -DASM_NO_MAIN -I../05_asm emu.c ../05_asm/asm.c -o emu
+./emu                           # run unit tests (programs are assembled by 05_asm)
+./emu hello.bin                 # run until "end: b end", UART to stdout
+./emu -stat -limit 1000000 loop.bin
+./emu -trace loop.trace loop.bin     # last blocks dumped on fault and on kill -USR1, see trace_decode.c
+
+Words are read from the RAM with memcpy, so the host must be little endian like versatilepb.
+*/
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "emu.h"
+
+#define COND_AL 14
+
+/* data processing opcodes */
+#define DP_AND 0
+#define DP_EOR 1
+#define DP_SUB 2
+#define DP_RSB 3
+#define DP_ADD 4
+#define DP_ADC 5
+#define DP_SBC 6
+#define DP_RSC 7
+#define DP_TST 8
+#define DP_TEQ 9
+#define DP_CMP 10
+#define DP_CMN 11
+#define DP_ORR 12
+#define DP_MOV 13
+#define DP_BIC 14
+#define DP_MVN 15
+#define DP_IS_TEST(op) ((op) >= DP_TST && (op) <= DP_CMN)
+
+/* op of memory instructions, bits 24-20 of the word */
+#define MEM_P 0x10
+#define MEM_U 0x08
+#define MEM_B 0x04
+#define MEM_W 0x02
+#define MEM_L 0x01
+
+#define SHIFT_LSL 0
+#define SHIFT_LSR 1
+#define SHIFT_ASR 2
+#define SHIFT_ROR 3
+
+#define BITS(word, hi, lo) (((unsigned int)(word) >> (lo)) & ((1u << ((hi)-(lo)+1)) - 1))
+
+
+/*
+decode
+*/
+
+static unsigned int ror32(unsigned int value, int amount) {
+    amount &= 31;
+    return amount == 0 ? value : (value >> amount) | (value << (32 - amount));
+}
+
+static void decode_dp(unsigned int word, struct EmuInsn *in) {
+    in->op = BITS(word, 24, 21);
+    in->set_flags = BITS(word, 20, 20);
+    in->rn = BITS(word, 19, 16);
+    in->rd = BITS(word, 15, 12);
+    if(DP_IS_TEST(in->op) && !in->set_flags) {
+        /* mrs, msr and friends */
+        in->kind = EK_UNDEFINED;
+        return;
+    }
+    if(word & (1 << 25)) {
+        int rot = BITS(word, 11, 8) * 2;
+        in->kind = EK_DP_IMM;
+        in->imm = ror32(BITS(word, 7, 0), rot);
+        in->imm_carry = rot != 0;
+        return;
+    }
+    in->rm = BITS(word, 3, 0);
+    in->shift = BITS(word, 6, 5);
+    if(word & (1 << 4)) {
+        if(word & (1 << 7)) {
+            /* halfword and swap */
+            in->kind = EK_UNDEFINED;
+            return;
+        }
+        in->kind = EK_DP_SHIFT_REG;
+        in->rs = BITS(word, 11, 8);
+    } else {
+        in->kind = EK_DP_SHIFT_IMM;
+        in->shift_amount = BITS(word, 11, 7);
+        if(in->shift == SHIFT_LSL && in->shift_amount == 0)
+            in->kind = EK_DP_REG;
+    }
+}
+
+static void decode_mem(unsigned int word, struct EmuInsn *in) {
+    in->op = BITS(word, 24, 20);
+    in->rn = BITS(word, 19, 16);
+    in->rd = BITS(word, 15, 12);
+    if((!(in->op & MEM_P) || (in->op & MEM_W)) && in->rn == 15) {
+        in->kind = EK_UNDEFINED;
+        return;
+    }
+    if(word & (1 << 25)) {
+        if(word & (1 << 4)) {
+            in->kind = EK_UNDEFINED;
+            return;
+        }
+        in->kind = EK_MEM_REG;
+        in->rm = BITS(word, 3, 0);
+        in->shift = BITS(word, 6, 5);
+        in->shift_amount = BITS(word, 11, 7);
+    } else {
+        in->kind = EK_MEM_IMM;
+        in->imm = BITS(word, 11, 0);
+    }
+}
+
+static void decode_multi(unsigned int word, struct EmuInsn *in) {
+    in->op = BITS(word, 24, 20);
+    in->rn = BITS(word, 19, 16);
+    in->imm = BITS(word, 15, 0);
+    /* S bit (user bank) and empty lists are out of the lesson subset */
+    if((in->op & MEM_B) || in->imm == 0 || in->rn == 15)
+        in->kind = EK_UNDEFINED;
+    else
+        in->kind = EK_MULTI;
+}
+
+static void decode_branch(unsigned int word, unsigned int addr, struct EmuInsn *in) {
+    int offset = (int)(word << 8) >> 8;
+
+    in->kind = word & (1 << 24) ? EK_BL : EK_B;
+    in->imm = addr + 8 + (unsigned int)offset*4;
+    if(in->kind == EK_B && in->cond == COND_AL && in->imm == addr)
+        in->kind = EK_HALT;
+}
+
+static void decode(unsigned int word, unsigned int addr, struct EmuInsn *in) {
+    memset(in, 0, sizeof(*in));
+    in->cond = BITS(word, 31, 28);
+    if(in->cond == 15) {
+        in->kind = EK_UNDEFINED;
+    } else if((word & 0x0fe000f0) == 0x00000090) {
+        in->kind = EK_MUL;
+        in->set_flags = BITS(word, 20, 20);
+        in->rd = BITS(word, 19, 16);
+        in->rs = BITS(word, 11, 8);
+        in->rm = BITS(word, 3, 0);
+    } else if((word & 0x0ffffff0) == 0x012fff10) {
+        in->kind = EK_BX;
+        in->rm = BITS(word, 3, 0);
+    } else if((word & 0x0ffffff0) == 0x012fff30) {
+        in->kind = EK_BLX;
+        in->rm = BITS(word, 3, 0);
+    } else if((word & 0x0c000000) == 0) {
+        decode_dp(word, in);
+    } else if((word & 0x0c000000) == 0x04000000) {
+        decode_mem(word, in);
+    } else if((word & 0x0e000000) == 0x08000000) {
+        decode_multi(word, in);
+    } else if((word & 0x0e000000) == 0x0a000000) {
+        decode_branch(word, addr, in);
+    } else {
+        in->kind = EK_UNDEFINED;
+    }
+}
+
+/*
+The block ends after an instruction which may change pc.
+*/
+static int ends_block(struct EmuInsn *in) {
+    switch(in->kind) {
+        case EK_DP_IMM:
+        case EK_DP_REG:
+        case EK_DP_SHIFT_IMM:
+        case EK_DP_SHIFT_REG:
+            return in->rd == 15 && !DP_IS_TEST(in->op);
+        case EK_MEM_IMM:
+        case EK_MEM_REG:
+            return (in->op & MEM_L) && in->rd == 15;
+        case EK_MULTI:
+            return (in->op & MEM_L) && (in->imm & (1 << 15));
+        case EK_MUL:
+            return 0;
+    }
+    return 1;
+}
+
+/*
+One case of the execute switch per form of operand 2 and opcode,
+so that an instruction is dispatched by a single jump.
+*/
+#define HANDLER_DP(kind, op) (((kind) - EK_DP_IMM)*16 + (op))
+#define HANDLER_OTHER(kind) (HANDLER_DP(EK_DP_SHIFT_REG, 15) + 1 + (kind))
+
+static int insn_handler(struct EmuInsn *in) {
+    if(in->kind <= EK_DP_SHIFT_REG)
+        return HANDLER_DP(in->kind, in->op);
+    return HANDLER_OTHER(in->kind);
+}
+
+void emu_decode(unsigned int word, unsigned int addr, struct EmuInsn *in) {
+    decode(word, addr, in);
+    in->writes_pc = in->kind < EK_B && ends_block(in);
+    in->handler = insn_handler(in);
+}
+
+
+/*
+block cache
+*/
+
+static unsigned int cache_index(unsigned int pc) {
+    return (pc >> 2) & (EMU_CACHE_SIZE - 1);
+}
+
+static struct EmuBlock *decode_block(struct Emu *emu, unsigned int pc) {
+    struct EmuBlock *block;
+    struct EmuInsn insns[EMU_BLOCK_MAX];
+    unsigned int addr = pc;
+    int num = 0;
+
+    do {
+        unsigned int word;
+        memcpy(&word, emu->ram + addr, 4);
+        emu_decode(word, addr, &insns[num]);
+        num++;
+        addr += 4;
+    } while(num < EMU_BLOCK_MAX && addr <= EMU_RAM_SIZE - 4 && !ends_block(&insns[num-1]));
+
+    block = malloc(sizeof(struct EmuBlock) + sizeof(struct EmuInsn)*num);
+    block->pc = pc;
+    block->insn_num = num;
+    block->succ_pc[0] = block->succ_pc[1] = 0;
+    block->succ[0] = block->succ[1] = NULL;
+    memcpy(block->insns, insns, sizeof(struct EmuInsn)*num);
+
+    block->next = emu->cache[cache_index(pc)];
+    emu->cache[cache_index(pc)] = block;
+    emu->code_pages[pc >> EMU_PAGE_SHIFT] = 1;
+    emu->code_pages[(addr - 1) >> EMU_PAGE_SHIFT] = 1;
+    emu->stat.blocks_decoded++;
+    return block;
+}
+
+static struct EmuBlock *find_block(struct Emu *emu, unsigned int pc) {
+    struct EmuBlock *block;
+
+    if(pc > EMU_RAM_SIZE - 4 || (pc & 3)) {
+        emu->status = EMU_FAULT;
+        emu->fault_addr = pc;
+        return NULL;
+    }
+    for(block = emu->cache[cache_index(pc)]; block != NULL; block = block->next) {
+        if(block->pc == pc)
+            return block;
+    }
+    return decode_block(emu, pc);
+}
+
+void emu_flush_cache(struct Emu *emu) {
+    int i;
+
+    for(i = 0; i < EMU_CACHE_SIZE; i++) {
+        struct EmuBlock *block = emu->cache[i];
+        while(block != NULL) {
+            struct EmuBlock *next = block->next;
+            free(block);
+            block = next;
+        }
+        emu->cache[i] = NULL;
+    }
+    memset(emu->code_pages, 0, sizeof(emu->code_pages));
+    emu->invalidate = 0;
+    emu->stat.cache_flushes++;
+}
+
+
+/*
+memory
+
+Only the RAM and the UART data register exist.
+Loads from the UART read 0.
+*/
+
+static int fault(struct Emu *emu, unsigned int addr) {
+    emu->status = EMU_FAULT;
+    emu->fault_addr = addr;
+    return 0;
+}
+
+static inline void mark_written(struct Emu *emu, unsigned int addr) {
+    if(emu->code_pages[addr >> EMU_PAGE_SHIFT])
+        emu->invalidate = 1;
+}
+
+/* unaligned loads rotate the word like ARMv5 */
+static inline int load_word(struct Emu *emu, unsigned int addr, unsigned int *out) {
+    if(addr <= EMU_RAM_SIZE - 4) {
+        unsigned int word;
+        memcpy(&word, emu->ram + (addr & ~3u), 4);
+        *out = ror32(word, (addr & 3)*8);
+        return 1;
+    }
+    if((addr & ~3u) == EMU_UART_DR) {
+        *out = 0;
+        return 1;
+    }
+    return fault(emu, addr);
+}
+
+static inline int load_byte(struct Emu *emu, unsigned int addr, unsigned int *out) {
+    if(addr < EMU_RAM_SIZE) {
+        *out = emu->ram[addr];
+        return 1;
+    }
+    if(addr == EMU_UART_DR) {
+        *out = 0;
+        return 1;
+    }
+    return fault(emu, addr);
+}
+
+static inline int store_word(struct Emu *emu, unsigned int addr, unsigned int value) {
+    if(addr <= EMU_RAM_SIZE - 4) {
+        addr &= ~3u;
+        memcpy(emu->ram + addr, &value, 4);
+        mark_written(emu, addr);
+        return 1;
+    }
+    if((addr & ~3u) == EMU_UART_DR) {
+        putc(value & 0xff, emu->uart);
+        return 1;
+    }
+    return fault(emu, addr);
+}
+
+static inline int store_byte(struct Emu *emu, unsigned int addr, unsigned int value) {
+    if(addr < EMU_RAM_SIZE) {
+        emu->ram[addr] = value;
+        mark_written(emu, addr);
+        return 1;
+    }
+    if(addr == EMU_UART_DR) {
+        putc(value & 0xff, emu->uart);
+        return 1;
+    }
+    return fault(emu, addr);
+}
+
+
+/*
+execute
+*/
+
+int emu_cond_pass(int cond, int nzcv) {
+    int n = (nzcv >> 3) & 1, z = (nzcv >> 2) & 1, c = (nzcv >> 1) & 1, v = nzcv & 1;
+
+    switch(cond) {
+        case 0: return z;
+        case 1: return !z;
+        case 2: return c;
+        case 3: return !c;
+        case 4: return n;
+        case 5: return !n;
+        case 6: return v;
+        case 7: return !v;
+        case 8: return c && !z;
+        case 9: return !c || z;
+        case 10: return n == v;
+        case 11: return n != v;
+        case 12: return !z && n == v;
+        case 13: return z || n != v;
+        case 14: return 1;
+    }
+    return 0;
+}
+
+/* bit nzcv of cond_table[cond] is emu_cond_pass(cond, nzcv) */
+static unsigned short cond_table[16];
+
+static void init_cond_table() {
+    int cond, nzcv;
+
+    for(cond = 0; cond < 16; cond++) {
+        cond_table[cond] = 0;
+        for(nzcv = 0; nzcv < 16; nzcv++)
+            cond_table[cond] |= emu_cond_pass(cond, nzcv) << nzcv;
+    }
+}
+
+/*
+Shift by an immediate amount, 0 means 32 for lsr/asr and rrx for ror.
+*/
+static inline unsigned int shift_by_imm(unsigned int value, int type, int amount,
+                                        unsigned int carry_in, unsigned int *carry_out) {
+    switch(type) {
+        case SHIFT_LSL:
+            if(amount == 0) {
+                *carry_out = carry_in;
+                return value;
+            }
+            *carry_out = (value >> (32 - amount)) & 1;
+            return value << amount;
+        case SHIFT_LSR:
+            if(amount == 0) {
+                *carry_out = value >> 31;
+                return 0;
+            }
+            *carry_out = (value >> (amount - 1)) & 1;
+            return value >> amount;
+        case SHIFT_ASR:
+            if(amount == 0) {
+                *carry_out = value >> 31;
+                return (unsigned int)((int)value >> 31);
+            }
+            *carry_out = (value >> (amount - 1)) & 1;
+            return (unsigned int)((int)value >> amount);
+    }
+    if(amount == 0) {
+        *carry_out = value & 1;
+        return (carry_in << 31) | (value >> 1);
+    }
+    *carry_out = (value >> (amount - 1)) & 1;
+    return ror32(value, amount);
+}
+
+/*
+Shift by the bottom byte of a register.
+*/
+static inline unsigned int shift_by_reg(unsigned int value, int type, unsigned int amount,
+                                        unsigned int carry_in, unsigned int *carry_out) {
+    amount &= 0xff;
+    if(amount == 0) {
+        *carry_out = carry_in;
+        return value;
+    }
+    switch(type) {
+        case SHIFT_LSL:
+            if(amount >= 32) {
+                *carry_out = amount == 32 ? value & 1 : 0;
+                return 0;
+            }
+            break;
+        case SHIFT_LSR:
+            if(amount >= 32) {
+                *carry_out = amount == 32 ? value >> 31 : 0;
+                return 0;
+            }
+            break;
+        case SHIFT_ASR:
+            if(amount >= 32) {
+                *carry_out = value >> 31;
+                return (unsigned int)((int)value >> 31);
+            }
+            break;
+        default:
+            if((amount & 31) == 0) {
+                *carry_out = value >> 31;
+                return value;
+            }
+            amount &= 31;
+            break;
+    }
+    return shift_by_imm(value, type, amount, carry_in, carry_out);
+}
+
+/*
+exec_block keeps the flags in the locals n, z, c and v,
+the macros below work on them.
+*/
+#define COND_PASS(cond) ((cond_table[cond] >> ((n << 3) | (z << 2) | (c << 1) | v)) & 1)
+
+#define SET_NZ(result) \
+    n = (result) >> 31; \
+    z = (result) == 0;
+
+#define OPERAND_IMM b = in->imm; carry = in->imm_carry ? b >> 31 : c
+#define OPERAND_REG b = r[in->rm]; carry = c
+#define OPERAND_SHIFT_IMM b = shift_by_imm(r[in->rm], in->shift, in->shift_amount, c, &carry)
+#define OPERAND_SHIFT_REG b = shift_by_reg(r[in->rm], in->shift, r[in->rs], c, &carry)
+
+#define LOGICAL(expr, write) \
+    result = (expr); \
+    if(write) \
+        r[in->rd] = result; \
+    if(in->set_flags) { \
+        SET_NZ(result); \
+        c = carry; \
+    }
+
+/*
+x + y + carry_in with the flags of the adder.
+Subtraction is x + ~y + 1.
+*/
+#define ARITH(x, y, carry_in, write) { \
+    unsigned int x_ = (x), y_ = (y); \
+    unsigned long long wide = (unsigned long long)x_ + y_ + (carry_in); \
+    result = (unsigned int)wide; \
+    if(in->set_flags) { \
+        SET_NZ(result); \
+        c = (unsigned int)(wide >> 32); \
+        v = (~(x_ ^ y_) & (x_ ^ result)) >> 31; \
+    } \
+    if(write) \
+        r[in->rd] = result; \
+}
+
+#define DP_CASES(kind, OPERAND) \
+    case HANDLER_DP(kind, DP_AND): OPERAND; LOGICAL(r[in->rn] & b, 1); break; \
+    case HANDLER_DP(kind, DP_EOR): OPERAND; LOGICAL(r[in->rn] ^ b, 1); break; \
+    case HANDLER_DP(kind, DP_SUB): OPERAND; ARITH(r[in->rn], ~b, 1, 1); break; \
+    case HANDLER_DP(kind, DP_RSB): OPERAND; ARITH(b, ~r[in->rn], 1, 1); break; \
+    case HANDLER_DP(kind, DP_ADD): OPERAND; ARITH(r[in->rn], b, 0, 1); break; \
+    case HANDLER_DP(kind, DP_ADC): OPERAND; ARITH(r[in->rn], b, c, 1); break; \
+    case HANDLER_DP(kind, DP_SBC): OPERAND; ARITH(r[in->rn], ~b, c, 1); break; \
+    case HANDLER_DP(kind, DP_RSC): OPERAND; ARITH(b, ~r[in->rn], c, 1); break; \
+    case HANDLER_DP(kind, DP_TST): OPERAND; LOGICAL(r[in->rn] & b, 0); break; \
+    case HANDLER_DP(kind, DP_TEQ): OPERAND; LOGICAL(r[in->rn] ^ b, 0); break; \
+    case HANDLER_DP(kind, DP_CMP): OPERAND; ARITH(r[in->rn], ~b, 1, 0); break; \
+    case HANDLER_DP(kind, DP_CMN): OPERAND; ARITH(r[in->rn], b, 0, 0); break; \
+    case HANDLER_DP(kind, DP_ORR): OPERAND; LOGICAL(r[in->rn] | b, 1); break; \
+    case HANDLER_DP(kind, DP_MOV): OPERAND; LOGICAL(b, 1); break; \
+    case HANDLER_DP(kind, DP_BIC): OPERAND; LOGICAL(r[in->rn] & ~b, 1); break; \
+    case HANDLER_DP(kind, DP_MVN): OPERAND; LOGICAL(~b, 1); break;
+
+static int exec_mem(struct Emu *emu, struct EmuInsn *in, unsigned int c) {
+    unsigned int *r = emu->r;
+    unsigned int offset, base, addr, value, unused;
+
+    if(in->kind == EK_MEM_IMM)
+        offset = in->imm;
+    else
+        offset = shift_by_imm(r[in->rm], in->shift, in->shift_amount, c, &unused);
+    base = r[in->rn];
+    addr = in->op & MEM_U ? base + offset : base - offset;
+    if(in->op & MEM_L) {
+        int ok = in->op & MEM_B ? load_byte(emu, in->op & MEM_P ? addr : base, &value)
+                                : load_word(emu, in->op & MEM_P ? addr : base, &value);
+        if(!ok)
+            return 0;
+        if(!(in->op & MEM_P) || (in->op & MEM_W))
+            r[in->rn] = addr;
+        r[in->rd] = value;
+        return 1;
+    }
+    /* str of pc stores pc+8 here, not the implementation defined pc+12 */
+    value = r[in->rd];
+    if(!(in->op & MEM_B ? store_byte(emu, in->op & MEM_P ? addr : base, value)
+                        : store_word(emu, in->op & MEM_P ? addr : base, value)))
+        return 0;
+    if(!(in->op & MEM_P) || (in->op & MEM_W))
+        r[in->rn] = addr;
+    return 1;
+}
+
+static int exec_multi(struct Emu *emu, struct EmuInsn *in) {
+    unsigned int *r = emu->r;
+    unsigned int list = in->imm;
+    unsigned int base = r[in->rn];
+    unsigned int size = (unsigned int)__builtin_popcount(list) * 4;
+    unsigned int addr, writeback;
+    int i;
+
+    switch(in->op & (MEM_P | MEM_U)) {
+        case MEM_U:             /* ia */
+            addr = base;
+            writeback = base + size;
+            break;
+        case MEM_P | MEM_U:     /* ib */
+            addr = base + 4;
+            writeback = base + size;
+            break;
+        case 0:                 /* da */
+            addr = base - size + 4;
+            writeback = base - size;
+            break;
+        default:                /* db */
+            addr = base - size;
+            writeback = addr;
+            break;
+    }
+
+    if(in->op & MEM_L) {
+        /* a loaded base wins over the writeback */
+        if(in->op & MEM_W)
+            r[in->rn] = writeback;
+        for(i = 0; i < 16; i++) {
+            if(list & (1 << i)) {
+                if(!load_word(emu, addr, &r[i]))
+                    return 0;
+                addr += 4;
+            }
+        }
+        return 1;
+    }
+    for(i = 0; i < 16; i++) {
+        if(list & (1 << i)) {
+            if(!store_word(emu, addr, r[i]))
+                return 0;
+            addr += 4;
+        }
+    }
+    if(in->op & MEM_W)
+        r[in->rn] = writeback;
+    return 1;
+}
+
+/*
+Execute block and leave the next pc in r[15].
+Return the number of executed instructions, including the ones whose condition failed.
+*/
+#define LEAVE(next_pc, count) \
+    do { \
+        r[15] = (next_pc); \
+        executed = (count); \
+        goto leave; \
+    } while(0)
+
+static int exec_block(struct Emu *emu, struct EmuBlock *block) {
+    unsigned int *r = emu->r;
+    unsigned int addr = block->pc;
+    unsigned int n = emu->n, z = emu->z, c = emu->c, v = emu->v;
+    unsigned int b, carry, result;
+    int i, executed;
+
+    for(i = 0; i < block->insn_num; i++, addr += 4) {
+        struct EmuInsn *in = &block->insns[i];
+
+        r[15] = addr + 8;
+        if(in->cond != COND_AL && !COND_PASS(in->cond))
+            continue;
+        switch(in->handler) {
+            DP_CASES(EK_DP_IMM, OPERAND_IMM)
+            DP_CASES(EK_DP_REG, OPERAND_REG)
+            DP_CASES(EK_DP_SHIFT_IMM, OPERAND_SHIFT_IMM)
+            DP_CASES(EK_DP_SHIFT_REG, OPERAND_SHIFT_REG)
+            case HANDLER_OTHER(EK_MUL):
+                r[in->rd] = r[in->rm] * r[in->rs];
+                if(in->set_flags) {
+                    SET_NZ(r[in->rd]);
+                }
+                break;
+            case HANDLER_OTHER(EK_MEM_IMM):
+            case HANDLER_OTHER(EK_MEM_REG):
+                if(!exec_mem(emu, in, c)) {
+                    LEAVE(addr, i);
+                }
+                if(emu->invalidate) {
+                    LEAVE(addr + 4, i + 1);
+                }
+                break;
+            case HANDLER_OTHER(EK_MULTI):
+                if(!exec_multi(emu, in)) {
+                    LEAVE(addr, i);
+                }
+                if(emu->invalidate) {
+                    LEAVE(addr + 4, i + 1);
+                }
+                break;
+            case HANDLER_OTHER(EK_BL):
+                r[14] = addr + 4;
+                /* fall through */
+            case HANDLER_OTHER(EK_B):
+                LEAVE(in->imm, i + 1);
+            case HANDLER_OTHER(EK_BLX):
+                b = r[in->rm];
+                r[14] = addr + 4;
+                LEAVE(b & ~1u, i + 1);
+            case HANDLER_OTHER(EK_BX):
+                LEAVE(r[in->rm] & ~1u, i + 1);
+            case HANDLER_OTHER(EK_HALT):
+                emu->status = EMU_HALTED;
+                LEAVE(addr, i + 1);
+            default:
+                emu->status = EMU_UNDEFINED;
+                emu->fault_addr = addr;
+                LEAVE(addr, i);
+        }
+        if(in->writes_pc)
+            LEAVE(r[15] & ~3u, i + 1);
+    }
+    LEAVE(addr, i);
+
+leave:
+    emu->n = n;
+    emu->z = z;
+    emu->c = c;
+    emu->v = v;
+    return executed;
+}
+
+int emu_exec_block(struct Emu *emu, struct EmuBlock *block) {
+    return exec_block(emu, block);
+}
+
+static void trace_block(struct Emu *emu, struct EmuBlock *block, long long at, int executed) {
+    struct EmuTraceEntry *entry = &emu->trace[emu->trace_next & (EMU_TRACE_SIZE - 1)];
+
+    entry->at = at;
+    entry->pc = block->pc;
+    entry->next_pc = emu->r[15];
+    entry->sp = emu->r[13];
+    entry->executed = executed;
+    /* a dump from a signal handler sees the entry complete before it is counted */
+    atomic_signal_fence(memory_order_release);
+    emu->trace_next++;
+}
+
+int emu_run(struct Emu *emu, long long max_insns) {
+    struct EmuBlock *prev = NULL;
+    long long executed = 0;
+    int count;
+
+    emu->status = EMU_RUNNING;
+    while(emu->status == EMU_RUNNING) {
+        unsigned int pc = emu->r[15];
+        struct EmuBlock *block;
+        int slot = 0;
+
+        if(max_insns > 0 && executed >= max_insns) {
+            emu->status = EMU_LIMIT;
+            break;
+        }
+        if(prev != NULL) {
+            slot = pc == prev->pc + prev->insn_num*4;
+            if(prev->succ_pc[slot] == pc && prev->succ[slot] != NULL) {
+                block = prev->succ[slot];
+                goto found;
+            }
+        }
+        block = find_block(emu, pc);
+        if(block == NULL)
+            break;
+        if(prev != NULL) {
+            prev->succ_pc[slot] = pc;
+            prev->succ[slot] = block;
+        }
+found:
+        count = exec_block(emu, block);
+        if(emu->trace_on)
+            trace_block(emu, block, emu->stat.executed + executed, count);
+        executed += count;
+        prev = block;
+        if(emu->invalidate) {
+            emu_flush_cache(emu);
+            prev = NULL;
+        }
+    }
+    emu->stat.executed += executed;
+    return emu->status;
+}
+
+
+/*
+setup
+*/
+
+void emu_init(struct Emu *emu) {
+    memset(emu, 0, sizeof(*emu));
+    init_cond_table();
+    /* pages are mapped on first touch, so startup doesn't depend on the RAM size */
+    emu->ram = mmap(NULL, EMU_RAM_SIZE, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(emu->ram == MAP_FAILED) {
+        fprintf(stderr, "can't allocate %d bytes of RAM\n", EMU_RAM_SIZE);
+        exit(1);
+    }
+    emu->uart = stdout;
+    emu->r[15] = EMU_LOAD_ADDR;
+}
+
+void emu_free(struct Emu *emu) {
+    emu_flush_cache(emu);
+    munmap(emu->ram, EMU_RAM_SIZE);
+    free(emu->trace);
+    emu->trace = NULL;
+}
+
+void emu_set_uart(struct Emu *emu, FILE *uart) {
+    emu->uart = uart;
+}
+
+void emu_load(struct Emu *emu, unsigned char *image, int size) {
+    if(size > EMU_RAM_SIZE - EMU_LOAD_ADDR) {
+        fprintf(stderr, "image of %d bytes doesn't fit in the RAM\n", size);
+        exit(1);
+    }
+    memcpy(emu->ram + EMU_LOAD_ADDR, image, size);
+    emu_flush_cache(emu);
+    emu->r[15] = EMU_LOAD_ADDR;
+}
+
+void emu_trace_enable(struct Emu *emu, int on) {
+    if(on && emu->trace == NULL) {
+        emu->trace = malloc(sizeof(struct EmuTraceEntry)*EMU_TRACE_SIZE);
+        if(emu->trace == NULL) {
+            fprintf(stderr, "can't allocate the trace ring\n");
+            return;
+        }
+    }
+    emu->trace_on = on;
+}
+
+static int write_all(int fd, void *buf, int size) {
+    char *p = buf;
+
+    while(size > 0) {
+        int written = (int)write(fd, p, size);
+        if(written <= 0)
+            return -1;
+        p += written;
+        size -= written;
+    }
+    return 0;
+}
+
+/*
+When the ring is full, the oldest slot is the one being overwritten next,
+it may be half written if we interrupted trace_block, so it is skipped.
+*/
+int emu_trace_dump(struct Emu *emu, int fd) {
+    unsigned int next = emu->trace_next;
+    struct EmuTraceHeader header;
+    unsigned int first, num, i;
+
+    atomic_signal_fence(memory_order_acquire);
+    if(emu->trace == NULL || next == 0)
+        return -1;
+    num = next < EMU_TRACE_SIZE ? next : EMU_TRACE_SIZE - 1;
+    first = next - num;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, EMU_TRACE_MAGIC, sizeof(header.magic));
+    header.entry_num = (int)num;
+    header.status = emu->status;
+    if(write_all(fd, &header, sizeof(header)) != 0)
+        return -1;
+    /* at most two runs, up to the end of the ring and from its start */
+    for(i = first; i != next; ) {
+        unsigned int index = i & (EMU_TRACE_SIZE - 1);
+        unsigned int run = EMU_TRACE_SIZE - index;
+        if(run > next - i)
+            run = next - i;
+        if(write_all(fd, &emu->trace[index], sizeof(struct EmuTraceEntry)*run) != 0)
+            return -1;
+        i += run;
+    }
+    return 0;
+}
+
+const char *emu_status_name(int status) {
+    static const char *names[] = {"running", "halted", "limit", "fault", "undefined instruction"};
+    if(status < EMU_RUNNING || status > EMU_UNDEFINED)
+        return "unknown";
+    return names[status];
+}
+
+#ifndef EMU_NO_MAIN
+
+#include <fcntl.h>
+#include <signal.h>
+
+#include "asm.h"
+
+/*
+test code
+*/
+
+static void assert_true(int boolflag) {
+    if(!boolflag) {
+        printf("assert fail\n");
+    }
+}
+
+static void assert_int_eq(int expect, int actual) {
+    if(expect != actual) {
+        printf("assert fail, expect 0x%08x, actual 0x%08x\n", expect, actual);
+    }
+}
+
+static void assert_str_eq(char *expect, char *actual) {
+    if(strcmp(expect, actual) != 0) {
+        printf("assert fail, expect \"%s\", actual \"%s\"\n", expect, actual);
+    }
+}
+
+/*
+Assemble lines with 05_asm and load them.
+*/
+static void load_lines(struct Emu *emu, char **lines) {
+    struct Assembler as;
+    int *code, word_num, i;
+
+    asm_init(&as, "test");
+    for(i = 0; lines[i] != NULL; i++) {
+        char buf[256];
+        strcpy(buf, lines[i]);
+        asm_one(&as, buf);
+    }
+    code = asm_finish(&as, &word_num);
+    assert_true(code != NULL);
+    if(code != NULL)
+        emu_load(emu, (unsigned char*)code, word_num*4);
+    asm_free(&as);
+}
+
+/*
+Run lines and compare the UART output and the status.
+emu is left for checking registers.
+*/
+static void assert_run(struct Emu *emu, char **lines, char *expect_uart, int expect_status) {
+    char *out;
+    size_t out_len;
+    FILE *uart = open_memstream(&out, &out_len);
+
+    emu_init(emu);
+    emu_set_uart(emu, uart);
+    load_lines(emu, lines);
+    assert_int_eq(expect_status, emu_run(emu, 100000));
+    fclose(uart);
+    assert_str_eq(expect_uart, out);
+    free(out);
+}
+
+static void test_hello_arm() {
+    char *lines[] = {
+        "ldr r0, =0x101f1000",
+        "mov r1, #0x68", "str r1, [r0]",
+        "mov r1, #0x65", "str r1, [r0]",
+        "mov r1, #0x6c", "str r1, [r0]",
+        "mov r1, #0x6c", "str r1, [r0]",
+        "mov r1, #0x6f", "str r1, [r0]",
+        "mov r2, #0x0D", "str r2, [r0]",
+        "mov r2, #0x0A", "str r2, [r0]",
+        "loop:", "b loop",
+        NULL};
+    struct Emu emu;
+
+    assert_run(&emu, lines, "hello\r\n", EMU_HALTED);
+    assert_int_eq(0x101f1000, emu.r[0]);
+    emu_free(&emu);
+}
+
+static void test_print_loop() {
+    char *lines[] = {
+        "ldr r0, =0x101f1000",
+        "ldr r1, =message",
+        "ldrb r3, [r1]",
+        "loop:",
+        "str r3, [r0]",
+        "add r1, r1, #1",
+        "ldrb r3, [r1]",
+        "cmp r3, #0",
+        "bne loop",
+        "end:",
+        "b end",
+        "message:",
+        ".raw \"Hello World\\n\"",
+        NULL};
+    struct Emu emu;
+
+    assert_run(&emu, lines, "Hello World\n", EMU_HALTED);
+    /* the loop body is decoded once */
+    assert_true(emu.stat.blocks_decoded <= 4);
+    emu_free(&emu);
+}
+
+static void test_print_hex() {
+    char *lines[] = {
+        "ldr r1, =0xdeadbeaf",
+        "ldr r0, =0x101f1000",
+        "mov r2, #28",
+        "loop:",
+        "lsr r3, r1, r2",
+        "and r3, r3, #0xf",
+        "cmp r3, #10",
+        "addge r3, r3, #0x57",
+        "addlt r3, r3, #0x30",
+        "str r3, [r0]",
+        "subs r2, r2, #4",
+        "bge loop",
+        "mov r3, #0x0a",
+        "str r3, [r0]",
+        "end:",
+        "b end",
+        NULL};
+    struct Emu emu;
+
+    assert_run(&emu, lines, "deadbeaf\n", EMU_HALTED);
+    emu_free(&emu);
+}
+
+static void test_putchar_mem() {
+    char *lines[] = {
+        "ldr r13, =0x08000000",
+        "ldr r0, =msg1",
+        "bl print",
+        "ldr r0, =msg2",
+        "bl print",
+        "end:",
+        "b end",
+        "putchar:",
+        "ldr r1, =0x101f1000",
+        "str r0, [r1]",
+        "mov r15, r14",
+        "print:",
+        "stmdb r13!, {r4, r14}",
+        "mov r4, r0",
+        "ldrb r0, [r4]",
+        "print_loop:",
+        "bl putchar",
+        "add r4, r4, #1",
+        "ldrb r0, [r4]",
+        "cmp r0, #0",
+        "bne print_loop",
+        "ldmia r13!, {r4, r14}",
+        "mov r15, r14",
+        "msg1:",
+        ".raw \"First text.\\n\"",
+        "msg2:",
+        ".raw \"Second text!\\n\"",
+        NULL};
+    struct Emu emu;
+
+    assert_run(&emu, lines, "First text.\nSecond text!\n", EMU_HALTED);
+    assert_int_eq(0x08000000, emu.r[13]);
+    emu_free(&emu);
+}
+
+static void test_flags() {
+    char *lines[] = {
+        "ldr r0, =0x80000000",
+        "adds r1, r0, r0",
+        "moveq r2, #1",     // z
+        "movcs r3, #1",     // c
+        "movvs r4, #1",     // v
+        "mov r5, #1",
+        "subs r6, r5, #2",
+        "movmi r7, #1",     // n
+        "movcc r8, #1",     // borrow
+        "cmp r5, #1",
+        "movhi r9, #1",     // not taken, z
+        "movls r10, #1",
+        "end:",
+        "b end",
+        NULL};
+    struct Emu emu;
+
+    assert_run(&emu, lines, "", EMU_HALTED);
+    assert_int_eq(0, emu.r[1]);
+    assert_int_eq(1, emu.r[2]);
+    assert_int_eq(1, emu.r[3]);
+    assert_int_eq(1, emu.r[4]);
+    assert_int_eq(-1, emu.r[6]);
+    assert_int_eq(1, emu.r[7]);
+    assert_int_eq(1, emu.r[8]);
+    assert_int_eq(0, emu.r[9]);
+    assert_int_eq(1, emu.r[10]);
+    emu_free(&emu);
+}
+
+static void test_shift_mul() {
+    char *lines[] = {
+        "ldr r0, =0x80000010",
+        "asr r1, r0, #4",
+        "lsrs r2, r0, #5",      // shifts out 1
+        "movcs r3, #1",
+        "mov r4, #7",
+        "mov r5, #6",
+        "mul r6, r4, r5",
+        "mov r7, #36",
+        "lsl r8, r4, r7",       // by register, more than 31
+        "end:",
+        "b end",
+        NULL};
+    struct Emu emu;
+
+    assert_run(&emu, lines, "", EMU_HALTED);
+    assert_int_eq(0xf8000001, emu.r[1]);
+    assert_int_eq(0x04000000, emu.r[2]);
+    assert_int_eq(1, emu.r[3]);
+    assert_int_eq(42, emu.r[6]);
+    assert_int_eq(0, emu.r[8]);
+    emu_free(&emu);
+}
+
+static void test_ldm_stm() {
+    char *lines[] = {
+        "ldr r13, =0x08000000",
+        "mov r0, #1",
+        "mov r1, #2",
+        "mov r2, #3",
+        "stmdb r13!, {r0-r2}",
+        "mov r12, r13",
+        "ldmia r13!, {r4-r6}",
+        "ldr r7, [r12, #4]",
+        "str r7, [r12, #-4]!",
+        "ldr r8, [r12], #8",
+        "end:",
+        "b end",
+        NULL};
+    struct Emu emu;
+
+    assert_run(&emu, lines, "", EMU_HALTED);
+    assert_int_eq(0x08000000, emu.r[13]);
+    assert_int_eq(1, emu.r[4]);
+    assert_int_eq(2, emu.r[5]);
+    assert_int_eq(3, emu.r[6]);
+    assert_int_eq(2, emu.r[7]);
+    assert_int_eq(2, emu.r[8]);
+    assert_int_eq(0x08000000 - 12 - 4 + 8, emu.r[12]);
+    emu_free(&emu);
+}
+
+static void test_bx_blx() {
+    char *lines[] = {
+        "ldr r0, =func",
+        "blx r0",
+        "add r1, r1, #1",
+        "end:",
+        "b end",
+        "func:",
+        "mov r1, #10",
+        "bx r14",
+        NULL};
+    struct Emu emu;
+
+    assert_run(&emu, lines, "", EMU_HALTED);
+    assert_int_eq(11, emu.r[1]);
+    emu_free(&emu);
+}
+
+/*
+The loop patches its own first instruction, the second round runs the new one.
+*/
+static void test_self_modifying() {
+    char *lines[] = {
+        "ldr r0, =patch",
+        "ldr r1, =0xe3a02007",  // mov r2, #7
+        "mov r3, #0",
+        "patch:",
+        "mov r2, #1",
+        "add r3, r3, r2",
+        "str r1, [r0]",
+        "cmp r3, #1",
+        "beq patch",
+        "end:",
+        "b end",
+        NULL};
+    struct Emu emu;
+
+    assert_run(&emu, lines, "", EMU_HALTED);
+    assert_int_eq(8, emu.r[3]);
+    assert_true(emu.stat.cache_flushes >= 2);
+    emu_free(&emu);
+}
+
+static void test_stop() {
+    char *fault_lines[] = {
+        "ldr r0, =0x20000000",
+        "ldr r1, [r0]",
+        "end:",
+        "b end",
+        NULL};
+    char *loop_lines[] = {
+        "loop:",
+        "add r0, r0, #1",
+        "b loop",
+        NULL};
+    char *undefined_lines[] = {
+        "mov r0, #1",
+        ".raw 0xe7f000f0",
+        NULL};
+    struct Emu emu;
+
+    assert_run(&emu, fault_lines, "", EMU_FAULT);
+    assert_int_eq(0x20000000, emu.fault_addr);
+    assert_int_eq(EMU_LOAD_ADDR + 4, emu.r[15]);
+    emu_free(&emu);
+
+    assert_run(&emu, loop_lines, "", EMU_LIMIT);
+    assert_true(emu.stat.executed >= 100000);
+    emu_free(&emu);
+
+    assert_run(&emu, undefined_lines, "", EMU_UNDEFINED);
+    assert_int_eq(EMU_LOAD_ADDR + 4, emu.fault_addr);
+    assert_int_eq(1, emu.r[0]);
+    emu_free(&emu);
+}
+
+static void test_trace() {
+    char *lines[] = {
+        "    mov r0, #0",
+        "    mov r13, #0x8000",
+        "loop:",
+        "    add r0, r0, #1",
+        "    cmp r0, #3",
+        "    bne loop",
+        "    ldr r1, =0x20000000",
+        "    ldr r1, [r1]",
+        NULL};
+    struct EmuTraceHeader header;
+    struct EmuTraceEntry entries[8];
+    struct Emu emu;
+    FILE *fp;
+
+    assert_run(&emu, lines, "", EMU_FAULT);
+    assert_int_eq(0, emu.trace_next);
+    assert_int_eq(-1, emu_trace_dump(&emu, 1));
+    emu_free(&emu);
+
+    emu_init(&emu);
+    load_lines(&emu, lines);
+    emu_trace_enable(&emu, 1);
+    assert_int_eq(EMU_FAULT, emu_run(&emu, 0));
+    /* first block to bne, the loop twice, then the block stopped by the fault */
+    assert_int_eq(4, emu.trace_next);
+    assert_int_eq(EMU_LOAD_ADDR, emu.trace[0].pc);
+    assert_int_eq(5, emu.trace[0].executed);
+    assert_int_eq(EMU_LOAD_ADDR + 8, emu.trace[0].next_pc);
+    assert_int_eq(0x8000, emu.trace[0].sp);
+    assert_int_eq(5, (int)emu.trace[1].at);
+    assert_int_eq(EMU_LOAD_ADDR + 8, emu.trace[2].pc);
+    assert_int_eq(EMU_LOAD_ADDR + 24, emu.trace[3].next_pc);
+    assert_int_eq(1, emu.trace[3].executed);
+
+    fp = tmpfile();
+    assert_int_eq(0, emu_trace_dump(&emu, fileno(fp)));
+    rewind(fp);
+    assert_int_eq(1, (int)fread(&header, sizeof(header), 1, fp));
+    assert_true(memcmp(header.magic, EMU_TRACE_MAGIC, 8) == 0);
+    assert_int_eq(4, header.entry_num);
+    assert_int_eq(EMU_FAULT, header.status);
+    assert_int_eq(4, (int)fread(entries, sizeof(entries[0]), 8, fp));
+    assert_int_eq(EMU_LOAD_ADDR + 8, entries[1].pc);
+    fclose(fp);
+    emu_free(&emu);
+}
+
+static void test_trace_ring_wraps() {
+    char *lines[] = {
+        "loop:",
+        "add r0, r0, #1",
+        "b loop",
+        NULL};
+    struct EmuTraceHeader header;
+    struct EmuTraceEntry last;
+    struct Emu emu;
+    FILE *fp;
+
+    emu_init(&emu);
+    load_lines(&emu, lines);
+    emu_trace_enable(&emu, 1);
+    assert_int_eq(EMU_LIMIT, emu_run(&emu, 2*(EMU_TRACE_SIZE + 10)));
+    assert_int_eq(EMU_TRACE_SIZE + 10, emu.trace_next);
+
+    /* stopped recording, only the flag is checked */
+    emu_trace_enable(&emu, 0);
+    assert_int_eq(EMU_LIMIT, emu_run(&emu, 100));
+    assert_int_eq(EMU_TRACE_SIZE + 10, emu.trace_next);
+
+    fp = tmpfile();
+    assert_int_eq(0, emu_trace_dump(&emu, fileno(fp)));
+    rewind(fp);
+    assert_int_eq(1, (int)fread(&header, sizeof(header), 1, fp));
+    assert_int_eq(EMU_TRACE_SIZE - 1, header.entry_num);
+    fseek(fp, sizeof(last)*(header.entry_num - 1), SEEK_CUR);
+    assert_int_eq(1, (int)fread(&last, sizeof(last), 1, fp));
+    assert_int_eq(2*(EMU_TRACE_SIZE + 9), (int)last.at);
+    fclose(fp);
+    emu_free(&emu);
+}
+
+static void run_unit_tests() {
+    test_hello_arm();
+    test_print_loop();
+    test_print_hex();
+    test_putchar_mem();
+    test_flags();
+    test_shift_mul();
+    test_ldm_stm();
+    test_bx_blx();
+    test_self_modifying();
+    test_stop();
+    test_trace();
+    test_trace_ring_wraps();
+}
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static unsigned char *read_file(char *path, int *out_size) {
+    FILE *fp = fopen(path, "rb");
+    unsigned char *buf;
+    long size;
+
+    if(fp == NULL) {
+        fprintf(stderr, "can't open %s\n", path);
+        exit(1);
+    }
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    rewind(fp);
+    buf = malloc(size > 0 ? size : 1);
+    if(fread(buf, 1, size, fp) != (size_t)size) {
+        fprintf(stderr, "can't read %s\n", path);
+        exit(1);
+    }
+    fclose(fp);
+    *out_size = (int)size;
+    return buf;
+}
+
+static struct Emu emu;
+static int trace_fd = -1;
+
+static void dump_trace_on_signal(int sig) {
+    (void)sig;
+    emu_trace_dump(&emu, trace_fd);
+}
+
+int main(int argc, char **argv) {
+    unsigned char *image;
+    long long limit = 0;
+    int size, status, stat = 0;
+    double begin, elapsed;
+
+    while(argc >= 2 && argv[1][0] == '-') {
+        if(strcmp(argv[1], "-stat") == 0) {
+            stat = 1;
+        } else if(strcmp(argv[1], "-limit") == 0 && argc >= 3) {
+            limit = atoll(argv[2]);
+            argv++;
+            argc--;
+        } else if(strcmp(argv[1], "-trace") == 0 && argc >= 3) {
+            trace_fd = open(argv[2], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if(trace_fd < 0) {
+                fprintf(stderr, "can't open %s\n", argv[2]);
+                exit(1);
+            }
+            argv++;
+            argc--;
+        } else {
+            fprintf(stderr, "usage: emu [-stat] [-limit N] [-trace out.trace] prog.bin\n");
+            exit(1);
+        }
+        argv++;
+        argc--;
+    }
+    if(argc < 2) {
+        run_unit_tests();
+        return 0;
+    }
+
+    begin = now_sec();
+    image = read_file(argv[1], &size);
+    emu_init(&emu);
+    emu_load(&emu, image, size);
+    if(trace_fd >= 0) {
+        emu_trace_enable(&emu, 1);
+        signal(SIGUSR1, dump_trace_on_signal);
+    }
+    status = emu_run(&emu, limit);
+    fflush(stdout);
+    elapsed = now_sec() - begin;
+
+    if(stat) {
+        fprintf(stderr, "%s: %lld instructions, %d blocks decoded, %.1f usec, %.1f MIPS\n",
+                emu_status_name(status), emu.stat.executed, emu.stat.blocks_decoded,
+                elapsed*1e6, emu.stat.executed/elapsed/1e6);
+    }
+    if(status == EMU_FAULT || status == EMU_UNDEFINED) {
+        fprintf(stderr, "%s at 0x%08x (pc 0x%08x)\n", emu_status_name(status), emu.fault_addr, emu.r[15]);
+        if(trace_fd >= 0)
+            emu_trace_dump(&emu, trace_fd);
+        exit(1);
+    }
+    emu_free(&emu);
+    free(image);
+    return 0;
+}
+
+#endif
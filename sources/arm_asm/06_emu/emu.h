@@ -0,0 +1,183 @@
+/*
+ARM32 interpreter of arm_asm.md chapter 06.
+
+Runs the lesson binaries without qemu: the memory of versatilepb from 0,
+the image loaded at EMU_LOAD_ADDR, and the UART data register at EMU_UART_DR.
+Only the instructions of the lessons are supported:
+data processing, mul, ldr/str(b), ldm/stm, b/bl and bx/blx.
+
+Instructions are decoded once per basic block and the blocks are cached by PC.
+*/
+#include <stdio.h>
+
+#define EMU_LOAD_ADDR 0x00010000
+#define EMU_UART_DR 0x101f1000
+#define EMU_RAM_SIZE (128*1024*1024)
+#define EMU_PAGE_SHIFT 12
+
+/* buckets of the block cache, power of 2 */
+#define EMU_CACHE_SIZE 4096
+#define EMU_BLOCK_MAX 64
+
+enum EmuStatus {
+    EMU_RUNNING,
+    EMU_HALTED,         /* reached "end: b end" */
+    EMU_LIMIT,          /* executed the given number of instructions */
+    EMU_FAULT,          /* access outside of the RAM and the UART */
+    EMU_UNDEFINED       /* instruction out of the supported subset */
+};
+
+enum EmuKind {
+    EK_DP_IMM,
+    EK_DP_REG,          /* register without shift */
+    EK_DP_SHIFT_IMM,
+    EK_DP_SHIFT_REG,
+    EK_MUL,
+    EK_MEM_IMM,
+    EK_MEM_REG,
+    EK_MULTI,
+    EK_B,
+    EK_BL,
+    EK_BX,
+    EK_BLX,
+    EK_HALT,
+    EK_UNDEFINED
+};
+
+/*
+One predecoded instruction.
+imm is the rotated immediate, the memory offset, the register list,
+or the branch target.
+*/
+struct EmuInsn {
+    unsigned char handler;      /* case of the execute switch */
+    unsigned char kind;
+    unsigned char cond;
+    unsigned char op;           /* data processing opcode, P/U/B/W/L bits of memory */
+    unsigned char set_flags;
+    unsigned char rd, rn, rm, rs;
+    unsigned char shift, shift_amount;
+    unsigned char imm_carry;    /* rotated immediate: carry out is bit 31 */
+    unsigned char writes_pc;    /* data processing or load to pc, ends the block */
+    unsigned int imm;
+};
+
+struct EmuBlock {
+    unsigned int pc;
+    int insn_num;
+    struct EmuBlock *next;      /* in the same bucket */
+    /* last successor by fall through [1] or jump [0], to skip the lookup */
+    unsigned int succ_pc[2];
+    struct EmuBlock *succ[2];
+    struct EmuInsn insns[];
+};
+
+/* entries of the trace ring, power of 2 */
+#define EMU_TRACE_SIZE 4096
+#define EMU_TRACE_MAGIC "EMUTRACE"
+
+/*
+One executed block, in the trace ring and in the dump.
+*/
+struct EmuTraceEntry {
+    long long at;           /* instructions executed before the block */
+    unsigned int pc;        /* first pc of the block */
+    unsigned int next_pc;   /* r15 after the block, the faulting pc if it stopped inside */
+    unsigned int sp;        /* r13 after the block */
+    int executed;           /* instructions of the block actually executed */
+};
+
+/*
+A dump is this header followed by entry_num entries from the oldest.
+Each dump is appended, so a file may have several.
+*/
+struct EmuTraceHeader {
+    char magic[8];
+    int entry_num;
+    int status;
+};
+
+struct EmuStat {
+    long long executed;
+    int blocks_decoded;
+    int cache_flushes;
+};
+
+struct Emu {
+    unsigned int r[16];
+    unsigned int n, z, c, v;
+    unsigned char *ram;
+    FILE *uart;
+    int status;
+    unsigned int fault_addr;
+    int invalidate;
+
+    struct EmuBlock *cache[EMU_CACHE_SIZE];
+    /* 1 if some block was decoded from the page */
+    unsigned char code_pages[EMU_RAM_SIZE >> EMU_PAGE_SHIFT];
+    struct EmuStat stat;
+
+    /* see emu_trace_enable */
+    int trace_on;
+    struct EmuTraceEntry *trace;
+    unsigned int trace_next;    /* entries ever written, the ring index is trace_next % EMU_TRACE_SIZE */
+};
+
+/*
+Allocate the RAM and write the UART to stdout.
+*/
+void emu_init(struct Emu *emu);
+void emu_free(struct Emu *emu);
+void emu_set_uart(struct Emu *emu, FILE *uart);
+
+/*
+Copy image to EMU_LOAD_ADDR and set pc to it.
+*/
+void emu_load(struct Emu *emu, unsigned char *image, int size);
+
+/*
+Run until the first block boundary at or after max_insns instructions (0 for no limit).
+The limit is checked between blocks, so a run may go over it by up to EMU_BLOCK_MAX - 1.
+Return the status, EMU_HALTED if the program reached its end loop.
+*/
+int emu_run(struct Emu *emu, long long max_insns);
+
+/*
+Drop every decoded block, e.g. after writing code from outside.
+*/
+void emu_flush_cache(struct Emu *emu);
+
+/*
+Name of an EmuStatus for messages, "unknown" for a value out of it.
+*/
+const char *emu_status_name(int status);
+
+/*
+Start or stop recording each executed block to the ring of the last EMU_TRACE_SIZE blocks.
+emu_run checks one flag per block, so a disabled trace costs nothing measurable.
+*/
+void emu_trace_enable(struct Emu *emu, int on);
+
+/*
+Write the ring to fd from the oldest entry, only with write(2),
+so that a signal handler interrupting emu_run may call it.
+Return 0 on success, -1 if nothing was recorded or the write failed.
+*/
+int emu_trace_dump(struct Emu *emu, int fd);
+
+/*
+For the translator of dbt.c, which falls back to the interpreter
+for the instructions it doesn't translate.
+*/
+
+/* Decode word at addr, a block ends after in if in->writes_pc or in->kind >= EK_B. */
+void emu_decode(unsigned int word, unsigned int addr, struct EmuInsn *in);
+
+/* Condition cond of flags nzcv = n<<3 | z<<2 | c<<1 | v. */
+int emu_cond_pass(int cond, int nzcv);
+
+/*
+Execute block, which needs not be in the cache.
+Return the number of executed instructions and leave the next pc in r[15].
+*/
+int emu_exec_block(struct Emu *emu, struct EmuBlock *block);
@@ -0,0 +1,242 @@
+/*
+Print the trace dumps of emu -trace.
+
+gcc -O2 -pthread -DEMU_NO_MAIN -DDISASM_NO_MAIN -I../04_disasm trace_decode.c emu.c ../04_disasm/disasm.c ../04_disasm/cl_utils.c -o trace_decode
+./trace_decode                      # run unit tests
+./trace_decode loop.trace           # one line per block, the oldest first
+./trace_decode loop.trace loop.bin  # with the disassembly of each block
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "disasm.h"
+#include "emu.h"
+
+static void print_word(unsigned char *image, int size, unsigned int addr, char *mark, FILE *out) {
+    char buf[DISASM_LINE_MAX];
+    unsigned int offset = addr - EMU_LOAD_ADDR;
+    int word;
+
+    if(addr < EMU_LOAD_ADDR || offset + 4 > (unsigned int)size) {
+        fprintf(out, "    0x%08x  (out of the image)%s\n", addr, mark);
+        return;
+    }
+    memcpy(&word, image + offset, 4);
+    if(!disasm_word(word, buf))
+        sprintf(buf, ".raw 0x%08x", word);
+    fprintf(out, "    0x%08x  %s%s\n", addr, buf, mark);
+}
+
+static void print_entry(struct EmuTraceEntry *entry, unsigned char *image, int size, FILE *out) {
+    int i;
+
+    fprintf(out, "%12lld  0x%08x  %3d  -> 0x%08x  sp 0x%08x\n",
+            entry->at, entry->pc, entry->executed, entry->next_pc, entry->sp);
+    if(image == NULL)
+        return;
+    for(i = 0; i < entry->executed; i++)
+        print_word(image, size, entry->pc + 4*i, "", out);
+}
+
+/*
+Print every dump of in. image is the program for the disassembly, or NULL.
+Return the number of dumps, or -1 if in is not a trace.
+*/
+static int decode_trace(FILE *in, unsigned char *image, int size, FILE *out) {
+    struct EmuTraceHeader header;
+    struct EmuTraceEntry entry;
+    int dump_num = 0;
+    int i;
+
+    while(fread(&header, sizeof(header), 1, in) == 1) {
+        if(memcmp(header.magic, EMU_TRACE_MAGIC, sizeof(header.magic)) != 0 || header.entry_num < 0
+           || header.status < EMU_RUNNING || header.status > EMU_UNDEFINED) {
+            fprintf(stderr, "not a trace dump at dump %d\n", dump_num + 1);
+            return -1;
+        }
+        dump_num++;
+        fprintf(out, "dump %d: last %d blocks, %s\n", dump_num, header.entry_num, emu_status_name(header.status));
+        fprintf(out, "%12s  %-10s  %3s     %-10s  %s\n", "insns", "pc", "n", "next", "sp");
+        for(i = 0; i < header.entry_num; i++) {
+            if(fread(&entry, sizeof(entry), 1, in) != 1) {
+                fprintf(stderr, "dump %d is truncated\n", dump_num);
+                return -1;
+            }
+            print_entry(&entry, image, size, out);
+            /* where a faulting run stopped, inside its last block */
+            if(image != NULL && i == header.entry_num - 1 &&
+               (header.status == EMU_FAULT || header.status == EMU_UNDEFINED))
+                print_word(image, size, entry.next_pc, "    <- stopped here", out);
+        }
+    }
+    return dump_num;
+}
+
+static unsigned char *read_file(char *path, int *out_size) {
+    FILE *fp = fopen(path, "rb");
+    unsigned char *buf;
+    long size;
+
+    if(fp == NULL) {
+        fprintf(stderr, "can't open %s\n", path);
+        exit(1);
+    }
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    rewind(fp);
+    buf = malloc(size > 0 ? size : 1);
+    if(fread(buf, 1, size, fp) != (size_t)size) {
+        fprintf(stderr, "can't read %s\n", path);
+        exit(1);
+    }
+    fclose(fp);
+    *out_size = (int)size;
+    return buf;
+}
+
+
+
+/*
+test code
+*/
+
+static void assert_true(int boolflag) {
+    if(!boolflag) {
+        printf("assert fail\n");
+    }
+}
+
+static void assert_int_eq(int expect, int actual) {
+    if(expect != actual) {
+        printf("assert fail, expect %d, actual %d\n", expect, actual);
+    }
+}
+
+static void assert_str_eq(char *expect, char *actual) {
+    if(strcmp(expect, actual) != 0) {
+        printf("assert fail, expect\n%s\nactual\n%s\n", expect, actual);
+    }
+}
+
+static void write_dump(FILE *fp, struct EmuTraceEntry *entries, int num, int status) {
+    struct EmuTraceHeader header;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, EMU_TRACE_MAGIC, sizeof(header.magic));
+    header.entry_num = num;
+    header.status = status;
+    fwrite(&header, sizeof(header), 1, fp);
+    fwrite(entries, sizeof(entries[0]), num, fp);
+}
+
+static void assert_decode(FILE *in, unsigned char *image, int size, int expect_num, char *expect) {
+    char *text = NULL;
+    size_t len = 0;
+    FILE *out = open_memstream(&text, &len);
+
+    rewind(in);
+    assert_int_eq(expect_num, decode_trace(in, image, size, out));
+    fclose(out);
+    assert_str_eq(expect, text);
+    free(text);
+}
+
+static void test_decode() {
+    /* mov r0, #1; ldr r1, [r2]; b the first */
+    unsigned int image[] = {0xe3a00001, 0xe5921000, 0xeafffffc};
+    struct EmuTraceEntry entries[] = {
+        {0, EMU_LOAD_ADDR, EMU_LOAD_ADDR, 0x8000, 3},
+        {3, EMU_LOAD_ADDR, EMU_LOAD_ADDR + 4, 0x8000, 1}
+    };
+    FILE *fp = tmpfile();
+
+    write_dump(fp, entries, 1, EMU_RUNNING);
+    write_dump(fp, entries, 2, EMU_FAULT);
+    assert_decode(fp, NULL, 0, 2,
+        "dump 1: last 1 blocks, running\n"
+        "       insns  pc            n     next        sp\n"
+        "           0  0x00010000    3  -> 0x00010000  sp 0x00008000\n"
+        "dump 2: last 2 blocks, fault\n"
+        "       insns  pc            n     next        sp\n"
+        "           0  0x00010000    3  -> 0x00010000  sp 0x00008000\n"
+        "           3  0x00010000    1  -> 0x00010004  sp 0x00008000\n");
+
+    rewind(fp);
+    write_dump(fp, entries + 1, 1, EMU_FAULT);
+    assert_decode(fp, (unsigned char*)image, sizeof(image), 2,
+        "dump 1: last 1 blocks, fault\n"
+        "       insns  pc            n     next        sp\n"
+        "           3  0x00010000    1  -> 0x00010004  sp 0x00008000\n"
+        "    0x00010000  mov r0, #0x1\n"
+        "    0x00010004  ldr r1, [r2]    <- stopped here\n"
+        "dump 2: last 2 blocks, fault\n"
+        "       insns  pc            n     next        sp\n"
+        "           0  0x00010000    3  -> 0x00010000  sp 0x00008000\n"
+        "    0x00010000  mov r0, #0x1\n"
+        "    0x00010004  ldr r1, [r2]\n"
+        "    0x00010008  b [r15, #-0x10]\n"
+        "           3  0x00010000    1  -> 0x00010004  sp 0x00008000\n"
+        "    0x00010000  mov r0, #0x1\n"
+        "    0x00010004  ldr r1, [r2]    <- stopped here\n");
+    fclose(fp);
+}
+
+static void test_decode_broken() {
+    struct EmuTraceEntry entries[2];
+    FILE *fp = tmpfile();
+
+    memset(entries, 0, sizeof(entries));
+    write_dump(fp, entries, 2, EMU_LIMIT);
+    fflush(fp);
+    assert_true(ftruncate(fileno(fp), sizeof(struct EmuTraceHeader) + sizeof(entries[0])) == 0);
+    assert_decode(fp, NULL, 0, -1,
+        "dump 1: last 2 blocks, limit\n"
+        "       insns  pc            n     next        sp\n"
+        "           0  0x00000000    0  -> 0x00000000  sp 0x00000000\n");
+    fclose(fp);
+
+    /* a header whose status is out of EmuStatus */
+    fp = tmpfile();
+    write_dump(fp, entries, 0, EMU_RUNNING);
+    write_dump(fp, entries, 0, EMU_UNDEFINED + 1);
+    assert_decode(fp, NULL, 0, -1,
+        "dump 1: last 0 blocks, running\n"
+        "       insns  pc            n     next        sp\n");
+    fclose(fp);
+    assert_str_eq("unknown", (char*)emu_status_name(EMU_UNDEFINED + 1));
+    assert_str_eq("unknown", (char*)emu_status_name(-1));
+
+    fp = tmpfile();
+    fputs("not a trace file, but long enough", fp);
+    assert_decode(fp, NULL, 0, -1, "");
+    fclose(fp);
+}
+
+static void run_unit_tests() {
+    test_decode();
+    test_decode_broken();
+}
+
+int main(int argc, char **argv) {
+    unsigned char *image = NULL;
+    int size = 0;
+    FILE *in;
+
+    if(argc < 2) {
+        run_unit_tests();
+        return 0;
+    }
+    in = fopen(argv[1], "rb");
+    if(in == NULL) {
+        fprintf(stderr, "can't open %s\n", argv[1]);
+        return 1;
+    }
+    if(argc >= 3)
+        image = read_file(argv[2], &size);
+    if(decode_trace(in, image, size, stdout) < 0)
+        return 1;
+    fclose(in);
+    free(image);
+    return 0;
+}
@@ -0,0 +1,270 @@
+/*
+Writer of ELF32 ARM relocatable objects.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "elf_obj.h"
+
+void obj_init(struct ObjWriter *w) {
+    memset(w, 0, sizeof(*w));
+    /* section 0 is the null section of ELF */
+    w->section_num = 1;
+}
+
+void obj_free(struct ObjWriter *w) {
+    int i;
+
+    for(i = 1; i < w->section_num; i++) {
+        free(w->sections[i].name);
+        free(w->sections[i].data);
+        free(w->sections[i].rels);
+    }
+    for(i = 0; i < w->symbol_num; i++)
+        free(w->symbols[i].name);
+    free(w->symbols);
+}
+
+int obj_add_section(struct ObjWriter *w, char *name, int type, int flags, int align) {
+    struct ObjSection *sec;
+
+    if(w->section_num == OBJ_SECTION_MAX) {
+        fprintf(stderr, "too many sections\n");
+        exit(1);
+    }
+    sec = &w->sections[w->section_num];
+    memset(sec, 0, sizeof(*sec));
+    sec->name = strdup(name);
+    sec->type = type;
+    sec->flags = flags;
+    sec->align = align;
+    return w->section_num++;
+}
+
+int obj_append(struct ObjWriter *w, int section, const void *data, int size, int align) {
+    struct ObjSection *sec = &w->sections[section];
+    int offset = (sec->size + align - 1) & ~(align - 1);
+
+    if(align > sec->align)
+        sec->align = align;
+    if(sec->type != SHT_NOBITS) {
+        if(offset + size > sec->capacity) {
+            sec->capacity = (offset + size)*2 + 64;
+            sec->data = realloc(sec->data, sec->capacity);
+        }
+        memset(sec->data + sec->size, 0, offset - sec->size);
+        if(data != NULL)
+            memcpy(sec->data + offset, data, size);
+        else
+            memset(sec->data + offset, 0, size);
+    }
+    sec->size = offset + size;
+    return offset;
+}
+
+int obj_add_symbol(struct ObjWriter *w, char *name, int bind, int type, int shndx,
+                   unsigned int value, unsigned int size) {
+    struct ObjSymbol *sym;
+
+    if(w->symbol_num == w->symbol_capacity) {
+        w->symbol_capacity = w->symbol_capacity*2 + 16;
+        w->symbols = realloc(w->symbols, sizeof(struct ObjSymbol)*w->symbol_capacity);
+    }
+    sym = &w->symbols[w->symbol_num];
+    sym->name = strdup(name);
+    sym->bind = bind;
+    sym->type = type;
+    sym->shndx = shndx;
+    sym->value = value;
+    sym->size = size;
+    return w->symbol_num++;
+}
+
+void obj_add_rel(struct ObjWriter *w, int section, unsigned int offset, int symbol, int type) {
+    struct ObjSection *sec = &w->sections[section];
+
+    if(sec->rel_num == sec->rel_capacity) {
+        sec->rel_capacity = sec->rel_capacity*2 + 16;
+        sec->rels = realloc(sec->rels, sizeof(Elf32_Rel)*sec->rel_capacity);
+    }
+    sec->rels[sec->rel_num].r_offset = offset;
+    sec->rels[sec->rel_num].r_info = ELF32_R_INFO(symbol, type);
+    sec->rel_num++;
+}
+
+
+/*
+write
+*/
+
+struct StrTab {
+    char *buf;
+    int size;
+    int capacity;
+};
+
+static int strtab_add(struct StrTab *st, char *str) {
+    int len = strlen(str) + 1;
+    int offset = st->size;
+
+    if(st->size + len > st->capacity) {
+        st->capacity = (st->size + len)*2 + 64;
+        st->buf = realloc(st->buf, st->capacity);
+    }
+    memcpy(st->buf + st->size, str, len);
+    st->size += len;
+    return offset;
+}
+
+static void write_at(FILE *fp, long offset, const void *data, size_t size) {
+    fseek(fp, offset, SEEK_SET);
+    fwrite(data, 1, size, fp);
+}
+
+static long align_offset(long offset, int align) {
+    return align <= 1 ? offset : (offset + align - 1) & ~(long)(align - 1);
+}
+
+int obj_write(struct ObjWriter *w, char *path) {
+    FILE *fp = fopen(path, "wb");
+    Elf32_Ehdr eh;
+    Elf32_Shdr *shdrs;
+    Elf32_Sym *syms;
+    struct StrTab strtab = {NULL, 0, 0}, shstrtab = {NULL, 0, 0};
+    int *sym_index = malloc(sizeof(int)*(w->symbol_num + 1));
+    int rel_num = 0, shnum, symtab_index, strtab_index, shstrtab_index;
+    int first_global, sym_num, i, j, k;
+    long offset;
+
+    if(fp == NULL) {
+        free(sym_index);
+        return -1;
+    }
+    for(i = 1; i < w->section_num; i++)
+        if(w->sections[i].rel_num > 0)
+            rel_num++;
+    symtab_index = w->section_num + rel_num;
+    strtab_index = symtab_index + 1;
+    shstrtab_index = symtab_index + 2;
+    shnum = symtab_index + 3;
+    shdrs = calloc(shnum, sizeof(Elf32_Shdr));
+
+    /* symbols: null, locals, globals */
+    syms = calloc(w->symbol_num + 1, sizeof(Elf32_Sym));
+    strtab_add(&strtab, "");
+    sym_num = 1;
+    for(k = 0; k < 2; k++) {
+        if(k == 1)
+            first_global = sym_num;
+        for(i = 0; i < w->symbol_num; i++) {
+            struct ObjSymbol *s = &w->symbols[i];
+            if((s->bind == STB_LOCAL) != (k == 0))
+                continue;
+            syms[sym_num].st_name = strtab_add(&strtab, s->name);
+            syms[sym_num].st_value = s->value;
+            syms[sym_num].st_size = s->size;
+            syms[sym_num].st_info = ELF32_ST_INFO(s->bind, s->type);
+            syms[sym_num].st_shndx = s->shndx;
+            sym_index[i] = sym_num++;
+        }
+    }
+
+    strtab_add(&shstrtab, "");
+    offset = sizeof(Elf32_Ehdr);
+    for(i = 1; i < w->section_num; i++) {
+        struct ObjSection *sec = &w->sections[i];
+        Elf32_Shdr *sh = &shdrs[i];
+        sh->sh_name = strtab_add(&shstrtab, sec->name);
+        sh->sh_type = sec->type;
+        sh->sh_flags = sec->flags;
+        sh->sh_addralign = sec->align;
+        sh->sh_size = sec->size;
+        offset = align_offset(offset, sec->align);
+        sh->sh_offset = offset;
+        if(sec->type != SHT_NOBITS) {
+            write_at(fp, offset, sec->data, sec->size);
+            offset += sec->size;
+        }
+    }
+    for(i = 1, j = w->section_num; i < w->section_num; i++) {
+        struct ObjSection *sec = &w->sections[i];
+        Elf32_Shdr *sh;
+        char name[256];
+        if(sec->rel_num == 0)
+            continue;
+        sh = &shdrs[j++];
+        snprintf(name, sizeof(name), ".rel%s", sec->name);
+        sh->sh_name = strtab_add(&shstrtab, name);
+        sh->sh_type = SHT_REL;
+        sh->sh_flags = SHF_INFO_LINK;
+        sh->sh_link = symtab_index;
+        sh->sh_info = i;
+        sh->sh_entsize = sizeof(Elf32_Rel);
+        sh->sh_addralign = 4;
+        sh->sh_size = sizeof(Elf32_Rel)*sec->rel_num;
+        offset = align_offset(offset, 4);
+        sh->sh_offset = offset;
+        for(k = 0; k < sec->rel_num; k++) {
+            Elf32_Rel rel = sec->rels[k];
+            rel.r_info = ELF32_R_INFO(sym_index[ELF32_R_SYM(rel.r_info)], ELF32_R_TYPE(rel.r_info));
+            write_at(fp, offset, &rel, sizeof(rel));
+            offset += sizeof(rel);
+        }
+    }
+
+    shdrs[symtab_index].sh_name = strtab_add(&shstrtab, ".symtab");
+    shdrs[symtab_index].sh_type = SHT_SYMTAB;
+    shdrs[symtab_index].sh_link = strtab_index;
+    shdrs[symtab_index].sh_info = first_global;
+    shdrs[symtab_index].sh_entsize = sizeof(Elf32_Sym);
+    shdrs[symtab_index].sh_addralign = 4;
+    shdrs[symtab_index].sh_size = sizeof(Elf32_Sym)*sym_num;
+    offset = align_offset(offset, 4);
+    shdrs[symtab_index].sh_offset = offset;
+    write_at(fp, offset, syms, sizeof(Elf32_Sym)*sym_num);
+    offset += sizeof(Elf32_Sym)*sym_num;
+
+    shdrs[strtab_index].sh_name = strtab_add(&shstrtab, ".strtab");
+    shdrs[strtab_index].sh_type = SHT_STRTAB;
+    shdrs[strtab_index].sh_addralign = 1;
+    shdrs[strtab_index].sh_size = strtab.size;
+    shdrs[strtab_index].sh_offset = offset;
+    write_at(fp, offset, strtab.buf, strtab.size);
+    offset += strtab.size;
+
+    shdrs[shstrtab_index].sh_name = strtab_add(&shstrtab, ".shstrtab");
+    shdrs[shstrtab_index].sh_type = SHT_STRTAB;
+    shdrs[shstrtab_index].sh_addralign = 1;
+    shdrs[shstrtab_index].sh_size = shstrtab.size;
+    shdrs[shstrtab_index].sh_offset = offset;
+    write_at(fp, offset, shstrtab.buf, shstrtab.size);
+    offset += shstrtab.size;
+
+    offset = align_offset(offset, 4);
+    write_at(fp, offset, shdrs, sizeof(Elf32_Shdr)*shnum);
+
+    memset(&eh, 0, sizeof(eh));
+    memcpy(eh.e_ident, ELFMAG, SELFMAG);
+    eh.e_ident[EI_CLASS] = ELFCLASS32;
+    eh.e_ident[EI_DATA] = ELFDATA2LSB;
+    eh.e_ident[EI_VERSION] = EV_CURRENT;
+    eh.e_type = ET_REL;
+    eh.e_machine = EM_ARM;
+    eh.e_version = EV_CURRENT;
+    eh.e_flags = EF_ARM_EABI_VER5;
+    eh.e_ehsize = sizeof(Elf32_Ehdr);
+    eh.e_shentsize = sizeof(Elf32_Shdr);
+    eh.e_shoff = offset;
+    eh.e_shnum = shnum;
+    eh.e_shstrndx = shstrtab_index;
+    write_at(fp, 0, &eh, sizeof(eh));
+
+    fclose(fp);
+    free(shdrs);
+    free(syms);
+    free(sym_index);
+    free(strtab.buf);
+    free(shstrtab.buf);
+    return 0;
+}
@@ -0,0 +1,66 @@
+/*
+Writer of ELF32 ARM relocatable objects, for the tests and the benchmark of mini_ld.
+
+Sections and symbols are added in any order, locals are moved before globals on write.
+Relocations are REL, the addend is the value already in the section.
+*/
+#include <elf.h>
+
+#define OBJ_SECTION_MAX 16
+
+struct ObjSection {
+    char *name;
+    int type;
+    int flags;
+    int align;
+    unsigned char *data;    /* NULL for SHT_NOBITS */
+    int size;
+    int capacity;
+
+    Elf32_Rel *rels;        /* r_info holds the symbol id of obj_add_symbol */
+    int rel_num;
+    int rel_capacity;
+};
+
+struct ObjSymbol {
+    char *name;
+    int bind;
+    int type;
+    int shndx;              /* section id of obj_add_section, or SHN_UNDEF, SHN_COMMON, SHN_ABS */
+    unsigned int value;
+    unsigned int size;
+};
+
+struct ObjWriter {
+    struct ObjSection sections[OBJ_SECTION_MAX];
+    int section_num;
+    struct ObjSymbol *symbols;
+    int symbol_num;
+    int symbol_capacity;
+};
+
+void obj_init(struct ObjWriter *w);
+void obj_free(struct ObjWriter *w);
+
+/*
+Return the section id, which is also its index in the written file.
+*/
+int obj_add_section(struct ObjWriter *w, char *name, int type, int flags, int align);
+
+/*
+Append size bytes (zeros if data is NULL) aligned to align, return their offset.
+*/
+int obj_append(struct ObjWriter *w, int section, const void *data, int size, int align);
+
+/*
+Return the symbol id to use in obj_add_rel.
+*/
+int obj_add_symbol(struct ObjWriter *w, char *name, int bind, int type, int shndx,
+                   unsigned int value, unsigned int size);
+
+void obj_add_rel(struct ObjWriter *w, int section, unsigned int offset, int symbol, int type);
+
+/*
+Return 0 on success, -1 if path can't be written.
+*/
+int obj_write(struct ObjWriter *w, char *path);
@@ -0,0 +1,213 @@
+/*
+Link time of many generated objects, by mini_ld and by the ARM ld found in PATH.
+
+gcc -O2 -pthread -DMINI_LD_NO_MAIN link_bench.c mini_ld.c elf_obj.c -o link_bench
+./link_bench [objects] [functions per object]
+
+Every function calls a function of the next object (R_ARM_CALL), jumps to itself (R_ARM_JUMP24)
+and loads the address of a data word (R_ARM_ABS32), every data word points to a function,
+and every object has its own .bss buffer and the same COMMON symbols.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "elf_obj.h"
+#include "mini_ld.h"
+
+#define BENCH_REPEAT 5
+#define BENCH_BSS_SIZE 4096
+#define BENCH_COMMON_NUM 16
+
+static char *linkers[] = {
+    "arm-linux-gnueabi-ld",
+    "arm-none-eabi-ld",
+    "arm-linux-gnueabihf-ld",
+    "ld.lld",
+    "ld.lld-14",
+    "rust-lld -flavor gnu",
+};
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static void write_object(char *path, int obj, int obj_num, int func_num) {
+    struct ObjWriter w;
+    int text, data, bss, i;
+    char name[64];
+    int *funcs = malloc(sizeof(int)*func_num);
+    int *nexts = malloc(sizeof(int)*func_num);
+    int *words = malloc(sizeof(int)*func_num);
+    unsigned int body[] = {
+        0xe92d4000,     /* push {lr} */
+        0xebfffffe,     /* bl f_<obj+1>_<i> */
+        0xe59f0004,     /* ldr r0, [pc, #4] */
+        0xe8bd8000,     /* pop {pc} */
+        0xeafffffe,     /* b f_<obj>_<i> */
+        0x00000000,     /* .word d_<obj>_<i> */
+    };
+    unsigned int zero = 0;
+
+    obj_init(&w);
+    text = obj_add_section(&w, ".text", SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, 4);
+    data = obj_add_section(&w, ".data", SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, 4);
+    bss = obj_add_section(&w, ".bss", SHT_NOBITS, SHF_ALLOC | SHF_WRITE, 8);
+
+    for(i = 0; i < func_num; i++) {
+        int offset = obj_append(&w, text, body, sizeof(body), 4);
+        snprintf(name, sizeof(name), "f_%d_%d", obj, i);
+        funcs[i] = obj_add_symbol(&w, name, STB_GLOBAL, STT_FUNC, text, offset, sizeof(body));
+        snprintf(name, sizeof(name), "f_%d_%d", (obj + 1) % obj_num, i);
+        nexts[i] = obj_num == 1 ? funcs[i] : obj_add_symbol(&w, name, STB_GLOBAL, STT_NOTYPE, SHN_UNDEF, 0, 0);
+        offset = obj_append(&w, data, &zero, 4, 4);
+        snprintf(name, sizeof(name), "d_%d_%d", obj, i);
+        words[i] = obj_add_symbol(&w, name, STB_GLOBAL, STT_OBJECT, data, offset, 4);
+        obj_add_rel(&w, data, offset, funcs[i], R_ARM_ABS32);
+    }
+    for(i = 0; i < func_num; i++) {
+        int offset = i*sizeof(body);
+        obj_add_rel(&w, text, offset + 4, nexts[i], R_ARM_CALL);
+        obj_add_rel(&w, text, offset + 16, funcs[i], R_ARM_JUMP24);
+        obj_add_rel(&w, text, offset + 20, words[i], R_ARM_ABS32);
+    }
+
+    obj_append(&w, bss, NULL, BENCH_BSS_SIZE, 8);
+    snprintf(name, sizeof(name), "b_%d", obj);
+    obj_add_symbol(&w, name, STB_GLOBAL, STT_OBJECT, bss, 0, BENCH_BSS_SIZE);
+    for(i = 0; i < BENCH_COMMON_NUM; i++) {
+        snprintf(name, sizeof(name), "c_%d", i);
+        obj_add_symbol(&w, name, STB_GLOBAL, STT_OBJECT, SHN_COMMON, 4, 4*(1 + obj % 4));
+    }
+    if(obj == 0)
+        obj_add_symbol(&w, "_start", STB_GLOBAL, STT_FUNC, text, 0, 0);
+
+    if(obj_write(&w, path) < 0) {
+        fprintf(stderr, "can't write %s\n", path);
+        exit(1);
+    }
+    obj_free(&w);
+    free(funcs);
+    free(nexts);
+    free(words);
+}
+
+/* best of BENCH_REPEAT */
+static double time_mini_ld(char **paths, int obj_num, char *out, int jobs) {
+    struct LdOptions opt;
+    double best = 1e9;
+    int i;
+
+    ld_default_options(&opt);
+    opt.jobs = jobs;
+    for(i = 0; i < BENCH_REPEAT; i++) {
+        double begin = now_sec(), elapsed;
+        if(ld_link(paths, obj_num, out, &opt) != 0) {
+            fprintf(stderr, "mini_ld failed\n");
+            exit(1);
+        }
+        elapsed = now_sec() - begin;
+        if(elapsed < best)
+            best = elapsed;
+    }
+    return best;
+}
+
+/* best of BENCH_REPEAT, negative if the linker is not found */
+static double time_command(char *cmd) {
+    double best = 1e9;
+    int i;
+
+    for(i = 0; i < BENCH_REPEAT; i++) {
+        double begin = now_sec(), elapsed;
+        if(system(cmd) != 0)
+            return -1;
+        elapsed = now_sec() - begin;
+        if(elapsed < best)
+            best = elapsed;
+    }
+    return best;
+}
+
+static long file_size(char *path) {
+    FILE *fp = fopen(path, "rb");
+    long size;
+
+    if(fp == NULL)
+        return -1;
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fclose(fp);
+    return size;
+}
+
+int main(int argc, char *argv[]) {
+    int obj_num = argc > 1 ? atoi(argv[1]) : 200;
+    int func_num = argc > 2 ? atoi(argv[2]) : 100;
+    int cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    char dir[] = "/tmp/link_benchXXXXXX";
+    char out[256], cmd[256];
+    char **paths;
+    char *objs;
+    size_t objs_len = 0;
+    double elapsed;
+    int found = 0;
+    int i;
+
+    if(obj_num < 1 || func_num < 1) {
+        fprintf(stderr, "Usage: link_bench [objects] [functions per object]\n");
+        exit(1);
+    }
+    if(mkdtemp(dir) == NULL) {
+        fprintf(stderr, "can't create %s\n", dir);
+        exit(1);
+    }
+    paths = malloc(sizeof(char*)*obj_num);
+    objs = malloc(obj_num*(strlen(dir) + 32));
+    for(i = 0; i < obj_num; i++) {
+        paths[i] = malloc(strlen(dir) + 32);
+        sprintf(paths[i], "%s/o%d.o", dir, i);
+        write_object(paths[i], i, obj_num, func_num);
+        objs_len += sprintf(objs + objs_len, " %s", paths[i]);
+    }
+    printf("%d objects, %d symbols, %d relocations\n",
+        obj_num, obj_num*(func_num*2 + 1) + BENCH_COMMON_NUM, obj_num*func_num*4);
+
+    snprintf(out, sizeof(out), "%s/mini.elf", dir);
+    elapsed = time_mini_ld(paths, obj_num, out, 1);
+    printf("mini_ld -j1: %.2f ms, %ld bytes\n", elapsed*1e3, file_size(out));
+    if(cpus > 1) {
+        elapsed = time_mini_ld(paths, obj_num, out, cpus);
+        printf("mini_ld -j%d: %.2f ms\n", cpus, elapsed*1e3);
+    }
+
+    for(i = 0; i < (int)(sizeof(linkers)/sizeof(linkers[0])); i++) {
+        char *cmdline;
+        snprintf(cmd, sizeof(cmd), "%s --version > /dev/null 2>&1", linkers[i]);
+        if(system(cmd) != 0)
+            continue;
+        cmdline = malloc(objs_len + 256);
+        sprintf(cmdline, "%s -static -Ttext=0x%x -e _start -o %s/ld.elf%s",
+                linkers[i], LD_DEFAULT_BASE, dir, objs);
+        elapsed = time_command(cmdline);
+        if(elapsed < 0)
+            printf("%s: failed\n", linkers[i]);
+        else
+            printf("%s: %.2f ms (including process startup)\n", linkers[i], elapsed*1e3);
+        free(cmdline);
+        found = 1;
+    }
+    if(!found)
+        printf("no ARM ld found in PATH\n");
+
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    system(cmd);
+    for(i = 0; i < obj_num; i++)
+        free(paths[i]);
+    free(paths);
+    free(objs);
+    return 0;
+}
@@ -0,0 +1,1245 @@
+/*
+Minimal static linker of ELF32 ARM relocatable objects.
+
+gcc -O2 -pthread mini_ld.c elf_obj.c -o mini_ld
+./mini_ld                                     # run unit tests
+./mini_ld [-bin] [-jN] [-base addr] [-e entry] -o out a.o b.o ...
+
+Inputs are mmapped and never copied, symbols are resolved through one hash table,
+then the output is mmapped and each input section is copied and relocated by the threads.
+Supported relocations are R_ARM_ABS32, R_ARM_REL32, R_ARM_CALL, R_ARM_JUMP24, R_ARM_PC24
+and R_ARM_MOVW_ABS_NC/R_ARM_MOVT_ABS, ARM state only.
+.ARM.exidx is dropped, so the objects should be built with -fno-unwind-tables if they have it.
+*/
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "elf_obj.h"
+#include "mini_ld.h"
+
+enum LdKind {
+    LK_TEXT,
+    LK_RODATA,
+    LK_DATA,
+    LK_BSS,
+    LK_NUM,
+    LK_NONE = -1
+};
+
+static char *kind_names[LK_NUM] = {".text", ".rodata", ".data", ".bss"};
+
+enum LdSymState {
+    LS_UNDEF,
+    LS_COMMON,
+    LS_WEAK,
+    LS_DEFINED
+};
+
+struct LdSymbol {
+    char *name;             /* in the strtab of the mmapped input */
+    unsigned int hash;
+    int state;
+    int weak_ref;           /* only referenced by weak undefined symbols */
+    int input;              /* defining input, or first referencing one */
+    int shndx;
+    unsigned int value;     /* alignment for LS_COMMON */
+    unsigned int size;
+    unsigned char info;
+    unsigned int addr;
+};
+
+struct LdInput {
+    char *path;
+    unsigned char *map;
+    size_t size;
+    Elf32_Ehdr *eh;
+    Elf32_Shdr *sh;
+    int shnum;
+    char *shstr;
+    Elf32_Sym *syms;
+    int sym_num;
+    char *strtab;
+
+    int *kind;              /* per section */
+    int *rel;               /* per section, index of the SHT_REL section for it, 0 for none */
+    unsigned int *addr;     /* per section */
+    int *gsyms;             /* per symbol, index to Linker.symbols, -1 for locals */
+};
+
+struct LdSection {
+    int input;
+    int shndx;
+    unsigned int addr;
+    unsigned int offset;    /* file offset */
+    unsigned int size;
+    char *diag;
+    size_t diag_len;
+};
+
+struct LdOutSection {
+    unsigned int addr;
+    unsigned int offset;
+    unsigned int size;
+    unsigned int align;
+    int index;              /* in the section headers of ELF, 0 if empty */
+};
+
+struct Linker {
+    struct LdOptions opt;
+    struct LdInput *inputs;
+    int input_num;
+    int errors;
+
+    struct LdSymbol *symbols;
+    int symbol_num;
+    int symbol_capacity;
+    /* open addressing, index+1 to symbols, 0 for empty */
+    int *table;
+    int table_size;
+
+    struct LdSection *sections;
+    int section_num;
+    struct LdOutSection out[LK_NUM];
+    unsigned int file_size;
+    unsigned int entry;
+
+    unsigned char *image;
+    int next_job;
+};
+
+static void ld_error(struct Linker *ld, char *fmt, ...) {
+    va_list ap;
+
+    va_start(ap, fmt);
+    vfprintf(ld->opt.diag, fmt, ap);
+    va_end(ap);
+    ld->errors++;
+}
+
+void ld_default_options(struct LdOptions *opt) {
+    memset(opt, 0, sizeof(*opt));
+    opt->format = LD_ELF;
+    opt->base = LD_DEFAULT_BASE;
+}
+
+static unsigned int align_up(unsigned int v, unsigned int align) {
+    return align <= 1 ? v : (v + align - 1) & ~(align - 1);
+}
+
+
+/*
+inputs
+*/
+
+static int input_kind(Elf32_Shdr *sh) {
+    if(!(sh->sh_flags & SHF_ALLOC))
+        return LK_NONE;
+    switch(sh->sh_type) {
+        case SHT_NOBITS:
+            return LK_BSS;
+        case SHT_PROGBITS:
+        case SHT_INIT_ARRAY:
+        case SHT_FINI_ARRAY:
+        case SHT_PREINIT_ARRAY:
+            if(sh->sh_flags & SHF_EXECINSTR)
+                return LK_TEXT;
+            return (sh->sh_flags & SHF_WRITE) ? LK_DATA : LK_RODATA;
+        default:
+            /* SHT_ARM_EXIDX, SHT_GROUP, ... */
+            return LK_NONE;
+    }
+}
+
+static int valid_range(struct LdInput *in, unsigned int offset, unsigned int size) {
+    return offset <= in->size && size <= in->size - offset;
+}
+
+static int open_input(struct Linker *ld, struct LdInput *in) {
+    int fd = open(in->path, O_RDONLY);
+    struct stat st;
+    int i;
+
+    if(fd < 0 || fstat(fd, &st) < 0) {
+        ld_error(ld, "%s: can't open\n", in->path);
+        if(fd >= 0)
+            close(fd);
+        return -1;
+    }
+    in->size = st.st_size;
+    in->map = in->size == 0 ? MAP_FAILED : mmap(NULL, in->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(in->map == MAP_FAILED) {
+        in->map = NULL;
+        ld_error(ld, "%s: can't map\n", in->path);
+        return -1;
+    }
+
+    in->eh = (Elf32_Ehdr*)in->map;
+    if(in->size < sizeof(Elf32_Ehdr)
+       || memcmp(in->eh->e_ident, ELFMAG, SELFMAG) != 0
+       || in->eh->e_ident[EI_CLASS] != ELFCLASS32
+       || in->eh->e_ident[EI_DATA] != ELFDATA2LSB
+       || in->eh->e_type != ET_REL
+       || in->eh->e_machine != EM_ARM
+       || in->eh->e_shentsize != sizeof(Elf32_Shdr)
+       || in->eh->e_shstrndx >= in->eh->e_shnum
+       || !valid_range(in, in->eh->e_shoff, in->eh->e_shnum*sizeof(Elf32_Shdr))) {
+        ld_error(ld, "%s: not an ELF32 ARM relocatable object\n", in->path);
+        return -1;
+    }
+    in->sh = (Elf32_Shdr*)(in->map + in->eh->e_shoff);
+    in->shnum = in->eh->e_shnum;
+    for(i = 1; i < in->shnum; i++) {
+        if(in->sh[i].sh_type != SHT_NOBITS && !valid_range(in, in->sh[i].sh_offset, in->sh[i].sh_size)) {
+            ld_error(ld, "%s: section out of the file\n", in->path);
+            return -1;
+        }
+    }
+    in->shstr = (char*)in->map + in->sh[in->eh->e_shstrndx].sh_offset;
+
+    in->kind = malloc(sizeof(int)*in->shnum);
+    in->rel = calloc(in->shnum, sizeof(int));
+    in->addr = calloc(in->shnum, sizeof(unsigned int));
+    for(i = 0; i < in->shnum; i++) {
+        Elf32_Shdr *sh = &in->sh[i];
+        in->kind[i] = i == 0 ? LK_NONE : input_kind(sh);
+        if(in->kind[i] != LK_NONE && (sh->sh_flags & SHF_TLS)) {
+            ld_error(ld, "%s: %s: TLS is not supported\n", in->path, in->shstr + sh->sh_name);
+            return -1;
+        }
+        if(sh->sh_type == SHT_SYMTAB) {
+            if(sh->sh_link >= (unsigned int)in->shnum || sh->sh_entsize != sizeof(Elf32_Sym)) {
+                ld_error(ld, "%s: broken symbol table\n", in->path);
+                return -1;
+            }
+            in->syms = (Elf32_Sym*)(in->map + sh->sh_offset);
+            in->sym_num = sh->sh_size/sizeof(Elf32_Sym);
+            in->strtab = (char*)in->map + in->sh[sh->sh_link].sh_offset;
+        }
+    }
+    for(i = 0; i < in->shnum; i++) {
+        Elf32_Shdr *sh = &in->sh[i];
+        if(sh->sh_type == SHT_RELA) {
+            ld_error(ld, "%s: SHT_RELA is not supported\n", in->path);
+            return -1;
+        }
+        if(sh->sh_type == SHT_REL && sh->sh_info < (unsigned int)in->shnum && in->kind[sh->sh_info] != LK_NONE)
+            in->rel[sh->sh_info] = i;
+    }
+    in->gsyms = malloc(sizeof(int)*(in->sym_num + 1));
+    return 0;
+}
+
+static void close_input(struct LdInput *in) {
+    if(in->map != NULL)
+        munmap(in->map, in->size);
+    free(in->kind);
+    free(in->rel);
+    free(in->addr);
+    free(in->gsyms);
+}
+
+
+/*
+symbols
+*/
+
+static unsigned int hash_name(char *name) {
+    unsigned int h = 2166136261u;
+    while(*name) {
+        h ^= (unsigned char)*name++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void table_insert(struct Linker *ld, int index) {
+    unsigned int mask = ld->table_size - 1;
+    unsigned int i = ld->symbols[index].hash & mask;
+
+    while(ld->table[i] != 0)
+        i = (i + 1) & mask;
+    ld->table[i] = index + 1;
+}
+
+/*
+Return the index of name, adding it as LS_UNDEF if not found.
+*/
+static int intern(struct Linker *ld, char *name, int input) {
+    unsigned int h = hash_name(name);
+    unsigned int mask = ld->table_size - 1;
+    unsigned int i;
+    struct LdSymbol *sym;
+    int j;
+
+    for(i = h & mask; ld->table[i] != 0; i = (i + 1) & mask) {
+        sym = &ld->symbols[ld->table[i] - 1];
+        if(sym->hash == h && strcmp(sym->name, name) == 0)
+            return ld->table[i] - 1;
+    }
+
+    if(ld->symbol_num == ld->symbol_capacity) {
+        ld->symbol_capacity = ld->symbol_capacity*2 + 256;
+        ld->symbols = realloc(ld->symbols, sizeof(struct LdSymbol)*ld->symbol_capacity);
+    }
+    sym = &ld->symbols[ld->symbol_num];
+    memset(sym, 0, sizeof(*sym));
+    sym->name = name;
+    sym->hash = h;
+    sym->state = LS_UNDEF;
+    sym->weak_ref = 1;
+    sym->input = input;
+    ld->symbol_num++;
+
+    /* keep the load under 1/2 */
+    if(ld->symbol_num*2 > ld->table_size) {
+        free(ld->table);
+        ld->table_size *= 2;
+        ld->table = calloc(ld->table_size, sizeof(int));
+        for(j = 0; j < ld->symbol_num; j++)
+            table_insert(ld, j);
+    } else {
+        ld->table[i] = ld->symbol_num;
+    }
+    return ld->symbol_num - 1;
+}
+
+static void define(struct LdSymbol *sym, int state, int input, Elf32_Sym *s) {
+    sym->state = state;
+    sym->input = input;
+    sym->shndx = s->st_shndx;
+    sym->value = s->st_value;
+    sym->size = s->st_size;
+    sym->info = s->st_info;
+}
+
+static void resolve_symbol(struct Linker *ld, int input, int index) {
+    struct LdInput *in = &ld->inputs[input];
+    Elf32_Sym *s = &in->syms[index];
+    int bind = ELF32_ST_BIND(s->st_info);
+    struct LdSymbol *sym;
+
+    if(bind == STB_LOCAL) {
+        in->gsyms[index] = -1;
+        return;
+    }
+    in->gsyms[index] = intern(ld, in->strtab + s->st_name, input);
+    sym = &ld->symbols[in->gsyms[index]];
+
+    if(s->st_shndx == SHN_UNDEF) {
+        if(bind != STB_WEAK)
+            sym->weak_ref = 0;
+    } else if(s->st_shndx == SHN_COMMON) {
+        /* tentative definitions are merged to the largest one */
+        if(sym->state == LS_UNDEF || sym->state == LS_WEAK) {
+            define(sym, LS_COMMON, input, s);
+        } else if(sym->state == LS_COMMON) {
+            if(s->st_size > sym->size)
+                sym->size = s->st_size;
+            if(s->st_value > sym->value)
+                sym->value = s->st_value;
+        }
+    } else if(bind == STB_WEAK) {
+        if(sym->state == LS_UNDEF)
+            define(sym, LS_WEAK, input, s);
+    } else {
+        if(sym->state == LS_DEFINED)
+            ld_error(ld, "multiple definition of `%s', first defined in %s\n",
+                     sym->name, ld->inputs[sym->input].path);
+        else
+            define(sym, LS_DEFINED, input, s);
+    }
+}
+
+static void resolve_symbols(struct Linker *ld) {
+    int i, j;
+
+    ld->table_size = 1024;
+    ld->table = calloc(ld->table_size, sizeof(int));
+    for(i = 0; i < ld->input_num; i++) {
+        struct LdInput *in = &ld->inputs[i];
+        for(j = 1; j < in->sym_num; j++) {
+            if(in->syms[j].st_shndx >= SHN_LORESERVE && in->syms[j].st_shndx != SHN_ABS
+               && in->syms[j].st_shndx != SHN_COMMON) {
+                ld_error(ld, "%s: unsupported section index of `%s'\n", in->path, in->strtab + in->syms[j].st_name);
+                continue;
+            }
+            if(in->syms[j].st_shndx < SHN_LORESERVE && in->syms[j].st_shndx >= in->shnum) {
+                ld_error(ld, "%s: bad section index of `%s'\n", in->path, in->strtab + in->syms[j].st_name);
+                continue;
+            }
+            resolve_symbol(ld, i, j);
+        }
+    }
+}
+
+
+/*
+layout
+*/
+
+static void add_section(struct Linker *ld, int input, int shndx) {
+    if(ld->section_num % 256 == 0)
+        ld->sections = realloc(ld->sections, sizeof(struct LdSection)*(ld->section_num + 256));
+    memset(&ld->sections[ld->section_num], 0, sizeof(struct LdSection));
+    ld->sections[ld->section_num].input = input;
+    ld->sections[ld->section_num].shndx = shndx;
+    ld->section_num++;
+}
+
+/*
+Place one section at *addr and return its address, delta is addr - file offset.
+*/
+static unsigned int place(struct Linker *ld, int kind, unsigned int *addr, unsigned int align,
+                          unsigned int size, unsigned int delta) {
+    struct LdOutSection *out = &ld->out[kind];
+    unsigned int start = align_up(*addr, align);
+
+    if(align > out->align)
+        out->align = align;
+    *addr = start + size;
+    out->size = *addr - out->addr;
+    if(kind != LK_BSS && *addr - delta > ld->file_size)
+        ld->file_size = *addr - delta;
+    return start;
+}
+
+static unsigned int kind_align(struct Linker *ld, int kind) {
+    unsigned int align = 1;
+    int i, j;
+
+    for(i = 0; i < ld->input_num; i++)
+        for(j = 1; j < ld->inputs[i].shnum; j++)
+            if(ld->inputs[i].kind[j] == kind && ld->inputs[i].sh[j].sh_addralign > align)
+                align = ld->inputs[i].sh[j].sh_addralign;
+    return align;
+}
+
+static void layout(struct Linker *ld, unsigned int header_size) {
+    unsigned int addr = ld->opt.base + header_size;
+    unsigned int delta = ld->opt.base;
+    int kind, i, j;
+
+    ld->file_size = header_size;
+    for(kind = 0; kind < LK_NUM; kind++) {
+        struct LdOutSection *out = &ld->out[kind];
+        unsigned int align = kind_align(ld, kind);
+
+        if(kind == LK_DATA && ld->opt.format == LD_ELF) {
+            /* next page, at the same offset in the page as in the file */
+            unsigned int offset = align_up(addr - delta, align);
+            addr = align_up(addr, LD_PAGE) + offset % LD_PAGE;
+            delta = addr - offset;
+        }
+        addr = align_up(addr, align);
+        out->addr = addr;
+        out->offset = addr - delta;
+        out->align = align;
+        for(i = 0; i < ld->input_num; i++) {
+            struct LdInput *in = &ld->inputs[i];
+            for(j = 1; j < in->shnum; j++) {
+                if(in->kind[j] != kind)
+                    continue;
+                in->addr[j] = place(ld, kind, &addr, in->sh[j].sh_addralign, in->sh[j].sh_size, delta);
+                if(kind != LK_BSS) {
+                    add_section(ld, i, j);
+                    ld->sections[ld->section_num - 1].addr = in->addr[j];
+                    ld->sections[ld->section_num - 1].offset = in->addr[j] - delta;
+                    ld->sections[ld->section_num - 1].size = in->sh[j].sh_size;
+                }
+            }
+        }
+        if(kind == LK_BSS) {
+            for(i = 0; i < ld->symbol_num; i++) {
+                struct LdSymbol *sym = &ld->symbols[i];
+                if(sym->state == LS_COMMON)
+                    sym->addr = place(ld, kind, &addr, sym->value, sym->size, delta);
+            }
+        }
+    }
+
+    for(i = 0; i < ld->symbol_num; i++) {
+        struct LdSymbol *sym = &ld->symbols[i];
+        if(sym->state == LS_WEAK || sym->state == LS_DEFINED) {
+            if(sym->shndx == SHN_ABS)
+                sym->addr = sym->value;
+            else
+                sym->addr = ld->inputs[sym->input].addr[sym->shndx] + sym->value;
+        }
+    }
+}
+
+static struct LdSymbol *find_symbol(struct Linker *ld, char *name) {
+    unsigned int h = hash_name(name);
+    unsigned int mask = ld->table_size - 1;
+    unsigned int i;
+
+    for(i = h & mask; ld->table[i] != 0; i = (i + 1) & mask) {
+        struct LdSymbol *sym = &ld->symbols[ld->table[i] - 1];
+        if(sym->hash == h && strcmp(sym->name, name) == 0)
+            return sym->state == LS_UNDEF ? NULL : sym;
+    }
+    return NULL;
+}
+
+static void set_entry(struct Linker *ld) {
+    struct LdSymbol *sym;
+
+    if(ld->opt.entry != NULL) {
+        sym = find_symbol(ld, ld->opt.entry);
+        if(sym == NULL)
+            ld_error(ld, "entry symbol `%s' not found\n", ld->opt.entry);
+    } else {
+        sym = find_symbol(ld, "_start");
+        if(sym == NULL)
+            sym = find_symbol(ld, "main");
+    }
+    ld->entry = sym != NULL ? sym->addr : ld->out[LK_TEXT].addr;
+}
+
+
+/*
+relocation
+*/
+
+static int sign_extend(unsigned int v, int bits) {
+    return (int)(v << (32 - bits)) >> (32 - bits);
+}
+
+static void apply_rel(struct Linker *ld, struct LdSection *sec, FILE *diag, Elf32_Rel *rel) {
+    struct LdInput *in = &ld->inputs[sec->input];
+    int type = ELF32_R_TYPE(rel->r_info);
+    unsigned int symi = ELF32_R_SYM(rel->r_info);
+    unsigned int *p, insn, s, pc;
+    int a, v;
+
+    if(type == R_ARM_NONE || type == R_ARM_V4BX)
+        return;
+    if(rel->r_offset > sec->size - 4 || sec->size < 4 || symi >= (unsigned int)in->sym_num) {
+        fprintf(diag, "%s: %s: broken relocation at 0x%x\n", in->path, in->shstr + in->sh[sec->shndx].sh_name, rel->r_offset);
+        return;
+    }
+    p = (unsigned int*)(ld->image + sec->offset + rel->r_offset);
+    pc = sec->addr + rel->r_offset;
+
+    if(in->gsyms[symi] >= 0) {
+        struct LdSymbol *sym = &ld->symbols[in->gsyms[symi]];
+        if(sym->state == LS_UNDEF && !sym->weak_ref) {
+            fprintf(diag, "%s: %s+0x%x: undefined reference to `%s'\n", in->path,
+                    in->shstr + in->sh[sec->shndx].sh_name, rel->r_offset, sym->name);
+            return;
+        }
+        /* weak undefined is 0 */
+        s = sym->addr;
+    } else {
+        Elf32_Sym *ls = &in->syms[symi];
+        if(ls->st_shndx == SHN_ABS)
+            s = ls->st_value;
+        else if(ls->st_shndx == SHN_UNDEF)
+            s = 0;
+        else
+            s = in->addr[ls->st_shndx] + ls->st_value;
+    }
+
+    insn = *p;
+    switch(type) {
+        case R_ARM_ABS32:
+            *p = s + insn;
+            break;
+        case R_ARM_REL32:
+            *p = s + insn - pc;
+            break;
+        case R_ARM_PC24:
+        case R_ARM_CALL:
+        case R_ARM_JUMP24:
+            a = sign_extend(insn & 0xffffff, 24)*4;
+            v = (int)(s + a - pc);
+            if(v < -0x2000000 || v >= 0x2000000 || (v & 3) != 0) {
+                fprintf(diag, "%s: %s+0x%x: branch to `%s' out of range\n", in->path,
+                        in->shstr + in->sh[sec->shndx].sh_name, rel->r_offset,
+                        in->strtab + in->syms[symi].st_name);
+                return;
+            }
+            *p = (insn & 0xff000000) | (((unsigned int)v >> 2) & 0xffffff);
+            break;
+        case R_ARM_MOVW_ABS_NC:
+        case R_ARM_MOVT_ABS:
+            a = sign_extend(((insn >> 4) & 0xf000) | (insn & 0xfff), 16);
+            v = s + a;
+            if(type == R_ARM_MOVT_ABS)
+                v = (unsigned int)v >> 16;
+            *p = (insn & 0xfff0f000) | ((v & 0xf000) << 4) | (v & 0xfff);
+            break;
+        default:
+            fprintf(diag, "%s: %s+0x%x: unsupported relocation type %d\n", in->path,
+                    in->shstr + in->sh[sec->shndx].sh_name, rel->r_offset, type);
+    }
+}
+
+static void relocate_section(struct Linker *ld, struct LdSection *sec) {
+    struct LdInput *in = &ld->inputs[sec->input];
+    Elf32_Shdr *sh = &in->sh[sec->shndx];
+    FILE *diag = open_memstream(&sec->diag, &sec->diag_len);
+    int reli = in->rel[sec->shndx];
+
+    if(sh->sh_size > 0)
+        memcpy(ld->image + sec->offset, in->map + sh->sh_offset, sh->sh_size);
+    if(reli != 0) {
+        Elf32_Rel *rels = (Elf32_Rel*)(in->map + in->sh[reli].sh_offset);
+        int n = in->sh[reli].sh_size/sizeof(Elf32_Rel);
+        int i;
+        for(i = 0; i < n; i++)
+            apply_rel(ld, sec, diag, &rels[i]);
+    }
+    fclose(diag);
+}
+
+static void *relocate_worker(void *arg) {
+    struct Linker *ld = arg;
+    int i;
+
+    while((i = __sync_fetch_and_add(&ld->next_job, 1)) < ld->section_num)
+        relocate_section(ld, &ld->sections[i]);
+    return NULL;
+}
+
+static void relocate_all(struct Linker *ld) {
+    int thread_num = ld->opt.jobs;
+    pthread_t *threads;
+    int i;
+
+    if(thread_num <= 0)
+        thread_num = sysconf(_SC_NPROCESSORS_ONLN);
+    if(thread_num > ld->section_num)
+        thread_num = ld->section_num;
+    if(thread_num <= 1) {
+        relocate_worker(ld);
+    } else {
+        threads = malloc(sizeof(pthread_t)*thread_num);
+        for(i = 0; i < thread_num; i++)
+            pthread_create(&threads[i], NULL, relocate_worker, ld);
+        for(i = 0; i < thread_num; i++)
+            pthread_join(threads[i], NULL);
+        free(threads);
+    }
+
+    /* in the order of the inputs, whatever order the threads finished in */
+    for(i = 0; i < ld->section_num; i++) {
+        if(ld->sections[i].diag_len > 0) {
+            fputs(ld->sections[i].diag, ld->opt.diag);
+            ld->errors++;
+        }
+        free(ld->sections[i].diag);
+    }
+}
+
+
+/*
+output
+*/
+
+#define LD_PHNUM 2
+#define LD_ELF_HEADER_SIZE (sizeof(Elf32_Ehdr) + LD_PHNUM*sizeof(Elf32_Phdr))
+
+struct LdTables {
+    Elf32_Sym *syms;
+    int sym_num;
+    char *strtab;
+    size_t strtab_size;
+    char *shstrtab;
+    size_t shstrtab_size;
+    Elf32_Shdr shdrs[LK_NUM + 4];
+    int shnum;
+};
+
+static int add_name(char **buf, size_t *size, char *name) {
+    int offset = *size;
+    int len = strlen(name) + 1;
+
+    *buf = realloc(*buf, *size + len);
+    memcpy(*buf + offset, name, len);
+    *size += len;
+    return offset;
+}
+
+/*
+Symbol table of the defined globals and the section headers, placed after the file image.
+*/
+static void build_tables(struct Linker *ld, struct LdTables *t) {
+    unsigned int offset;
+    int kind, i;
+
+    memset(t, 0, sizeof(*t));
+    add_name(&t->strtab, &t->strtab_size, "");
+    add_name(&t->shstrtab, &t->shstrtab_size, "");
+    t->shnum = 1;
+    for(kind = 0; kind < LK_NUM; kind++) {
+        struct LdOutSection *out = &ld->out[kind];
+        Elf32_Shdr *sh;
+        if(out->size == 0)
+            continue;
+        out->index = t->shnum;
+        sh = &t->shdrs[t->shnum++];
+        sh->sh_name = add_name(&t->shstrtab, &t->shstrtab_size, kind_names[kind]);
+        sh->sh_type = kind == LK_BSS ? SHT_NOBITS : SHT_PROGBITS;
+        sh->sh_flags = SHF_ALLOC | (kind == LK_TEXT ? SHF_EXECINSTR : 0)
+            | (kind >= LK_DATA ? SHF_WRITE : 0);
+        sh->sh_addr = out->addr;
+        sh->sh_offset = out->offset;
+        sh->sh_size = out->size;
+        sh->sh_addralign = out->align;
+    }
+
+    t->syms = calloc(ld->symbol_num + 1, sizeof(Elf32_Sym));
+    t->sym_num = 1;
+    for(i = 0; i < ld->symbol_num; i++) {
+        struct LdSymbol *sym = &ld->symbols[i];
+        Elf32_Sym *s;
+        if(sym->state == LS_UNDEF)
+            continue;
+        s = &t->syms[t->sym_num++];
+        s->st_name = add_name(&t->strtab, &t->strtab_size, sym->name);
+        s->st_value = sym->addr;
+        s->st_size = sym->size;
+        if(sym->state == LS_COMMON) {
+            s->st_info = ELF32_ST_INFO(STB_GLOBAL, STT_OBJECT);
+            s->st_shndx = ld->out[LK_BSS].index;
+        } else {
+            s->st_info = sym->info;
+            kind = sym->shndx == SHN_ABS ? LK_NONE : ld->inputs[sym->input].kind[sym->shndx];
+            /* symbols of the dropped sections are kept as absolute */
+            s->st_shndx = kind == LK_NONE ? SHN_ABS : ld->out[kind].index;
+        }
+    }
+
+    offset = ld->file_size;
+    i = t->shnum++;
+    t->shdrs[i].sh_name = add_name(&t->shstrtab, &t->shstrtab_size, ".symtab");
+    t->shdrs[i].sh_type = SHT_SYMTAB;
+    t->shdrs[i].sh_link = i + 1;
+    t->shdrs[i].sh_info = 1;
+    t->shdrs[i].sh_entsize = sizeof(Elf32_Sym);
+    t->shdrs[i].sh_addralign = 4;
+    t->shdrs[i].sh_offset = offset = align_up(offset, 4);
+    t->shdrs[i].sh_size = sizeof(Elf32_Sym)*t->sym_num;
+    offset += t->shdrs[i].sh_size;
+
+    i = t->shnum++;
+    t->shdrs[i].sh_name = add_name(&t->shstrtab, &t->shstrtab_size, ".strtab");
+    t->shdrs[i].sh_type = SHT_STRTAB;
+    t->shdrs[i].sh_addralign = 1;
+    t->shdrs[i].sh_offset = offset;
+    t->shdrs[i].sh_size = t->strtab_size;
+    offset += t->strtab_size;
+
+    i = t->shnum++;
+    t->shdrs[i].sh_name = add_name(&t->shstrtab, &t->shstrtab_size, ".shstrtab");
+    t->shdrs[i].sh_type = SHT_STRTAB;
+    t->shdrs[i].sh_addralign = 1;
+    t->shdrs[i].sh_offset = offset;
+    t->shdrs[i].sh_size = t->shstrtab_size;
+}
+
+static unsigned int tables_end(struct LdTables *t) {
+    Elf32_Shdr *last = &t->shdrs[t->shnum - 1];
+    return align_up(last->sh_offset + last->sh_size, 4) + sizeof(Elf32_Shdr)*t->shnum;
+}
+
+static void write_elf_headers(struct Linker *ld, struct LdTables *t) {
+    Elf32_Ehdr *eh = (Elf32_Ehdr*)ld->image;
+    Elf32_Phdr *ph = (Elf32_Phdr*)(ld->image + sizeof(Elf32_Ehdr));
+    Elf32_Shdr *last = &t->shdrs[t->shnum - 1];
+    unsigned int shoff = align_up(last->sh_offset + last->sh_size, 4);
+    unsigned int data_end = ld->out[LK_BSS].addr + ld->out[LK_BSS].size;
+
+    memcpy(eh->e_ident, ELFMAG, SELFMAG);
+    eh->e_ident[EI_CLASS] = ELFCLASS32;
+    eh->e_ident[EI_DATA] = ELFDATA2LSB;
+    eh->e_ident[EI_VERSION] = EV_CURRENT;
+    eh->e_type = ET_EXEC;
+    eh->e_machine = EM_ARM;
+    eh->e_version = EV_CURRENT;
+    eh->e_entry = ld->entry;
+    eh->e_phoff = sizeof(Elf32_Ehdr);
+    eh->e_shoff = shoff;
+    eh->e_flags = EF_ARM_EABI_VER5;
+    eh->e_ehsize = sizeof(Elf32_Ehdr);
+    eh->e_phentsize = sizeof(Elf32_Phdr);
+    eh->e_phnum = LD_PHNUM;
+    eh->e_shentsize = sizeof(Elf32_Shdr);
+    eh->e_shnum = t->shnum;
+    eh->e_shstrndx = t->shnum - 1;
+
+    /* headers, .text and .rodata */
+    ph[0].p_type = PT_LOAD;
+    ph[0].p_offset = 0;
+    ph[0].p_vaddr = ph[0].p_paddr = ld->opt.base;
+    ph[0].p_filesz = ph[0].p_memsz = ld->out[LK_RODATA].offset + ld->out[LK_RODATA].size;
+    ph[0].p_flags = PF_R | PF_X;
+    ph[0].p_align = LD_PAGE;
+
+    /* .data and .bss, only .data is in the file */
+    ph[1].p_type = PT_LOAD;
+    ph[1].p_offset = ld->out[LK_DATA].offset;
+    ph[1].p_vaddr = ph[1].p_paddr = ld->out[LK_DATA].addr;
+    ph[1].p_filesz = ld->out[LK_DATA].size;
+    ph[1].p_memsz = data_end - ld->out[LK_DATA].addr;
+    ph[1].p_flags = PF_R | PF_W;
+    ph[1].p_align = LD_PAGE;
+
+    memcpy(ld->image + t->shdrs[t->shnum - 3].sh_offset, t->syms, sizeof(Elf32_Sym)*t->sym_num);
+    memcpy(ld->image + t->shdrs[t->shnum - 2].sh_offset, t->strtab, t->strtab_size);
+    memcpy(ld->image + t->shdrs[t->shnum - 1].sh_offset, t->shstrtab, t->shstrtab_size);
+    memcpy(ld->image + shoff, t->shdrs, sizeof(Elf32_Shdr)*t->shnum);
+}
+
+static void free_tables(struct LdTables *t) {
+    free(t->syms);
+    free(t->strtab);
+    free(t->shstrtab);
+}
+
+static int map_output(struct Linker *ld, char *output, unsigned int size) {
+    int fd = open(output, O_RDWR | O_CREAT | O_TRUNC, 0755);
+
+    if(fd < 0) {
+        ld_error(ld, "%s: can't create\n", output);
+        return -1;
+    }
+    if(size == 0) {
+        close(fd);
+        return 0;
+    }
+    /* the gaps between the sections are left as zero by ftruncate */
+    if(ftruncate(fd, size) < 0
+       || (ld->image = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        ld->image = NULL;
+        close(fd);
+        ld_error(ld, "%s: can't map\n", output);
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+int ld_link(char **inputs, int input_num, char *output, struct LdOptions *opt) {
+    struct Linker ld;
+    struct LdTables tables;
+    unsigned int size;
+    int i;
+
+    memset(&ld, 0, sizeof(ld));
+    ld.opt = *opt;
+    if(ld.opt.diag == NULL)
+        ld.opt.diag = stderr;
+    ld.input_num = input_num;
+    ld.inputs = calloc(input_num, sizeof(struct LdInput));
+    memset(&tables, 0, sizeof(tables));
+
+    for(i = 0; i < input_num; i++) {
+        ld.inputs[i].path = inputs[i];
+        if(open_input(&ld, &ld.inputs[i]) < 0)
+            goto done;
+    }
+    resolve_symbols(&ld);
+    if(ld.errors)
+        goto done;
+
+    layout(&ld, ld.opt.format == LD_ELF ? LD_ELF_HEADER_SIZE : 0);
+    set_entry(&ld);
+    if(ld.errors)
+        goto done;
+    size = ld.file_size;
+    if(ld.opt.format == LD_ELF) {
+        build_tables(&ld, &tables);
+        size = tables_end(&tables);
+    }
+    if(map_output(&ld, output, size) < 0)
+        goto done;
+    relocate_all(&ld);
+    if(ld.opt.format == LD_ELF && ld.errors == 0)
+        write_elf_headers(&ld, &tables);
+    if(ld.image != NULL)
+        munmap(ld.image, size);
+
+done:
+    if(ld.errors)
+        unlink(output);
+    for(i = 0; i < input_num; i++)
+        close_input(&ld.inputs[i]);
+    free(ld.inputs);
+    free(ld.symbols);
+    free(ld.table);
+    free(ld.sections);
+    free_tables(&tables);
+    return ld.errors;
+}
+
+
+#ifndef MINI_LD_NO_MAIN
+
+/*
+unit tests, the objects are made by elf_obj.c
+*/
+
+#include <assert.h>
+
+static char test_dir[] = "/tmp/mini_ld_testXXXXXX";
+
+static void assert_true(int boolflag) {
+    if(!boolflag) {
+        printf("assert fail\n");
+        assert(0);
+    }
+}
+
+static void assert_int_eq(unsigned int expect, unsigned int actual) {
+    if(expect != actual) {
+        printf("assert fail, expect 0x%x, actual 0x%x\n", expect, actual);
+        assert(0);
+    }
+}
+
+static char *test_path(char *name) {
+    static char paths[8][256];
+    static int next = 0;
+    char *path = paths[next++ % 8];
+
+    snprintf(path, 256, "%s/%s", test_dir, name);
+    return path;
+}
+
+static unsigned char *read_output(char *path, long *size) {
+    FILE *fp = fopen(path, "rb");
+    unsigned char *buf;
+
+    if(fp == NULL) {
+        *size = -1;
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    *size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    buf = malloc(*size + 1);
+    *size = fread(buf, 1, *size, fp);
+    fclose(fp);
+    return buf;
+}
+
+static unsigned int word_at(unsigned char *buf, unsigned int offset) {
+    unsigned int v;
+    memcpy(&v, buf + offset, 4);
+    return v;
+}
+
+/* address of a symbol in a linked ELF */
+static unsigned int elf_symbol(unsigned char *buf, char *name) {
+    Elf32_Ehdr *eh = (Elf32_Ehdr*)buf;
+    Elf32_Shdr *sh = (Elf32_Shdr*)(buf + eh->e_shoff);
+    int i, j;
+
+    for(i = 0; i < eh->e_shnum; i++) {
+        if(sh[i].sh_type != SHT_SYMTAB)
+            continue;
+        for(j = 0; j < (int)(sh[i].sh_size/sizeof(Elf32_Sym)); j++) {
+            Elf32_Sym *s = (Elf32_Sym*)(buf + sh[i].sh_offset) + j;
+            if(strcmp((char*)buf + sh[sh[i].sh_link].sh_offset + s->st_name, name) == 0)
+                return s->st_value;
+        }
+    }
+    assert_true(0);
+    return 0;
+}
+
+static Elf32_Shdr *elf_section(unsigned char *buf, char *name) {
+    Elf32_Ehdr *eh = (Elf32_Ehdr*)buf;
+    Elf32_Shdr *sh = (Elf32_Shdr*)(buf + eh->e_shoff);
+    char *shstr = (char*)buf + sh[eh->e_shstrndx].sh_offset;
+    int i;
+
+    for(i = 0; i < eh->e_shnum; i++)
+        if(strcmp(shstr + sh[i].sh_name, name) == 0)
+            return &sh[i];
+    return NULL;
+}
+
+static unsigned int elf_word_at(unsigned char *buf, unsigned int addr) {
+    Elf32_Ehdr *eh = (Elf32_Ehdr*)buf;
+    Elf32_Phdr *ph = (Elf32_Phdr*)(buf + eh->e_phoff);
+    int i;
+
+    for(i = 0; i < eh->e_phnum; i++)
+        if(addr >= ph[i].p_vaddr && addr + 4 <= ph[i].p_vaddr + ph[i].p_filesz)
+            return word_at(buf, ph[i].p_offset + addr - ph[i].p_vaddr);
+    assert_true(0);
+    return 0;
+}
+
+/*
+main.o: _start calls print_something, has g_in_main in .data and the pointer to g_text.
+*/
+static void write_main_obj(char *path) {
+    struct ObjWriter w;
+    int text, data, call_sym, text_sym, zero = 0;
+    unsigned int insns[] = {
+        0xe3a00000,     /* mov r0, #0 */
+        0xebfffffe,     /* bl print_something */
+        0xeafffffe,     /* end: b end */
+    };
+
+    obj_init(&w);
+    text = obj_add_section(&w, ".text", SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, 4);
+    data = obj_add_section(&w, ".data", SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, 4);
+    obj_append(&w, text, insns, sizeof(insns), 4);
+    obj_append(&w, data, &zero, 4, 4);
+    obj_append(&w, data, &zero, 4, 4);
+    obj_add_symbol(&w, "_start", STB_GLOBAL, STT_FUNC, text, 0, sizeof(insns));
+    obj_add_symbol(&w, "g_in_main", STB_GLOBAL, STT_OBJECT, data, 0, 4);
+    obj_add_symbol(&w, "g_text_ptr", STB_GLOBAL, STT_OBJECT, data, 4, 4);
+    call_sym = obj_add_symbol(&w, "print_something", STB_GLOBAL, STT_NOTYPE, SHN_UNDEF, 0, 0);
+    text_sym = obj_add_symbol(&w, "g_text", STB_GLOBAL, STT_NOTYPE, SHN_UNDEF, 0, 0);
+    obj_add_symbol(&w, "g_common", STB_GLOBAL, STT_OBJECT, SHN_COMMON, 4, 4);
+    obj_add_rel(&w, text, 4, call_sym, R_ARM_CALL);
+    obj_add_rel(&w, data, 4, text_sym, R_ARM_ABS32);
+    assert_true(obj_write(&w, path) == 0);
+    obj_free(&w);
+}
+
+/*
+many_symbols.o: print_something, the string, g_large_buf[1024*1024] in .bss,
+a larger tentative g_common and a weak g_in_main.
+*/
+static void write_many_symbols_obj(char *path) {
+    struct ObjWriter w;
+    int text, rodata, bss, data, str_sym;
+    unsigned int insns[] = {
+        0xe1a0f00e,     /* mov pc, lr */
+        0xe59f0000,     /* ldr r0, [pc, #0] */
+        0xe1a0f00e,     /* mov pc, lr */
+        0x00000002,     /* .word g_text+2 */
+    };
+    unsigned int weak_value = 7;
+
+    obj_init(&w);
+    text = obj_add_section(&w, ".text", SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, 4);
+    rodata = obj_add_section(&w, ".rodata", SHT_PROGBITS, SHF_ALLOC, 4);
+    bss = obj_add_section(&w, ".bss", SHT_NOBITS, SHF_ALLOC | SHF_WRITE, 8);
+    data = obj_add_section(&w, ".data", SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, 4);
+    obj_append(&w, text, insns, sizeof(insns), 4);
+    obj_append(&w, rodata, "hello", 6, 4);
+    obj_append(&w, bss, NULL, 1024*1024, 8);
+    obj_append(&w, data, &weak_value, 4, 4);
+    obj_add_symbol(&w, "local_helper", STB_LOCAL, STT_FUNC, text, 4, 12);
+    str_sym = obj_add_symbol(&w, ".rodata", STB_LOCAL, STT_SECTION, rodata, 0, 0);
+    obj_add_symbol(&w, "print_something", STB_GLOBAL, STT_FUNC, text, 0, 4);
+    obj_add_symbol(&w, "g_text", STB_GLOBAL, STT_OBJECT, rodata, 0, 6);
+    obj_add_symbol(&w, "g_large_buf", STB_GLOBAL, STT_OBJECT, bss, 0, 1024*1024);
+    obj_add_symbol(&w, "g_common", STB_GLOBAL, STT_OBJECT, SHN_COMMON, 8, 16);
+    obj_add_symbol(&w, "g_in_main", STB_WEAK, STT_OBJECT, data, 0, 4);
+    obj_add_rel(&w, text, 12, str_sym, R_ARM_ABS32);
+    assert_true(obj_write(&w, path) == 0);
+    obj_free(&w);
+}
+
+static int link_quiet(char **inputs, int n, char *out, int format, int jobs) {
+    struct LdOptions opt;
+    FILE *null = fopen("/dev/null", "w");
+    int errors;
+
+    ld_default_options(&opt);
+    opt.format = format;
+    opt.jobs = jobs;
+    opt.diag = null;
+    errors = ld_link(inputs, n, out, &opt);
+    fclose(null);
+    return errors;
+}
+
+static void test_link_elf() {
+    char *inputs[] = {test_path("main.o"), test_path("many_symbols.o")};
+    char *out = test_path("a.elf");
+    unsigned char *buf;
+    long size;
+    Elf32_Ehdr *eh;
+    Elf32_Phdr *ph;
+    Elf32_Shdr *bss;
+    unsigned int start, print, g_text, large, common, bl;
+
+    write_main_obj(inputs[0]);
+    write_many_symbols_obj(inputs[1]);
+    assert_int_eq(0, link_quiet(inputs, 2, out, LD_ELF, 2));
+    buf = read_output(out, &size);
+    assert_true(buf != NULL);
+    eh = (Elf32_Ehdr*)buf;
+    ph = (Elf32_Phdr*)(buf + eh->e_phoff);
+
+    assert_int_eq(ET_EXEC, eh->e_type);
+    assert_int_eq(EM_ARM, eh->e_machine);
+    start = elf_symbol(buf, "_start");
+    print = elf_symbol(buf, "print_something");
+    g_text = elf_symbol(buf, "g_text");
+    assert_int_eq(start, eh->e_entry);
+    assert_int_eq(LD_DEFAULT_BASE + LD_ELF_HEADER_SIZE, start);
+    /* text of main.o, then of many_symbols.o */
+    assert_int_eq(start + 12, print);
+
+    /* bl print_something from _start+4: offset = (target - pc - 8)/4 */
+    bl = elf_word_at(buf, start + 4);
+    assert_int_eq(0xeb000000 | ((print - (start + 4) - 8) >> 2), bl);
+    /* g_text_ptr = &g_text, literal = .rodata+2 */
+    assert_int_eq(g_text, elf_word_at(buf, elf_symbol(buf, "g_text_ptr")));
+    assert_int_eq(g_text + 2, elf_word_at(buf, print + 12));
+
+    /* strong g_in_main of main.o wins over the weak one */
+    assert_int_eq(0, elf_word_at(buf, elf_symbol(buf, "g_in_main")));
+    assert_int_eq(elf_symbol(buf, "g_text_ptr") - 4, elf_symbol(buf, "g_in_main"));
+
+    /* 1MB of .bss is not in the file */
+    bss = elf_section(buf, ".bss");
+    assert_true(bss != NULL);
+    assert_int_eq(SHT_NOBITS, bss->sh_type);
+    assert_true(bss->sh_size >= 1024*1024 + 16);
+    assert_true(size < 64*1024);
+    large = elf_symbol(buf, "g_large_buf");
+    common = elf_symbol(buf, "g_common");
+    assert_int_eq(bss->sh_addr, large);
+    /* the largest tentative size and alignment */
+    assert_int_eq(large + 1024*1024, common);
+    assert_int_eq(0, common % 8);
+
+    /* data segment: same offset in the page, memsz covers .bss */
+    assert_int_eq(2, eh->e_phnum);
+    assert_int_eq(ph[1].p_offset % LD_PAGE, ph[1].p_vaddr % LD_PAGE);
+    assert_true(ph[1].p_vaddr >= ph[0].p_vaddr + ph[0].p_memsz);
+    assert_int_eq(common + 16, ph[1].p_vaddr + ph[1].p_memsz);
+    free(buf);
+}
+
+static void test_link_bin() {
+    char *inputs[] = {test_path("main.o"), test_path("many_symbols.o")};
+    char *out = test_path("a.bin");
+    unsigned char *buf;
+    long size;
+
+    write_main_obj(inputs[0]);
+    write_many_symbols_obj(inputs[1]);
+    assert_int_eq(0, link_quiet(inputs, 2, out, LD_BIN, 1));
+    buf = read_output(out, &size);
+
+    /* text 12+16, rodata 6 -> 8, data 8+4, no bss */
+    assert_int_eq(28 + 8 + 12, size);
+    assert_int_eq(0xe3a00000, word_at(buf, 0));
+    /* bl from 0x10004 to 0x1000c */
+    assert_int_eq(0xeb000000, word_at(buf, 4));
+    /* literal of print_something = g_text + 2 */
+    assert_int_eq(LD_DEFAULT_BASE + 28 + 2, word_at(buf, 12 + 12));
+    assert_true(memcmp(buf + 28, "hello", 6) == 0);
+    /* g_text_ptr */
+    assert_int_eq(LD_DEFAULT_BASE + 28, word_at(buf, 36 + 4));
+    free(buf);
+}
+
+static void test_link_jobs_same_output() {
+    char *inputs[] = {test_path("main.o"), test_path("many_symbols.o")};
+    unsigned char *a, *b;
+    long size_a, size_b;
+
+    assert_int_eq(0, link_quiet(inputs, 2, test_path("j1.elf"), LD_ELF, 1));
+    assert_int_eq(0, link_quiet(inputs, 2, test_path("j4.elf"), LD_ELF, 4));
+    a = read_output(test_path("j1.elf"), &size_a);
+    b = read_output(test_path("j4.elf"), &size_b);
+    assert_int_eq(size_a, size_b);
+    assert_true(memcmp(a, b, size_a) == 0);
+    free(a);
+    free(b);
+}
+
+static void test_link_errors() {
+    char *undef[] = {test_path("main.o")};
+    char *dup[] = {test_path("main.o"), test_path("main.o"), test_path("many_symbols.o")};
+    char *not_obj[] = {test_path("a.bin")};
+    char *out = test_path("err.elf");
+    long size;
+
+    /* print_something and g_text are undefined */
+    assert_int_eq(2, link_quiet(undef, 1, out, LD_ELF, 1));
+    assert_true(read_output(out, &size) == NULL);
+    /* _start, g_in_main, g_text_ptr */
+    assert_int_eq(3, link_quiet(dup, 3, out, LD_ELF, 1));
+    assert_int_eq(1, link_quiet(not_obj, 1, out, LD_ELF, 1));
+}
+
+static void test_branch_out_of_range() {
+    struct ObjWriter w;
+    int text, far;
+    unsigned int bl = 0xebfffffe;
+    char *inputs[] = {test_path("far.o")};
+
+    obj_init(&w);
+    text = obj_add_section(&w, ".text", SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, 4);
+    obj_append(&w, text, &bl, 4, 4);
+    obj_add_symbol(&w, "_start", STB_GLOBAL, STT_FUNC, text, 0, 4);
+    far = obj_add_symbol(&w, "far", STB_GLOBAL, STT_FUNC, SHN_ABS, 0x8000000, 0);
+    obj_add_rel(&w, text, 0, far, R_ARM_JUMP24);
+    assert_true(obj_write(&w, inputs[0]) == 0);
+    obj_free(&w);
+
+    assert_int_eq(1, link_quiet(inputs, 1, test_path("far.elf"), LD_ELF, 1));
+}
+
+static void run_unit_tests() {
+    char cmd[256];
+
+    assert_true(mkdtemp(test_dir) != NULL);
+    test_link_elf();
+    test_link_bin();
+    test_link_jobs_same_output();
+    test_link_errors();
+    test_branch_out_of_range();
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", test_dir);
+    system(cmd);
+}
+
+static void usage() {
+    fprintf(stderr, "Usage: mini_ld [-bin] [-jN] [-base addr] [-e entry] -o out a.o b.o ...\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    struct LdOptions opt;
+    char *output = NULL;
+    int i;
+
+    if(argc < 2) {
+        run_unit_tests();
+        return 0;
+    }
+
+    ld_default_options(&opt);
+    for(i = 1; i < argc && argv[i][0] == '-'; i++) {
+        if(strcmp(argv[i], "-bin") == 0) {
+            opt.format = LD_BIN;
+        } else if(strncmp(argv[i], "-j", 2) == 0) {
+            opt.jobs = atoi(argv[i] + 2);
+        } else if(strcmp(argv[i], "-base") == 0 && i + 1 < argc) {
+            opt.base = strtoul(argv[++i], NULL, 0);
+        } else if(strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+            opt.entry = argv[++i];
+        } else if(strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else {
+            usage();
+        }
+    }
+    if(output == NULL || i == argc)
+        usage();
+    return ld_link(argv + i, argc - i, output, &opt) == 0 ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,32 @@
+/*
+Minimal static linker of ELF32 ARM relocatable objects.
+
+.text, .rodata, .data and .bss of the inputs are concatenated in this order,
+and COMMON symbols are allocated at the end of .bss.
+*/
+#include <stdio.h>
+
+#define LD_DEFAULT_BASE 0x00010000
+/* data segment is placed at the same offset in the next page, like ld of ARM */
+#define LD_PAGE 0x10000
+
+enum LdFormat {
+    LD_ELF,         /* ET_EXEC, .bss as NOBITS */
+    LD_BIN          /* flat image from the base, .bss is not written */
+};
+
+struct LdOptions {
+    int format;
+    unsigned int base;      /* address of the first byte of the output */
+    int jobs;               /* threads to copy and relocate sections, 0 for the number of CPUs */
+    char *entry;            /* NULL for _start, then main, then the start of .text */
+    FILE *diag;             /* NULL for stderr */
+};
+
+void ld_default_options(struct LdOptions *opt);
+
+/*
+Link inputs to output.
+Return 0 on success, or the number of errors, in which case output is removed.
+*/
+int ld_link(char **inputs, int input_num, char *output, struct LdOptions *opt);
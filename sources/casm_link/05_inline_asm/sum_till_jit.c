@@ -1,5 +1,6 @@
 #include <stdio.h>
-#include <sys/mman.h>
+
+#include "../arm_emit/arm_emit.h"
 
 int sum_till(int a) {
     int sum=0;
@@ -33,22 +34,179 @@ int sum_till_inline(int a) {
 JIT
 */
 int *binary_buf;
+static struct Emitter emitter;
+static int emitter_ready;
+
+/*
+Same as sum_till_inline.
+r0: a, r1: i, r2: sum
+*/
+int *jit_sum_till() {
+    struct Emitter *e = &emitter;
+    int loop, end;
 
-int* allocate_executable_buf(int size) {
-    return (int*)mmap(0, size,
-                 PROT_READ | PROT_WRITE | PROT_EXEC,
-                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(emitter_ready) {
+        emitter_reset(e);
+    } else {
+        emitter_init(e, 16);
+        emitter_ready = 1;
+    }
+    loop = emit_new_label(e);
+    end = emit_new_label(e);
+
+    emit_mov_imm(e, 1, 0);          // mov r1, #0
+    emit_mov_imm(e, 2, 0);          // mov r2, #0
+    emit_bind_label(e, loop);       // loop:
+    emit_cmp(e, 0, 1);              // cmp r0, r1
+    emit_b_cond(e, COND_EQ, end);   // beq end
+    emit_add(e, 2, 2, 1);           // add r2, r2, r1
+    emit_add_imm(e, 1, 1, 1);       // add r1, r1, #1
+    emit_b(e, loop);                // b loop
+    emit_bind_label(e, end);        // end:
+    emit_mov(e, 0, 2);              // mov r0, r2
+    emit_ret(e);                    // mov r15, r14
+
+    return emitter_finish(e);
 }
 
 
-void jit_sum_till() {
-    /* TODO:
-    Place binary to binary_buf here.
-    Hint: put almost the same binary as sum_till_inline.
-    Compile and use arm-linux-gnueabi-objdump -S ./a.out to check binary.
-    */
-    // dummy implementation 
-    binary_buf[0] = 0xe1a0f00e; // mov r15, r14
+/*
+Value specialization
+
+Most callers pass the same a over and over.
+After SPEC_THRESHOLD calls with the same a, compile a version which
+returns the precomputed result, guarded by "cmp r0, #a".
+When the guard fails, it jumps to the generic code above, so the
+specialized entry is always safe to call.
+
+hits and guard_failures are incremented by the generated code itself.
+If guard failures since the last specialization exceed hits by SPEC_FAILURE_LIMIT,
+the site goes back to the generic code and starts recording again.
+*/
+#define SPEC_THRESHOLD 16
+#define SPEC_FAILURE_LIMIT 64
+
+struct SpecSite {
+    int *generic;
+    int *entry;
+    struct Emitter spec;
+    int is_specialized;
+    int spec_arg;
+    int last_arg;
+    int same_count;
+    int hits;
+    int guard_failures;
+    int hits_at_spec;
+    int failures_at_spec;
+    int spec_count;
+};
+
+/*
+Same result as the loop, including wrap around for negative a
+(the loop runs until i wraps to a).
+*/
+static int sum_till_closed_form(int a) {
+    unsigned int n = (unsigned int)a;
+    if(n % 2 == 0)
+        return (int)((n/2)*(n-1));
+    return (int)(n*((n-1)/2));
+}
+
+/*
+r0: a
+cmp r0, #a
+bne fail
+(*hits)++
+mov r0, #sum
+mov r15, r14
+fail:
+(*guard_failures)++
+jump to generic
+*/
+static int *jit_sum_till_specialized(struct SpecSite *site, int a) {
+    struct Emitter *e = &site->spec;
+    int fail;
+
+    emitter_reset(e);
+    fail = emit_new_label(e);
+
+    emit_cmp_const(e, 0, a, 2);
+    emit_b_cond(e, COND_NE, fail);
+    emit_counter_inc(e, &site->hits, 2, 3);
+    emit_mov_imm(e, 0, sum_till_closed_form(a));
+    emit_ret(e);
+    emit_bind_label(e, fail);
+    emit_counter_inc(e, &site->guard_failures, 2, 3);
+    emit_jump_abs(e, site->generic);
+
+    return emitter_finish(e);
+}
+
+void spec_site_init(struct SpecSite *site, int *generic) {
+    site->generic = generic;
+    site->entry = generic;
+    emitter_init(&site->spec, 16);
+    site->is_specialized = 0;
+    site->spec_arg = 0;
+    site->last_arg = 0;
+    site->same_count = 0;
+    site->hits = 0;
+    site->guard_failures = 0;
+    site->hits_at_spec = 0;
+    site->failures_at_spec = 0;
+    site->spec_count = 0;
+}
+
+void spec_site_free(struct SpecSite *site) {
+    emitter_free(&site->spec);
+}
+
+static void spec_site_record(struct SpecSite *site, int a) {
+    int *entry;
+
+    if(site->same_count > 0 && site->last_arg == a) {
+        site->same_count++;
+    } else {
+        site->last_arg = a;
+        site->same_count = 1;
+    }
+    if(site->same_count < SPEC_THRESHOLD)
+        return;
+
+    entry = jit_sum_till_specialized(site, a);
+    if(entry == NULL) {
+        // emitter error is already printed, stay on the generic code.
+        site->same_count = 0;
+        return;
+    }
+    site->spec_arg = a;
+    site->entry = entry;
+    site->is_specialized = 1;
+    site->hits_at_spec = site->hits;
+    site->failures_at_spec = site->guard_failures;
+    site->spec_count++;
+}
+
+static void spec_site_check(struct SpecSite *site) {
+    int hits = site->hits - site->hits_at_spec;
+    int failures = site->guard_failures - site->failures_at_spec;
+
+    if(failures <= hits + SPEC_FAILURE_LIMIT)
+        return;
+    // mostly other values, the guard only costs.
+    site->entry = site->generic;
+    site->is_specialized = 0;
+    site->same_count = 0;
+}
+
+int sum_till_call(struct SpecSite *site, int a) {
+    int (*funcvar)(int) = (int(*)(int))site->entry;
+
+    if(site->is_specialized)
+        spec_site_check(site);
+    else
+        spec_site_record(site, a);
+    return funcvar(a);
 }
 
 
@@ -64,6 +222,53 @@ void assert_true(int boolflag) {
 }
 
 
+static void test_sum_till_closed_form() {
+    int i;
+    for(i = 0; i < 1000; i++)
+        assert_true(sum_till_closed_form(i) == sum_till(i));
+    // loop wraps around for negative a.
+    assert_true(sum_till_closed_form(-1) == (int)(0xffffffffu*(0xfffffffeu/2)));
+}
+
+static void test_spec_site() {
+    struct SpecSite site;
+    int i;
+
+    spec_site_init(&site, binary_buf);
+
+    for(i = 0; i < SPEC_THRESHOLD; i++)
+        assert_true(sum_till_call(&site, 100000) == sum_till(100000));
+    assert_true(site.is_specialized);
+    assert_true(site.spec_arg == 100000);
+
+    for(i = 0; i < 10; i++)
+        assert_true(sum_till_call(&site, 100000) == sum_till(100000));
+    assert_true(site.hits == 10);
+    assert_true(site.guard_failures == 0);
+
+    // guard failure falls back to generic code with correct result.
+    assert_true(sum_till_call(&site, 10) == 45);
+    assert_true(site.guard_failures == 1);
+    assert_true(site.is_specialized);
+
+    // other values dominate, deoptimize.
+    for(i = 0; i < 10 + SPEC_FAILURE_LIMIT + 1; i++)
+        assert_true(sum_till_call(&site, i) == sum_till(i));
+    assert_true(!site.is_specialized);
+    assert_true(site.entry == site.generic);
+
+    // and specialize again for a new hot value.
+    for(i = 0; i < SPEC_THRESHOLD; i++)
+        sum_till_call(&site, 7);
+    assert_true(site.is_specialized);
+    assert_true(site.spec_arg == 7);
+    assert_true(site.spec_count == 2);
+    assert_true(sum_till_call(&site, 7) == 21);
+
+    spec_site_free(&site);
+}
+
+
 int main() {
     int res;
     int (*funcvar)(int);
@@ -74,11 +279,7 @@ int main() {
     res = sum_till_inline(10);
     assert_true(res == 45);
 
-    /* TODO: Pass below code.
-    */
-    binary_buf = allocate_executable_buf(1024);
-
-    jit_sum_till();
+    binary_buf = jit_sum_till();
 
     funcvar = (int(*)(int))binary_buf;
     res = funcvar(10);
@@ -87,6 +288,14 @@ int main() {
     res = funcvar(11);
     assert_true(res == 55);
 
+    // compiling again reuses the buffer of the emitter.
+    assert_true(jit_sum_till() == binary_buf);
+    res = funcvar(11);
+    assert_true(res == 55);
+
+    test_sum_till_closed_form();
+    test_spec_site();
+
     return 0;
 }
 
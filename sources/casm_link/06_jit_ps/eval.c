@@ -1,32 +1,36 @@
 #include "parser.h"
+#include "program.h"
+#include "eval.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
 
-static int stack_pos = 0;
-static int stack[1024];
-void stack_push(int val) {
-    stack[stack_pos++] = val;
+void stack_push(struct EvalContext *ctx, int val) {
+    if(ctx->stack_pos == EVAL_STACK_SIZE) {
+        fprintf(stderr, "stack overflow, exit.\n");
+        exit(1);
+    }
+    ctx->stack[ctx->stack_pos++] = val;
 }
-int stack_pop() {
-    if(stack_pos == 0) {
+int stack_pop(struct EvalContext *ctx) {
+    if(ctx->stack_pos == 0) {
         fprintf(stderr, "stack pop while stack is empty, exit.\n");
         exit(1);
     }
-    return stack[--stack_pos];
+    return ctx->stack[--ctx->stack_pos];
 }
 
-int eval(int r0, int r1, char *str) {    
+int eval_unoptimized_ctx(struct EvalContext *ctx, int r0, int r1, char *str) {
     struct Substr remain={str, strlen(str)};
     int val;
 
-    stack_pos = 0;
+    ctx->stack_pos = 0;
 
     while(!is_end(&remain)) {
         skip_space(&remain);
         if(is_number(remain.ptr)) {
-            stack_push(parse_number(remain.ptr));
+            stack_push(ctx, parse_number(remain.ptr));
             skip_token(&remain);
             continue;
         }else if(is_register(remain.ptr)) {
@@ -35,7 +39,7 @@ int eval(int r0, int r1, char *str) {
             } else {
                 val = r0;
             }
-            stack_push(val);
+            stack_push(ctx, val);
             skip_token(&remain);
             continue;
         } else {
@@ -43,29 +47,53 @@ int eval(int r0, int r1, char *str) {
             int arg1, arg2;
 
             val = parse_word(&remain);
+            if(val == OP_UNKNOWN) {
+                fprintf(stderr, "Unknown word, %s\n", remain.ptr);
+                exit(1);
+            }
             skip_token(&remain);
 
-            arg2 = stack_pop();
-            arg1 = stack_pop();
+            arg2 = stack_pop(ctx);
+            arg1 = stack_pop(ctx);
 
             switch(val) {
                 case OP_ADD:
-                    stack_push(arg1+arg2);
+                    stack_push(ctx, arg1+arg2);
                     break;
                 case OP_SUB:
-                    stack_push(arg1-arg2);
+                    stack_push(ctx, arg1-arg2);
                     break;
                 case OP_MUL:
-                    stack_push(arg1*arg2);                
+                    stack_push(ctx, arg1*arg2);                
                     break;
                 case OP_DIV:
-                    stack_push(arg1/arg2);
+                    stack_push(ctx, arg1/arg2);
                     break;
             }
             continue;
         }
     }
-    return stack_pop();
+    return stack_pop(ctx);
+}
+
+int eval_unoptimized(int r0, int r1, char *str) {
+    struct EvalContext ctx;
+    return eval_unoptimized_ctx(&ctx, r0, r1, str);
+}
+
+/*
+Compile and run str. Use compile and run directly
+when the same expression is evaluated many times.
+*/
+int eval(int r0, int r1, char *str) {
+    struct Program *prog = compile(str);
+    int res;
+
+    if(prog == NULL)
+        exit(1);
+    res = run(prog, r0, r1);
+    program_free(prog);
+    return res;
 }
 
 #include "test_util.h"
@@ -76,8 +104,112 @@ static void test_eval() {
     assert_int_eq(21, actual);    
 }
 
+static void test_eval_unoptimized() {
+    int actual;
+    actual = eval_unoptimized(1, 5, "3 7 add r1 sub 4 mul r0 add");
+    assert_int_eq(21, actual);
+}
+
+/*
+Random expression generator for differential test.
+Values are tracked while generating so that
+the expression never divides by zero nor overflows.
+*/
+static char *gen_pos;
+
+static void gen_token(char *token) {
+    gen_pos += sprintf(gen_pos, "%s ", token);
+}
+
+static int gen_operand(int r0, int r1, char *out_token) {
+    static int interesting[] = {0, 1, 2, 3, 4, 5, 7, 8, 10, 16, 25, 64, 100, 1000, 65536};
+    switch(rand()%4) {
+        case 0:
+            strcpy(out_token, "r0");
+            return r0;
+        case 1:
+            strcpy(out_token, "r1");
+            return r1;
+        case 2: {
+            int val = interesting[rand()%(sizeof(interesting)/sizeof(int))];
+            sprintf(out_token, "%d", val);
+            return val;
+        }
+    }
+    sprintf(out_token, "%d", rand()%100000);
+    return atoi(out_token);
+}
+
+static int gen_fits(long long val) {
+    return val >= -2147483647LL-1 && val <= 2147483647LL;
+}
+
+/*
+Emit postfix expression of given depth into gen_pos and return its value.
+*/
+static int gen_expr(int depth, int r0, int r1) {
+    static char *ops[] = {"add", "sub", "mul", "div"};
+    char token[16];
+    long long arg1, arg2, val;
+    int op;
+
+    if(depth == 0 || rand()%4 == 0) {
+        val = gen_operand(r0, r1, token);
+        gen_token(token);
+        return (int)val;
+    }
+
+    arg1 = gen_expr(depth-1, r0, r1);
+    /* sometimes reuse the same sub expression to exercise CSE and x-x. */
+    if(rand()%8 == 0) {
+        gen_token("r0");
+        arg2 = r0;
+    } else {
+        arg2 = gen_expr(depth-1, r0, r1);
+    }
+
+    for(op = rand()%4; ; op = (op+1)%4) {
+        switch(op) {
+            case 0: val = arg1+arg2; break;
+            case 1: val = arg1-arg2; break;
+            case 2: val = arg1*arg2; break;
+            default:
+                if(arg2 == 0 || (arg1 == -2147483647LL-1 && arg2 == -1))
+                    continue;
+                val = arg1/arg2;
+                break;
+        }
+        if(gen_fits(val))
+            break;
+    }
+    gen_token(ops[op]);
+    return (int)val;
+}
+
+static void test_eval_random_differential() {
+    static int regs[] = {0, 1, -1, 7, -7, 100, -100, 2147483647, -2147483647-1};
+    char buf[64*1024];
+    int i;
+
+    srand(1);
+    for(i = 0; i < 10000; i++) {
+        int r0 = rand()%2 ? regs[rand()%(sizeof(regs)/sizeof(int))] : rand()-RAND_MAX/2;
+        int r1 = rand()%2 ? regs[rand()%(sizeof(regs)/sizeof(int))] : rand()-RAND_MAX/2;
+        int expect;
+
+        gen_pos = buf;
+        expect = gen_expr(rand()%6, r0, r1);
+        gen_pos[-1] = '\0';
+
+        assert_int_eq(expect, eval_unoptimized(r0, r1, buf));
+        assert_int_eq(expect, eval(r0, r1, buf));
+    }
+}
+
 static void run_unit_tests() {
     test_eval();
+    test_eval_unoptimized();
+    test_eval_random_differential();
 
     printf("all test done\n");
 }
@@ -0,0 +1,22 @@
+#define EVAL_STACK_SIZE 1024
+
+/*
+All state of one evaluation.
+Each thread should use its own context.
+*/
+struct EvalContext {
+    int stack_pos;
+    int stack[EVAL_STACK_SIZE];
+};
+
+/*
+Execute str as written, without any optimization.
+Used as the reference of eval.
+*/
+int eval_unoptimized_ctx(struct EvalContext *ctx, int r0, int r1, char *str);
+int eval_unoptimized(int r0, int r1, char *str);
+
+/*
+Optimize and evaluate str. This is reentrant.
+*/
+int eval(int r0, int r1, char *str);
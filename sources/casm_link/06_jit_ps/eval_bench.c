@@ -0,0 +1,54 @@
+/*
+Benchmark of string eval against precompiled Program.
+
+gcc -O2 eval_bench.c eval.c program.c int_array.c optimizer.c parser.c
+*/
+#include <stdio.h>
+#include <time.h>
+
+#include "program.h"
+#include "eval.h"
+
+#define CALL_NUM 1000000
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static void report(char *name, double begin, int sum) {
+    double elapsed = now_sec() - begin;
+    printf("%-16s %12.0f calls/sec (checksum %d)\n", name, CALL_NUM/elapsed, sum);
+}
+
+static void bench(char *str) {
+    struct Program *prog;
+    double begin;
+    int i, sum;
+
+    printf("%s\n", str);
+
+    begin = now_sec();
+    for(i = 0, sum = 0; i < CALL_NUM; i++)
+        sum += eval_unoptimized(i, i+1, str);
+    report("eval_unoptimized", begin, sum);
+
+    begin = now_sec();
+    for(i = 0, sum = 0; i < CALL_NUM; i++)
+        sum += eval(i, i+1, str);
+    report("eval", begin, sum);
+
+    begin = now_sec();
+    prog = compile(str);
+    for(i = 0, sum = 0; i < CALL_NUM; i++)
+        sum += run(prog, i, i+1);
+    report("compile+run", begin, sum);
+    program_free(prog);
+}
+
+int main() {
+    bench("3 7 add r1 sub 4 mul r0 add");
+    bench("r0 r1 add r0 r1 add mul 7 div r1 3 mul sub 2 div");
+    return 0;
+}
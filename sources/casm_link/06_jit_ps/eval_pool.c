@@ -0,0 +1,296 @@
+#include "program.h"
+#include "eval_pool.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+
+/*
+Jobs taken from own range at once.
+Large enough to make locking cost negligible, small enough to balance.
+*/
+#define CHUNK_SIZE 64
+
+struct Worker {
+    struct EvalPool *pool;
+    int id;
+    pthread_t thread;
+
+    /* jobs [begin, end) not taken yet. guarded by lock. */
+    pthread_mutex_t lock;
+    int begin;
+    int end;
+
+    /* last compiled expression. valid only while one eval_pool_run. */
+    char *cached_str;
+    struct Program *cached_prog;
+    int error_num;
+} __attribute__((aligned(64)));
+
+struct EvalPool {
+    int thread_num;
+    struct Worker *workers;
+
+    pthread_mutex_t lock;
+    pthread_cond_t start_cond;
+    pthread_cond_t done_cond;
+    int generation;
+    int running;
+    int shutdown;
+
+    struct EvalJob *jobs;
+    int *results;
+};
+
+
+static int take_chunk(struct Worker *w, int *out_begin, int *out_end) {
+    int found = 0;
+
+    pthread_mutex_lock(&w->lock);
+    if(w->begin < w->end) {
+        *out_begin = w->begin;
+        *out_end = w->begin + CHUNK_SIZE < w->end ? w->begin + CHUNK_SIZE : w->end;
+        w->begin = *out_end;
+        found = 1;
+    }
+    pthread_mutex_unlock(&w->lock);
+    return found;
+}
+
+/*
+Take upper half of the remaining jobs of some other worker into own range.
+*/
+static int steal(struct Worker *w) {
+    struct EvalPool *pool = w->pool;
+    int i;
+
+    for(i = 1; i < pool->thread_num; i++) {
+        struct Worker *victim = &pool->workers[(w->id + i) % pool->thread_num];
+        int begin = 0, end = 0;
+
+        pthread_mutex_lock(&victim->lock);
+        if(victim->begin < victim->end) {
+            begin = victim->begin + (victim->end - victim->begin)/2;
+            end = victim->end;
+            victim->end = begin;
+        }
+        pthread_mutex_unlock(&victim->lock);
+
+        if(begin < end) {
+            pthread_mutex_lock(&w->lock);
+            w->begin = begin;
+            w->end = end;
+            pthread_mutex_unlock(&w->lock);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void eval_job(struct Worker *w, int idx) {
+    struct EvalJob *job = &w->pool->jobs[idx];
+
+    if(w->cached_str == NULL || strcmp(w->cached_str, job->str) != 0) {
+        if(w->cached_prog != NULL)
+            program_free(w->cached_prog);
+        w->cached_str = job->str;
+        w->cached_prog = compile(job->str);
+    }
+
+    if(w->cached_prog == NULL) {
+        w->error_num++;
+        w->pool->results[idx] = 0;
+        return;
+    }
+    w->pool->results[idx] = run(w->cached_prog, job->r0, job->r1);
+}
+
+static void work(struct Worker *w) {
+    int begin, end, i;
+
+    while(take_chunk(w, &begin, &end) || (steal(w) && take_chunk(w, &begin, &end))) {
+        for(i = begin; i < end; i++)
+            eval_job(w, i);
+    }
+
+    if(w->cached_prog != NULL)
+        program_free(w->cached_prog);
+    w->cached_str = NULL;
+    w->cached_prog = NULL;
+}
+
+static void *worker_main(void *arg) {
+    struct Worker *w = arg;
+    struct EvalPool *pool = w->pool;
+    int seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for(;;) {
+        while(pool->generation == seen && !pool->shutdown)
+            pthread_cond_wait(&pool->start_cond, &pool->lock);
+        if(pool->shutdown)
+            break;
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        work(w);
+
+        pthread_mutex_lock(&pool->lock);
+        if(--pool->running == 0)
+            pthread_cond_signal(&pool->done_cond);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+struct EvalPool *eval_pool_new(int thread_num) {
+    struct EvalPool *pool;
+    int i;
+
+    if(thread_num <= 0)
+        thread_num = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if(thread_num <= 0)
+        thread_num = 1;
+
+    pool = calloc(1, sizeof(struct EvalPool));
+    pool->thread_num = thread_num;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+
+    if(posix_memalign((void**)&pool->workers, 64, sizeof(struct Worker)*thread_num) != 0) {
+        fprintf(stderr, "can not allocate workers, exit.\n");
+        exit(1);
+    }
+    memset(pool->workers, 0, sizeof(struct Worker)*thread_num);
+
+    // worker 0 is the caller of eval_pool_run.
+    for(i = 0; i < thread_num; i++) {
+        struct Worker *w = &pool->workers[i];
+        w->pool = pool;
+        w->id = i;
+        pthread_mutex_init(&w->lock, NULL);
+        if(i != 0)
+            pthread_create(&w->thread, NULL, worker_main, w);
+    }
+    return pool;
+}
+
+void eval_pool_free(struct EvalPool *pool) {
+    int i;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->start_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for(i = 0; i < pool->thread_num; i++) {
+        if(i != 0)
+            pthread_join(pool->workers[i].thread, NULL);
+        pthread_mutex_destroy(&pool->workers[i].lock);
+    }
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_cond_destroy(&pool->start_cond);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->workers);
+    free(pool);
+}
+
+int eval_pool_thread_num(struct EvalPool *pool) {
+    return pool->thread_num;
+}
+
+int eval_pool_run(struct EvalPool *pool, struct EvalJob *jobs, int job_num, int *out_results) {
+    int i, error_num = 0;
+
+    pool->jobs = jobs;
+    pool->results = out_results;
+
+    // split jobs evenly. stealing fixes the imbalance.
+    for(i = 0; i < pool->thread_num; i++) {
+        struct Worker *w = &pool->workers[i];
+        w->begin = (int)((long long)job_num * i / pool->thread_num);
+        w->end = (int)((long long)job_num * (i+1) / pool->thread_num);
+        w->error_num = 0;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->running = pool->thread_num-1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    work(&pool->workers[0]);
+
+    pthread_mutex_lock(&pool->lock);
+    while(pool->running != 0)
+        pthread_cond_wait(&pool->done_cond, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+
+    for(i = 0; i < pool->thread_num; i++)
+        error_num += pool->workers[i].error_num;
+    return error_num;
+}
+
+
+
+/*
+test code
+*/
+#include "eval.h"
+#include "test_util.h"
+
+static void test_eval_pool_result_order() {
+    static char *exprs[] = {"r0 r1 add", "r0 7 div r1 sub", "3 r0 mul r1 2 div add"};
+    struct EvalPool *pool = eval_pool_new(4);
+    int job_num = 10000;
+    struct EvalJob *jobs = malloc(sizeof(struct EvalJob)*job_num);
+    int *results = malloc(sizeof(int)*job_num);
+    int i;
+
+    for(i = 0; i < job_num; i++) {
+        jobs[i].str = exprs[(i/100) % 3];
+        jobs[i].r0 = i;
+        jobs[i].r1 = -i;
+    }
+
+    assert_int_eq(0, eval_pool_run(pool, jobs, job_num, results));
+    for(i = 0; i < job_num; i++)
+        assert_int_eq(eval_unoptimized(jobs[i].r0, jobs[i].r1, jobs[i].str), results[i]);
+
+    // pool can be reused.
+    assert_int_eq(0, eval_pool_run(pool, jobs, 5, results));
+    assert_int_eq(0, results[0]);
+
+    eval_pool_free(pool);
+    free(results);
+    free(jobs);
+}
+
+static void test_eval_pool_compile_error() {
+    struct EvalPool *pool = eval_pool_new(2);
+    struct EvalJob jobs[] = {{"1 2 add", 0, 0}, {"1 foo", 0, 0}, {"r0", 5, 0}};
+    int results[3];
+
+    assert_int_eq(1, eval_pool_run(pool, jobs, 3, results));
+    assert_int_eq(3, results[0]);
+    assert_int_eq(0, results[1]);
+    assert_int_eq(5, results[2]);
+
+    eval_pool_free(pool);
+}
+
+static void run_unit_tests() {
+    test_eval_pool_result_order();
+    test_eval_pool_compile_error();
+
+    printf("all test done\n");
+}
+
+#if 0
+int main() {
+    run_unit_tests();
+    return 0;
+}
+#endif
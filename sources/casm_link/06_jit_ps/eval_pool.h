@@ -0,0 +1,23 @@
+struct EvalJob {
+    char *str;
+    int r0;
+    int r1;
+};
+
+struct EvalPool;
+
+/*
+Create pool with thread_num threads including the caller.
+thread_num 0 means one thread per online core.
+*/
+struct EvalPool *eval_pool_new(int thread_num);
+void eval_pool_free(struct EvalPool *pool);
+
+int eval_pool_thread_num(struct EvalPool *pool);
+
+/*
+Evaluate all jobs and store each result to out_results[i].
+Each thread starts from its own part of jobs and steals the rest from others.
+Return the number of jobs whose expression failed to compile (their result is 0).
+*/
+int eval_pool_run(struct EvalPool *pool, struct EvalJob *jobs, int job_num, int *out_results);
@@ -0,0 +1,73 @@
+/*
+Scaling benchmark of eval_pool.
+
+gcc -O2 -pthread eval_pool_bench.c eval_pool.c eval.c program.c int_array.c optimizer.c parser.c
+./a.out [max_threads]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "eval_pool.h"
+
+#define JOB_NUM (4*1024*1024)
+#define REPEAT 5
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static double bench(int thread_num, struct EvalJob *jobs, int *results) {
+    struct EvalPool *pool = eval_pool_new(thread_num);
+    double begin, best = 0;
+    int i;
+
+    for(i = 0; i < REPEAT; i++) {
+        double elapsed;
+        begin = now_sec();
+        eval_pool_run(pool, jobs, JOB_NUM, results);
+        elapsed = now_sec() - begin;
+        if(i == 0 || elapsed < best)
+            best = elapsed;
+    }
+    eval_pool_free(pool);
+    return JOB_NUM/best;
+}
+
+int main(int argc, char **argv) {
+    static char *exprs[] = {
+        "3 7 add r1 sub 4 mul r0 add",
+        "r0 r1 add r0 r1 add mul 7 div r1 3 mul sub 2 div",
+        "r0 r1 div r1 r0 sub mul",
+        "r0 100 mul r1 10 div add"
+    };
+    int max_threads = argc > 1 ? atoi(argv[1]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    struct EvalJob *jobs = malloc(sizeof(struct EvalJob)*JOB_NUM);
+    int *results = malloc(sizeof(int)*JOB_NUM);
+    double base = 0;
+    int i;
+
+    // runs of the same expression like real batches, with varying length.
+    for(i = 0; i < JOB_NUM; i++) {
+        jobs[i].str = exprs[(i/1000) % 4];
+        jobs[i].r0 = i;
+        jobs[i].r1 = i%13+1;
+    }
+
+    printf("threads       jobs/sec  speedup\n");
+    for(i = 1; i <= max_threads; i = i < max_threads && i*2 > max_threads ? max_threads : i*2) {
+        double rate = bench(i, jobs, results);
+        if(i == 1)
+            base = rate;
+        printf("%7d %14.0f %8.2f\n", i, rate, rate/base);
+        if(i == max_threads)
+            break;
+    }
+
+    free(results);
+    free(jobs);
+    return 0;
+}
@@ -0,0 +1,554 @@
+#include "int_array.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define INT_ARRAY_X86
+#endif
+
+struct IntArrayKernels {
+    char *isa;
+    void (*add)(int *out, int *a, int *b, int n);
+    void (*sub)(int *out, int *a, int *b, int n);
+    void (*mul)(int *out, int *a, int *b, int n);
+    void (*add_scalar)(int *out, int *a, int value, int n);
+    void (*sub_scalar)(int *out, int *a, int value, int n);
+    void (*rsb_scalar)(int *out, int *a, int value, int n);
+    void (*mul_scalar)(int *out, int *a, int value, int n);
+    long long (*sum)(int *a, int n);
+    int (*min)(int *a, int n);
+    int (*max)(int *a, int n);
+    void (*fill)(int *out, int value, int n);
+};
+
+
+/*
+scalar kernels, also used for the tails of the vector kernels.
+*/
+
+#define SCALAR_BINARY(name, expr) \
+static void scalar_##name(int *out, int *a, int *b, int n) { \
+    int i; \
+    for(i = 0; i < n; i++) { \
+        unsigned int x = a[i], y = b[i]; \
+        out[i] = (int)(expr); \
+    } \
+} \
+static void scalar_##name##_scalar(int *out, int *a, int value, int n) { \
+    int i; \
+    for(i = 0; i < n; i++) { \
+        unsigned int x = a[i], y = value; \
+        out[i] = (int)(expr); \
+    } \
+}
+
+SCALAR_BINARY(add, x + y)
+SCALAR_BINARY(sub, x - y)
+SCALAR_BINARY(mul, x * y)
+
+static void scalar_rsb_scalar(int *out, int *a, int value, int n) {
+    int i;
+    for(i = 0; i < n; i++)
+        out[i] = (int)((unsigned int)value - (unsigned int)a[i]);
+}
+
+static long long scalar_sum(int *a, int n) {
+    long long sum = 0;
+    int i;
+    for(i = 0; i < n; i++)
+        sum += a[i];
+    return sum;
+}
+
+static int scalar_min(int *a, int n) {
+    int res = a[0];
+    int i;
+    for(i = 1; i < n; i++)
+        if(a[i] < res)
+            res = a[i];
+    return res;
+}
+
+static int scalar_max(int *a, int n) {
+    int res = a[0];
+    int i;
+    for(i = 1; i < n; i++)
+        if(a[i] > res)
+            res = a[i];
+    return res;
+}
+
+static void scalar_fill(int *out, int value, int n) {
+    int i;
+    for(i = 0; i < n; i++)
+        out[i] = value;
+}
+
+static struct IntArrayKernels scalar_kernels = {
+    "scalar",
+    scalar_add, scalar_sub, scalar_mul,
+    scalar_add_scalar, scalar_sub_scalar, scalar_rsb_scalar, scalar_mul_scalar,
+    scalar_sum, scalar_min, scalar_max,
+    scalar_fill
+};
+
+
+#ifdef INT_ARRAY_X86
+
+/*
+SSE2 kernels, always available on x86-64.
+SSE2 has no 32bit mullo and no 32bit min/max, they are built from the 64bit multiply and compare.
+*/
+
+static __m128i sse2_lanes_add(__m128i x, __m128i y) { return _mm_add_epi32(x, y); }
+static __m128i sse2_lanes_sub(__m128i x, __m128i y) { return _mm_sub_epi32(x, y); }
+static __m128i sse2_lanes_rsb(__m128i x, __m128i y) { return _mm_sub_epi32(y, x); }
+
+static __m128i sse2_lanes_mul(__m128i x, __m128i y) {
+    __m128i even = _mm_mul_epu32(x, y);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(x, 32), _mm_srli_epi64(y, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+static __m128i sse2_select(__m128i mask, __m128i x, __m128i y) {
+    return _mm_or_si128(_mm_and_si128(mask, x), _mm_andnot_si128(mask, y));
+}
+
+#define SSE2_BINARY(name) \
+static void sse2_##name(int *out, int *a, int *b, int n) { \
+    int i; \
+    for(i = 0; i + 4 <= n; i += 4) { \
+        __m128i x = _mm_loadu_si128((__m128i*)(a + i)); \
+        __m128i y = _mm_loadu_si128((__m128i*)(b + i)); \
+        _mm_storeu_si128((__m128i*)(out + i), sse2_lanes_##name(x, y)); \
+    } \
+    scalar_##name(out + i, a + i, b + i, n - i); \
+}
+
+#define SSE2_SCALAR(name) \
+static void sse2_##name##_scalar(int *out, int *a, int value, int n) { \
+    __m128i y = _mm_set1_epi32(value); \
+    int i; \
+    for(i = 0; i + 4 <= n; i += 4) { \
+        __m128i x = _mm_loadu_si128((__m128i*)(a + i)); \
+        _mm_storeu_si128((__m128i*)(out + i), sse2_lanes_##name(x, y)); \
+    } \
+    scalar_##name##_scalar(out + i, a + i, value, n - i); \
+}
+
+SSE2_BINARY(add)
+SSE2_BINARY(sub)
+SSE2_BINARY(mul)
+SSE2_SCALAR(add)
+SSE2_SCALAR(sub)
+SSE2_SCALAR(rsb)
+SSE2_SCALAR(mul)
+
+static long long sse2_sum(int *a, int n) {
+    __m128i acc = _mm_setzero_si128();
+    long long lanes[2];
+    int i;
+
+    for(i = 0; i + 4 <= n; i += 4) {
+        __m128i x = _mm_loadu_si128((__m128i*)(a + i));
+        __m128i sign = _mm_srai_epi32(x, 31);
+        acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(x, sign));
+        acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(x, sign));
+    }
+    _mm_storeu_si128((__m128i*)lanes, acc);
+    return lanes[0] + lanes[1] + scalar_sum(a + i, n - i);
+}
+
+static int sse2_min(int *a, int n) {
+    __m128i acc;
+    int lanes[4];
+    int i, res;
+
+    if(n < 4)
+        return scalar_min(a, n);
+    acc = _mm_loadu_si128((__m128i*)a);
+    for(i = 4; i + 4 <= n; i += 4) {
+        __m128i x = _mm_loadu_si128((__m128i*)(a + i));
+        acc = sse2_select(_mm_cmpgt_epi32(acc, x), x, acc);
+    }
+    _mm_storeu_si128((__m128i*)lanes, acc);
+    res = scalar_min(lanes, 4);
+    if(i < n && scalar_min(a + i, n - i) < res)
+        res = scalar_min(a + i, n - i);
+    return res;
+}
+
+static int sse2_max(int *a, int n) {
+    __m128i acc;
+    int lanes[4];
+    int i, res;
+
+    if(n < 4)
+        return scalar_max(a, n);
+    acc = _mm_loadu_si128((__m128i*)a);
+    for(i = 4; i + 4 <= n; i += 4) {
+        __m128i x = _mm_loadu_si128((__m128i*)(a + i));
+        acc = sse2_select(_mm_cmpgt_epi32(x, acc), x, acc);
+    }
+    _mm_storeu_si128((__m128i*)lanes, acc);
+    res = scalar_max(lanes, 4);
+    if(i < n && scalar_max(a + i, n - i) > res)
+        res = scalar_max(a + i, n - i);
+    return res;
+}
+
+static void sse2_fill(int *out, int value, int n) {
+    __m128i v = _mm_set1_epi32(value);
+    int i;
+
+    for(i = 0; i + 4 <= n; i += 4)
+        _mm_storeu_si128((__m128i*)(out + i), v);
+    scalar_fill(out + i, value, n - i);
+}
+
+static struct IntArrayKernels sse2_kernels = {
+    "sse2",
+    sse2_add, sse2_sub, sse2_mul,
+    sse2_add_scalar, sse2_sub_scalar, sse2_rsb_scalar, sse2_mul_scalar,
+    sse2_sum, sse2_min, sse2_max,
+    sse2_fill
+};
+
+
+/*
+AVX2 kernels, compiled with the target attribute so the file needs no -mavx2.
+They are only called after the CPU check.
+*/
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static __m256i avx2_lanes_add(__m256i x, __m256i y) { return _mm256_add_epi32(x, y); }
+AVX2 static __m256i avx2_lanes_sub(__m256i x, __m256i y) { return _mm256_sub_epi32(x, y); }
+AVX2 static __m256i avx2_lanes_rsb(__m256i x, __m256i y) { return _mm256_sub_epi32(y, x); }
+AVX2 static __m256i avx2_lanes_mul(__m256i x, __m256i y) { return _mm256_mullo_epi32(x, y); }
+
+#define AVX2_BINARY(name) \
+AVX2 static void avx2_##name(int *out, int *a, int *b, int n) { \
+    int i; \
+    for(i = 0; i + 8 <= n; i += 8) { \
+        __m256i x = _mm256_loadu_si256((__m256i*)(a + i)); \
+        __m256i y = _mm256_loadu_si256((__m256i*)(b + i)); \
+        _mm256_storeu_si256((__m256i*)(out + i), avx2_lanes_##name(x, y)); \
+    } \
+    scalar_##name(out + i, a + i, b + i, n - i); \
+}
+
+#define AVX2_SCALAR(name) \
+AVX2 static void avx2_##name##_scalar(int *out, int *a, int value, int n) { \
+    __m256i y = _mm256_set1_epi32(value); \
+    int i; \
+    for(i = 0; i + 8 <= n; i += 8) { \
+        __m256i x = _mm256_loadu_si256((__m256i*)(a + i)); \
+        _mm256_storeu_si256((__m256i*)(out + i), avx2_lanes_##name(x, y)); \
+    } \
+    scalar_##name##_scalar(out + i, a + i, value, n - i); \
+}
+
+AVX2_BINARY(add)
+AVX2_BINARY(sub)
+AVX2_BINARY(mul)
+AVX2_SCALAR(add)
+AVX2_SCALAR(sub)
+AVX2_SCALAR(rsb)
+AVX2_SCALAR(mul)
+
+AVX2 static long long avx2_sum(int *a, int n) {
+    __m256i acc = _mm256_setzero_si256();
+    long long lanes[4];
+    int i;
+
+    for(i = 0; i + 8 <= n; i += 8) {
+        acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm_loadu_si128((__m128i*)(a + i))));
+        acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm_loadu_si128((__m128i*)(a + i + 4))));
+    }
+    _mm256_storeu_si256((__m256i*)lanes, acc);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + scalar_sum(a + i, n - i);
+}
+
+AVX2 static int avx2_min(int *a, int n) {
+    __m256i acc;
+    int lanes[8];
+    int i, res;
+
+    if(n < 8)
+        return scalar_min(a, n);
+    acc = _mm256_loadu_si256((__m256i*)a);
+    for(i = 8; i + 8 <= n; i += 8)
+        acc = _mm256_min_epi32(acc, _mm256_loadu_si256((__m256i*)(a + i)));
+    _mm256_storeu_si256((__m256i*)lanes, acc);
+    res = scalar_min(lanes, 8);
+    if(i < n && scalar_min(a + i, n - i) < res)
+        res = scalar_min(a + i, n - i);
+    return res;
+}
+
+AVX2 static int avx2_max(int *a, int n) {
+    __m256i acc;
+    int lanes[8];
+    int i, res;
+
+    if(n < 8)
+        return scalar_max(a, n);
+    acc = _mm256_loadu_si256((__m256i*)a);
+    for(i = 8; i + 8 <= n; i += 8)
+        acc = _mm256_max_epi32(acc, _mm256_loadu_si256((__m256i*)(a + i)));
+    _mm256_storeu_si256((__m256i*)lanes, acc);
+    res = scalar_max(lanes, 8);
+    if(i < n && scalar_max(a + i, n - i) > res)
+        res = scalar_max(a + i, n - i);
+    return res;
+}
+
+AVX2 static void avx2_fill(int *out, int value, int n) {
+    __m256i v = _mm256_set1_epi32(value);
+    int i;
+
+    for(i = 0; i + 8 <= n; i += 8)
+        _mm256_storeu_si256((__m256i*)(out + i), v);
+    scalar_fill(out + i, value, n - i);
+}
+
+static struct IntArrayKernels avx2_kernels = {
+    "avx2",
+    avx2_add, avx2_sub, avx2_mul,
+    avx2_add_scalar, avx2_sub_scalar, avx2_rsb_scalar, avx2_mul_scalar,
+    avx2_sum, avx2_min, avx2_max,
+    avx2_fill
+};
+
+#endif
+
+
+static struct IntArrayKernels *kernels = &scalar_kernels;
+
+__attribute__((constructor)) static void int_array_select(void) {
+#ifdef INT_ARRAY_X86
+    __builtin_cpu_init();
+    kernels = __builtin_cpu_supports("avx2") ? &avx2_kernels : &sse2_kernels;
+#endif
+}
+
+char *int_array_isa(void) {
+    return kernels->isa;
+}
+
+int int_array_use_isa(char *isa) {
+    if(strcmp(isa, "scalar") == 0) {
+        kernels = &scalar_kernels;
+        return 0;
+    }
+#ifdef INT_ARRAY_X86
+    if(strcmp(isa, "sse2") == 0) {
+        kernels = &sse2_kernels;
+        return 0;
+    }
+    if(strcmp(isa, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+        kernels = &avx2_kernels;
+        return 0;
+    }
+#endif
+    return -1;
+}
+
+void int_array_add(int *out, int *a, int *b, int n) {
+    kernels->add(out, a, b, n);
+}
+
+void int_array_sub(int *out, int *a, int *b, int n) {
+    kernels->sub(out, a, b, n);
+}
+
+void int_array_mul(int *out, int *a, int *b, int n) {
+    kernels->mul(out, a, b, n);
+}
+
+void int_array_add_scalar(int *out, int *a, int value, int n) {
+    kernels->add_scalar(out, a, value, n);
+}
+
+void int_array_sub_scalar(int *out, int *a, int value, int n) {
+    kernels->sub_scalar(out, a, value, n);
+}
+
+void int_array_rsb_scalar(int *out, int *a, int value, int n) {
+    kernels->rsb_scalar(out, a, value, n);
+}
+
+void int_array_mul_scalar(int *out, int *a, int value, int n) {
+    kernels->mul_scalar(out, a, value, n);
+}
+
+long long int_array_sum(int *a, int n) {
+    return kernels->sum(a, n);
+}
+
+int int_array_min(int *a, int n) {
+    return kernels->min(a, n);
+}
+
+int int_array_max(int *a, int n) {
+    return kernels->max(a, n);
+}
+
+void int_array_fill(int *out, int value, int n) {
+    kernels->fill(out, value, n);
+}
+
+/*
+libc memmove already picks its own vector kernel at load time,
+and unlike memcpy it allows out to overlap a.
+*/
+void int_array_copy(int *out, int *a, int n) {
+    if(n > 0)
+        memmove(out, a, sizeof(int)*n);
+}
+
+
+
+/*
+test code
+*/
+#include "test_util.h"
+
+#define TEST_LEN 37
+
+static void make_test_input(int *a, int *b, int seed) {
+    int i;
+    for(i = 0; i < TEST_LEN; i++) {
+        a[i] = (int)((unsigned int)(i + seed)*2654435761u);
+        b[i] = (int)((unsigned int)(i*7 + seed)*40503u) - 1000000;
+    }
+    a[3] = 0x7fffffff;
+    a[5] = -0x7fffffff - 1;
+    b[5] = -1;
+}
+
+static void assert_array_eq(int *expect, int *actual, int n) {
+    int i;
+    for(i = 0; i < n; i++)
+        assert_int_eq(expect[i], actual[i]);
+}
+
+/*
+Every length up to TEST_LEN, so that each kernel runs its vector loop and its tail.
+*/
+static void check_kernels_against_scalar() {
+    int a[TEST_LEN], b[TEST_LEN];
+    int expect[TEST_LEN], actual[TEST_LEN];
+    int n;
+
+    make_test_input(a, b, 1);
+    for(n = 0; n <= TEST_LEN; n++) {
+        scalar_add(expect, a, b, n);
+        int_array_add(actual, a, b, n);
+        assert_array_eq(expect, actual, n);
+        scalar_sub(expect, a, b, n);
+        int_array_sub(actual, a, b, n);
+        assert_array_eq(expect, actual, n);
+        scalar_mul(expect, a, b, n);
+        int_array_mul(actual, a, b, n);
+        assert_array_eq(expect, actual, n);
+
+        scalar_add_scalar(expect, a, -7, n);
+        int_array_add_scalar(actual, a, -7, n);
+        assert_array_eq(expect, actual, n);
+        scalar_sub_scalar(expect, a, 100, n);
+        int_array_sub_scalar(actual, a, 100, n);
+        assert_array_eq(expect, actual, n);
+        scalar_rsb_scalar(expect, a, 100, n);
+        int_array_rsb_scalar(actual, a, 100, n);
+        assert_array_eq(expect, actual, n);
+        scalar_mul_scalar(expect, a, 0x10001, n);
+        int_array_mul_scalar(actual, a, 0x10001, n);
+        assert_array_eq(expect, actual, n);
+
+        assert_true(scalar_sum(a, n) == int_array_sum(a, n));
+        if(n > 0) {
+            assert_int_eq(scalar_min(a, n), int_array_min(a, n));
+            assert_int_eq(scalar_max(a, n), int_array_max(a, n));
+            assert_int_eq(scalar_min(b, n), int_array_min(b, n));
+            assert_int_eq(scalar_max(b, n), int_array_max(b, n));
+        }
+
+        scalar_fill(expect, 42, n);
+        int_array_fill(actual, 42, n);
+        assert_array_eq(expect, actual, n);
+        int_array_copy(actual, b, n);
+        assert_array_eq(b, actual, n);
+    }
+}
+
+static void test_int_array_values() {
+    int a[] = {1, -2, 3, 0x7fffffff, 5, 6, 7, 8, 9};
+    int b[] = {10, 20, 30, 1, 50, 60, 70, 80, 90};
+    int out[9];
+
+    int_array_add(out, a, b, 9);
+    assert_int_eq(11, out[0]);
+    assert_int_eq(-0x7fffffff - 1, out[3]);
+    int_array_rsb_scalar(out, a, 10, 9);
+    assert_int_eq(12, out[1]);
+    assert_true(0x7fffffffLL + 37 == int_array_sum(a, 9));
+    assert_int_eq(-2, int_array_min(a, 9));
+    assert_int_eq(0x7fffffff, int_array_max(a, 9));
+
+    /* overlapping copy, both directions */
+    int_array_copy(b + 1, b, 8);
+    assert_int_eq(10, b[1]);
+    assert_int_eq(80, b[8]);
+    int_array_copy(b, b + 1, 8);
+    assert_int_eq(10, b[0]);
+    assert_int_eq(80, b[7]);
+}
+
+static void test_int_array_large_sum() {
+    int n = 1000;
+    int *a = malloc(sizeof(int)*n);
+
+    int_array_fill(a, 0x7fffffff, n);
+    assert_true(0x7fffffffLL*n == int_array_sum(a, n));
+    free(a);
+}
+
+static void test_int_array_each_isa() {
+    static char *isas[] = {"scalar", "sse2", "avx2"};
+    char *orig = int_array_isa();
+    int i;
+
+    for(i = 0; i < 3; i++) {
+        if(int_array_use_isa(isas[i]) != 0) {
+            printf("%s not supported, skipped\n", isas[i]);
+            continue;
+        }
+        check_kernels_against_scalar();
+        test_int_array_values();
+        test_int_array_large_sum();
+    }
+    int_array_use_isa(orig);
+}
+
+static void test_int_array_unknown_isa() {
+    assert_int_eq(-1, int_array_use_isa("neon64"));
+}
+
+static void run_unit_tests() {
+    test_int_array_each_isa();
+    test_int_array_unknown_isa();
+
+    printf("all test done\n");
+}
+
+#if 0
+int main() {
+    run_unit_tests();
+    return 0;
+}
+#endif
@@ -0,0 +1,37 @@
+/*
+Bulk primitives over packed int arrays, used by run_array.
+
+Each primitive has scalar, SSE2 and AVX2 kernels on x86,
+and the best one the CPU supports is chosen at startup.
+Arithmetic wraps like run (two's complement), sums are 64bit.
+out may be the same array as an input, and int_array_copy allows any overlap.
+*/
+
+void int_array_add(int *out, int *a, int *b, int n);
+void int_array_sub(int *out, int *a, int *b, int n);
+void int_array_mul(int *out, int *a, int *b, int n);
+
+void int_array_add_scalar(int *out, int *a, int value, int n);
+void int_array_sub_scalar(int *out, int *a, int value, int n);
+/* out[i] = value - a[i] */
+void int_array_rsb_scalar(int *out, int *a, int value, int n);
+void int_array_mul_scalar(int *out, int *a, int value, int n);
+
+long long int_array_sum(int *a, int n);
+/* n must be 1 or more. */
+int int_array_min(int *a, int n);
+int int_array_max(int *a, int n);
+
+void int_array_fill(int *out, int value, int n);
+void int_array_copy(int *out, int *a, int n);
+
+/*
+Name of the kernels in use, "avx2", "sse2" or "scalar".
+*/
+char *int_array_isa(void);
+
+/*
+Use the kernels of isa instead, for tests and benchmarks.
+Return 0 on success, -1 if the CPU or the build doesn't support it.
+*/
+int int_array_use_isa(char *isa);
@@ -0,0 +1,408 @@
+#include "jit_debug.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <elf.h>
+#include <unistd.h>
+
+static int debug_flags = 0;
+static char *debug_dump_dir = NULL;
+
+void jit_debug_enable(int flags, char *dump_dir) {
+    debug_flags = flags;
+    debug_dump_dir = dump_dir;
+}
+
+void jit_debug_init_from_env() {
+    int flags = 0;
+    char *dir = getenv("PS_JIT_DUMP");
+
+    if(getenv("PS_JIT_PERF_MAP") != NULL)
+        flags |= JIT_DEBUG_PERF_MAP;
+    if(getenv("PS_JIT_GDB") != NULL)
+        flags |= JIT_DEBUG_GDB;
+    if(dir != NULL)
+        flags |= JIT_DEBUG_DUMP;
+    jit_debug_enable(flags, dir);
+}
+
+
+/*
+perf map
+*/
+static FILE *perf_map = NULL;
+
+static void perf_map_write(int *code, int size, char *name) {
+    if(perf_map == NULL) {
+        char path[64];
+        sprintf(path, "/tmp/perf-%d.map", (int)getpid());
+        perf_map = fopen(path, "a");
+        if(perf_map == NULL)
+            return;
+    }
+    fprintf(perf_map, "%lx %x %s\n", (unsigned long)(uintptr_t)code, size, name);
+    fflush(perf_map);
+}
+
+
+/*
+raw code dump
+*/
+static int dump_seq = 0;
+
+static void dump_write(int *code, int size, char *name) {
+    char path[1024];
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "%s/ps-jit-%d-%d.bin", debug_dump_dir, (int)getpid(), dump_seq);
+    fp = fopen(path, "wb");
+    if(fp == NULL)
+        return;
+    fwrite(code, 1, size, fp);
+    fclose(fp);
+
+    snprintf(path, sizeof(path), "%s/ps-jit-%d.txt", debug_dump_dir, (int)getpid());
+    fp = fopen(path, "a");
+    if(fp == NULL)
+        return;
+    fprintf(fp, "%d %lx %x %s\n", dump_seq, (unsigned long)(uintptr_t)code, size, name);
+    fclose(fp);
+    dump_seq++;
+}
+
+
+/*
+GDB JIT interface.
+Names and layout are fixed by gdb, see "JIT Compilation Interface" in gdb manual.
+*/
+enum {
+    JIT_NOACTION = 0,
+    JIT_REGISTER_FN,
+    JIT_UNREGISTER_FN
+};
+
+struct jit_code_entry {
+    struct jit_code_entry *next_entry;
+    struct jit_code_entry *prev_entry;
+    const char *symfile_addr;
+    uint64_t symfile_size;
+};
+
+struct jit_descriptor {
+    uint32_t version;
+    uint32_t action_flag;
+    struct jit_code_entry *relevant_entry;
+    struct jit_code_entry *first_entry;
+};
+
+void __attribute__((noinline)) __jit_debug_register_code() {
+    __asm__ volatile("");
+}
+
+struct jit_descriptor __jit_debug_descriptor = { 1, JIT_NOACTION, NULL, NULL };
+
+struct GdbEntry {
+    struct jit_code_entry entry;
+    int *code;
+};
+
+static void gdb_notify(struct jit_code_entry *entry, int action) {
+    __jit_debug_descriptor.relevant_entry = entry;
+    __jit_debug_descriptor.action_flag = action;
+    __jit_debug_register_code();
+}
+
+static void gdb_unregister(int *code) {
+    struct jit_code_entry *entry = __jit_debug_descriptor.first_entry;
+
+    for(; entry != NULL; entry = entry->next_entry) {
+        if(((struct GdbEntry*)entry)->code != code)
+            continue;
+        if(entry->prev_entry != NULL)
+            entry->prev_entry->next_entry = entry->next_entry;
+        else
+            __jit_debug_descriptor.first_entry = entry->next_entry;
+        if(entry->next_entry != NULL)
+            entry->next_entry->prev_entry = entry->prev_entry;
+        gdb_notify(entry, JIT_UNREGISTER_FN);
+        free((char*)entry->symfile_addr);
+        free(entry);
+        return;
+    }
+}
+
+
+/*
+In-memory ELF object.
+
+Sections are null, .text (NOBITS at the code address), .eh_frame,
+.shstrtab, .strtab and .symtab with one function symbol.
+This is the same layout as LuaJIT's gdbjit which gdb is known to accept.
+*/
+enum {
+    SECT_NULL,
+    SECT_TEXT,
+    SECT_EHFRAME,
+    SECT_SHSTRTAB,
+    SECT_STRTAB,
+    SECT_SYMTAB,
+    SECT_NUM
+};
+
+#define DW_CFA_advance_loc2 0x03
+#define DW_CFA_def_cfa 0x0c
+#define DW_CFA_def_cfa_offset 0x0e
+#define DW_CFA_advance_loc 0x40
+#define DW_CFA_offset 0x80
+#define DW_EH_PE_udata4 0x03
+#define DW_EH_PE_textrel 0x20
+#define DW_REG_SP 13
+#define DW_REG_LR 14
+
+struct ElfWriter {
+    char *buf;
+    int pos;
+};
+
+static void put_u8(struct ElfWriter *w, int val) {
+    w->buf[w->pos++] = (char)val;
+}
+
+static void put_u32(struct ElfWriter *w, uint32_t val) {
+    memcpy(&w->buf[w->pos], &val, 4);
+    w->pos += 4;
+}
+
+/* all values written here are small enough to fit one byte of (s)leb128. */
+static void put_leb(struct ElfWriter *w, int val) {
+    put_u8(w, val & 0x7f);
+}
+
+static int put_str(struct ElfWriter *w, char *str) {
+    int start = w->pos;
+    int len = strlen(str)+1;
+    memcpy(&w->buf[w->pos], str, len);
+    w->pos += len;
+    return start;
+}
+
+static void align4(struct ElfWriter *w) {
+    while(w->pos % 4 != 0)
+        put_u8(w, 0);
+}
+
+/*
+One CIE and one FDE. Length fields are patched after their contents.
+*/
+static void put_eh_frame(struct ElfWriter *w, int size, int prologue_size, int saved_regs) {
+    int cie_start, fde_start, len_pos, reg, slot;
+
+    cie_start = w->pos;
+    put_u32(w, 0);
+    put_u32(w, 0);                  // CIE id
+    put_u8(w, 1);                   // version
+    put_str(w, "zR");
+    put_leb(w, 1);                  // code alignment
+    put_leb(w, -4);                 // data alignment
+    put_u8(w, DW_REG_LR);           // return address register
+    put_leb(w, 1);                  // augmentation data length
+    put_u8(w, DW_EH_PE_textrel | DW_EH_PE_udata4);
+    put_u8(w, DW_CFA_def_cfa);      // cfa = sp at entry
+    put_leb(w, DW_REG_SP);
+    put_leb(w, 0);
+    align4(w);
+    *(uint32_t*)&w->buf[cie_start] = w->pos - cie_start - 4;
+
+    fde_start = w->pos;
+    len_pos = w->pos;
+    put_u32(w, 0);
+    put_u32(w, w->pos - cie_start); // offset to CIE
+    put_u32(w, 0);                  // start, relative to .text
+    put_u32(w, size);
+    put_leb(w, 0);                  // augmentation data length
+
+    // after stmdb, saved registers are right below cfa, the highest one on top.
+    if(prologue_size < 0x40) {
+        put_u8(w, DW_CFA_advance_loc | prologue_size);
+    } else {
+        // specialized code has guards before the prologue.
+        put_u8(w, DW_CFA_advance_loc2);
+        put_u8(w, prologue_size & 0xff);
+        put_u8(w, (prologue_size >> 8) & 0xff);
+    }
+    put_u8(w, DW_CFA_def_cfa_offset);
+    put_leb(w, 4*__builtin_popcount(saved_regs));
+    for(reg = 15, slot = 1; reg >= 0; reg--) {
+        if(saved_regs & (1 << reg)) {
+            put_u8(w, DW_CFA_offset | reg);
+            put_leb(w, slot++);
+        }
+    }
+    align4(w);
+    *(uint32_t*)&w->buf[len_pos] = w->pos - fde_start - 4;
+
+    put_u32(w, 0);                  // terminator
+}
+
+static void set_section(Elf32_Shdr *shdr, int name, int type, int flags, int offset, int size) {
+    shdr->sh_name = name;
+    shdr->sh_type = type;
+    shdr->sh_flags = flags;
+    shdr->sh_offset = offset;
+    shdr->sh_size = size;
+    shdr->sh_addralign = 4;
+}
+
+static char *build_elf(int *code, int size, char *name, int prologue_size, int saved_regs, int *out_len) {
+    struct ElfWriter w;
+    Elf32_Ehdr *ehdr;
+    Elf32_Shdr shdr[SECT_NUM];
+    Elf32_Sym syms[2];
+    int shstr_name[SECT_NUM];
+    int ehframe_pos, shstrtab_pos, strtab_pos, symtab_pos, sym_name;
+
+    w.buf = calloc(1, 512 + strlen(name) + sizeof(shdr));
+    w.pos = sizeof(Elf32_Ehdr);
+    memset(shdr, 0, sizeof(shdr));
+    memset(syms, 0, sizeof(syms));
+
+    ehframe_pos = w.pos;
+    put_eh_frame(&w, size, prologue_size, saved_regs);
+
+    shstrtab_pos = w.pos;
+    put_str(&w, "");
+    shstr_name[SECT_TEXT] = put_str(&w, ".text") - shstrtab_pos;
+    shstr_name[SECT_EHFRAME] = put_str(&w, ".eh_frame") - shstrtab_pos;
+    shstr_name[SECT_SHSTRTAB] = put_str(&w, ".shstrtab") - shstrtab_pos;
+    shstr_name[SECT_STRTAB] = put_str(&w, ".strtab") - shstrtab_pos;
+    shstr_name[SECT_SYMTAB] = put_str(&w, ".symtab") - shstrtab_pos;
+
+    strtab_pos = w.pos;
+    put_str(&w, "");
+    sym_name = put_str(&w, name) - strtab_pos;
+    align4(&w);
+
+    symtab_pos = w.pos;
+    syms[1].st_name = sym_name;
+    syms[1].st_value = 0;
+    syms[1].st_size = size;
+    syms[1].st_info = ELF32_ST_INFO(STB_GLOBAL, STT_FUNC);
+    syms[1].st_shndx = SECT_TEXT;
+    memcpy(&w.buf[w.pos], syms, sizeof(syms));
+    w.pos += sizeof(syms);
+
+    set_section(&shdr[SECT_TEXT], shstr_name[SECT_TEXT], SHT_NOBITS, SHF_ALLOC | SHF_EXECINSTR, 0, size);
+    shdr[SECT_TEXT].sh_addr = (Elf32_Addr)(uintptr_t)code;
+    set_section(&shdr[SECT_EHFRAME], shstr_name[SECT_EHFRAME], SHT_PROGBITS, SHF_ALLOC, ehframe_pos, shstrtab_pos - ehframe_pos);
+    set_section(&shdr[SECT_SHSTRTAB], shstr_name[SECT_SHSTRTAB], SHT_STRTAB, 0, shstrtab_pos, strtab_pos - shstrtab_pos);
+    set_section(&shdr[SECT_STRTAB], shstr_name[SECT_STRTAB], SHT_STRTAB, 0, strtab_pos, symtab_pos - strtab_pos);
+    set_section(&shdr[SECT_SYMTAB], shstr_name[SECT_SYMTAB], SHT_SYMTAB, 0, symtab_pos, sizeof(syms));
+    shdr[SECT_SYMTAB].sh_link = SECT_STRTAB;
+    shdr[SECT_SYMTAB].sh_info = 1;
+    shdr[SECT_SYMTAB].sh_entsize = sizeof(Elf32_Sym);
+
+    ehdr = (Elf32_Ehdr*)w.buf;
+    memcpy(ehdr->e_ident, ELFMAG, SELFMAG);
+    ehdr->e_ident[EI_CLASS] = ELFCLASS32;
+    ehdr->e_ident[EI_DATA] = ELFDATA2LSB;
+    ehdr->e_ident[EI_VERSION] = EV_CURRENT;
+    ehdr->e_type = ET_REL;
+    ehdr->e_machine = EM_ARM;
+    ehdr->e_version = EV_CURRENT;
+    ehdr->e_flags = EF_ARM_EABI_VER5;
+    ehdr->e_ehsize = sizeof(Elf32_Ehdr);
+    ehdr->e_shentsize = sizeof(Elf32_Shdr);
+    ehdr->e_shnum = SECT_NUM;
+    ehdr->e_shstrndx = SECT_SHSTRTAB;
+    ehdr->e_shoff = w.pos;
+    memcpy(&w.buf[w.pos], shdr, sizeof(shdr));
+    w.pos += sizeof(shdr);
+
+    *out_len = w.pos;
+    return w.buf;
+}
+
+static void gdb_register(int *code, int size, char *name, int prologue_size, int saved_regs) {
+    struct GdbEntry *gdb_entry;
+    struct jit_code_entry *entry;
+    int len;
+
+    gdb_unregister(code);
+
+    gdb_entry = calloc(1, sizeof(struct GdbEntry));
+    gdb_entry->code = code;
+    entry = &gdb_entry->entry;
+    entry->symfile_addr = build_elf(code, size, name, prologue_size, saved_regs, &len);
+    entry->symfile_size = len;
+
+    entry->next_entry = __jit_debug_descriptor.first_entry;
+    if(entry->next_entry != NULL)
+        entry->next_entry->prev_entry = entry;
+    __jit_debug_descriptor.first_entry = entry;
+    gdb_notify(entry, JIT_REGISTER_FN);
+}
+
+
+void jit_debug_register(int *code, int size, char *name, int prologue_size, int saved_regs) {
+    if(debug_flags == 0)
+        return;
+
+    if(debug_flags & JIT_DEBUG_PERF_MAP)
+        perf_map_write(code, size, name);
+    if(debug_flags & JIT_DEBUG_GDB)
+        gdb_register(code, size, name, prologue_size, saved_regs);
+    if(debug_flags & JIT_DEBUG_DUMP)
+        dump_write(code, size, name);
+}
+
+
+
+/*
+test code
+*/
+#include "test_util.h"
+
+static void test_build_elf() {
+    static int code[4];
+    int len;
+    char *elf = build_elf(code, sizeof(code), "3 4 add", 4, 0x5ff0, &len);
+    Elf32_Ehdr *ehdr = (Elf32_Ehdr*)elf;
+    Elf32_Shdr *shdr = (Elf32_Shdr*)(elf + ehdr->e_shoff);
+    Elf32_Sym *sym = (Elf32_Sym*)(elf + shdr[SECT_SYMTAB].sh_offset) + 1;
+
+    assert_true(memcmp(elf, ELFMAG, SELFMAG) == 0);
+    assert_int_eq(ehdr->e_shoff + SECT_NUM*sizeof(Elf32_Shdr), len);
+    assert_int_eq((int)(uintptr_t)code, shdr[SECT_TEXT].sh_addr);
+    assert_true(strcmp(elf + shdr[SECT_STRTAB].sh_offset + sym->st_name, "3 4 add") == 0);
+    assert_true(strcmp(elf + shdr[SECT_SHSTRTAB].sh_offset + shdr[SECT_EHFRAME].sh_name, ".eh_frame") == 0);
+    assert_int_eq(sizeof(code), sym->st_size);
+    free(elf);
+}
+
+static void test_gdb_register_replace() {
+    static int code[4];
+
+    gdb_register(code, sizeof(code), "first", 4, 0x5ff0);
+    gdb_register(code, sizeof(code), "second", 4, 0x5ff0);
+
+    assert_true(__jit_debug_descriptor.first_entry != NULL);
+    assert_true(__jit_debug_descriptor.first_entry->next_entry == NULL);
+
+    gdb_unregister(code);
+    assert_true(__jit_debug_descriptor.first_entry == NULL);
+}
+
+static void run_unit_tests() {
+    test_build_elf();
+    test_gdb_register_replace();
+
+    printf("all test done\n");
+}
+
+#if 0
+int main() {
+    run_unit_tests();
+    return 0;
+}
+#endif
@@ -0,0 +1,29 @@
+/*
+Make JIT generated code visible to perf and gdb.
+
+All of them are off by default. Enable by jit_debug_enable,
+or by environment variables read in jit_debug_init_from_env.
+
+- PS_JIT_PERF_MAP=1  append "addr size name" to /tmp/perf-<pid>.map
+- PS_JIT_GDB=1       register an in-memory ELF through __jit_debug_register_code
+- PS_JIT_DUMP=<dir>  write <dir>/ps-jit-<pid>-<seq>.bin and a line in <dir>/ps-jit-<pid>.txt
+
+Dumped code can be disassembled with
+arm-linux-gnueabi-objdump -D -b binary -m arm --adjust-vma=<addr> ps-jit-<pid>-<seq>.bin
+*/
+enum {
+    JIT_DEBUG_PERF_MAP = 1,
+    JIT_DEBUG_GDB = 2,
+    JIT_DEBUG_DUMP = 4
+};
+
+void jit_debug_enable(int flags, char *dump_dir);
+void jit_debug_init_from_env();
+
+/*
+Tell tools that code[0, size) is a function called name.
+prologue_size is the byte offset just after "stmdb sp!, {saved_regs}",
+nothing may be pushed before it. It is used to describe the frame for backtrace.
+Registering the same address again replaces the old one.
+*/
+void jit_debug_register(int *code, int size, char *name, int prologue_size, int saved_regs);
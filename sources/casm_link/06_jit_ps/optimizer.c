@@ -0,0 +1,518 @@
+#include "parser.h"
+#include "optimizer.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+
+/*
+node creation
+*/
+
+static unsigned int ssa_hash(int op, int arg1, int arg2) {
+    unsigned int h = (unsigned int)op;
+    h = h*31 + (unsigned int)arg1;
+    h = h*31 + (unsigned int)arg2;
+    return h ^ (h >> 11);
+}
+
+/*
+Return existing node if the same (op, arg1, arg2) is already there.
+*/
+static int ssa_node(struct SsaGraph *g, int op, int arg1, int arg2) {
+    unsigned int h = ssa_hash(op, arg1, arg2) % SSA_HASH_SIZE;
+    struct SsaNode *node;
+
+    while(g->hash[h] != 0) {
+        node = &g->nodes[g->hash[h]-1];
+        if(node->op == op && node->arg1 == arg1 && node->arg2 == arg2)
+            return g->hash[h]-1;
+        h = (h+1) % SSA_HASH_SIZE;
+    }
+
+    if(g->node_num == SSA_NODE_MAX) {
+        fprintf(stderr, "too many nodes, exit.\n");
+        exit(1);
+    }
+    node = &g->nodes[g->node_num];
+    node->op = op;
+    node->arg1 = arg1;
+    node->arg2 = arg2;
+    g->hash[h] = ++g->node_num;
+    return g->node_num-1;
+}
+
+static int ssa_const(struct SsaGraph *g, int val) {
+    return ssa_node(g, SSA_CONST, val, 0);
+}
+
+static int is_const(struct SsaGraph *g, int idx) {
+    return g->nodes[idx].op == SSA_CONST;
+}
+
+static int const_val(struct SsaGraph *g, int idx) {
+    return g->nodes[idx].arg1;
+}
+
+/*
+return n if val is 2^n (1 <= n <= 31), otherwise 0.
+*/
+static int log2_exact(unsigned int val) {
+    int n = 0;
+    if(val < 2 || (val & (val-1)) != 0)
+        return 0;
+    while(val != 1) {
+        val >>= 1;
+        n++;
+    }
+    return n;
+}
+
+static int ssa_binop(struct SsaGraph *g, int op, int a, int b);
+
+static int ssa_shift(struct SsaGraph *g, int op, int a, int amount) {
+    if(is_const(g, a)) {
+        unsigned int val = (unsigned int)const_val(g, a);
+        switch(op) {
+            case SSA_SHL:
+                return ssa_const(g, (int)(val << amount));
+            case SSA_LSR:
+                return ssa_const(g, (int)(val >> amount));
+            case SSA_ASR:
+                return ssa_const(g, const_val(g, a) >> amount);
+        }
+    }
+    return ssa_node(g, op, a, amount);
+}
+
+static int ssa_neg(struct SsaGraph *g, int a) {
+    return ssa_binop(g, SSA_SUB, ssa_const(g, 0), a);
+}
+
+/*
+Magic number for signed division by constant d (2 <= d).
+See Hacker's Delight, 10-1.
+*/
+static void div_magic(int d, int *out_magic, int *out_shift) {
+    const unsigned int two31 = 0x80000000u;
+    unsigned int ad = (unsigned int)d;
+    unsigned int anc = two31 - 1 - two31%ad;
+    unsigned int q1 = two31/anc, r1 = two31 - q1*anc;
+    unsigned int q2 = two31/ad, r2 = two31 - q2*ad;
+    unsigned int delta;
+    int p = 31;
+
+    do {
+        p++;
+        q1 *= 2; r1 *= 2;
+        if(r1 >= anc) { q1++; r1 -= anc; }
+        q2 *= 2; r2 *= 2;
+        if(r2 >= ad) { q2++; r2 -= ad; }
+        delta = ad - r2;
+    } while(q1 < delta || (q1 == delta && r1 == 0));
+
+    *out_magic = (int)(q2+1);
+    *out_shift = p-32;
+}
+
+/*
+a / d for constant d, rounding toward zero like C.
+*/
+static int ssa_div_const(struct SsaGraph *g, int a, int d) {
+    int n, magic, shift, q;
+
+    if(d == 1)
+        return a;
+    if(d == -1)
+        return ssa_neg(g, a);
+    if(d == 0 || d == (int)0x80000000)
+        return ssa_node(g, SSA_DIV, a, ssa_const(g, d));
+    if(d < 0)
+        return ssa_neg(g, ssa_div_const(g, a, -d));
+
+    n = log2_exact((unsigned int)d);
+    if(n != 0) {
+        /* add d-1 to negative value before shift so that it rounds toward zero. */
+        int bias = n == 1 ? ssa_shift(g, SSA_LSR, a, 31)
+                          : ssa_shift(g, SSA_LSR, ssa_shift(g, SSA_ASR, a, 31), 32-n);
+        return ssa_shift(g, SSA_ASR, ssa_binop(g, SSA_ADD, a, bias), n);
+    }
+
+    div_magic(d, &magic, &shift);
+    q = ssa_node(g, SSA_MULHS, a, magic);
+    if(magic < 0)
+        q = ssa_binop(g, SSA_ADD, q, a);
+    if(shift > 0)
+        q = ssa_shift(g, SSA_ASR, q, shift);
+    return ssa_binop(g, SSA_ADD, q, ssa_shift(g, SSA_LSR, q, 31));
+}
+
+static int ssa_mul_const(struct SsaGraph *g, int a, int c) {
+    int n;
+
+    if(c == 0)
+        return ssa_const(g, 0);
+    if(c == 1)
+        return a;
+    if(c == -1)
+        return ssa_neg(g, a);
+
+    n = log2_exact((unsigned int)c);
+    if(n != 0)
+        return ssa_shift(g, SSA_SHL, a, n);
+    n = log2_exact(0u - (unsigned int)c);
+    if(n != 0)
+        return ssa_neg(g, ssa_shift(g, SSA_SHL, a, n));
+
+    return ssa_node(g, SSA_MUL, a, ssa_const(g, c));
+}
+
+static int fold(int op, int arg1, int arg2) {
+    switch(op) {
+        case SSA_ADD:
+            return (int)((unsigned int)arg1 + (unsigned int)arg2);
+        case SSA_SUB:
+            return (int)((unsigned int)arg1 - (unsigned int)arg2);
+        case SSA_MUL:
+            return (int)((unsigned int)arg1 * (unsigned int)arg2);
+        case SSA_DIV:
+            return arg1 / arg2;
+    }
+    return 0;
+}
+
+static int ssa_binop(struct SsaGraph *g, int op, int a, int b) {
+    int tmp;
+
+    if(is_const(g, a) && is_const(g, b)) {
+        int arg1 = const_val(g, a);
+        int arg2 = const_val(g, b);
+        /* keep the division which traps at runtime as is. */
+        if(op != SSA_DIV || (arg2 != 0 && !(arg1 == (int)0x80000000 && arg2 == -1)))
+            return ssa_const(g, fold(op, arg1, arg2));
+    }
+
+    /* commutative: constant to the right, otherwise order by index for CSE. */
+    if((op == SSA_ADD || op == SSA_MUL)
+        && (is_const(g, a) || (!is_const(g, b) && b < a))) {
+        tmp = a;
+        a = b;
+        b = tmp;
+    }
+
+    switch(op) {
+        case SSA_ADD:
+            if(is_const(g, b) && const_val(g, b) == 0)
+                return a;
+            break;
+        case SSA_SUB:
+            if(a == b)
+                return ssa_const(g, 0);
+            if(is_const(g, b) && const_val(g, b) == 0)
+                return a;
+            break;
+        case SSA_MUL:
+            if(is_const(g, b))
+                return ssa_mul_const(g, a, const_val(g, b));
+            break;
+        case SSA_DIV:
+            if(is_const(g, b))
+                return ssa_div_const(g, a, const_val(g, b));
+            break;
+    }
+    return ssa_node(g, op, a, b);
+}
+
+
+/*
+build
+*/
+
+static void ssa_count_uses(struct SsaGraph *g) {
+    int i;
+    memset(g->uses, 0, sizeof(int)*g->node_num);
+    g->uses[g->root] = 1;
+    for(i = g->node_num-1; i >= 0; i--) {
+        struct SsaNode *node = &g->nodes[i];
+        if(g->uses[i] == 0)
+            continue;
+        switch(node->op) {
+            case SSA_ADD:
+            case SSA_SUB:
+            case SSA_MUL:
+            case SSA_DIV:
+                g->uses[node->arg1]++;
+                g->uses[node->arg2]++;
+                break;
+            case SSA_SHL:
+            case SSA_LSR:
+            case SSA_ASR:
+            case SSA_MULHS:
+                g->uses[node->arg1]++;
+                break;
+        }
+    }
+}
+
+static int word_to_ssa_op(int word) {
+    switch(word) {
+        case OP_ADD:
+            return SSA_ADD;
+        case OP_SUB:
+            return SSA_SUB;
+        case OP_MUL:
+            return SSA_MUL;
+    }
+    return SSA_DIV;
+}
+
+/*
+Largest number of nodes one token can add (division by constant).
+*/
+#define SSA_NODE_PER_TOKEN 16
+
+static int build_error(char *msg, char *str, struct Substr *at) {
+    fprintf(stderr, "%s at %d: %s\n", msg, (int)(at->ptr - str), str);
+    return 0;
+}
+
+static int ssa_register(struct SsaGraph *g, int reg, int spec_mask, int r0, int r1) {
+    if(reg == 0)
+        return (spec_mask & SSA_SPEC_R0) ? ssa_const(g, r0) : ssa_node(g, SSA_R0, 0, 0);
+    return (spec_mask & SSA_SPEC_R1) ? ssa_const(g, r1) : ssa_node(g, SSA_R1, 0, 0);
+}
+
+int ssa_build_specialized(char *str, int spec_mask, int r0, int r1, struct SsaGraph *out_graph) {
+    struct Substr remain={str, strlen(str)};
+    int stack[SSA_NODE_MAX];
+    int stack_pos = 0;
+
+    out_graph->node_num = 0;
+    memset(out_graph->hash, 0, sizeof(out_graph->hash));
+
+    while(!is_end(&remain)) {
+        skip_space(&remain);
+        if(is_end(&remain))
+            break;
+        if(stack_pos == SSA_NODE_MAX || out_graph->node_num > SSA_NODE_MAX-SSA_NODE_PER_TOKEN)
+            return build_error("expression too long", str, &remain);
+        if(is_number(remain.ptr)) {
+            stack[stack_pos++] = ssa_const(out_graph, parse_number(remain.ptr));
+        } else if(is_register(remain.ptr)) {
+            stack[stack_pos++] = ssa_register(out_graph, remain.ptr[1] == '1', spec_mask, r0, r1);
+        } else {
+            // must be op.
+            int word = parse_word(&remain);
+            int arg1, arg2;
+
+            if(word == OP_UNKNOWN)
+                return build_error("unknown word", str, &remain);
+            if(stack_pos < 2)
+                return build_error("stack underflow", str, &remain);
+            arg2 = stack[--stack_pos];
+            arg1 = stack[--stack_pos];
+            stack[stack_pos++] = ssa_binop(out_graph, word_to_ssa_op(word), arg1, arg2);
+        }
+        skip_token(&remain);
+    }
+
+    if(stack_pos == 0)
+        return build_error("empty expression", str, &remain);
+    out_graph->root = stack[stack_pos-1];
+    ssa_count_uses(out_graph);
+    return 1;
+}
+
+int ssa_build(char *str, struct SsaGraph *out_graph) {
+    return ssa_build_specialized(str, 0, 0, 0, out_graph);
+}
+
+
+/*
+eval
+*/
+
+int ssa_eval(struct SsaGraph *g, int r0, int r1) {
+    int values[SSA_NODE_MAX];
+    int i;
+
+    for(i = 0; i <= g->root; i++) {
+        struct SsaNode *node = &g->nodes[i];
+        int arg1;
+
+        if(g->uses[i] == 0)
+            continue;
+        if(node->op != SSA_CONST)
+            arg1 = values[node->arg1];
+        switch(node->op) {
+            case SSA_CONST:
+                values[i] = node->arg1;
+                break;
+            case SSA_R0:
+                values[i] = r0;
+                break;
+            case SSA_R1:
+                values[i] = r1;
+                break;
+            case SSA_ADD:
+            case SSA_SUB:
+            case SSA_MUL:
+            case SSA_DIV:
+                values[i] = fold(node->op, arg1, values[node->arg2]);
+                break;
+            case SSA_SHL:
+                values[i] = (int)((unsigned int)arg1 << node->arg2);
+                break;
+            case SSA_LSR:
+                values[i] = (int)((unsigned int)arg1 >> node->arg2);
+                break;
+            case SSA_ASR:
+                values[i] = arg1 >> node->arg2;
+                break;
+            case SSA_MULHS:
+                values[i] = (int)(((long long)arg1 * node->arg2) >> 32);
+                break;
+        }
+    }
+    return values[g->root];
+}
+
+void ssa_print(struct SsaGraph *g) {
+    static char *names[] = {
+        "const", "r0", "r1", "add", "sub", "mul", "div", "shl", "lsr", "asr", "mulhs"
+    };
+    int i;
+
+    for(i = 0; i < g->node_num; i++) {
+        struct SsaNode *node = &g->nodes[i];
+        if(g->uses[i] == 0)
+            continue;
+        switch(node->op) {
+            case SSA_CONST:
+                printf("v%d = %d\n", i, node->arg1);
+                break;
+            case SSA_R0:
+            case SSA_R1:
+                printf("v%d = %s\n", i, names[node->op]);
+                break;
+            case SSA_ADD:
+            case SSA_SUB:
+            case SSA_MUL:
+            case SSA_DIV:
+                printf("v%d = %s v%d v%d\n", i, names[node->op], node->arg1, node->arg2);
+                break;
+            default:
+                printf("v%d = %s v%d #%d\n", i, names[node->op], node->arg1, node->arg2);
+                break;
+        }
+    }
+    printf("return v%d\n", g->root);
+}
+
+
+
+/*
+test code
+*/
+#include "test_util.h"
+
+static int live_node_num(struct SsaGraph *g) {
+    int i, num = 0;
+    for(i = 0; i < g->node_num; i++) {
+        if(g->uses[i] != 0)
+            num++;
+    }
+    return num;
+}
+
+static void test_ssa_fold_constant() {
+    struct SsaGraph g;
+    ssa_build("3 7 add 2 sub 4 mul", &g);
+
+    assert_int_eq(1, live_node_num(&g));
+    assert_int_eq(SSA_CONST, g.nodes[g.root].op);
+    assert_int_eq(32, ssa_eval(&g, 0, 0));
+}
+
+static void test_ssa_cse() {
+    struct SsaGraph g;
+    ssa_build("r0 r1 add r1 r0 add mul", &g);
+
+    /* r0, r1, add, mul */
+    assert_int_eq(4, live_node_num(&g));
+    assert_int_eq(49, ssa_eval(&g, 3, 4));
+}
+
+static void test_ssa_algebra() {
+    struct SsaGraph g;
+
+    ssa_build("r0 1 mul 0 add", &g);
+    assert_int_eq(SSA_R0, g.nodes[g.root].op);
+
+    ssa_build("r0 r1 add r0 r1 add sub", &g);
+    assert_int_eq(SSA_CONST, g.nodes[g.root].op);
+    assert_int_eq(0, ssa_eval(&g, 3, 4));
+}
+
+static void test_ssa_strength_reduce_mul() {
+    struct SsaGraph g;
+    ssa_build("r0 8 mul", &g);
+
+    assert_int_eq(SSA_SHL, g.nodes[g.root].op);
+    assert_int_eq(-24, ssa_eval(&g, -3, 0));
+}
+
+static void test_ssa_strength_reduce_div() {
+    struct SsaGraph g;
+
+    ssa_build("r0 4 div", &g);
+    assert_int_eq(SSA_ASR, g.nodes[g.root].op);
+    assert_int_eq(-1, ssa_eval(&g, -7, 0));
+    assert_int_eq(1, ssa_eval(&g, 7, 0));
+
+    ssa_build("r0 7 div", &g);
+    assert_int_eq(-3, ssa_eval(&g, -21, 0));
+    assert_int_eq(-2, ssa_eval(&g, -20, 0));
+    assert_int_eq(306783378, ssa_eval(&g, 2147483647, 0));
+    assert_int_eq(-306783378, ssa_eval(&g, -2147483647-1, 0));
+}
+
+static void test_ssa_div_by_zero_is_kept() {
+    struct SsaGraph g;
+    ssa_build("3 0 div", &g);
+
+    assert_int_eq(SSA_DIV, g.nodes[g.root].op);
+}
+
+static void test_ssa_specialized() {
+    struct SsaGraph g;
+
+    // whole expression folds to a constant.
+    ssa_build_specialized("r0 r1 add 7 div", SSA_SPEC_R0|SSA_SPEC_R1, 10, 4, &g);
+    assert_int_eq(SSA_CONST, g.nodes[g.root].op);
+    assert_int_eq(2, g.nodes[g.root].arg1);
+
+    // constant r1 turns div into shifts.
+    ssa_build_specialized("r0 r1 div", SSA_SPEC_R1, 0, 8, &g);
+    assert_int_eq(SSA_ASR, g.nodes[g.root].op);
+    assert_int_eq(-2, ssa_eval(&g, -17, 0));
+}
+
+static void run_unit_tests() {
+    test_ssa_fold_constant();
+    test_ssa_cse();
+    test_ssa_algebra();
+    test_ssa_strength_reduce_mul();
+    test_ssa_strength_reduce_div();
+    test_ssa_div_by_zero_is_kept();
+    test_ssa_specialized();
+
+    printf("all test done\n");
+}
+
+#if 0
+int main() {
+    run_unit_tests();
+    return 0;
+}
+#endif
@@ -0,0 +1,64 @@
+/*
+SSA DAG for the postfix expression language.
+
+Each node is one value. Nodes are appended in evaluation order,
+so arguments always have smaller index than the node using them.
+Same (op, arg1, arg2) is never created twice (CSE).
+*/
+enum SsaOp {
+    SSA_CONST,  /* arg1: value */
+    SSA_R0,
+    SSA_R1,
+    SSA_ADD,    /* arg1, arg2: node */
+    SSA_SUB,
+    SSA_MUL,
+    SSA_DIV,
+    SSA_SHL,    /* arg1: node, arg2: shift amount (1-31) */
+    SSA_LSR,
+    SSA_ASR,
+    SSA_MULHS   /* arg1: node, arg2: constant. upper 32bit of signed 64bit product */
+};
+
+struct SsaNode {
+    int op;
+    int arg1;
+    int arg2;
+};
+
+#define SSA_NODE_MAX 1024
+#define SSA_HASH_SIZE 2048
+
+struct SsaGraph {
+    struct SsaNode nodes[SSA_NODE_MAX];
+    int node_num;
+    int root;
+    /* number of live users of each node. root is counted as one user. 0 means dead. */
+    int uses[SSA_NODE_MAX];
+    int hash[SSA_HASH_SIZE];
+};
+
+/*
+Parse str and build optimized graph into out_graph.
+Constant folding, CSE, algebraic simplification and
+strength reduction of mul/div by constant are done while building.
+Return 0 and print the reason to stderr if str is not a valid expression.
+*/
+int ssa_build(char *str, struct SsaGraph *out_graph);
+
+enum {
+    SSA_SPEC_R0 = 1,
+    SSA_SPEC_R1 = 2
+};
+
+/*
+Same as ssa_build, but registers in spec_mask are replaced by the constant r0/r1
+so the rest of the expression folds around them.
+*/
+int ssa_build_specialized(char *str, int spec_mask, int r0, int r1, struct SsaGraph *out_graph);
+
+/*
+Evaluate live nodes of graph and return the value of root.
+*/
+int ssa_eval(struct SsaGraph *graph, int r0, int r1);
+
+void ssa_print(struct SsaGraph *graph);
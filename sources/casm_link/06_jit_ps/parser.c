@@ -58,18 +58,37 @@ int begin_with(struct Substr *in_str, char *expect) {
     return begin_with_len(in_str, expect, strlen(expect));
 }
 
+/*
+Built-in words differ in the first char, which selects the only candidate.
+*/
+static const char *word_names[] = {"add", "sub", "mul", "div"};
+
+static int word_candidate(char c) {
+    switch(c) {
+        case 'a':
+            return OP_ADD;
+        case 's':
+            return OP_SUB;
+        case 'm':
+            return OP_MUL;
+        case 'd':
+            return OP_DIV;
+    }
+    return OP_UNKNOWN;
+}
+
 int parse_word(struct Substr *in_str) {
-    if(begin_with(in_str, "add"))
-        return OP_ADD;
-    if(begin_with(in_str, "sub"))
-        return OP_SUB;
-    if(begin_with(in_str, "mul"))
-        return OP_MUL;
-    if(begin_with(in_str, "div"))
-        return OP_DIV;
+    int len = 0;
+    int op;
 
-    fprintf(stderr, "Unknown word, %s\n", in_str->ptr);
-    exit(1);
+    while(len < in_str->len && in_str->ptr[len] != ' ')
+        len++;
+    if(len == 0)
+        return OP_UNKNOWN;
+    op = word_candidate(in_str->ptr[0]);
+    if(op == OP_UNKNOWN || len != (int)strlen(word_names[op]) || memcmp(in_str->ptr, word_names[op], len) != 0)
+        return OP_UNKNOWN;
+    return op;
 }
 
 /*
@@ -194,6 +213,19 @@ void test_begin_with() {
     assert_false(begin_with(&sub, "very"));
 }
 
+void test_parse_word() {
+    struct Substr add = {"add 1", 5};
+    struct Substr div = {"div", 3};
+    struct Substr longer = {"addx", 4};
+    struct Substr shorter = {"su 1", 4};
+    struct Substr other = {"dup", 3};
+
+    assert_int_eq(OP_ADD, parse_word(&add));
+    assert_int_eq(OP_DIV, parse_word(&div));
+    assert_int_eq(OP_UNKNOWN, parse_word(&longer));
+    assert_int_eq(OP_UNKNOWN, parse_word(&shorter));
+    assert_int_eq(OP_UNKNOWN, parse_word(&other));
+}
 
 static void run_unit_tests() {
     test_skip_space_NotSpaceDoNothing();
@@ -209,7 +241,7 @@ static void run_unit_tests() {
     test_parse_number();
 
     test_begin_with();
-
+    test_parse_word();
 
     printf("all test done\n");
 }
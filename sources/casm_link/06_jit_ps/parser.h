@@ -15,12 +15,14 @@ enum {
     OP_ADD,
     OP_SUB,
     OP_MUL,
-    OP_DIV
+    OP_DIV,
+    OP_UNKNOWN
 };
 
 /*
 input: "add ..." or "sub ..." or "mul ..." or "div ...""
-return: one of OP_ADD, OP_SUB, OP_MUL, OP_DIV
+return: one of OP_ADD, OP_SUB, OP_MUL, OP_DIV, or OP_UNKNOWN for other words.
+The whole token must match, "addx" is OP_UNKNOWN.
 */
 int parse_word(struct Substr *in_str);
 
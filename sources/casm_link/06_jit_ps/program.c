@@ -0,0 +1,349 @@
+#include "int_array.h"
+#include "optimizer.h"
+#include "program.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+
+static int emit_op(struct Program *prog, int op, int arg1, int arg2) {
+    struct ProgramOp *code = &prog->code[prog->len];
+    code->op = op;
+    code->arg1 = arg1;
+    code->arg2 = arg2;
+    return prog->len++;
+}
+
+/*
+Constants are usually embedded as immediate,
+so their slot is emitted only when somebody really needs it.
+*/
+static int slot_of(struct SsaGraph *g, struct Program *prog, int *slots, int idx) {
+    if(slots[idx] < 0)
+        slots[idx] = emit_op(prog, P_CONST, g->nodes[idx].arg1, 0);
+    return slots[idx];
+}
+
+static int emit_binop(struct SsaGraph *g, struct Program *prog, int *slots, struct SsaNode *node) {
+    static int imm_ops[] = {0, 0, 0, P_ADDI, P_SUBI, P_MULI, P_DIVI};
+    int a = node->arg1;
+    int b = node->arg2;
+    int is_const_a = g->nodes[a].op == SSA_CONST;
+    int is_const_b = g->nodes[b].op == SSA_CONST;
+
+    if(is_const_a && !is_const_b) {
+        if(node->op == SSA_SUB)
+            return emit_op(prog, P_RSBI, slots[b], g->nodes[a].arg1);
+        if(node->op == SSA_ADD || node->op == SSA_MUL)
+            return emit_op(prog, imm_ops[node->op], slots[b], g->nodes[a].arg1);
+    }
+    if(is_const_b)
+        return emit_op(prog, imm_ops[node->op], slot_of(g, prog, slots, a), g->nodes[b].arg1);
+
+    return emit_op(prog, node->op - SSA_ADD + P_ADD, slot_of(g, prog, slots, a), slots[b]);
+}
+
+static struct Program *program_from_graph(struct SsaGraph *g) {
+    struct Program *prog;
+    int slots[SSA_NODE_MAX];
+    int i, live = 0;
+
+    for(i = 0; i <= g->root; i++) {
+        slots[i] = -1;
+        if(g->uses[i] != 0)
+            live++;
+    }
+
+    prog = malloc(sizeof(struct Program) + sizeof(struct ProgramOp)*live);
+    prog->len = 0;
+
+    for(i = 0; i <= g->root; i++) {
+        struct SsaNode *node = &g->nodes[i];
+        if(g->uses[i] == 0)
+            continue;
+        switch(node->op) {
+            case SSA_CONST:
+                if(i == g->root)
+                    slot_of(g, prog, slots, i);
+                break;
+            case SSA_R0:
+                slots[i] = emit_op(prog, P_R0, 0, 0);
+                break;
+            case SSA_R1:
+                slots[i] = emit_op(prog, P_R1, 0, 0);
+                break;
+            case SSA_ADD:
+            case SSA_SUB:
+            case SSA_MUL:
+            case SSA_DIV:
+                slots[i] = emit_binop(g, prog, slots, node);
+                break;
+            case SSA_SHL:
+            case SSA_LSR:
+            case SSA_ASR:
+            case SSA_MULHS:
+                slots[i] = emit_op(prog, node->op - SSA_SHL + P_SHL, slots[node->arg1], node->arg2);
+                break;
+        }
+    }
+    return prog;
+}
+
+struct Program *compile(char *str) {
+    struct SsaGraph graph;
+
+    if(!ssa_build(str, &graph))
+        return NULL;
+    return program_from_graph(&graph);
+}
+
+void program_free(struct Program *prog) {
+    free(prog);
+}
+
+int run(struct Program *prog, int r0, int r1) {
+    int values[SSA_NODE_MAX];
+    struct ProgramOp *code = prog->code;
+    int i;
+
+    for(i = 0; i < prog->len; i++, code++) {
+        switch(code->op) {
+            case P_CONST:
+                values[i] = code->arg1;
+                break;
+            case P_R0:
+                values[i] = r0;
+                break;
+            case P_R1:
+                values[i] = r1;
+                break;
+            case P_ADD:
+                values[i] = (int)((unsigned int)values[code->arg1] + (unsigned int)values[code->arg2]);
+                break;
+            case P_SUB:
+                values[i] = (int)((unsigned int)values[code->arg1] - (unsigned int)values[code->arg2]);
+                break;
+            case P_MUL:
+                values[i] = (int)((unsigned int)values[code->arg1] * (unsigned int)values[code->arg2]);
+                break;
+            case P_DIV:
+                values[i] = values[code->arg1] / values[code->arg2];
+                break;
+            case P_ADDI:
+                values[i] = (int)((unsigned int)values[code->arg1] + (unsigned int)code->arg2);
+                break;
+            case P_SUBI:
+                values[i] = (int)((unsigned int)values[code->arg1] - (unsigned int)code->arg2);
+                break;
+            case P_RSBI:
+                values[i] = (int)((unsigned int)code->arg2 - (unsigned int)values[code->arg1]);
+                break;
+            case P_MULI:
+                values[i] = (int)((unsigned int)values[code->arg1] * (unsigned int)code->arg2);
+                break;
+            case P_DIVI:
+                values[i] = values[code->arg1] / code->arg2;
+                break;
+            case P_SHL:
+                values[i] = (int)((unsigned int)values[code->arg1] << code->arg2);
+                break;
+            case P_LSR:
+                values[i] = (int)((unsigned int)values[code->arg1] >> code->arg2);
+                break;
+            case P_ASR:
+                values[i] = values[code->arg1] >> code->arg2;
+                break;
+            case P_MULHS:
+                values[i] = (int)(((long long)values[code->arg1] * code->arg2) >> 32);
+                break;
+        }
+    }
+    return values[prog->len-1];
+}
+
+/* inputs per block of run_array, the columns of a block stay in L1. */
+#define RUN_ARRAY_BLOCK 256
+
+/*
+Run every op for inputs [base, base+m), op i writes cols[i].
+*/
+static void run_block(struct Program *prog, int **cols, int *buf, int *r0, int *r1, int m) {
+    struct ProgramOp *code = prog->code;
+    int i, j;
+
+    for(i = 0; i < prog->len; i++, code++) {
+        int *dst = buf + i*RUN_ARRAY_BLOCK;
+        int *a;
+
+        if(code->op == P_R0 || code->op == P_R1) {
+            cols[i] = code->op == P_R0 ? r0 : r1;
+            continue;
+        }
+        cols[i] = dst;
+        if(code->op == P_CONST) {
+            int_array_fill(dst, code->arg1, m);
+            continue;
+        }
+        a = cols[code->arg1];
+        switch(code->op) {
+            case P_ADD:
+                int_array_add(dst, a, cols[code->arg2], m);
+                break;
+            case P_SUB:
+                int_array_sub(dst, a, cols[code->arg2], m);
+                break;
+            case P_MUL:
+                int_array_mul(dst, a, cols[code->arg2], m);
+                break;
+            case P_DIV:
+                for(j = 0; j < m; j++)
+                    dst[j] = a[j] / cols[code->arg2][j];
+                break;
+            case P_ADDI:
+                int_array_add_scalar(dst, a, code->arg2, m);
+                break;
+            case P_SUBI:
+                int_array_sub_scalar(dst, a, code->arg2, m);
+                break;
+            case P_RSBI:
+                int_array_rsb_scalar(dst, a, code->arg2, m);
+                break;
+            case P_MULI:
+                int_array_mul_scalar(dst, a, code->arg2, m);
+                break;
+            case P_DIVI:
+                for(j = 0; j < m; j++)
+                    dst[j] = a[j] / code->arg2;
+                break;
+            case P_SHL:
+                for(j = 0; j < m; j++)
+                    dst[j] = (int)((unsigned int)a[j] << code->arg2);
+                break;
+            case P_LSR:
+                for(j = 0; j < m; j++)
+                    dst[j] = (int)((unsigned int)a[j] >> code->arg2);
+                break;
+            case P_ASR:
+                for(j = 0; j < m; j++)
+                    dst[j] = a[j] >> code->arg2;
+                break;
+            case P_MULHS:
+                for(j = 0; j < m; j++)
+                    dst[j] = (int)(((long long)a[j] * code->arg2) >> 32);
+                break;
+        }
+    }
+}
+
+void run_array(struct Program *prog, int *r0, int *r1, int *out, int n) {
+    int **cols = malloc(sizeof(int*)*prog->len);
+    int *buf = malloc(sizeof(int)*RUN_ARRAY_BLOCK*prog->len);
+    int base;
+
+    for(base = 0; base < n; base += RUN_ARRAY_BLOCK) {
+        int m = n - base < RUN_ARRAY_BLOCK ? n - base : RUN_ARRAY_BLOCK;
+        run_block(prog, cols, buf, r0 + base, r1 + base, m);
+        int_array_copy(out + base, cols[prog->len-1], m);
+    }
+    free(buf);
+    free(cols);
+}
+
+
+
+/*
+test code
+*/
+#include "test_util.h"
+
+static void test_compile_run() {
+    struct Program *prog = compile("3 7 add r1 sub 4 mul r0 add");
+
+    assert_int_eq(21, run(prog, 1, 5));
+    assert_int_eq(25, run(prog, 1, 4));
+    program_free(prog);
+}
+
+static void test_compile_embed_immediate() {
+    struct Program *prog = compile("r0 3 add");
+
+    /* r0, addi */
+    assert_int_eq(2, prog->len);
+    assert_int_eq(P_ADDI, prog->code[1].op);
+    assert_int_eq(8, run(prog, 5, 0));
+    program_free(prog);
+
+    prog = compile("10 r0 sub");
+    assert_int_eq(P_RSBI, prog->code[1].op);
+    assert_int_eq(7, run(prog, 3, 0));
+    program_free(prog);
+}
+
+static void test_compile_constant_only() {
+    struct Program *prog = compile("3 4 mul");
+
+    assert_int_eq(1, prog->len);
+    assert_int_eq(12, run(prog, 0, 0));
+    program_free(prog);
+}
+
+static void test_compile_const_numerator() {
+    struct Program *prog = compile("100 r1 div");
+
+    assert_int_eq(-33, run(prog, 0, -3));
+    program_free(prog);
+}
+
+static void test_compile_error() {
+    assert_true(compile("3 4 foo") == NULL);
+    assert_true(compile("3 add") == NULL);
+    assert_true(compile("") == NULL);
+}
+
+static void assert_run_array_same_as_run(char *str, int n) {
+    struct Program *prog = compile(str);
+    int *r0 = malloc(sizeof(int)*n);
+    int *r1 = malloc(sizeof(int)*n);
+    int *out = malloc(sizeof(int)*n);
+    int i;
+
+    for(i = 0; i < n; i++) {
+        r0[i] = i*37 - 5000;
+        r1[i] = (i % 11) + 1;
+    }
+    run_array(prog, r0, r1, out, n);
+    for(i = 0; i < n; i++)
+        assert_int_eq(run(prog, r0[i], r1[i]), out[i]);
+    free(r0);
+    free(r1);
+    free(out);
+    program_free(prog);
+}
+
+static void test_run_array() {
+    /* not a multiple of the block, and all ops including the optimized division. */
+    assert_run_array_same_as_run("3 7 add r1 sub 4 mul r0 add", 1000);
+    assert_run_array_same_as_run("r0 r1 mul 10 r0 sub add r0 r1 div sub", 1000);
+    assert_run_array_same_as_run("r0 7 div r0 8 div add r0 3 mul 2 sub sub", 1000);
+    assert_run_array_same_as_run("r1", 300);
+    assert_run_array_same_as_run("3 4 mul", 5);
+    assert_run_array_same_as_run("r0 r1 add", 0);
+}
+
+static void run_unit_tests() {
+    test_compile_run();
+    test_compile_embed_immediate();
+    test_compile_constant_only();
+    test_compile_const_numerator();
+    test_compile_error();
+    test_run_array();
+
+    printf("all test done\n");
+}
+
+#if 0
+int main() {
+    run_unit_tests();
+    return 0;
+}
+#endif
@@ -0,0 +1,55 @@
+/*
+Compiled form of an expression.
+
+Each op writes the value slot of its own index,
+so the result is always in the slot of the last op.
+*/
+enum ProgramOpCode {
+    P_CONST,    /* arg1: value */
+    P_R0,
+    P_R1,
+    P_ADD,      /* arg1, arg2: slot */
+    P_SUB,
+    P_MUL,
+    P_DIV,
+    P_ADDI,     /* arg1: slot, arg2: immediate */
+    P_SUBI,
+    P_RSBI,     /* arg2 - arg1 */
+    P_MULI,
+    P_DIVI,
+    P_SHL,
+    P_LSR,
+    P_ASR,
+    P_MULHS
+};
+
+struct ProgramOp {
+    int op;
+    int arg1;
+    int arg2;
+};
+
+struct Program {
+    int len;
+    struct ProgramOp code[];
+};
+
+/*
+Parse and optimize str once.
+Return NULL and print the reason to stderr if str is not a valid expression.
+*/
+struct Program *compile(char *str);
+
+/*
+Execute compiled program. No parsing happens here.
+*/
+int run(struct Program *prog, int r0, int r1);
+
+/*
+out[i] = run(prog, r0[i], r1[i]) for each i < n.
+Each op is done for a block of inputs at once by the int_array kernels,
+so the op dispatch is paid once per block instead of once per input.
+*/
+void run_array(struct Program *prog, int *r0, int *r1, int *out, int n);
+
+void program_free(struct Program *prog);
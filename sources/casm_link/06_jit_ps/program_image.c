@@ -0,0 +1,392 @@
+#include "optimizer.h"
+#include "program.h"
+#include "program_image.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define IMAGE_MAGIC "PSIMAGE"
+#define IMAGE_VERSION 1
+
+/*
+File layout, every offset is from the top of the file and 4 byte aligned:
+header, entries, hash table of entry index+1 (0 for empty), names, programs.
+A program is stored as struct Program, len followed by the ops.
+*/
+struct ImageHeader {
+    char magic[8];
+    int version;
+    int size;
+    int entry_num;
+    int entries_offset;
+    int table_size;     /* power of 2 */
+    int table_offset;
+};
+
+struct ImageEntry {
+    int name_offset;
+    unsigned int hash;
+    int prog_offset;
+};
+
+struct ProgramImage {
+    unsigned char *base;
+    int size;
+    struct ImageHeader *header;
+    struct ImageEntry *entries;
+    unsigned int *table;
+    /* per entry, 0: not checked yet, 1: valid, -1: broken */
+    signed char *checked;
+};
+
+static unsigned int hash_name(char *name) {
+    unsigned int h = 2166136261u;
+    while(*name) {
+        h ^= (unsigned char)*name++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int align4(int n) {
+    return (n + 3) & ~3;
+}
+
+/*
+A division by the constant 0 traps on run.
+save refuses such a program, and load treats it as broken.
+*/
+static int has_const_zero_div(struct Program *prog) {
+    int i;
+    for(i = 0; i < prog->len; i++) {
+        if(prog->code[i].op == P_DIVI && prog->code[i].arg2 == 0)
+            return 1;
+    }
+    return 0;
+}
+
+
+/*
+save
+*/
+
+int program_image_save(char *path, char **names, char **exprs, int num) {
+    struct Program **progs = calloc(num, sizeof(struct Program*));
+    struct ImageEntry *entries = calloc(num, sizeof(struct ImageEntry));
+    struct ImageHeader header;
+    unsigned int *table;
+    unsigned char *buf;
+    int offset, i, ret = -1;
+    FILE *fp;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, IMAGE_MAGIC, sizeof(header.magic));
+    header.version = IMAGE_VERSION;
+    header.entry_num = num;
+    header.entries_offset = sizeof(struct ImageHeader);
+    /* keep the load under 1/2 */
+    header.table_size = 1;
+    while(header.table_size < num*2)
+        header.table_size *= 2;
+    header.table_offset = header.entries_offset + sizeof(struct ImageEntry)*num;
+
+    offset = header.table_offset + sizeof(unsigned int)*header.table_size;
+    for(i = 0; i < num; i++) {
+        entries[i].name_offset = offset;
+        entries[i].hash = hash_name(names[i]);
+        offset = align4(offset + strlen(names[i]) + 1);
+    }
+    for(i = 0; i < num; i++) {
+        progs[i] = compile(exprs[i]);
+        if(progs[i] == NULL) {
+            fprintf(stderr, "can't compile %s\n", names[i]);
+            goto done;
+        }
+        if(has_const_zero_div(progs[i])) {
+            fprintf(stderr, "division by 0 in %s\n", names[i]);
+            goto done;
+        }
+        entries[i].prog_offset = offset;
+        offset += sizeof(struct Program) + sizeof(struct ProgramOp)*progs[i]->len;
+    }
+    header.size = offset;
+
+    buf = calloc(1, header.size);
+    memcpy(buf, &header, sizeof(header));
+    memcpy(buf + header.entries_offset, entries, sizeof(struct ImageEntry)*num);
+    table = (unsigned int*)(buf + header.table_offset);
+    for(i = 0; i < num; i++) {
+        unsigned int mask = header.table_size - 1;
+        unsigned int slot = entries[i].hash & mask;
+        while(table[slot] != 0)
+            slot = (slot + 1) & mask;
+        table[slot] = i + 1;
+        strcpy((char*)buf + entries[i].name_offset, names[i]);
+        memcpy(buf + entries[i].prog_offset, progs[i],
+               sizeof(struct Program) + sizeof(struct ProgramOp)*progs[i]->len);
+    }
+
+    fp = fopen(path, "wb");
+    if(fp == NULL) {
+        fprintf(stderr, "can't open %s\n", path);
+    } else {
+        if(fwrite(buf, 1, header.size, fp) == (size_t)header.size)
+            ret = 0;
+        else
+            fprintf(stderr, "can't write %s\n", path);
+        fclose(fp);
+    }
+    free(buf);
+
+done:
+    for(i = 0; i < num; i++)
+        if(progs[i] != NULL)
+            program_free(progs[i]);
+    free(progs);
+    free(entries);
+    return ret;
+}
+
+
+/*
+load
+*/
+
+struct ProgramImage *program_image_load(char *path) {
+    struct ProgramImage *image;
+    struct ImageHeader *header;
+    struct stat st;
+    unsigned char *base;
+    int fd = open(path, O_RDONLY);
+
+    if(fd < 0) {
+        fprintf(stderr, "can't open %s\n", path);
+        return NULL;
+    }
+    if(fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(struct ImageHeader) || st.st_size > 0x7fffffff) {
+        fprintf(stderr, "%s is not a program image\n", path);
+        close(fd);
+        return NULL;
+    }
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(base == MAP_FAILED) {
+        fprintf(stderr, "can't map %s\n", path);
+        return NULL;
+    }
+
+    header = (struct ImageHeader*)base;
+    if(memcmp(header->magic, IMAGE_MAGIC, sizeof(header->magic)) != 0
+       || header->version != IMAGE_VERSION
+       || header->size != st.st_size
+       || header->entry_num < 0 || header->entry_num > (int)(st.st_size/sizeof(struct ImageEntry))
+       || header->entries_offset != (int)sizeof(struct ImageHeader)
+       || header->table_size <= 0 || (header->table_size & (header->table_size - 1)) != 0
+       || header->table_size > (int)(st.st_size/sizeof(unsigned int))
+       || (size_t)header->table_offset != header->entries_offset + sizeof(struct ImageEntry)*header->entry_num
+       || header->table_offset + sizeof(unsigned int)*header->table_size > (size_t)st.st_size) {
+        fprintf(stderr, "%s is not a program image of this version\n", path);
+        munmap(base, st.st_size);
+        return NULL;
+    }
+
+    image = malloc(sizeof(struct ProgramImage));
+    image->base = base;
+    image->size = st.st_size;
+    image->header = header;
+    image->entries = (struct ImageEntry*)(base + header->entries_offset);
+    image->table = (unsigned int*)(base + header->table_offset);
+    image->checked = calloc(header->entry_num + 1, 1);
+    return image;
+}
+
+static int is_slot_op(int op) {
+    return op >= P_ADD && op <= P_MULHS;
+}
+
+/*
+Check what run trusts: every slot refers to an earlier op,
+and the name and the program are inside of the file.
+*/
+static int check_entry(struct ProgramImage *image, struct ImageEntry *entry) {
+    struct Program *prog;
+    int i;
+
+    if(entry->name_offset < image->header->table_offset || entry->name_offset >= image->size
+       || memchr(image->base + entry->name_offset, '\0', image->size - entry->name_offset) == NULL)
+        return -1;
+    if(entry->prog_offset < image->header->table_offset || (entry->prog_offset & 3) != 0
+       || entry->prog_offset > image->size - (int)sizeof(struct Program))
+        return -1;
+    prog = (struct Program*)(image->base + entry->prog_offset);
+    if(prog->len <= 0 || prog->len > SSA_NODE_MAX
+       || prog->len > (image->size - entry->prog_offset - (int)sizeof(struct Program))/(int)sizeof(struct ProgramOp))
+        return -1;
+    for(i = 0; i < prog->len; i++) {
+        struct ProgramOp *code = &prog->code[i];
+        if(code->op < P_CONST || code->op > P_MULHS)
+            return -1;
+        if(is_slot_op(code->op) && (code->arg1 < 0 || code->arg1 >= i))
+            return -1;
+        if(code->op >= P_ADD && code->op <= P_DIV && (code->arg2 < 0 || code->arg2 >= i))
+            return -1;
+        if(code->op >= P_SHL && code->op <= P_ASR && (code->arg2 < 0 || code->arg2 > 31))
+            return -1;
+    }
+    if(has_const_zero_div(prog))
+        return -1;
+    return 1;
+}
+
+struct Program *program_image_find(struct ProgramImage *image, char *name) {
+    unsigned int h = hash_name(name);
+    unsigned int mask = image->header->table_size - 1;
+    unsigned int slot, index;
+    int probes;
+
+    for(slot = h & mask, probes = 0; probes < image->header->table_size; slot = (slot + 1) & mask, probes++) {
+        struct ImageEntry *entry;
+        index = image->table[slot];
+        if(index == 0 || index > (unsigned int)image->header->entry_num)
+            return NULL;
+        entry = &image->entries[index - 1];
+        if(entry->hash != h)
+            continue;
+        if(image->checked[index] == 0) {
+            image->checked[index] = check_entry(image, entry);
+            if(image->checked[index] < 0)
+                fprintf(stderr, "broken program of entry %d in image\n", index - 1);
+        }
+        if(image->checked[index] < 0)
+            continue;
+        if(strcmp((char*)image->base + entry->name_offset, name) == 0)
+            return (struct Program*)(image->base + entry->prog_offset);
+    }
+    return NULL;
+}
+
+int program_image_count(struct ProgramImage *image) {
+    return image->header->entry_num;
+}
+
+void program_image_free(struct ProgramImage *image) {
+    munmap(image->base, image->size);
+    free(image->checked);
+    free(image);
+}
+
+
+/*
+test code
+*/
+#include "eval.h"
+#include "test_util.h"
+
+static char *test_image_path = "/tmp/program_image_test.img";
+
+static void test_program_image_round_trip() {
+    static char *names[] = {"sum", "scaled", "const", "div7"};
+    static char *exprs[] = {"r0 r1 add", "3 r0 mul r1 2 div add", "1 2 add 4 mul", "r0 7 div r1 sub"};
+    struct ProgramImage *image;
+    int i, r0;
+
+    assert_int_eq(0, program_image_save(test_image_path, names, exprs, 4));
+    image = program_image_load(test_image_path);
+    assert_true(image != NULL);
+    assert_int_eq(4, program_image_count(image));
+    for(i = 0; i < 4; i++) {
+        struct Program *prog = program_image_find(image, names[i]);
+        assert_true(prog != NULL);
+        for(r0 = -20; r0 <= 20; r0 += 7)
+            assert_int_eq(eval_unoptimized(r0, 5, exprs[i]), run(prog, r0, 5));
+    }
+    assert_true(program_image_find(image, "missing") == NULL);
+    assert_true(program_image_find(image, "") == NULL);
+    program_image_free(image);
+}
+
+static void test_program_image_many() {
+    int num = 3000;
+    char **names = malloc(sizeof(char*)*num);
+    char **exprs = malloc(sizeof(char*)*num);
+    struct ProgramImage *image;
+    int i;
+
+    for(i = 0; i < num; i++) {
+        names[i] = malloc(32);
+        exprs[i] = malloc(64);
+        sprintf(names[i], "f%d", i);
+        sprintf(exprs[i], "r0 %d mul r1 add %d sub", i, i*3);
+    }
+    assert_int_eq(0, program_image_save(test_image_path, names, exprs, num));
+    image = program_image_load(test_image_path);
+    for(i = 0; i < num; i++)
+        assert_int_eq(2*i + 1 - i*3, run(program_image_find(image, names[i]), 2, 1));
+    program_image_free(image);
+    for(i = 0; i < num; i++) {
+        free(names[i]);
+        free(exprs[i]);
+    }
+    free(names);
+    free(exprs);
+}
+
+static void test_program_image_broken() {
+    static char *names[] = {"a", "b"};
+    static char *exprs[] = {"r0 r1 add", "r0 1 add"};
+    struct ImageHeader header;
+    struct ImageEntry entry;
+    struct Program prog;
+    struct ProgramImage *image;
+    struct ProgramOp op;
+    FILE *fp;
+
+    // compile error, nothing written.
+    assert_int_eq(-1, program_image_save(test_image_path, names, (char*[]){"r0 r1 add", "1 foo"}, 2));
+    // compiles, but would be rejected on load.
+    assert_int_eq(-1, program_image_save(test_image_path, names, (char*[]){"r0 r1 add", "r0 0 div"}, 2));
+
+    assert_int_eq(0, program_image_save(test_image_path, names, exprs, 2));
+    fp = fopen(test_image_path, "r+b");
+    fread(&header, sizeof(header), 1, fp);
+    fread(&entry, sizeof(entry), 1, fp);
+    // make the first op of "a" refer to a later slot.
+    fseek(fp, entry.prog_offset, SEEK_SET);
+    fread(&prog, sizeof(prog), 1, fp);
+    fread(&op, sizeof(op), 1, fp);
+    op.op = P_ADD;
+    op.arg1 = 5;
+    fseek(fp, entry.prog_offset + sizeof(prog), SEEK_SET);
+    fwrite(&op, sizeof(op), 1, fp);
+    fclose(fp);
+
+    image = program_image_load(test_image_path);
+    assert_true(image != NULL);
+    assert_true(program_image_find(image, "a") == NULL);
+    assert_true(program_image_find(image, "b") != NULL);
+    program_image_free(image);
+
+    // truncated.
+    truncate(test_image_path, sizeof(header) + 4);
+    assert_true(program_image_load(test_image_path) == NULL);
+    unlink(test_image_path);
+}
+
+static void run_unit_tests() {
+    test_program_image_round_trip();
+    test_program_image_many();
+    test_program_image_broken();
+
+    printf("all test done\n");
+}
+
+#if 0
+int main() {
+    run_unit_tests();
+    return 0;
+}
+#endif
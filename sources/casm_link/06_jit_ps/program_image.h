@@ -0,0 +1,30 @@
+/*
+Image file of named compiled programs, to skip parse and optimize at startup.
+
+Programs refer to their slots by index, so the image has no pointer to fix.
+Loading is one mmap, and each program is checked on its first lookup,
+so only the pages of the programs in use are touched.
+*/
+struct Program;
+struct ProgramImage;
+
+/*
+Compile exprs[i] as names[i] and write them all to path.
+Return 0 on success, -1 and print the reason to stderr on a compile or write error.
+*/
+int program_image_save(char *path, char **names, char **exprs, int num);
+
+/*
+Map the image at path copy-on-write.
+Return NULL and print the reason to stderr if it isn't a valid image.
+*/
+struct ProgramImage *program_image_load(char *path);
+
+/*
+Return the program of name, pointing into the mapping, or NULL if not found or broken.
+*/
+struct Program *program_image_find(struct ProgramImage *image, char *name);
+
+int program_image_count(struct ProgramImage *image);
+
+void program_image_free(struct ProgramImage *image);
@@ -0,0 +1,104 @@
+/*
+Startup by compiling a prelude of named expressions, and by loading its image.
+
+gcc -O2 program_image_bench.c program_image.c program.c int_array.c optimizer.c parser.c
+./a.out [prelude_size]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "program.h"
+#include "program_image.h"
+
+#define REPEAT 5
+#define IMAGE_PATH "/tmp/program_image_bench.img"
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static void make_prelude(int num, char **names, char **exprs) {
+    int i;
+
+    for(i = 0; i < num; i++) {
+        names[i] = malloc(32);
+        exprs[i] = malloc(128);
+        sprintf(names[i], "lib_func_%d", i);
+        sprintf(exprs[i], "r0 %d mul r1 %d add 2 mul sub %d r0 r1 add mul add 8 div",
+                i % 97 + 1, i % 13, i % 31);
+    }
+}
+
+/*
+Prepare every program for use, and return the time of the best run.
+*/
+static double bench_compile(int num, char **exprs) {
+    struct Program **progs = malloc(sizeof(struct Program*)*num);
+    double best = 0;
+    int r, i;
+
+    for(r = 0; r < REPEAT; r++) {
+        double begin = now_sec(), elapsed;
+        for(i = 0; i < num; i++)
+            progs[i] = compile(exprs[i]);
+        elapsed = now_sec() - begin;
+        if(r == 0 || elapsed < best)
+            best = elapsed;
+        for(i = 0; i < num; i++)
+            program_free(progs[i]);
+    }
+    free(progs);
+    return best;
+}
+
+static double bench_load(int num, char **names, int used) {
+    double best = 0;
+    int r, i, sum = 0;
+
+    for(r = 0; r < REPEAT; r++) {
+        double begin = now_sec(), elapsed;
+        struct ProgramImage *image = program_image_load(IMAGE_PATH);
+        for(i = 0; i < used; i++)
+            sum += run(program_image_find(image, names[i*(num/used)]), 1, 2);
+        elapsed = now_sec() - begin;
+        if(r == 0 || elapsed < best)
+            best = elapsed;
+        program_image_free(image);
+    }
+    if(sum == 12345)
+        printf("unlikely\n");
+    return best;
+}
+
+int main(int argc, char **argv) {
+    int num = argc > 1 ? atoi(argv[1]) : 10000;
+    char **names = malloc(sizeof(char*)*num);
+    char **exprs = malloc(sizeof(char*)*num);
+    double compile_time, load_all, load_few;
+    int i;
+
+    make_prelude(num, names, exprs);
+    compile_time = bench_compile(num, exprs);
+    if(program_image_save(IMAGE_PATH, names, exprs, num) != 0)
+        return 1;
+    load_all = bench_load(num, names, num);
+    load_few = bench_load(num, names, 10);
+
+    printf("%d programs\n", num);
+    printf("compile all: %.2f ms\n", compile_time*1e3);
+    printf("load image and use all: %.2f ms (%.1fx)\n", load_all*1e3, compile_time/load_all);
+    printf("load image and use 10: %.3f ms (%.1fx)\n", load_few*1e3, compile_time/load_few);
+
+    unlink(IMAGE_PATH);
+    for(i = 0; i < num; i++) {
+        free(names[i]);
+        free(exprs[i]);
+    }
+    free(names);
+    free(exprs);
+    return 0;
+}
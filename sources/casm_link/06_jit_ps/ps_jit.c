@@ -1,43 +1,403 @@
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-#include <sys/mman.h>
 
+#include "../arm_emit/arm_emit.h"
 #include "parser.h"
+#include "optimizer.h"
+#include "eval.h"
+#include "jit_debug.h"
 #include "test_util.h"
 
-extern int eval(int r0, int r1, char *str);
-
 /*
 JIT
 */
 int *binary_buf = NULL;
+static struct Emitter jit_emitter;
 
-int* allocate_executable_buf(int size) {
-    return (int*)mmap(0, size,
-                 PROT_READ | PROT_WRITE | PROT_EXEC,
-                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+void ensure_jit_buf() {
+    static int initialized = 0;
+    if(!initialized) {
+        emitter_init(&jit_emitter, 256);
+        jit_debug_init_from_env();
+        initialized = 1;
+    }
 }
 
-void ensure_jit_buf() {
-    if(binary_buf == NULL) {
-        binary_buf = allocate_executable_buf(1024);
+/*
+register allocation
+
+Values are kept in callee saved r4-r11.
+r0-r3 and r12 are scratch, they are clobbered by division helper call.
+*/
+#define REG_FIRST 4
+#define REG_LAST 11
+
+/* r4-r12, r14. r12 is only pushed to keep sp 8 byte aligned for the helper call. */
+#define SAVED_REGS 0x5ff0
+
+static int reg_used[16];
+
+static int alloc_reg() {
+    int reg;
+    for(reg = REG_FIRST; reg <= REG_LAST; reg++) {
+        if(!reg_used[reg]) {
+            reg_used[reg] = 1;
+            return reg;
+        }
+    }
+    fprintf(stderr, "jit: expression needs too many registers.\n");
+    return -1;
+}
+
+static int jit_idiv(int arg1, int arg2) {
+    return arg1 / arg2;
+}
+
+/*
+Emit one node into rd. Operands are already in registers.
+*/
+static void emit_node(struct Emitter *e, struct SsaNode *node, int rd, int ra, int rb) {
+    switch(node->op) {
+        case SSA_CONST:
+            emit_mov_imm(e, rd, node->arg1);
+            break;
+        case SSA_ADD:
+            emit_add(e, rd, ra, rb);
+            break;
+        case SSA_SUB:
+            emit_sub(e, rd, ra, rb);
+            break;
+        case SSA_MUL:
+            // rd may be ra or rb, which mul does not allow for both.
+            emit_mul(e, REG_IP, ra, rb);
+            emit_mov(e, rd, REG_IP);
+            break;
+        case SSA_DIV:
+            emit_mov(e, 0, ra);
+            emit_mov(e, 1, rb);
+            emit_mov_imm(e, REG_IP, (int)(intptr_t)jit_idiv);
+            emit_blx(e, REG_IP);
+            emit_mov(e, rd, 0);
+            break;
+        case SSA_SHL:
+            emit_mov_shift(e, rd, ra, SHIFT_LSL, node->arg2);
+            break;
+        case SSA_LSR:
+            emit_mov_shift(e, rd, ra, SHIFT_LSR, node->arg2);
+            break;
+        case SSA_ASR:
+            emit_mov_shift(e, rd, ra, SHIFT_ASR, node->arg2);
+            break;
+        case SSA_MULHS:
+            emit_mov_imm(e, REG_IP, node->arg2);
+            emit_smull(e, 2, 3, ra, REG_IP);
+            emit_mov(e, rd, 3);
+            break;
+    }
+}
+
+static int jit_graph(struct Emitter *e, struct SsaGraph *g) {
+    int regs[SSA_NODE_MAX];
+    int uses[SSA_NODE_MAX];
+    int i;
+
+    memset(reg_used, 0, sizeof(reg_used));
+    memcpy(uses, g->uses, sizeof(uses));
+
+    emit_push(e, SAVED_REGS);
+
+    // r0 and r1 are clobbered by the helper call, copy them first.
+    for(i = 0; i < g->node_num; i++) {
+        int op = g->nodes[i].op;
+        if(uses[i] != 0 && (op == SSA_R0 || op == SSA_R1)) {
+            regs[i] = alloc_reg();
+            if(regs[i] < 0)
+                return 0;
+            emit_mov(e, regs[i], op == SSA_R0 ? 0 : 1);
+        }
     }
+
+    for(i = 0; i <= g->root; i++) {
+        struct SsaNode *node = &g->nodes[i];
+        int ra = 0, rb = 0;
+
+        if(uses[i] == 0 || node->op == SSA_R0 || node->op == SSA_R1)
+            continue;
+
+        switch(node->op) {
+            case SSA_ADD:
+            case SSA_SUB:
+            case SSA_MUL:
+            case SSA_DIV:
+                rb = regs[node->arg2];
+                if(--uses[node->arg2] == 0)
+                    reg_used[rb] = 0;
+                // fall through
+            case SSA_SHL:
+            case SSA_LSR:
+            case SSA_ASR:
+            case SSA_MULHS:
+                ra = regs[node->arg1];
+                if(--uses[node->arg1] == 0)
+                    reg_used[ra] = 0;
+                break;
+        }
+
+        regs[i] = alloc_reg();
+        if(regs[i] < 0)
+            return 0;
+        emit_node(e, node, regs[i], ra, rb);
+    }
+
+    emit_mov(e, 0, regs[g->root]);
+    emit_pop(e, (SAVED_REGS & ~(1 << REG_LR)) | (1 << REG_PC));
+    return 1;
 }
 
+/*
+Compile input into binary_buf. The previous result is overwritten.
+Return NULL if the expression is invalid or too large to compile.
+*/
 int* jit_script(char *input) {
+    struct SsaGraph graph;
+
     ensure_jit_buf();
-    /*
-    TODO: emit binary here
-    */
-    // dummy code to avoid crash.
-    binary_buf[0] = 0xe1a0f00e; // 0xe1a0f00e
+    emitter_reset(&jit_emitter);
+    if(!ssa_build(input, &graph) || !jit_graph(&jit_emitter, &graph))
+        return NULL;
 
+    binary_buf = emitter_finish(&jit_emitter);
+    if(binary_buf != NULL)
+        jit_debug_register(binary_buf, jit_emitter.pos*4, input, 4, SAVED_REGS);
     return binary_buf;
 }
 
 
+/*
+Value specialization
+
+A JitSite watches the arguments of calls to one script.
+When r0 or r1 has been the same for JIT_SPEC_THRESHOLD calls in a row,
+the script is compiled again with that value as a constant,
+so that constant folding and strength reduction work on it.
+The specialized code starts with guards comparing the arguments,
+and jumps to the generic code when they do not match:
+
+    cmp r0, #val
+    bne fail
+    b body
+fail:
+    (*guard_failures)++
+    jump to generic code
+body:
+    (*hits)++
+    push ...
+
+If guard failures since specialization exceed hits by JIT_SPEC_FAILURE_LIMIT,
+the site goes back to the generic code and starts recording again.
+*/
+#define JIT_SPEC_THRESHOLD 16
+#define JIT_SPEC_FAILURE_LIMIT 64
+
+struct JitSite {
+    char *script;
+    struct Emitter generic_code;
+    struct Emitter spec_code;
+    int *generic;
+    /* code to call, generic or specialized. */
+    int *entry;
+    /* registers baked into the current specialized code, 0 while generic. */
+    int spec_mask;
+    int spec_r0;
+    int spec_r1;
+    /* number of calls in a row with the same value. */
+    int last_r0;
+    int last_r1;
+    int same_r0;
+    int same_r1;
+    /* counted by generated code. */
+    int hits;
+    int guard_failures;
+    int hits_at_spec;
+    int failures_at_spec;
+    int spec_count;
+};
+
+static int *jit_compile_generic(struct JitSite *site) {
+    struct SsaGraph graph;
+    int *code;
+
+    if(!ssa_build(site->script, &graph) || !jit_graph(&site->generic_code, &graph))
+        return NULL;
+    code = emitter_finish(&site->generic_code);
+    if(code != NULL)
+        jit_debug_register(code, site->generic_code.pos*4, site->script, 4, SAVED_REGS);
+    return code;
+}
+
+static int *jit_compile_specialized(struct JitSite *site) {
+    struct Emitter *e = &site->spec_code;
+    struct SsaGraph graph;
+    int fail, body, prologue_size;
+    int *code;
+
+    emitter_reset(e);
+    if(!ssa_build_specialized(site->script, site->spec_mask, site->spec_r0, site->spec_r1, &graph))
+        return NULL;
+
+    fail = emit_new_label(e);
+    body = emit_new_label(e);
+    if(site->spec_mask & SSA_SPEC_R0) {
+        emit_cmp_const(e, 0, site->spec_r0, 2);
+        emit_b_cond(e, COND_NE, fail);
+    }
+    if(site->spec_mask & SSA_SPEC_R1) {
+        emit_cmp_const(e, 1, site->spec_r1, 2);
+        emit_b_cond(e, COND_NE, fail);
+    }
+    emit_b(e, body);
+    emit_bind_label(e, fail);
+    emit_counter_inc(e, &site->guard_failures, 2, 3);
+    emit_jump_abs(e, site->generic);
+    emit_bind_label(e, body);
+    emit_counter_inc(e, &site->hits, 2, 3);
+
+    prologue_size = (e->pos + 1)*4;
+    if(!jit_graph(e, &graph))
+        return NULL;
+    code = emitter_finish(e);
+    if(code != NULL)
+        jit_debug_register(code, e->pos*4, site->script, prologue_size, SAVED_REGS);
+    return code;
+}
+
+int jit_site_init(struct JitSite *site, char *script) {
+    memset(site, 0, sizeof(struct JitSite));
+    site->script = script;
+    ensure_jit_buf();
+    emitter_init(&site->generic_code, 256);
+    emitter_init(&site->spec_code, 256);
+    site->generic = jit_compile_generic(site);
+    site->entry = site->generic;
+    return site->generic != NULL;
+}
+
+void jit_site_free(struct JitSite *site) {
+    emitter_free(&site->generic_code);
+    emitter_free(&site->spec_code);
+}
+
+static void jit_site_record(struct JitSite *site, int r0, int r1) {
+    int mask = 0;
+    int *code;
+
+    site->same_r0 = site->same_r0 > 0 && site->last_r0 == r0 ? site->same_r0+1 : 1;
+    site->same_r1 = site->same_r1 > 0 && site->last_r1 == r1 ? site->same_r1+1 : 1;
+    site->last_r0 = r0;
+    site->last_r1 = r1;
+
+    if(site->same_r0 >= JIT_SPEC_THRESHOLD)
+        mask |= SSA_SPEC_R0;
+    if(site->same_r1 >= JIT_SPEC_THRESHOLD)
+        mask |= SSA_SPEC_R1;
+    if(mask == 0)
+        return;
+
+    site->spec_mask = mask;
+    site->spec_r0 = r0;
+    site->spec_r1 = r1;
+    code = jit_compile_specialized(site);
+    if(code == NULL) {
+        // keep generic code, try again after another run of the same values.
+        site->spec_mask = 0;
+        site->same_r0 = site->same_r1 = 0;
+        return;
+    }
+    site->entry = code;
+    site->hits_at_spec = site->hits;
+    site->failures_at_spec = site->guard_failures;
+    site->spec_count++;
+}
+
+static void jit_site_check(struct JitSite *site) {
+    int hits = site->hits - site->hits_at_spec;
+    int failures = site->guard_failures - site->failures_at_spec;
+
+    if(failures <= hits + JIT_SPEC_FAILURE_LIMIT)
+        return;
+    site->entry = site->generic;
+    site->spec_mask = 0;
+    site->same_r0 = site->same_r1 = 0;
+}
+
+int jit_site_call(struct JitSite *site, int r0, int r1) {
+    int (*funcvar)(int, int) = (int(*)(int, int))site->entry;
+
+    if(site->spec_mask)
+        jit_site_check(site);
+    else
+        jit_site_record(site, r0, r1);
+    return funcvar(r0, r1);
+}
+
+
+static void test_jit_script_with_div() {
+    int (*funcvar)(int, int);
+
+    funcvar = (int(*)(int, int))jit_script("r0 7 div r1 r0 div add r0 r0 mul 4 div sub");
+    assert_int_eq(eval(-100, 3, "r0 7 div r1 r0 div add r0 r0 mul 4 div sub"), funcvar(-100, 3));
+    assert_int_eq(eval(12345, -9, "r0 7 div r1 r0 div add r0 r0 mul 4 div sub"), funcvar(12345, -9));
+}
+
+static void test_jit_script_large_const() {
+    int (*funcvar)(int, int);
+
+    funcvar = (int(*)(int, int))jit_script("r0 123456789 add");
+    assert_int_eq(123456790, funcvar(1, 0));
+}
+
+static void test_jit_site_specialize() {
+    static char *script = "r0 r1 add r1 div r0 3 mul sub";
+    struct JitSite site;
+    int i;
+
+    assert_int_eq(1, jit_site_init(&site, script));
+
+    // r1 is hot, r0 changes.
+    for(i = 0; i < JIT_SPEC_THRESHOLD + 10; i++)
+        assert_int_eq(eval(i, 8, script), jit_site_call(&site, i, 8));
+    assert_int_eq(SSA_SPEC_R1, site.spec_mask);
+    assert_int_eq(8, site.spec_r1);
+    assert_int_eq(10, site.hits);
+    assert_int_eq(0, site.guard_failures);
+
+    // guard failure runs generic code.
+    assert_int_eq(eval(5, 3, script), jit_site_call(&site, 5, 3));
+    assert_int_eq(1, site.guard_failures);
+
+    // r1 changes every call, back to generic.
+    for(i = 0; i < 10 + JIT_SPEC_FAILURE_LIMIT + 1; i++)
+        assert_int_eq(eval(i, -i-1, script), jit_site_call(&site, i, -i-1));
+    assert_int_eq(0, site.spec_mask);
+    assert_int_eq(1, site.entry == site.generic);
+
+    // both hot, result is one constant.
+    for(i = 0; i < JIT_SPEC_THRESHOLD + 1; i++)
+        assert_int_eq(eval(100, -7, script), jit_site_call(&site, 100, -7));
+    assert_int_eq(SSA_SPEC_R0|SSA_SPEC_R1, site.spec_mask);
+    assert_int_eq(2, site.spec_count);
+    assert_int_eq(eval(101, -7, script), jit_site_call(&site, 101, -7));
+
+    jit_site_free(&site);
+}
+
 static void run_unit_tests() {
+    test_jit_script_with_div();
+    test_jit_script_large_const();
+    test_jit_site_specialize();
+
     printf("all test done\n");
 }
 
@@ -51,9 +411,6 @@ int main() {
     res = eval(1, 5, "3 7 add r1 sub 4 mul");
     printf("res=%d\n", res);
 
-    /*
-     TODO: Make below test pass.
-    */
     funcvar = (int(*)(int, int))jit_script("3 7 add r1 sub 4 mul");
 
     res = funcvar(1, 5);
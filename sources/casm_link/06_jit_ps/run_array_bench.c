@@ -0,0 +1,118 @@
+/*
+Benchmark of run for each input against run_array, and of the int_array kernels of each isa.
+
+gcc -O2 run_array_bench.c program.c int_array.c optimizer.c parser.c
+./a.out [input_num]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "int_array.h"
+#include "program.h"
+
+#define REPEAT 5
+
+static char *isas[] = {"scalar", "sse2", "avx2"};
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static double bench_run_loop(struct Program *prog, int *r0, int *r1, int *out, int n) {
+    double best = 0;
+    int r, i;
+
+    for(r = 0; r < REPEAT; r++) {
+        double begin = now_sec(), elapsed;
+        for(i = 0; i < n; i++)
+            out[i] = run(prog, r0[i], r1[i]);
+        elapsed = now_sec() - begin;
+        if(r == 0 || elapsed < best)
+            best = elapsed;
+    }
+    return best;
+}
+
+static double bench_run_array(struct Program *prog, int *r0, int *r1, int *out, int n) {
+    double best = 0;
+    int r;
+
+    for(r = 0; r < REPEAT; r++) {
+        double begin = now_sec(), elapsed;
+        run_array(prog, r0, r1, out, n);
+        elapsed = now_sec() - begin;
+        if(r == 0 || elapsed < best)
+            best = elapsed;
+    }
+    return best;
+}
+
+static double bench_sum(int *a, int n, long long *out_sum) {
+    double best = 0;
+    int r;
+
+    for(r = 0; r < REPEAT; r++) {
+        double begin = now_sec(), elapsed;
+        *out_sum = int_array_sum(a, n);
+        elapsed = now_sec() - begin;
+        if(r == 0 || elapsed < best)
+            best = elapsed;
+    }
+    return best;
+}
+
+static void bench_expr(char *str, int *r0, int *r1, int *out, int n) {
+    struct Program *prog = compile(str);
+    double loop_time;
+    int i;
+
+    printf("%s\n", str);
+    loop_time = bench_run_loop(prog, r0, r1, out, n);
+    printf("  %-16s %8.2f ns/input\n", "run loop", loop_time*1e9/n);
+    for(i = 0; i < 3; i++) {
+        double array_time;
+        if(int_array_use_isa(isas[i]) != 0)
+            continue;
+        array_time = bench_run_array(prog, r0, r1, out, n);
+        printf("  run_array %-6s %8.2f ns/input (%.1fx)\n", isas[i], array_time*1e9/n, loop_time/array_time);
+    }
+    program_free(prog);
+}
+
+int main(int argc, char **argv) {
+    int n = argc > 1 ? atoi(argv[1]) : 1024*1024;
+    int *r0 = malloc(sizeof(int)*n);
+    int *r1 = malloc(sizeof(int)*n);
+    int *out = malloc(sizeof(int)*n);
+    char *orig = int_array_isa();
+    int i;
+
+    for(i = 0; i < n; i++) {
+        r0[i] = i;
+        r1[i] = i % 1000 + 1;
+    }
+    printf("%d inputs, startup isa %s\n", n, orig);
+
+    bench_expr("r0 r1 add", r0, r1, out, n);
+    bench_expr("r0 3 mul r1 sub r0 r1 mul add 7 sub", r0, r1, out, n);
+    bench_expr("r0 r1 mul 10 r0 sub add r0 7 div sub", r0, r1, out, n);
+
+    printf("sum\n");
+    for(i = 0; i < 3; i++) {
+        long long sum;
+        double elapsed;
+        if(int_array_use_isa(isas[i]) != 0)
+            continue;
+        elapsed = bench_sum(r0, n, &sum);
+        printf("  %-16s %8.3f ns/element (sum %lld)\n", isas[i], elapsed*1e9/n, sum);
+    }
+
+    int_array_use_isa(orig);
+    free(r0);
+    free(r1);
+    free(out);
+    return 0;
+}
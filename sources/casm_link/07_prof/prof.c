@@ -0,0 +1,857 @@
+/*
+Sampling profiler by the frame pointer chain.
+
+gcc -O2 -fno-omit-frame-pointer -pthread prof.c -o prof
+./prof                                        # run unit tests
+
+To profile another program, link this file with -DPROF_NO_MAIN and set PROF_OUT, e.g. for emu.c:
+gcc -O2 -fno-omit-frame-pointer -pthread -DASM_NO_MAIN -DPROF_NO_MAIN -I../05_asm \
+    emu.c ../05_asm/asm.c ../../casm_link/07_prof/prof.c -o emu
+PROF_OUT=emu.folded ./emu -limit 2000000000 loop.bin
+flamegraph.pl emu.folded > emu.svg
+*/
+#define _GNU_SOURCE
+#include <elf.h>
+#include <fcntl.h>
+#include <link.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include "prof.h"
+
+/*
+Slots of the saved frame pointer and the return address from the frame pointer, in words.
+*/
+#if defined(__x86_64__)
+/* push rbp; mov rbp, rsp */
+#define PROF_FP_SLOT 0
+#define PROF_RET_SLOT 1
+#elif defined(__arm__) && defined(__clang__)
+/* push {r11, lr}; mov r11, sp, the layout of stack_walk_answer.c */
+#define PROF_FP_SLOT 0
+#define PROF_RET_SLOT 1
+#elif defined(__arm__)
+/* gcc: push {fp, lr}; add fp, sp, #4 */
+#define PROF_FP_SLOT -1
+#define PROF_RET_SLOT 0
+#else
+#error "prof.c supports x86-64 and ARM32 only"
+#endif
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+#define PROF_RING_MASK (PROF_RING_WORDS - 1)
+#define PROF_COLLECT_MSEC 50
+#define PROF_SEGMENT_MAX 16
+
+/*
+One producer, the handler on the owning thread, and one consumer, the collector.
+A sample is the depth followed by the PCs from the leaf.
+*/
+struct ProfRing {
+    uintptr_t words[PROF_RING_WORDS];
+    unsigned long head;     /* written by the producer only */
+    unsigned long tail;     /* written by the consumer only */
+};
+
+struct ProfThread {
+    struct ProfRing ring;
+    uintptr_t stack_lo;
+    uintptr_t stack_hi;
+    timer_t timer;
+    unsigned long dropped;
+    unsigned long truncated;
+    int stopped;            /* timer deleted */
+    int done;               /* the thread won't sample any more, can be freed */
+    struct ProfThread *next;
+};
+
+struct ProfStack {
+    uintptr_t *pcs;
+    int depth;
+    unsigned int hash;
+    long long count;
+};
+
+static pthread_mutex_t prof_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread struct ProfThread *prof_self;
+static int prof_running;
+static long prof_interval_ns;
+static pthread_t prof_collector;
+static int prof_collector_stop;
+
+/* under prof_lock */
+static struct ProfThread *prof_threads;
+static struct ProfStack *prof_stacks;
+static int prof_stack_num;
+static int prof_stack_capacity;
+static int *prof_table;    /* index+1 to prof_stacks, 0 for empty */
+static int prof_table_size;
+static struct ProfStat prof_stat;
+
+
+/*
+sampling, nothing here may allocate or lock
+*/
+
+static void ring_push(struct ProfThread *t, uintptr_t *pcs, int depth) {
+    unsigned long head = t->ring.head;
+    unsigned long tail = __atomic_load_n(&t->ring.tail, __ATOMIC_ACQUIRE);
+    int i;
+
+    if((unsigned long)PROF_RING_WORDS - (head - tail) < (unsigned long)depth + 1) {
+        __atomic_store_n(&t->dropped, t->dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+    t->ring.words[head++ & PROF_RING_MASK] = depth;
+    for(i = 0; i < depth; i++)
+        t->ring.words[head++ & PROF_RING_MASK] = pcs[i];
+    __atomic_store_n(&t->ring.head, head, __ATOMIC_RELEASE);
+}
+
+/*
+Follow the frame pointers only while they stay in the stack of the thread and go up,
+so a broken chain ends the walk instead of faulting.
+*/
+static void prof_handler(int sig, siginfo_t *info, void *context) {
+    ucontext_t *uc = context;
+    struct ProfThread *t = prof_self;
+    uintptr_t pcs[PROF_DEPTH_MAX];
+    uintptr_t fp, sp, *frame;
+    int lo = PROF_FP_SLOT < PROF_RET_SLOT ? PROF_FP_SLOT : PROF_RET_SLOT;
+    int hi = PROF_FP_SLOT < PROF_RET_SLOT ? PROF_RET_SLOT : PROF_FP_SLOT;
+    int depth = 0;
+
+    (void)sig;
+    (void)info;
+    if(t == NULL)
+        return;
+#if defined(__x86_64__)
+    pcs[depth++] = uc->uc_mcontext.gregs[REG_RIP];
+    fp = uc->uc_mcontext.gregs[REG_RBP];
+    sp = uc->uc_mcontext.gregs[REG_RSP];
+#else
+    pcs[depth++] = uc->uc_mcontext.arm_pc;
+    fp = uc->uc_mcontext.arm_fp;
+    sp = uc->uc_mcontext.arm_sp;
+#endif
+
+    while(depth < PROF_DEPTH_MAX) {
+        uintptr_t slot_lo = fp + lo*(intptr_t)sizeof(uintptr_t);
+        uintptr_t slot_end = fp + (hi + 1)*(intptr_t)sizeof(uintptr_t);
+        uintptr_t next;
+        if(fp == 0 || fp % sizeof(uintptr_t) != 0 || slot_lo < sp || slot_end > t->stack_hi)
+            break;
+        frame = (uintptr_t*)fp;
+        if(frame[PROF_RET_SLOT] == 0)
+            break;
+        pcs[depth++] = frame[PROF_RET_SLOT];
+        next = frame[PROF_FP_SLOT];
+        if(next <= fp)
+            break;
+        fp = next;
+    }
+    if(depth == PROF_DEPTH_MAX)
+        __atomic_store_n(&t->truncated, t->truncated + 1, __ATOMIC_RELAXED);
+    ring_push(t, pcs, depth);
+}
+
+
+/*
+collection
+*/
+
+static unsigned int hash_pcs(uintptr_t *pcs, int depth) {
+    unsigned int h = 2166136261u;
+    int i;
+
+    for(i = 0; i < depth; i++) {
+        h ^= (unsigned int)(pcs[i] ^ (pcs[i] >> 29));
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void table_insert(int index) {
+    unsigned int mask = prof_table_size - 1;
+    unsigned int i = prof_stacks[index].hash & mask;
+
+    while(prof_table[i] != 0)
+        i = (i + 1) & mask;
+    prof_table[i] = index + 1;
+}
+
+static void add_stack(uintptr_t *pcs, int depth) {
+    unsigned int h = hash_pcs(pcs, depth);
+    unsigned int mask, i;
+    struct ProfStack *s;
+    int j;
+
+    if(prof_table == NULL) {
+        prof_table_size = 1024;
+        prof_table = calloc(prof_table_size, sizeof(int));
+    }
+    mask = prof_table_size - 1;
+    for(i = h & mask; prof_table[i] != 0; i = (i + 1) & mask) {
+        s = &prof_stacks[prof_table[i] - 1];
+        if(s->hash == h && s->depth == depth && memcmp(s->pcs, pcs, sizeof(uintptr_t)*depth) == 0) {
+            s->count++;
+            return;
+        }
+    }
+
+    if(prof_stack_num == prof_stack_capacity) {
+        prof_stack_capacity = prof_stack_capacity*2 + 256;
+        prof_stacks = realloc(prof_stacks, sizeof(struct ProfStack)*prof_stack_capacity);
+    }
+    s = &prof_stacks[prof_stack_num++];
+    s->pcs = malloc(sizeof(uintptr_t)*depth);
+    memcpy(s->pcs, pcs, sizeof(uintptr_t)*depth);
+    s->depth = depth;
+    s->hash = h;
+    s->count = 1;
+
+    if(prof_stack_num*2 > prof_table_size) {
+        free(prof_table);
+        prof_table_size *= 2;
+        prof_table = calloc(prof_table_size, sizeof(int));
+        for(j = 0; j < prof_stack_num; j++)
+            table_insert(j);
+    } else {
+        prof_table[i] = prof_stack_num;
+    }
+}
+
+static void drain(struct ProfThread *t) {
+    unsigned long head = __atomic_load_n(&t->ring.head, __ATOMIC_ACQUIRE);
+    unsigned long tail = t->ring.tail;
+    uintptr_t pcs[PROF_DEPTH_MAX];
+    int depth, i;
+
+    while(tail != head) {
+        depth = t->ring.words[tail++ & PROF_RING_MASK];
+        for(i = 0; i < depth; i++)
+            pcs[i] = t->ring.words[tail++ & PROF_RING_MASK];
+        add_stack(pcs, depth);
+        prof_stat.samples++;
+    }
+    __atomic_store_n(&t->ring.tail, tail, __ATOMIC_RELEASE);
+}
+
+/*
+Drain every ring and free the threads which are done.
+*/
+static void collect(void) {
+    struct ProfThread **p;
+
+    pthread_mutex_lock(&prof_lock);
+    p = &prof_threads;
+    while(*p != NULL) {
+        struct ProfThread *t = *p;
+        drain(t);
+        if(__atomic_load_n(&t->done, __ATOMIC_ACQUIRE)) {
+            prof_stat.dropped += t->dropped;
+            prof_stat.truncated += t->truncated;
+            *p = t->next;
+            free(t);
+        } else {
+            p = &t->next;
+        }
+    }
+    pthread_mutex_unlock(&prof_lock);
+}
+
+static void *collector_main(void *arg) {
+    struct timespec ts = {0, PROF_COLLECT_MSEC*1000000L};
+
+    (void)arg;
+    while(!__atomic_load_n(&prof_collector_stop, __ATOMIC_ACQUIRE)) {
+        nanosleep(&ts, NULL);
+        collect();
+    }
+    return NULL;
+}
+
+
+/*
+control
+*/
+
+int prof_thread_start(void) {
+    struct ProfThread *t;
+    struct sigevent sev;
+    struct itimerspec its;
+    pthread_attr_t attr;
+    void *stack;
+    size_t stack_size;
+
+    if(!__atomic_load_n(&prof_running, __ATOMIC_ACQUIRE) || prof_self != NULL)
+        return -1;
+    t = calloc(1, sizeof(struct ProfThread));
+    if(t == NULL)
+        return -1;
+    /* without the bounds only the interrupted PC is sampled */
+    if(pthread_getattr_np(pthread_self(), &attr) == 0) {
+        if(pthread_attr_getstack(&attr, &stack, &stack_size) == 0) {
+            t->stack_lo = (uintptr_t)stack;
+            t->stack_hi = (uintptr_t)stack + stack_size;
+        }
+        pthread_attr_destroy(&attr);
+    }
+
+    memset(&sev, 0, sizeof(sev));
+    sev.sigev_notify = SIGEV_THREAD_ID;
+    sev.sigev_signo = SIGPROF;
+    sev.sigev_notify_thread_id = syscall(SYS_gettid);
+    if(timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &t->timer) < 0) {
+        free(t);
+        return -1;
+    }
+
+    pthread_mutex_lock(&prof_lock);
+    t->next = prof_threads;
+    prof_threads = t;
+    prof_stat.threads++;
+    pthread_mutex_unlock(&prof_lock);
+
+    prof_self = t;
+    its.it_interval.tv_sec = prof_interval_ns/1000000000L;
+    its.it_interval.tv_nsec = prof_interval_ns%1000000000L;
+    its.it_value = its.it_interval;
+    timer_settime(t->timer, 0, &its, NULL);
+    return 0;
+}
+
+void prof_thread_stop(void) {
+    struct ProfThread *t = prof_self;
+
+    if(t == NULL)
+        return;
+    pthread_mutex_lock(&prof_lock);
+    if(!t->stopped)
+        timer_delete(t->timer);
+    t->stopped = 1;
+    pthread_mutex_unlock(&prof_lock);
+    /* a signal generated before the delete is handled here, while prof_self is still valid */
+    prof_self = NULL;
+    __atomic_store_n(&t->done, 1, __ATOMIC_RELEASE);
+}
+
+int prof_start(int hz) {
+    struct sigaction sa;
+
+    if(__atomic_load_n(&prof_running, __ATOMIC_ACQUIRE))
+        return -1;
+    if(hz <= 0)
+        hz = PROF_DEFAULT_HZ;
+    prof_interval_ns = 1000000000L/hz;
+
+    /* stays installed after prof_stop, the default action of a late SIGPROF is to terminate */
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = prof_handler;
+    sa.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if(sigaction(SIGPROF, &sa, NULL) < 0)
+        return -1;
+
+    __atomic_store_n(&prof_collector_stop, 0, __ATOMIC_RELEASE);
+    if(pthread_create(&prof_collector, NULL, collector_main, NULL) != 0)
+        return -1;
+    __atomic_store_n(&prof_running, 1, __ATOMIC_RELEASE);
+    if(prof_thread_start() < 0) {
+        prof_stop();
+        return -1;
+    }
+    return 0;
+}
+
+/*
+The rings of the threads which didn't call prof_thread_stop are kept,
+their handler may still run for a signal generated before the timer was deleted.
+*/
+void prof_stop(void) {
+    struct ProfThread *t;
+
+    if(!__atomic_load_n(&prof_running, __ATOMIC_ACQUIRE))
+        return;
+    prof_thread_stop();
+    pthread_mutex_lock(&prof_lock);
+    for(t = prof_threads; t != NULL; t = t->next) {
+        if(!t->stopped)
+            timer_delete(t->timer);
+        t->stopped = 1;
+    }
+    pthread_mutex_unlock(&prof_lock);
+
+    __atomic_store_n(&prof_collector_stop, 1, __ATOMIC_RELEASE);
+    pthread_join(prof_collector, NULL);
+    __atomic_store_n(&prof_running, 0, __ATOMIC_RELEASE);
+    collect();
+}
+
+void prof_get_stat(struct ProfStat *stat) {
+    struct ProfThread *t;
+
+    pthread_mutex_lock(&prof_lock);
+    *stat = prof_stat;
+    for(t = prof_threads; t != NULL; t = t->next) {
+        stat->dropped += __atomic_load_n(&t->dropped, __ATOMIC_RELAXED);
+        stat->truncated += __atomic_load_n(&t->truncated, __ATOMIC_RELAXED);
+    }
+    stat->stacks = prof_stack_num;
+    pthread_mutex_unlock(&prof_lock);
+}
+
+void prof_reset(void) {
+    int i;
+
+    pthread_mutex_lock(&prof_lock);
+    for(i = 0; i < prof_stack_num; i++)
+        free(prof_stacks[i].pcs);
+    free(prof_stacks);
+    free(prof_table);
+    prof_stacks = NULL;
+    prof_stack_num = prof_stack_capacity = 0;
+    prof_table = NULL;
+    prof_table_size = 0;
+    memset(&prof_stat, 0, sizeof(prof_stat));
+    pthread_mutex_unlock(&prof_lock);
+}
+
+
+/*
+symbolization, after the sampling
+*/
+
+struct ProfSym {
+    uintptr_t addr;
+    uintptr_t size;
+    char *name;
+};
+
+struct ProfModule {
+    char *path;
+    char *label;            /* [basename] for the PCs without a symbol */
+    uintptr_t bias;
+    uintptr_t seg_lo[PROF_SEGMENT_MAX];
+    uintptr_t seg_hi[PROF_SEGMENT_MAX];
+    int seg_num;
+
+    int loaded;
+    unsigned char *map;
+    size_t map_size;
+    struct ProfSym *syms;
+    int sym_num;
+};
+
+struct ProfModules {
+    struct ProfModule *mods;
+    int num;
+};
+
+static int add_module(struct dl_phdr_info *info, size_t size, void *arg) {
+    struct ProfModules *ms = arg;
+    struct ProfModule *m;
+    char *base;
+    int i;
+
+    (void)size;
+    ms->mods = realloc(ms->mods, sizeof(struct ProfModule)*(ms->num + 1));
+    m = &ms->mods[ms->num++];
+    memset(m, 0, sizeof(*m));
+    m->path = strdup(info->dlpi_name[0] != '\0' ? info->dlpi_name : "/proc/self/exe");
+    base = strrchr(info->dlpi_name, '/');
+    base = base != NULL ? base + 1 : info->dlpi_name[0] != '\0' ? (char*)info->dlpi_name : "exe";
+    m->label = malloc(strlen(base) + 3);
+    sprintf(m->label, "[%s]", base);
+    m->bias = info->dlpi_addr;
+    for(i = 0; i < info->dlpi_phnum && m->seg_num < PROF_SEGMENT_MAX; i++) {
+        const ElfW(Phdr) *ph = &info->dlpi_phdr[i];
+        if(ph->p_type != PT_LOAD)
+            continue;
+        m->seg_lo[m->seg_num] = m->bias + ph->p_vaddr;
+        m->seg_hi[m->seg_num] = m->bias + ph->p_vaddr + ph->p_memsz;
+        m->seg_num++;
+    }
+    return 0;
+}
+
+static int compare_sym(const void *a, const void *b) {
+    const struct ProfSym *x = a, *y = b;
+    return x->addr < y->addr ? -1 : x->addr > y->addr;
+}
+
+/*
+Functions of .symtab, or of .dynsym if stripped.
+*/
+static void load_symbols(struct ProfModule *m) {
+    int fd = open(m->path, O_RDONLY);
+    struct stat st;
+    ElfW(Ehdr) *eh;
+    ElfW(Shdr) *sh, *symtab = NULL;
+    int i, n;
+
+    m->loaded = 1;
+    if(fd < 0)
+        return;
+    if(fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(ElfW(Ehdr))) {
+        close(fd);
+        return;
+    }
+    m->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(m->map == MAP_FAILED) {
+        m->map = NULL;
+        return;
+    }
+    m->map_size = st.st_size;
+    eh = (ElfW(Ehdr)*)m->map;
+    if(memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0 || eh->e_shoff + eh->e_shnum*sizeof(ElfW(Shdr)) > m->map_size)
+        return;
+    sh = (ElfW(Shdr)*)(m->map + eh->e_shoff);
+    for(i = 0; i < eh->e_shnum; i++)
+        if(sh[i].sh_type == SHT_SYMTAB || (sh[i].sh_type == SHT_DYNSYM && symtab == NULL))
+            symtab = &sh[i];
+    if(symtab == NULL || symtab->sh_link >= eh->e_shnum
+       || symtab->sh_offset + symtab->sh_size > m->map_size)
+        return;
+
+    n = symtab->sh_size/sizeof(ElfW(Sym));
+    m->syms = malloc(sizeof(struct ProfSym)*n);
+    for(i = 0; i < n; i++) {
+        ElfW(Sym) *s = (ElfW(Sym)*)(m->map + symtab->sh_offset) + i;
+        int type = ELF32_ST_TYPE(s->st_info);
+        if((type != STT_FUNC && type != STT_GNU_IFUNC) || s->st_shndx == SHN_UNDEF || s->st_value == 0)
+            continue;
+        /* thumb bit */
+        m->syms[m->sym_num].addr = m->bias + (s->st_value & ~(uintptr_t)1);
+        m->syms[m->sym_num].size = s->st_size;
+        m->syms[m->sym_num].name = (char*)m->map + sh[symtab->sh_link].sh_offset + s->st_name;
+        m->sym_num++;
+    }
+    qsort(m->syms, m->sym_num, sizeof(struct ProfSym), compare_sym);
+}
+
+static char *lookup_module(struct ProfModule *m, uintptr_t pc) {
+    int lo = 0, hi, mid;
+
+    if(!m->loaded)
+        load_symbols(m);
+    hi = m->sym_num - 1;
+    /* the last symbol at or below pc */
+    while(lo <= hi) {
+        mid = (lo + hi)/2;
+        if(m->syms[mid].addr <= pc)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    if(hi >= 0 && (m->syms[hi].size == 0 || pc < m->syms[hi].addr + m->syms[hi].size))
+        return m->syms[hi].name;
+    return m->label;
+}
+
+static char *symbolize(struct ProfModules *ms, uintptr_t pc) {
+    int i, j;
+
+    for(i = 0; i < ms->num; i++)
+        for(j = 0; j < ms->mods[i].seg_num; j++)
+            if(pc >= ms->mods[i].seg_lo[j] && pc < ms->mods[i].seg_hi[j])
+                return lookup_module(&ms->mods[i], pc);
+    return "[anon]";
+}
+
+struct ProfLine {
+    char *text;
+    long long count;
+};
+
+static int compare_line(const void *a, const void *b) {
+    return strcmp(((struct ProfLine*)a)->text, ((struct ProfLine*)b)->text);
+}
+
+void prof_write_folded(FILE *fp) {
+    struct ProfModules ms = {NULL, 0};
+    struct ProfLine *lines;
+    int line_num = 0, i, j;
+
+    dl_iterate_phdr(add_module, &ms);
+    pthread_mutex_lock(&prof_lock);
+    lines = malloc(sizeof(struct ProfLine)*(prof_stack_num + 1));
+    for(i = 0; i < prof_stack_num; i++) {
+        struct ProfStack *s = &prof_stacks[i];
+        size_t len = 0;
+        FILE *text = open_memstream(&lines[i].text, &len);
+        /* from the root, a return address is the next instruction of the call */
+        for(j = s->depth - 1; j >= 0; j--)
+            fprintf(text, j == s->depth - 1 ? "%s" : ";%s", symbolize(&ms, j == 0 ? s->pcs[0] : s->pcs[j] - 1));
+        fclose(text);
+        lines[i].count = s->count;
+    }
+    line_num = prof_stack_num;
+    pthread_mutex_unlock(&prof_lock);
+
+    /* different PCs of the same functions are one line */
+    qsort(lines, line_num, sizeof(struct ProfLine), compare_line);
+    for(i = 0; i < line_num; i = j) {
+        long long count = 0;
+        for(j = i; j < line_num && strcmp(lines[i].text, lines[j].text) == 0; j++)
+            count += lines[j].count;
+        fprintf(fp, "%s %lld\n", lines[i].text, count);
+    }
+
+    for(i = 0; i < line_num; i++)
+        free(lines[i].text);
+    free(lines);
+    for(i = 0; i < ms.num; i++) {
+        free(ms.mods[i].path);
+        free(ms.mods[i].label);
+        free(ms.mods[i].syms);
+        if(ms.mods[i].map != NULL)
+            munmap(ms.mods[i].map, ms.mods[i].map_size);
+    }
+    free(ms.mods);
+}
+
+
+/*
+PROF_OUT, PROF_HZ
+*/
+
+static void prof_auto_stop(void) {
+    char *path = getenv("PROF_OUT");
+    struct ProfStat stat;
+    FILE *fp;
+
+    prof_stop();
+    prof_get_stat(&stat);
+    fp = fopen(path, "w");
+    if(fp == NULL) {
+        fprintf(stderr, "prof: can't open %s\n", path);
+        return;
+    }
+    prof_write_folded(fp);
+    fclose(fp);
+    fprintf(stderr, "prof: %lld samples, %d stacks, %lld dropped, written to %s\n",
+            stat.samples, stat.stacks, stat.dropped, path);
+}
+
+__attribute__((constructor)) static void prof_auto_start(void) {
+    char *hz = getenv("PROF_HZ");
+
+    if(getenv("PROF_OUT") == NULL)
+        return;
+    if(prof_start(hz != NULL ? atoi(hz) : PROF_DEFAULT_HZ) < 0) {
+        fprintf(stderr, "prof: can't start\n");
+        return;
+    }
+    atexit(prof_auto_stop);
+}
+
+
+#ifndef PROF_NO_MAIN
+
+#include <assert.h>
+
+static void assert_true(int boolflag) {
+    if(!boolflag) {
+        printf("assert fail\n");
+        assert(0);
+    }
+}
+
+static double thread_cpu_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static volatile unsigned int sink;
+
+__attribute__((noinline, noclone)) static void prof_test_spin(double sec) {
+    double end = thread_cpu_sec() + sec;
+    unsigned int x = 1;
+    int i;
+
+    while(thread_cpu_sec() < end)
+        for(i = 0; i < 10000; i++)
+            x = x*1103515245 + 12345;
+    sink = x;
+}
+
+__attribute__((noinline, noclone)) static int prof_test_func3(int a) {
+    prof_test_spin(0.3);
+    return a*3 + sink;
+}
+
+__attribute__((noinline, noclone)) static int prof_test_func2(int a) {
+    return prof_test_func3(a + 1) + 2 + sink;
+}
+
+__attribute__((noinline, noclone)) static int prof_test_func1(int a) {
+    return prof_test_func2(a) + 1 + sink;
+}
+
+static char *folded_text() {
+    char *text;
+    size_t len;
+    FILE *fp = open_memstream(&text, &len);
+
+    prof_write_folded(fp);
+    fclose(fp);
+    return text;
+}
+
+/* count of the line which has chain, 0 if none */
+static long long folded_count(char *text, char *chain) {
+    long long count = 0;
+    char *p = text;
+
+    while((p = strstr(p, chain)) != NULL) {
+        char *end = strchr(p, '\n');
+        char *space = memrchr(p, ' ', end - p);
+        count += atoll(space + 1);
+        p = end;
+    }
+    return count;
+}
+
+static void test_ring_full() {
+    struct ProfThread *t = calloc(1, sizeof(struct ProfThread));
+    struct ProfStat stat;
+    uintptr_t pcs[PROF_DEPTH_MAX];
+    int i, fits = PROF_RING_WORDS/(PROF_DEPTH_MAX + 1);
+
+    for(i = 0; i < PROF_DEPTH_MAX; i++)
+        pcs[i] = 0x1000 + i;
+    for(i = 0; i < fits + 10; i++)
+        ring_push(t, pcs, PROF_DEPTH_MAX);
+    assert_true(t->dropped == 10);
+
+    prof_reset();
+    drain(t);
+    /* wraps around */
+    for(i = 0; i < fits; i++)
+        ring_push(t, pcs, i % 2 == 0 ? PROF_DEPTH_MAX : 3);
+    assert_true(t->dropped == 10);
+    drain(t);
+    prof_get_stat(&stat);
+    assert_true(stat.samples == fits*2);
+    assert_true(stat.stacks == 2);
+    assert_true(prof_stacks[0].count == fits + (fits + 1)/2);
+    prof_reset();
+    free(t);
+}
+
+static void test_walk() {
+    struct ProfStat stat;
+    char *text;
+    long long count;
+
+    prof_reset();
+    assert_true(prof_start(1000) == 0);
+    assert_true(prof_start(1000) == -1);
+    prof_test_func1(1);
+    prof_stop();
+    prof_get_stat(&stat);
+    text = folded_text();
+
+    /* 300 msec, at most 1kHz and at least the tick of the kernel */
+    assert_true(stat.samples >= 25);
+    assert_true(stat.dropped == 0);
+    count = folded_count(text, "prof_test_func1;prof_test_func2;prof_test_func3;prof_test_spin");
+    assert_true(count > stat.samples*8/10);
+    assert_true(strstr(text, "main;") != NULL);
+    free(text);
+    prof_reset();
+}
+
+static void *test_thread_main(void *arg) {
+    (void)arg;
+    assert_true(prof_thread_start() == 0);
+    prof_test_spin(0.2);
+    prof_thread_stop();
+    return NULL;
+}
+
+static void test_threads() {
+    pthread_t threads[2];
+    struct ProfStat stat;
+    char *text;
+    int i;
+
+    prof_reset();
+    assert_true(prof_thread_start() == -1);
+    assert_true(prof_start(1000) == 0);
+    for(i = 0; i < 2; i++)
+        pthread_create(&threads[i], NULL, test_thread_main, NULL);
+    for(i = 0; i < 2; i++)
+        pthread_join(threads[i], NULL);
+    prof_stop();
+    prof_get_stat(&stat);
+    text = folded_text();
+    assert_true(stat.threads == 3);
+    assert_true(folded_count(text, "test_thread_main;prof_test_spin") >= 30);
+    free(text);
+    prof_reset();
+}
+
+#if defined(__x86_64__)
+/* code in an anonymous mapping, like the translated blocks of dbt.c */
+__attribute__((noinline, noclone)) static void prof_test_call_jit(void (*code)(void)) {
+    double end = thread_cpu_sec() + 0.1;
+    while(thread_cpu_sec() < end)
+        code();
+}
+
+static void test_jit_code() {
+    unsigned char loop[] = {
+        0xb9, 0x40, 0x42, 0x0f, 0x00,   /* mov ecx, 1000000 */
+        0xff, 0xc9,                     /* dec ecx */
+        0x75, 0xfc,                     /* jnz dec */
+        0xc3,                           /* ret */
+    };
+    void *code = mmap(NULL, 4096, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    char *text;
+
+    assert_true(code != MAP_FAILED);
+    memcpy(code, loop, sizeof(loop));
+    prof_reset();
+    assert_true(prof_start(1000) == 0);
+    prof_test_call_jit(code);
+    prof_stop();
+    text = folded_text();
+    /* the JIT code has no frame, so the caller of prof_test_call_jit comes next */
+    assert_true(folded_count(text, ";[anon]") >= 8);
+    free(text);
+    munmap(code, 4096);
+    prof_reset();
+}
+#endif
+
+static void run_unit_tests() {
+    test_ring_full();
+    test_walk();
+    test_threads();
+#if defined(__x86_64__)
+    test_jit_code();
+#endif
+}
+
+int main() {
+    run_unit_tests();
+    return 0;
+}
+
+#endif
@@ -0,0 +1,62 @@
+/*
+Sampling profiler by the frame pointer chain, like stack_walk_answer.c of 04_c_sources.
+
+The CPU time timer of each registered thread sends SIGPROF,
+the handler walks the saved frame pointers (rbp on x86-64, r11 on ARM32)
+and writes the raw PCs to the ring buffer of the thread, without locks and allocation.
+A collector thread drains the rings, and the PCs are symbolized after the run
+by the symbol tables of the loaded ELF files.
+
+Everything profiled should be built with -fno-omit-frame-pointer (and -marm on ARM32).
+Code without frames, such as the JIT code, is sampled but hides its caller.
+The kernel checks the CPU time timers at its tick, so the real rate is at most CONFIG_HZ.
+Output is the folded stacks of flamegraph.pl, "main;func1;func2 123" per line.
+
+Link prof.c and set PROF_OUT to profile a whole program without touching its code:
+PROF_OUT=emu.folded PROF_HZ=1000 ./emu -limit 1000000000 loop.bin
+*/
+#include <stdio.h>
+
+#define PROF_DEFAULT_HZ 1000
+#define PROF_DEPTH_MAX 64
+/* words of the ring of each thread, power of 2 */
+#define PROF_RING_WORDS (1 << 16)
+
+struct ProfStat {
+    long long samples;      /* stored in the rings */
+    long long dropped;      /* the ring was full */
+    long long truncated;    /* deeper than PROF_DEPTH_MAX */
+    int stacks;             /* distinct PC stacks */
+    int threads;
+};
+
+/*
+Install the handler, start the collector and register the calling thread.
+Return 0 on success, -1 if already running or the timer can't be created.
+*/
+int prof_start(int hz);
+
+/*
+Sample the calling thread too, call prof_thread_stop before it exits.
+Return 0 on success, -1 if not running or the timer can't be created.
+*/
+int prof_thread_start(void);
+void prof_thread_stop(void);
+
+/*
+Stop every timer and collect the rest of the samples.
+*/
+void prof_stop(void);
+
+/*
+Symbolize and write the folded stacks collected so far, sorted.
+PCs out of any ELF file, such as JIT code, are written as [anon].
+*/
+void prof_write_folded(FILE *fp);
+
+void prof_get_stat(struct ProfStat *stat);
+
+/*
+Forget the collected stacks.
+*/
+void prof_reset(void);
@@ -0,0 +1,97 @@
+/*
+Overhead of the profiler on a CPU bound workload.
+
+gcc -O2 -fno-omit-frame-pointer -pthread -DPROF_NO_MAIN prof_bench.c prof.c -o prof_bench
+./prof_bench [hz]
+
+The CPU time timers are checked at the tick of the kernel, so the effective rate
+may be lower than the requested one. The cost of one sample is measured by raise(SIGPROF)
+too, which gives the overhead at exactly the requested rate.
+*/
+#include <signal.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "prof.h"
+
+#define BENCH_REPEAT 5
+#define BENCH_RAISES 100000
+
+static volatile unsigned int sink;
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+/*
+Some depth of calls, like an interpreter loop.
+*/
+__attribute__((noinline)) static unsigned int leaf(unsigned int x) {
+    int i;
+    for(i = 0; i < 64; i++)
+        x = x*1103515245 + 12345;
+    return x;
+}
+
+__attribute__((noinline)) static unsigned int middle(unsigned int x, int depth) {
+    if(depth == 0)
+        return leaf(x);
+    return middle(x + depth, depth - 1) ^ depth;
+}
+
+static double run_workload() {
+    double begin = now_sec();
+    unsigned int x = 1;
+    int i;
+
+    for(i = 0; i < 4000000; i++)
+        x = middle(x, i & 7);
+    sink = x;
+    return now_sec() - begin;
+}
+
+static double best_of(int profile, int hz) {
+    double best = 1e9;
+    int i;
+
+    for(i = 0; i < BENCH_REPEAT; i++) {
+        double elapsed;
+        if(profile && prof_start(hz) < 0) {
+            fprintf(stderr, "can't start the profiler\n");
+            exit(1);
+        }
+        elapsed = run_workload();
+        if(profile)
+            prof_stop();
+        if(elapsed < best)
+            best = elapsed;
+    }
+    return best;
+}
+
+int main(int argc, char *argv[]) {
+    int hz = argc > 1 ? atoi(argv[1]) : PROF_DEFAULT_HZ;
+    struct ProfStat stat;
+    double base, profiled, begin, per_sample;
+    int i;
+
+    base = best_of(0, hz);
+    profiled = best_of(1, hz);
+    prof_get_stat(&stat);
+    printf("workload: %.1f ms, profiled %.1f ms, overhead %.2f%%\n",
+        base*1e3, profiled*1e3, (profiled/base - 1)*100);
+    printf("effective rate: %.0f Hz for %d Hz, %lld samples, %d stacks, %lld dropped\n",
+        stat.samples/(profiled*BENCH_REPEAT), hz, stat.samples, stat.stacks, stat.dropped);
+
+    prof_reset();
+    prof_start(hz);
+    begin = now_sec();
+    for(i = 0; i < BENCH_RAISES; i++)
+        raise(SIGPROF);
+    per_sample = (now_sec() - begin)/BENCH_RAISES;
+    prof_stop();
+    printf("one sample: %.2f usec, %.3f%% at %d Hz\n", per_sample*1e6, per_sample*hz*100, hz);
+    return 0;
+}
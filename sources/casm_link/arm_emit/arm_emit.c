@@ -0,0 +1,520 @@
+#include "arm_emit.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+
+static int* allocate_executable_buf(int size) {
+    void *buf = mmap(0, size,
+                 PROT_READ | PROT_WRITE | PROT_EXEC,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return buf == MAP_FAILED ? NULL : (int*)buf;
+}
+
+static void emit_error(struct Emitter *e, char *msg, int val) {
+    if(!e->error)
+        fprintf(stderr, "emitter: %s (%d) at word %d\n", msg, val, e->pos);
+    e->error = 1;
+}
+
+void emitter_init(struct Emitter *e, int initial_words) {
+    memset(e, 0, sizeof(struct Emitter));
+    e->capacity = initial_words > 0 ? initial_words : 256;
+    e->buf = allocate_executable_buf(e->capacity*4);
+    if(e->buf == NULL) {
+        e->capacity = 0;
+        emit_error(e, "can not allocate code buffer", initial_words);
+    }
+}
+
+void emitter_reset(struct Emitter *e) {
+    e->pos = 0;
+    e->error = e->buf == NULL;
+    e->label_num = 0;
+    e->fixup_num = 0;
+}
+
+void emitter_free(struct Emitter *e) {
+    if(e->buf != NULL)
+        munmap(e->buf, e->capacity*4);
+    free(e->label_pos);
+    free(e->label_fixup);
+    free(e->fixup_at);
+    free(e->fixup_next);
+    memset(e, 0, sizeof(struct Emitter));
+}
+
+/*
+Double the buffer. Code is not running yet and branches are pc relative,
+so moving it is just a copy.
+*/
+static int grow(struct Emitter *e) {
+    int *newbuf;
+
+    if(e->error)
+        return 0;
+    newbuf = allocate_executable_buf(e->capacity*2*4);
+    if(newbuf == NULL) {
+        emit_error(e, "can not grow code buffer", e->capacity);
+        return 0;
+    }
+    memcpy(newbuf, e->buf, e->pos*4);
+    munmap(e->buf, e->capacity*4);
+    e->buf = newbuf;
+    e->capacity *= 2;
+    return 1;
+}
+
+void emit_word(struct Emitter *e, int word) {
+    if(e->pos == e->capacity && !grow(e))
+        return;
+    e->buf[e->pos++] = word;
+}
+
+int *emitter_finish(struct Emitter *e) {
+    int i;
+
+    for(i = 0; i < e->label_num; i++) {
+        if(e->label_fixup[i] != -1)
+            emit_error(e, "label used but not bound", i);
+    }
+    if(e->error)
+        return NULL;
+
+    __builtin___clear_cache((char*)e->buf, (char*)(e->buf + e->pos));
+    return e->buf;
+}
+
+void emitter_dump(struct Emitter *e) {
+    int i;
+    for(i = 0; i < e->pos; i++)
+        printf("%08x: %08x\n", i*4, e->buf[i]);
+}
+
+
+/*
+data processing
+*/
+int arm_encode_imm(unsigned int val) {
+    int rot;
+    for(rot = 0; rot < 16; rot++) {
+        unsigned int imm8 = rot == 0 ? val : (val << (2*rot)) | (val >> (32-2*rot));
+        if(imm8 <= 0xff)
+            return (rot << 8) | imm8;
+    }
+    return -1;
+}
+
+void emit_dp_reg(struct Emitter *e, int cond, int op, int rd, int rn, int rm, int shift, int amount) {
+    int s = (op == DP_CMP || op == DP_CMN) ? 1 : 0;
+    emit_word(e, ((unsigned int)cond << 28) | (op << 21) | (s << 20) | (rn << 16) | (rd << 12)
+                 | ((amount & 0x1f) << 7) | (shift << 5) | rm);
+}
+
+void emit_dp_imm(struct Emitter *e, int cond, int op, int rd, int rn, unsigned int val) {
+    int s = (op == DP_CMP || op == DP_CMN) ? 1 : 0;
+    int imm12 = arm_encode_imm(val);
+
+    if(imm12 < 0) {
+        emit_error(e, "immediate can not be encoded", (int)val);
+        return;
+    }
+    emit_word(e, ((unsigned int)cond << 28) | (1 << 25) | (op << 21) | (s << 20) | (rn << 16) | (rd << 12) | imm12);
+}
+
+void emit_mov(struct Emitter *e, int rd, int rm) {
+    emit_dp_reg(e, COND_AL, DP_MOV, rd, 0, rm, SHIFT_LSL, 0);
+}
+
+void emit_mov_shift(struct Emitter *e, int rd, int rm, int shift, int amount) {
+    if(amount < 1 || amount > 31) {
+        emit_error(e, "shift amount out of range", amount);
+        return;
+    }
+    emit_dp_reg(e, COND_AL, DP_MOV, rd, 0, rm, shift, amount);
+}
+
+void emit_mov_imm(struct Emitter *e, int rd, int val) {
+    unsigned int rest = (unsigned int)val;
+    int first = 1;
+
+    if(arm_encode_imm(rest) >= 0) {
+        emit_dp_imm(e, COND_AL, DP_MOV, rd, 0, rest);
+        return;
+    }
+    if(arm_encode_imm(~rest) >= 0) {
+        emit_dp_imm(e, COND_AL, DP_MVN, rd, 0, ~rest);
+        return;
+    }
+
+    // one 8bit chunk at even position per instruction.
+    while(rest != 0) {
+        int low = 0;
+        unsigned int chunk;
+        while(((rest >> low) & 3) == 0)
+            low += 2;
+        chunk = rest & (0xffu << low);
+        emit_dp_imm(e, COND_AL, first ? DP_MOV : DP_ORR, rd, first ? 0 : rd, chunk);
+        rest &= ~chunk;
+        first = 0;
+    }
+}
+
+void emit_add(struct Emitter *e, int rd, int rn, int rm) {
+    emit_dp_reg(e, COND_AL, DP_ADD, rd, rn, rm, SHIFT_LSL, 0);
+}
+
+/*
+op rd, rn, #val. Use alt_op with -val when only that is encodable.
+*/
+static void emit_dp_imm_or_negated(struct Emitter *e, int op, int alt_op, int rd, int rn, int val) {
+    if(arm_encode_imm((unsigned int)val) < 0 && arm_encode_imm(0u - (unsigned int)val) >= 0)
+        emit_dp_imm(e, COND_AL, alt_op, rd, rn, 0u - (unsigned int)val);
+    else
+        emit_dp_imm(e, COND_AL, op, rd, rn, (unsigned int)val);
+}
+
+void emit_add_imm(struct Emitter *e, int rd, int rn, int val) {
+    emit_dp_imm_or_negated(e, DP_ADD, DP_SUB, rd, rn, val);
+}
+
+void emit_sub(struct Emitter *e, int rd, int rn, int rm) {
+    emit_dp_reg(e, COND_AL, DP_SUB, rd, rn, rm, SHIFT_LSL, 0);
+}
+
+void emit_sub_imm(struct Emitter *e, int rd, int rn, int val) {
+    emit_dp_imm_or_negated(e, DP_SUB, DP_ADD, rd, rn, val);
+}
+
+void emit_rsb_imm(struct Emitter *e, int rd, int rn, int val) {
+    emit_dp_imm(e, COND_AL, DP_RSB, rd, rn, (unsigned int)val);
+}
+
+void emit_cmp(struct Emitter *e, int rn, int rm) {
+    emit_dp_reg(e, COND_AL, DP_CMP, 0, rn, rm, SHIFT_LSL, 0);
+}
+
+void emit_cmp_imm(struct Emitter *e, int rn, int val) {
+    emit_dp_imm_or_negated(e, DP_CMP, DP_CMN, 0, rn, val);
+}
+
+void emit_cmp_const(struct Emitter *e, int rn, int val, int scratch) {
+    if(arm_encode_imm((unsigned int)val) >= 0 || arm_encode_imm(0u - (unsigned int)val) >= 0) {
+        emit_cmp_imm(e, rn, val);
+        return;
+    }
+    emit_mov_imm(e, scratch, val);
+    emit_cmp(e, rn, scratch);
+}
+
+
+/*
+multiply
+*/
+void emit_mul(struct Emitter *e, int rd, int rm, int rs) {
+    int tmp;
+
+    // rd and rm must differ before ARMv6. mul is commutative.
+    if(rd == rm) {
+        tmp = rm;
+        rm = rs;
+        rs = tmp;
+    }
+    if(rd == rm) {
+        emit_error(e, "mul rd and rm must differ", rd);
+        return;
+    }
+    emit_word(e, 0xe0000090 | (rd << 16) | (rs << 8) | rm);
+}
+
+void emit_smull(struct Emitter *e, int rdlo, int rdhi, int rm, int rs) {
+    if(rdlo == rdhi || rdlo == rm || rdhi == rm) {
+        emit_error(e, "smull rdlo, rdhi and rm must differ", rm);
+        return;
+    }
+    emit_word(e, 0xe0c00090 | (rdhi << 16) | (rdlo << 12) | (rs << 8) | rm);
+}
+
+
+/*
+load/store
+*/
+static void emit_ldst(struct Emitter *e, int load, int byte, int rt, int rn, int offset) {
+    int up = 1;
+
+    if(offset < 0) {
+        up = 0;
+        offset = -offset;
+    }
+    if(offset > 0xfff) {
+        emit_error(e, "load/store offset out of range", offset);
+        return;
+    }
+    // pre-indexed, no writeback
+    emit_word(e, 0xe5000000 | (up << 23) | (byte << 22) | (load << 20) | (rn << 16) | (rt << 12) | offset);
+}
+
+void emit_ldr(struct Emitter *e, int rt, int rn, int offset) {
+    emit_ldst(e, 1, 0, rt, rn, offset);
+}
+
+void emit_str(struct Emitter *e, int rt, int rn, int offset) {
+    emit_ldst(e, 0, 0, rt, rn, offset);
+}
+
+void emit_ldrb(struct Emitter *e, int rt, int rn, int offset) {
+    emit_ldst(e, 1, 1, rt, rn, offset);
+}
+
+void emit_strb(struct Emitter *e, int rt, int rn, int offset) {
+    emit_ldst(e, 0, 1, rt, rn, offset);
+}
+
+void emit_push(struct Emitter *e, int regs) {
+    emit_word(e, 0xe92d0000 | (regs & 0xffff));
+}
+
+void emit_pop(struct Emitter *e, int regs) {
+    emit_word(e, 0xe8bd0000 | (regs & 0xffff));
+}
+
+
+/*
+branch and label
+*/
+static int grow_array(int **arr, int size) {
+    int *newarr = realloc(*arr, sizeof(int)*size);
+    if(newarr == NULL)
+        return 0;
+    *arr = newarr;
+    return 1;
+}
+
+int emit_new_label(struct Emitter *e) {
+    if(e->label_num == e->label_capacity) {
+        int size = e->label_capacity == 0 ? 16 : e->label_capacity*2;
+        if(!grow_array(&e->label_pos, size) || !grow_array(&e->label_fixup, size)) {
+            emit_error(e, "can not allocate label", e->label_num);
+            return 0;
+        }
+        e->label_capacity = size;
+    }
+    e->label_pos[e->label_num] = -1;
+    e->label_fixup[e->label_num] = -1;
+    return e->label_num++;
+}
+
+/*
+Fill the 24bit offset of the branch at word position at.
+*/
+static void patch_branch(struct Emitter *e, int at, int target) {
+    int offset = target - (at + 2);
+
+    if(offset < -(1 << 23) || offset >= (1 << 23)) {
+        emit_error(e, "branch offset out of range", offset);
+        return;
+    }
+    e->buf[at] = (e->buf[at] & 0xff000000) | (offset & 0x00ffffff);
+}
+
+void emit_bind_label(struct Emitter *e, int label) {
+    int fixup;
+
+    if(label < 0 || label >= e->label_num || e->label_pos[label] != -1) {
+        emit_error(e, "label bound twice or unknown", label);
+        return;
+    }
+    e->label_pos[label] = e->pos;
+
+    for(fixup = e->label_fixup[label]; fixup != -1; fixup = e->fixup_next[fixup])
+        patch_branch(e, e->fixup_at[fixup], e->pos);
+    e->label_fixup[label] = -1;
+}
+
+static void emit_branch(struct Emitter *e, int cond, int link, int label) {
+    int at = e->pos;
+
+    if(label < 0 || label >= e->label_num) {
+        emit_error(e, "unknown label", label);
+        return;
+    }
+
+    emit_word(e, ((unsigned int)cond << 28) | 0x0a000000 | (link << 24));
+    if(e->error)
+        return;
+
+    if(e->label_pos[label] != -1) {
+        patch_branch(e, at, e->label_pos[label]);
+        return;
+    }
+
+    // forward reference. patched when the label is bound.
+    if(e->fixup_num == e->fixup_capacity) {
+        int size = e->fixup_capacity == 0 ? 16 : e->fixup_capacity*2;
+        if(!grow_array(&e->fixup_at, size) || !grow_array(&e->fixup_next, size)) {
+            emit_error(e, "can not allocate fixup", e->fixup_num);
+            return;
+        }
+        e->fixup_capacity = size;
+    }
+    e->fixup_at[e->fixup_num] = at;
+    e->fixup_next[e->fixup_num] = e->label_fixup[label];
+    e->label_fixup[label] = e->fixup_num++;
+}
+
+void emit_b_cond(struct Emitter *e, int cond, int label) {
+    emit_branch(e, cond, 0, label);
+}
+
+void emit_b(struct Emitter *e, int label) {
+    emit_branch(e, COND_AL, 0, label);
+}
+
+void emit_bl(struct Emitter *e, int label) {
+    emit_branch(e, COND_AL, 1, label);
+}
+
+void emit_blx(struct Emitter *e, int rm) {
+    emit_word(e, 0xe12fff30 | rm);
+}
+
+void emit_ret(struct Emitter *e) {
+    emit_mov(e, REG_PC, REG_LR);
+}
+
+void emit_jump_abs(struct Emitter *e, int *target) {
+    emit_mov_imm(e, REG_IP, (int)(intptr_t)target);
+    emit_mov(e, REG_PC, REG_IP);
+}
+
+void emit_counter_inc(struct Emitter *e, int *counter, int scratch1, int scratch2) {
+    emit_mov_imm(e, scratch1, (int)(intptr_t)counter);
+    emit_ldr(e, scratch2, scratch1, 0);
+    emit_add_imm(e, scratch2, scratch2, 1);
+    emit_str(e, scratch2, scratch1, 0);
+}
+
+
+
+/*
+test code
+*/
+static void assert_true(int boolflag) {
+    if(!boolflag) {
+        printf("assert fail\n");
+    }
+}
+
+static void assert_int_eq(int expect, int actual) {
+    if(expect != actual) {
+        printf("assert fail, expect %x, actual %x\n", expect, actual);
+    }
+}
+
+static void test_encode_imm() {
+    assert_int_eq(0x068, arm_encode_imm(0x68));
+    assert_int_eq(0x4ff, arm_encode_imm(0xff000000));
+    assert_int_eq(0x302, arm_encode_imm(0x08000000));
+    assert_int_eq(-1, arm_encode_imm(0x101));
+}
+
+static void test_emit_simple() {
+    struct Emitter e;
+    emitter_init(&e, 4);
+
+    emit_mov_imm(&e, 1, 0x68);
+    emit_cmp(&e, 0, 1);
+    emit_add(&e, 2, 2, 1);
+    emit_add_imm(&e, 1, 1, 1);
+    emit_ldr(&e, 0, 15, 0x24);
+    emit_strb(&e, 1, 0, 0);
+    emit_push(&e, 0x4000);
+    emit_ret(&e);
+
+    assert_int_eq(0xe3a01068, e.buf[0]); // mov r1, #0x68
+    assert_int_eq(0xe1500001, e.buf[1]); // cmp r0, r1
+    assert_int_eq(0xe0822001, e.buf[2]); // add r2, r2, r1
+    assert_int_eq(0xe2811001, e.buf[3]); // add r1, r1, #1
+    assert_int_eq(0xe59f0024, e.buf[4]); // ldr r0, [r15, #0x24]
+    assert_int_eq(0xe5c01000, e.buf[5]); // strb r1, [r0]
+    assert_int_eq(0xe92d4000, e.buf[6]); // stmdb r13!, {r14}
+    assert_int_eq(0xe1a0f00e, e.buf[7]); // mov r15, r14
+    assert_true(e.capacity >= 8);
+    assert_true(emitter_finish(&e) != NULL);
+
+    emitter_free(&e);
+}
+
+static void test_emit_mov_imm_large() {
+    struct Emitter e;
+    emitter_init(&e, 16);
+
+    emit_mov_imm(&e, 0, 0x101f1000);
+    emit_mov_imm(&e, 1, -2);
+
+    assert_int_eq(4, e.pos);
+    assert_int_eq(0xe3a00af1, e.buf[0]); // mov r0, #0xf1000
+    assert_int_eq(0xe3800601, e.buf[1]); // orr r0, r0, #0x100000
+    assert_int_eq(0xe3800201, e.buf[2]); // orr r0, r0, #0x10000000
+    assert_int_eq(0xe3e01001, e.buf[3]); // mvn r1, #1
+
+    emitter_free(&e);
+}
+
+static void test_emit_labels() {
+    struct Emitter e;
+    int loop, end;
+    emitter_init(&e, 16);
+
+    loop = emit_new_label(&e);
+    end = emit_new_label(&e);
+    emit_bind_label(&e, loop);
+    emit_cmp(&e, 0, 1);
+    emit_b_cond(&e, COND_EQ, end);
+    emit_b(&e, loop);
+    emit_bind_label(&e, end);
+    emit_ret(&e);
+
+    assert_int_eq(0x0a000000, e.buf[1]); // beq end (pc+8 is end)
+    assert_int_eq(0xeafffffc, e.buf[2]); // b loop
+    assert_true(emitter_finish(&e) != NULL);
+
+    emitter_free(&e);
+}
+
+static void test_emit_errors() {
+    struct Emitter e;
+    emitter_init(&e, 16);
+
+    emit_b(&e, emit_new_label(&e));
+    assert_true(emitter_finish(&e) == NULL);
+
+    emitter_reset(&e);
+    emit_ldr(&e, 0, 1, 4096);
+    assert_true(emitter_finish(&e) == NULL);
+
+    emitter_reset(&e);
+    emit_dp_imm(&e, COND_AL, DP_MOV, 0, 0, 0x101);
+    assert_true(emitter_finish(&e) == NULL);
+
+    emitter_free(&e);
+}
+
+static void run_unit_tests() {
+    test_encode_imm();
+    test_emit_simple();
+    test_emit_mov_imm_large();
+    test_emit_labels();
+    test_emit_errors();
+
+    printf("all test done\n");
+}
+
+#if 0
+int main() {
+    run_unit_tests();
+    return 0;
+}
+#endif
@@ -0,0 +1,126 @@
+/*
+ARM code emitter for the JIT lessons.
+
+Instructions are appended to an executable buffer which grows when full.
+Errors (bad immediate, out of range offset, unbound label) are sticky:
+they are printed once and emitter_finish returns NULL.
+*/
+struct Emitter {
+    int *buf;
+    int capacity;   /* words */
+    int pos;        /* words */
+    int error;
+
+    /* label_pos[label] is word position, -1 if not bound yet. */
+    int *label_pos;
+    int *label_fixup;   /* head of fixup list of the label, -1 if none */
+    int label_num;
+    int label_capacity;
+
+    /* fixups waiting for their label. chained through fixup_next. */
+    int *fixup_at;
+    int *fixup_next;
+    int fixup_num;
+    int fixup_capacity;
+};
+
+enum {
+    COND_EQ, COND_NE, COND_CS, COND_CC, COND_MI, COND_PL, COND_VS, COND_VC,
+    COND_HI, COND_LS, COND_GE, COND_LT, COND_GT, COND_LE, COND_AL
+};
+
+enum {
+    SHIFT_LSL,
+    SHIFT_LSR,
+    SHIFT_ASR,
+    SHIFT_ROR
+};
+
+enum {
+    DP_AND = 0x0,
+    DP_EOR = 0x1,
+    DP_SUB = 0x2,
+    DP_RSB = 0x3,
+    DP_ADD = 0x4,
+    DP_CMP = 0xa,
+    DP_CMN = 0xb,
+    DP_ORR = 0xc,
+    DP_MOV = 0xd,
+    DP_BIC = 0xe,
+    DP_MVN = 0xf
+};
+
+#define REG_IP 12
+#define REG_SP 13
+#define REG_LR 14
+#define REG_PC 15
+
+void emitter_init(struct Emitter *e, int initial_words);
+/* forget code and labels but keep the buffer. */
+void emitter_reset(struct Emitter *e);
+void emitter_free(struct Emitter *e);
+
+/*
+Check all labels are resolved and flush instruction cache.
+Return start of the code, or NULL if any error happened.
+The code stays valid until the emitter is reset or freed.
+*/
+int *emitter_finish(struct Emitter *e);
+
+/* print address, word of each instruction. */
+void emitter_dump(struct Emitter *e);
+
+/*
+Encode val as rotated 8bit immediate operand.
+Return -1 if val can not be encoded.
+*/
+int arm_encode_imm(unsigned int val);
+
+void emit_word(struct Emitter *e, int word);
+
+/* data processing */
+void emit_dp_reg(struct Emitter *e, int cond, int op, int rd, int rn, int rm, int shift, int amount);
+void emit_dp_imm(struct Emitter *e, int cond, int op, int rd, int rn, unsigned int val);
+
+void emit_mov(struct Emitter *e, int rd, int rm);
+void emit_mov_shift(struct Emitter *e, int rd, int rm, int shift, int amount);
+/* any 32bit value, with one mov/mvn or up to four mov/orr. */
+void emit_mov_imm(struct Emitter *e, int rd, int val);
+void emit_add(struct Emitter *e, int rd, int rn, int rm);
+/* use sub instead when only -val is encodable. */
+void emit_add_imm(struct Emitter *e, int rd, int rn, int val);
+void emit_sub(struct Emitter *e, int rd, int rn, int rm);
+void emit_sub_imm(struct Emitter *e, int rd, int rn, int val);
+void emit_rsb_imm(struct Emitter *e, int rd, int rn, int val);
+void emit_cmp(struct Emitter *e, int rn, int rm);
+void emit_cmp_imm(struct Emitter *e, int rn, int val);
+/* cmp with any 32bit value. scratch is used when val is not encodable. */
+void emit_cmp_const(struct Emitter *e, int rn, int val, int scratch);
+
+/* multiply */
+void emit_mul(struct Emitter *e, int rd, int rm, int rs);
+void emit_smull(struct Emitter *e, int rdlo, int rdhi, int rm, int rs);
+
+/* load/store with immediate offset (-4095 to 4095) */
+void emit_ldr(struct Emitter *e, int rt, int rn, int offset);
+void emit_str(struct Emitter *e, int rt, int rn, int offset);
+void emit_ldrb(struct Emitter *e, int rt, int rn, int offset);
+void emit_strb(struct Emitter *e, int rt, int rn, int offset);
+/* stmdb sp!, {regs} and ldmia sp!, {regs}. regs is bit mask */
+void emit_push(struct Emitter *e, int regs);
+void emit_pop(struct Emitter *e, int regs);
+
+/* branch */
+int emit_new_label(struct Emitter *e);
+void emit_bind_label(struct Emitter *e, int label);
+void emit_b_cond(struct Emitter *e, int cond, int label);
+void emit_b(struct Emitter *e, int label);
+void emit_bl(struct Emitter *e, int label);
+void emit_blx(struct Emitter *e, int rm);
+/* mov r15, r14 */
+void emit_ret(struct Emitter *e);
+/* jump to absolute address through ip, registers other than ip are kept. */
+void emit_jump_abs(struct Emitter *e, int *target);
+
+/* (*counter)++ using two scratch registers. */
+void emit_counter_inc(struct Emitter *e, int *counter, int scratch1, int scratch2);
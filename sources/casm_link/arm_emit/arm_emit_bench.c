@@ -0,0 +1,90 @@
+/*
+Emission throughput benchmark.
+
+gcc -O2 arm_emit_bench.c arm_emit.c
+*/
+#include <stdio.h>
+#include <time.h>
+
+#include "arm_emit.h"
+
+#define BIG_BLOCKS 1000000
+#define SMALL_FUNCS 1000000
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+/*
+One loop body of mixed forms with a forward and a backward branch.
+*/
+static void emit_block(struct Emitter *e, int i) {
+    int top = emit_new_label(e);
+    int skip = emit_new_label(e);
+
+    emit_bind_label(e, top);
+    emit_mov_imm(e, 1, i);
+    emit_ldr(e, 2, 0, (i & 0xff)*4);
+    emit_add(e, 2, 2, 1);
+    emit_cmp_imm(e, 2, 100);
+    emit_b_cond(e, COND_GT, skip);
+    emit_mul(e, 3, 2, 1);
+    emit_strb(e, 3, 0, i & 0xfff);
+    emit_sub_imm(e, 1, 1, 1);
+    emit_b_cond(e, COND_NE, top);
+    emit_bind_label(e, skip);
+}
+
+/*
+sum_till from 05_inline_asm.
+*/
+static int *emit_sum_till(struct Emitter *e) {
+    int loop = emit_new_label(e);
+    int end = emit_new_label(e);
+
+    emit_mov_imm(e, 1, 0);
+    emit_mov_imm(e, 2, 0);
+    emit_bind_label(e, loop);
+    emit_cmp(e, 0, 1);
+    emit_b_cond(e, COND_EQ, end);
+    emit_add(e, 2, 2, 1);
+    emit_add_imm(e, 1, 1, 1);
+    emit_b(e, loop);
+    emit_bind_label(e, end);
+    emit_mov(e, 0, 2);
+    emit_ret(e);
+    return emitter_finish(e);
+}
+
+int main() {
+    struct Emitter e;
+    double begin, elapsed;
+    int i;
+
+    // one large function, including buffer growth.
+    emitter_init(&e, 256);
+    begin = now_sec();
+    for(i = 0; i < BIG_BLOCKS; i++)
+        emit_block(&e, i);
+    emitter_finish(&e);
+    elapsed = now_sec() - begin;
+    printf("large function: %d words, %.1f M instructions/sec, %.1f MB/s\n",
+        e.pos, e.pos/elapsed/1e6, e.pos*4/elapsed/1e6);
+    emitter_free(&e);
+
+    // many small functions, which is what JIT compile latency looks like.
+    emitter_init(&e, 256);
+    begin = now_sec();
+    for(i = 0; i < SMALL_FUNCS; i++) {
+        emitter_reset(&e);
+        emit_sum_till(&e);
+    }
+    elapsed = now_sec() - begin;
+    printf("sum_till: %.1f M functions/sec, %.0f ns per function\n",
+        SMALL_FUNCS/elapsed/1e6, elapsed/SMALL_FUNCS*1e9);
+    emitter_free(&e);
+
+    return 0;
+}
@@ -1,9 +1,22 @@
 #include <stdio.h>
 
+/*
+Input of cl_getc. Use one for each thread.
+*/
+struct ClGetcSource {
+    const char *input;
+    int pos;
+};
+
 /*
 return one character and move cursor.
 return EOF if end of file.
 */
-int cl_getc();
+int cl_getc_from(struct ClGetcSource *src);
+void cl_getc_src_init(struct ClGetcSource *src, char* str);
 
-void cl_getc_set_src(char* str);
\ No newline at end of file
+/*
+Same as above for the default source.
+*/
+int cl_getc();
+void cl_getc_set_src(char* str);
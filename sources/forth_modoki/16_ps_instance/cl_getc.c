@@ -0,0 +1,23 @@
+#include "clesson.h"
+
+static struct ClGetcSource default_src = {"123 456", 0};
+
+
+int cl_getc_from(struct ClGetcSource *src) {
+    if(src->input[src->pos] == '\0')
+        return EOF;
+    return src->input[src->pos++];
+}
+
+void cl_getc_src_init(struct ClGetcSource *src, char* str) {
+    src->input = str;
+    src->pos = 0;
+}
+
+int cl_getc() {
+    return cl_getc_from(&default_src);
+}
+
+void cl_getc_set_src(char* str){
+    cl_getc_src_init(&default_src, str);
+}
@@ -0,0 +1,141 @@
+/*
+Generate primitive_table.h, the perfect hash of the built-in primitive names.
+
+gcc gen_primitive_table.c -o gen_primitive_table && ./gen_primitive_table > primitive_table.h
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "primitive.h"
+
+#define TABLE_SIZE 64
+#define BUCKET_NUM 16
+
+static struct {
+    char *name;
+    int id;
+} keys[] = {
+    {"add", PRIM_ADD}, {"sub", PRIM_SUB}, {"mul", PRIM_MUL}, {"div", PRIM_DIV},
+    {"eq", PRIM_EQ}, {"neq", PRIM_NEQ}, {"gt", PRIM_GT}, {"ge", PRIM_GE},
+    {"lt", PRIM_LT}, {"le", PRIM_LE},
+    {"pop", PRIM_POP}, {"exch", PRIM_EXCH}, {"dup", PRIM_DUP},
+    {"index", PRIM_INDEX}, {"roll", PRIM_ROLL},
+    {"def", PRIM_DEF}, {"=", PRIM_PRINT}, {"pstack", PRIM_PSTACK},
+    {"exec", PRIM_EXEC}, {"if", PRIM_IF}, {"ifelse", PRIM_IFELSE},
+    {"while", PRIM_WHILE}, {"repeat", PRIM_REPEAT}
+};
+
+#define KEY_NUM ((int)(sizeof(keys)/sizeof(keys[0])))
+
+static unsigned long long key_hash[KEY_NUM];
+
+static void check_keys() {
+    int i, j;
+
+    if(KEY_NUM != PRIM_NUM - 1) {
+        fprintf(stderr, "%d names for %d primitives\n", KEY_NUM, PRIM_NUM - 1);
+        exit(1);
+    }
+    for(i = 0; i < KEY_NUM; i++) {
+        for(j = 0; j < i; j++) {
+            if(strcmp(keys[i].name, keys[j].name) == 0 || keys[i].id == keys[j].id) {
+                fprintf(stderr, "duplicated primitive %s\n", keys[i].name);
+                exit(1);
+            }
+        }
+        key_hash[i] = primitive_hash(keys[i].name, strlen(keys[i].name));
+    }
+}
+
+
+/*
+Hash and displace, the same search as gen_mnemonic_table.c.
+*/
+static int bucket_keys[BUCKET_NUM][KEY_NUM];
+static int bucket_size[BUCKET_NUM];
+static int bucket_order[BUCKET_NUM];
+static unsigned int displace[BUCKET_NUM];
+static int slot_key[TABLE_SIZE];
+
+static int compare_bucket(const void *a, const void *b) {
+    return bucket_size[*(int*)b] - bucket_size[*(int*)a];
+}
+
+static int try_displace(int bucket, unsigned int d) {
+    unsigned int slots[KEY_NUM];
+    int i, j;
+
+    for(i = 0; i < bucket_size[bucket]; i++) {
+        slots[i] = primitive_slot(key_hash[bucket_keys[bucket][i]], d, TABLE_SIZE);
+        if(slot_key[slots[i]] >= 0)
+            return 0;
+        for(j = 0; j < i; j++) {
+            if(slots[j] == slots[i])
+                return 0;
+        }
+    }
+    for(i = 0; i < bucket_size[bucket]; i++)
+        slot_key[slots[i]] = bucket_keys[bucket][i];
+    return 1;
+}
+
+static void build_table() {
+    int i;
+
+    for(i = 0; i < KEY_NUM; i++) {
+        int b = key_hash[i] % BUCKET_NUM;
+        bucket_keys[b][bucket_size[b]++] = i;
+    }
+    for(i = 0; i < BUCKET_NUM; i++)
+        bucket_order[i] = i;
+    qsort(bucket_order, BUCKET_NUM, sizeof(int), compare_bucket);
+    memset(slot_key, -1, sizeof(slot_key));
+
+    for(i = 0; i < BUCKET_NUM; i++) {
+        int b = bucket_order[i];
+        unsigned int d;
+
+        if(bucket_size[b] == 0)
+            break;
+        for(d = 0; d < TABLE_SIZE*TABLE_SIZE; d++) {
+            if(try_displace(b, d))
+                break;
+        }
+        if(d == TABLE_SIZE*TABLE_SIZE) {
+            fprintf(stderr, "no displacement for bucket %d\n", b);
+            exit(1);
+        }
+        displace[b] = d;
+    }
+}
+
+static void print_table() {
+    int i;
+
+    printf("/* Generated by gen_primitive_table.c, do not edit. %d keys. */\n", KEY_NUM);
+    printf("#define PRIMITIVE_TABLE_SIZE %d\n", TABLE_SIZE);
+    printf("#define PRIMITIVE_BUCKET_NUM %d\n\n", BUCKET_NUM);
+
+    printf("static const unsigned int primitive_displace[PRIMITIVE_BUCKET_NUM] = {");
+    for(i = 0; i < BUCKET_NUM; i++)
+        printf("%s%u", i == 0 ? "\n    " : i % 8 == 0 ? ",\n    " : ", ", displace[i]);
+    printf("\n};\n\n");
+
+    printf("static const struct Primitive primitive_table[PRIMITIVE_TABLE_SIZE] = {\n");
+    for(i = 0; i < TABLE_SIZE; i++) {
+        if(slot_key[i] < 0) {
+            printf("    {0, 0},\n");
+            continue;
+        }
+        printf("    {\"%s\", %d},\n", keys[slot_key[i]].name, keys[slot_key[i]].id);
+    }
+    printf("};\n");
+}
+
+int main() {
+    check_keys();
+    build_table();
+    print_table();
+    return 0;
+}
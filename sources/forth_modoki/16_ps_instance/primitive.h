@@ -0,0 +1,57 @@
+/*
+Built-in primitive names of the interpreter.
+
+Every name is one key of a perfect hash table in primitive_table.h,
+so a built-in is found with a single probe and nothing is registered at startup.
+That file is generated by gen_primitive_table.c, do not edit it by hand.
+
+gcc gen_primitive_table.c -o gen_primitive_table && ./gen_primitive_table > primitive_table.h
+*/
+enum PrimitiveId {
+    PRIM_NONE,
+
+    PRIM_ADD, PRIM_SUB, PRIM_MUL, PRIM_DIV,
+    PRIM_EQ, PRIM_NEQ, PRIM_GT, PRIM_GE, PRIM_LT, PRIM_LE,
+    PRIM_POP, PRIM_EXCH, PRIM_DUP, PRIM_INDEX, PRIM_ROLL,
+    PRIM_DEF, PRIM_PRINT, PRIM_PSTACK,
+
+    /* expanded at compile time */
+    PRIM_EXEC, PRIM_IF, PRIM_IFELSE, PRIM_WHILE, PRIM_REPEAT,
+
+    PRIM_NUM
+};
+
+struct Primitive {
+    const char *name;
+    unsigned char id;
+};
+
+/*
+FNV-1a followed by a 64bit finalizer, as mnemonic_hash of arm_asm/05_asm.
+The generator and the lookup must use the same function.
+*/
+static inline unsigned long long primitive_hash(const char *str, int len) {
+    unsigned long long h = 0xcbf29ce484222325ULL;
+    int i;
+
+    for(i = 0; i < len; i++) {
+        h ^= (unsigned char)str[i];
+        h *= 0x100000001b3ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/*
+Hash and displace: the bucket of the key gives displacement d,
+and the slot is (f1 + d0*f2 + d1) % table_size where d = d0*table_size + d1.
+*/
+static inline unsigned int primitive_slot(unsigned long long h, unsigned int displace, unsigned int table_size) {
+    unsigned long long f1 = (h >> 20) % table_size;
+    unsigned long long f2 = (h >> 40) % table_size;
+    unsigned long long d0 = displace / table_size;
+    unsigned long long d1 = displace % table_size;
+    return (unsigned int)((f1 + d0*f2 + d1) % table_size);
+}
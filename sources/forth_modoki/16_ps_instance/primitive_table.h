@@ -0,0 +1,75 @@
+/* Generated by gen_primitive_table.c, do not edit. 23 keys. */
+#define PRIMITIVE_TABLE_SIZE 64
+#define PRIMITIVE_BUCKET_NUM 16
+
+static const unsigned int primitive_displace[PRIMITIVE_BUCKET_NUM] = {
+    0, 0, 0, 0, 0, 0, 0, 3,
+    1, 0, 0, 0, 0, 0, 0, 1
+};
+
+static const struct Primitive primitive_table[PRIMITIVE_TABLE_SIZE] = {
+    {0, 0},
+    {"neq", 6},
+    {"le", 10},
+    {0, 0},
+    {"exec", 19},
+    {0, 0},
+    {"add", 1},
+    {"pstack", 18},
+    {0, 0},
+    {0, 0},
+    {0, 0},
+    {"def", 16},
+    {0, 0},
+    {0, 0},
+    {0, 0},
+    {0, 0},
+    {0, 0},
+    {0, 0},
+    {"gt", 7},
+    {"eq", 5},
+    {0, 0},
+    {"index", 14},
+    {0, 0},
+    {0, 0},
+    {0, 0},
+    {0, 0},
+    {"exch", 12},
+    {"ifelse", 21},
+    {0, 0},
+    {0, 0},
+    {"ge", 8},
+    {0, 0},
+    {0, 0},
+    {"lt", 9},
+    {"div", 4},
+    {"sub", 2},
+    {0, 0},
+    {"repeat", 23},
+    {0, 0},
+    {0, 0},
+    {0, 0},
+    {0, 0},
+    {0, 0},
+    {0, 0},
+    {"if", 20},
+    {"=", 17},
+    {0, 0},
+    {0, 0},
+    {"roll", 15},
+    {0, 0},
+    {0, 0},
+    {0, 0},
+    {"while", 22},
+    {"mul", 3},
+    {"dup", 13},
+    {0, 0},
+    {0, 0},
+    {"pop", 11},
+    {0, 0},
+    {0, 0},
+    {0, 0},
+    {0, 0},
+    {0, 0},
+    {0, 0},
+};
@@ -0,0 +1,1310 @@
+/*
+PostScript interpreter of forth_modoki.md up to chapter 14, as instances.
+
+gcc -O2 -pthread ps.c cl_getc.c -o ps
+./ps                    # run unit tests
+./ps ../ps/factorial.ps # run a file and print the stack left
+
+eval compiles what it reads into exec arrays and runs them on the VM
+(eval_exec_array) with co_stack, so no C recursion happens at run time.
+ifelse, if, while and repeat are expanded at compile time into
+jmp, jmp_not_if and local variables as in chapters 13 and 14.
+Built-in names are in the generated primitive_table.h, see primitive.h.
+ps_jit.c compiles hot exec arrays to ARM code through ps->jit_run.
+*/
+#include <assert.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ps.h"
+#include "primitive.h"
+#include "primitive_table.h"
+
+#define ARENA_BLOCK_SIZE 4096
+
+
+/*
+errors and memory
+*/
+
+void ps_fail(struct PsInterp *ps, const char *fmt, ...) {
+    va_list ap;
+
+    if(ps->error[0] != '\0')
+        return;
+    va_start(ap, fmt);
+    vsnprintf(ps->error, sizeof(ps->error), fmt, ap);
+    va_end(ap);
+}
+
+static int has_error(struct PsInterp *ps) {
+    return ps->error[0] != '\0';
+}
+
+static void *ps_alloc(struct PsInterp *ps, int size) {
+    struct ArenaBlock *block = ps->arena;
+    void *res;
+
+    size = (size + 7) & ~7;
+    if(block == NULL || block->used + size > block->size) {
+        int block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        block = malloc(sizeof(struct ArenaBlock) + block_size);
+        block->next = ps->arena;
+        block->used = 0;
+        block->size = block_size;
+        ps->arena = block;
+    }
+    res = block->buf + block->used;
+    block->used += size;
+    return res;
+}
+
+static char *ps_strdup(struct PsInterp *ps, char *str) {
+    int len = strlen(str);
+    char *res = ps_alloc(ps, len + 1);
+    memcpy(res, str, len + 1);
+    return res;
+}
+
+
+/*
+stack
+*/
+
+static void stack_push(struct PsInterp *ps, struct Element *elem) {
+    if(ps->stack_pos == STACK_SIZE) {
+        ps_fail(ps, "stack overflow");
+        return;
+    }
+    ps->stack[ps->stack_pos++] = *elem;
+}
+
+static void stack_push_number(struct PsInterp *ps, int number) {
+    struct Element elem;
+    elem.etype = ELEMENT_NUMBER;
+    elem.u.number = number;
+    stack_push(ps, &elem);
+}
+
+/*
+Return 0 and set the error if the stack is empty.
+*/
+static int stack_pop(struct PsInterp *ps, struct Element *out_elem) {
+    if(ps->stack_pos == 0) {
+        ps_fail(ps, "stack underflow");
+        return 0;
+    }
+    *out_elem = ps->stack[--ps->stack_pos];
+    return 1;
+}
+
+static int stack_pop_number(struct PsInterp *ps, int *out_number) {
+    struct Element elem;
+
+    if(!stack_pop(ps, &elem))
+        return 0;
+    if(elem.etype != ELEMENT_NUMBER) {
+        ps_fail(ps, "number expected");
+        return 0;
+    }
+    *out_number = elem.u.number;
+    return 1;
+}
+
+
+/*
+dictionary of user definitions
+*/
+
+static unsigned int hash(char *str) {
+    unsigned int val = 0;
+    while(*str)
+        val = val*31 + (unsigned char)*str++;
+    return val;
+}
+
+static void dict_put(struct PsInterp *ps, char *key, struct Element *elem) {
+    unsigned int idx = hash(key) % DICT_SIZE;
+    struct KeyValue *kv;
+
+    for(kv = ps->dict[idx]; kv != NULL; kv = kv->next) {
+        if(strcmp(kv->key, key) == 0) {
+            kv->value = *elem;
+            return;
+        }
+    }
+    kv = ps_alloc(ps, sizeof(struct KeyValue));
+    ps->dict_version++;
+    kv->key = ps_strdup(ps, key);
+    kv->value = *elem;
+    kv->next = ps->dict[idx];
+    ps->dict[idx] = kv;
+}
+
+static struct Element *dict_get(struct PsInterp *ps, char *key) {
+    struct KeyValue *kv;
+
+    for(kv = ps->dict[hash(key) % DICT_SIZE]; kv != NULL; kv = kv->next) {
+        if(strcmp(kv->key, key) == 0)
+            return &kv->value;
+    }
+    return NULL;
+}
+
+
+/*
+parser
+*/
+
+enum LexicalType {
+    NUMBER,
+    EXECUTABLE_NAME,
+    LITERAL_NAME,
+    OPEN_CURLY,
+    CLOSE_CURLY,
+    END_OF_FILE,
+    UNKNOWN
+};
+
+struct Token {
+    enum LexicalType ltype;
+    union {
+        int number;
+        char onechar;
+        char *name;
+    } u;
+};
+
+/*
+Input with the char read ahead, and the buffer of the last name.
+*/
+struct Parser {
+    struct ClGetcSource *src;
+    int ch;
+    char name[NAME_SIZE];
+};
+
+static int is_name_start(int ch) {
+    return isalpha(ch) || ch == '_' || ch == '=';
+}
+
+static int is_name_char(int ch) {
+    return isalnum(ch) || ch == '_' || ch == '=';
+}
+
+static void parser_init(struct Parser *parser, struct ClGetcSource *src) {
+    parser->src = src;
+    parser->ch = cl_getc_from(src);
+}
+
+static int parser_next(struct Parser *parser) {
+    parser->ch = cl_getc_from(parser->src);
+    return parser->ch;
+}
+
+static void parse_name(struct Parser *parser) {
+    int len = 0;
+
+    while(is_name_char(parser->ch)) {
+        if(len < NAME_SIZE - 1)
+            parser->name[len++] = parser->ch;
+        parser_next(parser);
+    }
+    parser->name[len] = '\0';
+}
+
+/*
+Spaces, newlines and comments from % to the end of the line are skipped.
+u.name of a name token points to parser->name, valid until the next call.
+*/
+static void parse_one(struct Parser *parser, struct Token *out_token) {
+    int ch = parser->ch;
+
+    while(ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r' || ch == '%') {
+        if(ch == '%') {
+            while(ch != '\n' && ch != EOF)
+                ch = parser_next(parser);
+        } else {
+            ch = parser_next(parser);
+        }
+    }
+
+    if(ch == EOF) {
+        out_token->ltype = END_OF_FILE;
+    } else if(isdigit(ch) || ch == '-') {
+        int sign = 1, number = 0;
+        if(ch == '-') {
+            sign = -1;
+            ch = parser_next(parser);
+            if(!isdigit(ch)) {
+                out_token->ltype = UNKNOWN;
+                out_token->u.onechar = '-';
+                return;
+            }
+        }
+        while(isdigit(ch)) {
+            number = number*10 + (ch - '0');
+            ch = parser_next(parser);
+        }
+        out_token->ltype = NUMBER;
+        out_token->u.number = sign*number;
+    } else if(ch == '/') {
+        parser_next(parser);
+        parse_name(parser);
+        out_token->ltype = LITERAL_NAME;
+        out_token->u.name = parser->name;
+    } else if(is_name_start(ch)) {
+        parse_name(parser);
+        out_token->ltype = EXECUTABLE_NAME;
+        out_token->u.name = parser->name;
+    } else if(ch == '{' || ch == '}') {
+        out_token->ltype = ch == '{' ? OPEN_CURLY : CLOSE_CURLY;
+        out_token->u.onechar = ch;
+        parser_next(parser);
+    } else {
+        out_token->ltype = UNKNOWN;
+        out_token->u.onechar = ch;
+        parser_next(parser);
+    }
+}
+
+
+/*
+primitives
+*/
+
+static void add_op(struct PsInterp *ps) {
+    int a, b;
+    if(stack_pop_number(ps, &b) && stack_pop_number(ps, &a))
+        stack_push_number(ps, (int)((unsigned int)a + (unsigned int)b));
+}
+
+static void sub_op(struct PsInterp *ps) {
+    int a, b;
+    if(stack_pop_number(ps, &b) && stack_pop_number(ps, &a))
+        stack_push_number(ps, (int)((unsigned int)a - (unsigned int)b));
+}
+
+static void mul_op(struct PsInterp *ps) {
+    int a, b;
+    if(stack_pop_number(ps, &b) && stack_pop_number(ps, &a))
+        stack_push_number(ps, (int)((unsigned int)a * (unsigned int)b));
+}
+
+static void div_op(struct PsInterp *ps) {
+    int a, b;
+    if(!stack_pop_number(ps, &b) || !stack_pop_number(ps, &a))
+        return;
+    if(b == 0 || (a == -0x7fffffff - 1 && b == -1)) {
+        ps_fail(ps, "div: undefined result");
+        return;
+    }
+    stack_push_number(ps, a / b);
+}
+
+#define COMPARE_OP(name, expr) \
+static void name##_op(struct PsInterp *ps) { \
+    int a, b; \
+    if(stack_pop_number(ps, &b) && stack_pop_number(ps, &a)) \
+        stack_push_number(ps, (expr)); \
+}
+
+COMPARE_OP(eq, a == b)
+COMPARE_OP(neq, a != b)
+COMPARE_OP(gt, a > b)
+COMPARE_OP(ge, a >= b)
+COMPARE_OP(lt, a < b)
+COMPARE_OP(le, a <= b)
+
+static void pop_op(struct PsInterp *ps) {
+    struct Element elem;
+    stack_pop(ps, &elem);
+}
+
+static void exch_op(struct PsInterp *ps) {
+    struct Element a, b;
+    if(stack_pop(ps, &b) && stack_pop(ps, &a)) {
+        stack_push(ps, &b);
+        stack_push(ps, &a);
+    }
+}
+
+static void dup_op(struct PsInterp *ps) {
+    struct Element elem;
+    if(stack_pop(ps, &elem)) {
+        stack_push(ps, &elem);
+        stack_push(ps, &elem);
+    }
+}
+
+static void index_op(struct PsInterp *ps) {
+    int n;
+    if(!stack_pop_number(ps, &n))
+        return;
+    if(n < 0 || n >= ps->stack_pos) {
+        ps_fail(ps, "index: out of the stack");
+        return;
+    }
+    stack_push(ps, &ps->stack[ps->stack_pos - 1 - n]);
+}
+
+/*
+n j roll: rotate the top n elements by j toward the top.
+*/
+static void roll_op(struct PsInterp *ps) {
+    struct Element tmp[STACK_SIZE];
+    struct Element *top;
+    int n, j, i;
+
+    if(!stack_pop_number(ps, &j) || !stack_pop_number(ps, &n))
+        return;
+    if(n < 0 || n > ps->stack_pos) {
+        ps_fail(ps, "roll: out of the stack");
+        return;
+    }
+    if(n == 0)
+        return;
+    j = ((j % n) + n) % n;
+    top = &ps->stack[ps->stack_pos - n];
+    for(i = 0; i < n; i++)
+        tmp[(i + j) % n] = top[i];
+    memcpy(top, tmp, sizeof(struct Element)*n);
+}
+
+static void def_op(struct PsInterp *ps) {
+    struct Element name, value;
+
+    if(!stack_pop(ps, &value) || !stack_pop(ps, &name))
+        return;
+    if(name.etype != ELEMENT_LITERAL_NAME) {
+        ps_fail(ps, "def: literal name expected");
+        return;
+    }
+    dict_put(ps, name.u.name, &value);
+}
+
+static void print_element(struct Element *elem, FILE *out) {
+    switch(elem->etype) {
+        case ELEMENT_NUMBER:
+            fprintf(out, "%d\n", elem->u.number);
+            break;
+        case ELEMENT_LITERAL_NAME:
+            fprintf(out, "/%s\n", elem->u.name);
+            break;
+        case ELEMENT_EXECUTABLE_NAME:
+            fprintf(out, "%s\n", elem->u.name);
+            break;
+        case ELEMENT_EXEC_ARRAY:
+            fprintf(out, "--exec array--\n");
+            break;
+        default:
+            fprintf(out, "--operator--\n");
+            break;
+    }
+}
+
+void ps_print_stack(struct PsInterp *ps, FILE *out) {
+    int i;
+    for(i = ps->stack_pos - 1; i >= 0; i--)
+        print_element(&ps->stack[i], out);
+}
+
+static void print_op(struct PsInterp *ps) {
+    struct Element elem;
+    if(stack_pop(ps, &elem) && ps->out != NULL)
+        print_element(&elem, ps->out);
+}
+
+static void pstack_op(struct PsInterp *ps) {
+    if(ps->out != NULL)
+        ps_print_stack(ps, ps->out);
+}
+
+
+/*
+compiler
+
+Emitter appends elements of the exec array being compiled.
+*/
+
+struct Emitter {
+    struct PsInterp *ps;
+    struct Element *elems;
+    int pos;
+    int capacity;
+};
+
+static void emit_elem(struct Emitter *emitter, struct Element *elem) {
+    if(emitter->pos == emitter->capacity) {
+        emitter->capacity = emitter->capacity ? emitter->capacity*2 : 16;
+        emitter->elems = realloc(emitter->elems, sizeof(struct Element)*emitter->capacity);
+    }
+    emitter->elems[emitter->pos++] = *elem;
+}
+
+static void emit_number(struct Emitter *emitter, int number) {
+    struct Element elem;
+    elem.etype = ELEMENT_NUMBER;
+    elem.u.number = number;
+    emit_elem(emitter, &elem);
+}
+
+static void emit_op(struct Emitter *emitter, int op) {
+    struct Element elem;
+    elem.etype = ELEMENT_OP;
+    elem.u.op = op;
+    emit_elem(emitter, &elem);
+}
+
+/*
+Primitives in generated code are called directly,
+so that a user definition of the same name doesn't break ifelse and loops.
+*/
+static void emit_cfunc(struct Emitter *emitter, void (*cfunc)(struct PsInterp*)) {
+    struct Element elem;
+    elem.etype = ELEMENT_C_FUNC;
+    elem.u.cfunc = cfunc;
+    emit_elem(emitter, &elem);
+}
+
+/*
+Copy the emitted elements to an exec array of the instance.
+*/
+static struct ElementArray *emitter_finish(struct Emitter *emitter) {
+    struct ElementArray *res = ps_alloc(emitter->ps, sizeof(struct ElementArray) + sizeof(struct Element)*emitter->pos);
+
+    res->len = emitter->pos;
+    if(emitter->pos > 0)
+        memcpy(res->elements, emitter->elems, sizeof(struct Element)*emitter->pos);
+    return res;
+}
+
+/* proc exec */
+static void exec_compile(struct Emitter *emitter) {
+    emit_op(emitter, OP_EXEC);
+}
+
+/* bool proc if */
+static void if_compile(struct Emitter *emitter) {
+    emit_cfunc(emitter, exch_op);
+    emit_number(emitter, 4);
+    emit_op(emitter, OP_JMP_NOT_IF);
+    emit_op(emitter, OP_EXEC);
+    emit_number(emitter, 2);
+    emit_op(emitter, OP_JMP);
+    emit_cfunc(emitter, pop_op);
+}
+
+/* bool proc1 proc2 ifelse, the code of chapter 13 */
+static void ifelse_compile(struct Emitter *emitter) {
+    emit_number(emitter, 3);
+    emit_number(emitter, 2);
+    emit_cfunc(emitter, roll_op);
+    emit_number(emitter, 5);
+    emit_op(emitter, OP_JMP_NOT_IF);
+    emit_cfunc(emitter, pop_op);
+    emit_op(emitter, OP_EXEC);
+    emit_number(emitter, 4);
+    emit_op(emitter, OP_JMP);
+    emit_cfunc(emitter, exch_op);
+    emit_cfunc(emitter, pop_op);
+    emit_op(emitter, OP_EXEC);
+}
+
+/* cond body while, the code of chapter 14 and lpop of the two locals */
+static void while_compile(struct Emitter *emitter) {
+    emit_op(emitter, OP_STORE);
+    emit_op(emitter, OP_STORE);
+    emit_number(emitter, 0);
+    emit_op(emitter, OP_LOAD);
+    emit_op(emitter, OP_EXEC);
+    emit_number(emitter, 6);
+    emit_op(emitter, OP_JMP_NOT_IF);
+    emit_number(emitter, 1);
+    emit_op(emitter, OP_LOAD);
+    emit_op(emitter, OP_EXEC);
+    emit_number(emitter, -9);
+    emit_op(emitter, OP_JMP);
+    emit_op(emitter, OP_LPOP);
+    emit_op(emitter, OP_LPOP);
+}
+
+/*
+n proc repeat. The counter is local 0 and proc is local 1,
+the counter is replaced by lpop and store.
+*/
+static void repeat_compile(struct Emitter *emitter) {
+    emit_op(emitter, OP_STORE);
+    emit_op(emitter, OP_STORE);
+    emit_number(emitter, 0);
+    emit_op(emitter, OP_LOAD);
+    emit_number(emitter, 0);
+    emit_cfunc(emitter, gt_op);
+    emit_number(emitter, 12);
+    emit_op(emitter, OP_JMP_NOT_IF);
+    emit_number(emitter, 1);
+    emit_op(emitter, OP_LOAD);
+    emit_op(emitter, OP_EXEC);
+    emit_number(emitter, 0);
+    emit_op(emitter, OP_LOAD);
+    emit_number(emitter, 1);
+    emit_cfunc(emitter, sub_op);
+    emit_op(emitter, OP_LPOP);
+    emit_op(emitter, OP_STORE);
+    emit_number(emitter, -16);
+    emit_op(emitter, OP_JMP);
+    emit_op(emitter, OP_LPOP);
+    emit_op(emitter, OP_LPOP);
+}
+
+
+/*
+built-in primitives, shared by all instances.
+
+Names are looked up in the generated perfect hash of primitive_table.h
+with a single probe, and the id selects the entry of builtins.
+Nothing is registered at startup and nothing is ever written.
+*/
+
+struct Builtin {
+    void (*cfunc)(struct PsInterp *ps);
+    /* the code to emit instead of the name, NULL for a plain primitive */
+    void (*compile)(struct Emitter *emitter);
+};
+
+static const struct Builtin builtins[PRIM_NUM] = {
+    [PRIM_ADD] = {add_op, NULL}, [PRIM_SUB] = {sub_op, NULL},
+    [PRIM_MUL] = {mul_op, NULL}, [PRIM_DIV] = {div_op, NULL},
+    [PRIM_EQ] = {eq_op, NULL}, [PRIM_NEQ] = {neq_op, NULL},
+    [PRIM_GT] = {gt_op, NULL}, [PRIM_GE] = {ge_op, NULL},
+    [PRIM_LT] = {lt_op, NULL}, [PRIM_LE] = {le_op, NULL},
+    [PRIM_POP] = {pop_op, NULL}, [PRIM_EXCH] = {exch_op, NULL},
+    [PRIM_DUP] = {dup_op, NULL}, [PRIM_INDEX] = {index_op, NULL},
+    [PRIM_ROLL] = {roll_op, NULL}, [PRIM_DEF] = {def_op, NULL},
+    [PRIM_PRINT] = {print_op, NULL}, [PRIM_PSTACK] = {pstack_op, NULL},
+    [PRIM_EXEC] = {NULL, exec_compile}, [PRIM_IF] = {NULL, if_compile},
+    [PRIM_IFELSE] = {NULL, ifelse_compile}, [PRIM_WHILE] = {NULL, while_compile},
+    [PRIM_REPEAT] = {NULL, repeat_compile}
+};
+
+static int primitive_lookup(char *name) {
+    int len = strlen(name);
+    unsigned long long h = primitive_hash(name, len);
+    unsigned int d = primitive_displace[h % PRIMITIVE_BUCKET_NUM];
+    const struct Primitive *p = &primitive_table[primitive_slot(h, d, PRIMITIVE_TABLE_SIZE)];
+
+    if(p->name == NULL || strcmp(p->name, name) != 0)
+        return PRIM_NONE;
+    return p->id;
+}
+
+static const struct Builtin *builtin_get(char *name) {
+    int id = primitive_lookup(name);
+
+    return id == PRIM_NONE ? NULL : &builtins[id];
+}
+
+
+/*
+Compile up to the matching "}" into an exec array.
+A name is expanded by its compile function unless the user defined it,
+user definitions always win over built-ins.
+*/
+static struct ElementArray *compile_exec_array(struct PsInterp *ps, struct Parser *parser) {
+    struct Emitter emitter = {ps, NULL, 0, 0};
+    struct ElementArray *res = NULL;
+    struct Token token;
+    struct Element elem;
+
+    while(!has_error(ps)) {
+        parse_one(parser, &token);
+        if(token.ltype == CLOSE_CURLY) {
+            res = emitter_finish(&emitter);
+            break;
+        }
+        switch(token.ltype) {
+            case NUMBER:
+                emit_number(&emitter, token.u.number);
+                break;
+            case LITERAL_NAME:
+                elem.etype = ELEMENT_LITERAL_NAME;
+                elem.u.name = ps_strdup(ps, token.u.name);
+                emit_elem(&emitter, &elem);
+                break;
+            case EXECUTABLE_NAME: {
+                const struct Builtin *builtin = builtin_get(token.u.name);
+                if(builtin != NULL && builtin->compile != NULL && dict_get(ps, token.u.name) == NULL) {
+                    builtin->compile(&emitter);
+                } else {
+                    elem.etype = ELEMENT_EXECUTABLE_NAME;
+                    elem.u.name = ps_strdup(ps, token.u.name);
+                    emit_elem(&emitter, &elem);
+                }
+                break;
+            }
+            case OPEN_CURLY:
+                elem.etype = ELEMENT_EXEC_ARRAY;
+                elem.u.byte_codes = compile_exec_array(ps, parser);
+                if(elem.u.byte_codes != NULL)
+                    emit_elem(&emitter, &elem);
+                break;
+            case END_OF_FILE:
+                ps_fail(ps, "unmatched {");
+                break;
+            default:
+                ps_fail(ps, "unknown character '%c'", token.u.onechar);
+                break;
+        }
+    }
+    free(emitter.elems);
+    return res;
+}
+
+
+/*
+VM
+*/
+
+static int co_push_cont(struct PsInterp *ps, struct ElementArray *exec_array, int prev) {
+    struct CoEntry *entry;
+
+    if(ps->co_pos == CO_STACK_SIZE) {
+        ps_fail(ps, "co_stack overflow");
+        return 0;
+    }
+    entry = &ps->co_stack[ps->co_pos++];
+    entry->is_cont = 1;
+    entry->u.cont.exec_array = exec_array;
+    entry->u.cont.pc = 0;
+    entry->u.cont.prev = prev;
+    return 1;
+}
+
+/*
+Whether the code from pc only returns, which is the end of the array
+or "n jmp" to the end like the then part of compiled if and ifelse.
+*/
+int ps_returns_from(struct ElementArray *exec_array, int pc) {
+    struct Element *elems = exec_array->elements;
+
+    if(pc == exec_array->len)
+        return 1;
+    return pc + 1 < exec_array->len && elems[pc].etype == ELEMENT_NUMBER
+        && elems[pc+1].etype == ELEMENT_OP && elems[pc+1].u.op == OP_JMP
+        && pc + 1 + elems[pc].u.number == exec_array->len;
+}
+
+/*
+Call exec_array from the continuation at frame.
+A call which is followed only by the return of an array without locals
+replaces its frame, so that tail recursion runs in constant co_stack.
+Return the frame to run next.
+*/
+static int call_exec_array(struct PsInterp *ps, struct ElementArray *exec_array, int frame) {
+    struct CoEntry *cur = &ps->co_stack[frame];
+
+    if(ps->co_pos == frame + 1 && ps_returns_from(cur->u.cont.exec_array, cur->u.cont.pc)) {
+        cur->u.cont.exec_array = exec_array;
+        cur->u.cont.pc = 0;
+        return frame;
+    }
+    if(!co_push_cont(ps, exec_array, frame))
+        return frame;
+    return ps->co_pos - 1;
+}
+
+/*
+Execute the value of an executable name.
+Return the frame to run next, a new one if it is an exec array.
+*/
+static int exec_name(struct PsInterp *ps, char *name, int frame) {
+    struct Element *value = dict_get(ps, name);
+    const struct Builtin *builtin;
+
+    if(value != NULL) {
+        switch(value->etype) {
+            case ELEMENT_EXEC_ARRAY:
+                return call_exec_array(ps, value->u.byte_codes, frame);
+            case ELEMENT_C_FUNC:
+                value->u.cfunc(ps);
+                break;
+            default:
+                stack_push(ps, value);
+                break;
+        }
+        return frame;
+    }
+    builtin = builtin_get(name);
+    if(builtin == NULL)
+        ps_fail(ps, "undefined name %s", name);
+    else if(builtin->cfunc == NULL)
+        ps_fail(ps, "%s is only allowed where it is compiled", name);
+    else
+        builtin->cfunc(ps);
+    return frame;
+}
+
+static int pop_jump(struct PsInterp *ps, struct CoEntry *cont, int *out_pc) {
+    int offset, pc = cont->u.cont.pc - 1;
+
+    if(!stack_pop_number(ps, &offset))
+        return 0;
+    if(pc + offset < 0 || pc + offset > cont->u.cont.exec_array->len) {
+        ps_fail(ps, "jmp out of the exec array");
+        return 0;
+    }
+    *out_pc = pc + offset;
+    return 1;
+}
+
+/*
+Local n of the frame, 0 is the last stored one.
+*/
+static struct Element *local_at(struct PsInterp *ps, int frame, int n) {
+    int idx = ps->co_pos - 1 - n;
+
+    if(n < 0 || idx <= frame) {
+        ps_fail(ps, "no local variable %d", n);
+        return NULL;
+    }
+    return &ps->co_stack[idx].u.local;
+}
+
+static void exec_op(struct PsInterp *ps, struct CoEntry *cont, int op, int *inout_frame) {
+    struct Element elem, *local;
+    int n, cond, pc;
+
+    switch(op) {
+        case OP_EXEC:
+            if(!stack_pop(ps, &elem))
+                break;
+            if(elem.etype == ELEMENT_EXEC_ARRAY)
+                *inout_frame = call_exec_array(ps, elem.u.byte_codes, *inout_frame);
+            else
+                stack_push(ps, &elem);
+            break;
+        case OP_JMP:
+            if(pop_jump(ps, cont, &pc))
+                cont->u.cont.pc = pc;
+            break;
+        case OP_JMP_NOT_IF:
+            if(!pop_jump(ps, cont, &pc) || !stack_pop_number(ps, &cond))
+                break;
+            if(cond == 0)
+                cont->u.cont.pc = pc;
+            break;
+        case OP_STORE:
+            if(!stack_pop(ps, &elem))
+                break;
+            if(ps->co_pos == CO_STACK_SIZE) {
+                ps_fail(ps, "co_stack overflow");
+                break;
+            }
+            ps->co_stack[ps->co_pos].is_cont = 0;
+            ps->co_stack[ps->co_pos].u.local = elem;
+            ps->co_pos++;
+            break;
+        case OP_LOAD:
+            if(stack_pop_number(ps, &n) && (local = local_at(ps, *inout_frame, n)) != NULL)
+                stack_push(ps, local);
+            break;
+        case OP_LPOP:
+            if(local_at(ps, *inout_frame, 0) != NULL)
+                ps->co_pos--;
+            break;
+    }
+}
+
+static void eval_exec_array(struct PsInterp *ps, struct ElementArray *exec_array) {
+    int base = ps->co_pos;
+    int frame;
+
+    if(!co_push_cont(ps, exec_array, -1))
+        return;
+    frame = base;
+    while(frame >= base && !has_error(ps)) {
+        struct CoEntry *cont = &ps->co_stack[frame];
+        struct Element *elem;
+
+        if(cont->u.cont.pc >= cont->u.cont.exec_array->len) {
+            /* drop the locals and the continuation */
+            ps->co_pos = frame;
+            frame = cont->u.cont.prev;
+            continue;
+        }
+        if(cont->u.cont.pc == 0 && ps->jit_run != NULL && ps->jit_run(ps, cont, frame))
+            continue;
+        if(ps->max_steps > 0 && ++ps->steps > ps->max_steps) {
+            ps_fail(ps, "step limit %lld exceeded", ps->max_steps);
+            break;
+        }
+        elem = &cont->u.cont.exec_array->elements[cont->u.cont.pc++];
+        switch(elem->etype) {
+            case ELEMENT_EXECUTABLE_NAME:
+                frame = exec_name(ps, elem->u.name, frame);
+                break;
+            case ELEMENT_C_FUNC:
+                elem->u.cfunc(ps);
+                break;
+            case ELEMENT_OP:
+                exec_op(ps, cont, elem->u.op, &frame);
+                break;
+            default:
+                stack_push(ps, elem);
+                break;
+        }
+    }
+    ps->co_pos = base;
+}
+
+
+/*
+entries for the JIT
+*/
+
+void ps_exec_name(struct PsInterp *ps, char *name) {
+    struct Element *value = dict_get(ps, name);
+
+    if(value != NULL && value->etype == ELEMENT_EXEC_ARRAY)
+        eval_exec_array(ps, value->u.byte_codes);
+    else
+        exec_name(ps, name, -1); /* no frame is needed without an exec array */
+}
+
+struct ElementArray *ps_exec_name_tail(struct PsInterp *ps, char *name) {
+    struct Element *value = dict_get(ps, name);
+
+    if(value != NULL && value->etype == ELEMENT_EXEC_ARRAY)
+        return value->u.byte_codes;
+    exec_name(ps, name, -1);
+    return NULL;
+}
+
+void ps_exec_top(struct PsInterp *ps) {
+    struct Element elem;
+
+    if(!stack_pop(ps, &elem))
+        return;
+    if(elem.etype == ELEMENT_EXEC_ARRAY)
+        eval_exec_array(ps, elem.u.byte_codes);
+    else
+        stack_push(ps, &elem);
+}
+
+struct ElementArray *ps_exec_top_tail(struct PsInterp *ps) {
+    struct Element elem;
+
+    if(!stack_pop(ps, &elem))
+        return NULL;
+    if(elem.etype == ELEMENT_EXEC_ARRAY)
+        return elem.u.byte_codes;
+    stack_push(ps, &elem);
+    return NULL;
+}
+
+int ps_resolve_primitive(struct PsInterp *ps, char *name, struct Element *out_elem) {
+    const struct Builtin *builtin;
+
+    if(dict_get(ps, name) != NULL)
+        return 0;
+    builtin = builtin_get(name);
+    if(builtin == NULL || builtin->cfunc == NULL)
+        return 0;
+    out_elem->etype = ELEMENT_C_FUNC;
+    out_elem->u.cfunc = builtin->cfunc;
+    return 1;
+}
+
+int ps_cfunc_primitive(void (*cfunc)(struct PsInterp *ps)) {
+    int id;
+
+    for(id = PRIM_NONE + 1; id < PRIM_NUM; id++) {
+        if(builtins[id].cfunc == cfunc)
+            return id;
+    }
+    return PRIM_NONE;
+}
+
+
+/*
+eval
+
+Each top level token is compiled alone and run,
+so a def takes effect on the compile of the tokens after it.
+*/
+int ps_eval(struct PsInterp *ps, char *input) {
+    struct Parser parser;
+    struct Token token;
+    struct Element elem;
+    struct Emitter emitter = {ps, NULL, 0, 0};
+
+    if(has_error(ps))
+        return -1;
+    cl_getc_src_init(&ps->src, input);
+    parser_init(&parser, &ps->src);
+    while(!has_error(ps)) {
+        parse_one(&parser, &token);
+        if(token.ltype == END_OF_FILE)
+            break;
+        switch(token.ltype) {
+            case NUMBER:
+                stack_push_number(ps, token.u.number);
+                break;
+            case LITERAL_NAME:
+                elem.etype = ELEMENT_LITERAL_NAME;
+                elem.u.name = ps_strdup(ps, token.u.name);
+                stack_push(ps, &elem);
+                break;
+            case OPEN_CURLY:
+                elem.etype = ELEMENT_EXEC_ARRAY;
+                elem.u.byte_codes = compile_exec_array(ps, &parser);
+                if(elem.u.byte_codes != NULL)
+                    stack_push(ps, &elem);
+                break;
+            case EXECUTABLE_NAME: {
+                const struct Builtin *builtin = builtin_get(token.u.name);
+                if(builtin != NULL && builtin->compile != NULL && dict_get(ps, token.u.name) == NULL) {
+                    /* code generated for a top level ifelse and the like */
+                    emitter.pos = 0;
+                    builtin->compile(&emitter);
+                    eval_exec_array(ps, emitter_finish(&emitter));
+                } else {
+                    struct ElementArray *call = ps_alloc(ps, sizeof(struct ElementArray) + sizeof(struct Element));
+                    call->len = 1;
+                    call->elements[0].etype = ELEMENT_EXECUTABLE_NAME;
+                    call->elements[0].u.name = ps_strdup(ps, token.u.name);
+                    eval_exec_array(ps, call);
+                }
+                break;
+            }
+            case CLOSE_CURLY:
+                ps_fail(ps, "unmatched }");
+                break;
+            default:
+                ps_fail(ps, "unknown character '%c'", token.u.onechar);
+                break;
+        }
+    }
+    free(emitter.elems);
+    return has_error(ps) ? -1 : 0;
+}
+
+
+/*
+instances
+*/
+
+struct PsInterp *ps_new(FILE *out) {
+    struct PsInterp *ps = malloc(sizeof(struct PsInterp));
+
+    ps->out = out;
+    ps->stack_pos = 0;
+    ps->co_pos = 0;
+    ps->dict_version = 0;
+    memset(ps->dict, 0, sizeof(ps->dict));
+    ps->arena = NULL;
+    ps->steps = 0;
+    ps->max_steps = 0;
+    ps->error[0] = '\0';
+    ps->jit = NULL;
+    ps->jit_run = NULL;
+    ps->jit_free = NULL;
+    return ps;
+}
+
+void ps_free(struct PsInterp *ps) {
+    if(ps->jit_free != NULL)
+        ps->jit_free(ps);
+    while(ps->arena != NULL) {
+        struct ArenaBlock *next = ps->arena->next;
+        free(ps->arena);
+        ps->arena = next;
+    }
+    free(ps);
+}
+
+
+#ifndef PS_NO_MAIN
+
+/*
+test code
+*/
+
+/*
+The stack from the bottom, separated by spaces.
+*/
+static char *stack_str(struct PsInterp *ps) {
+    static char buf[1024];
+    int i, len = 0;
+
+    buf[0] = '\0';
+    for(i = 0; i < ps->stack_pos; i++) {
+        struct Element *elem = &ps->stack[i];
+        char *sep = i == 0 ? "" : " ";
+        if(elem->etype == ELEMENT_NUMBER)
+            len += snprintf(buf + len, sizeof(buf) - len, "%s%d", sep, elem->u.number);
+        else if(elem->etype == ELEMENT_LITERAL_NAME)
+            len += snprintf(buf + len, sizeof(buf) - len, "%s/%s", sep, elem->u.name);
+        else
+            len += snprintf(buf + len, sizeof(buf) - len, "%s{}", sep);
+    }
+    return buf;
+}
+
+static void assert_eval(char *input, char *expect_stack) {
+    struct PsInterp *ps = ps_new(NULL);
+
+    if(ps_eval(ps, input) != 0)
+        fprintf(stderr, "fail: %s\n%s\n", input, ps->error);
+    assert(has_error(ps) == 0);
+    if(strcmp(expect_stack, stack_str(ps)) != 0)
+        fprintf(stderr, "fail: %s\nexpect: %s\nactual: %s\n", input, expect_stack, stack_str(ps));
+    assert(strcmp(expect_stack, stack_str(ps)) == 0);
+    ps_free(ps);
+}
+
+static void assert_eval_error(char *input, char *expect_error) {
+    struct PsInterp *ps = ps_new(NULL);
+
+    assert(ps_eval(ps, input) == -1);
+    assert(strcmp(expect_error, ps->error) == 0);
+    ps_free(ps);
+}
+
+static void test_eval_num_and_add() {
+    assert_eval("123", "123");
+    assert_eval("123 456", "123 456");
+    assert_eval("1 2 add", "3");
+    assert_eval("10 -3 sub 4 mul 7 div", "7");
+}
+
+static void test_eval_def() {
+    assert_eval("/abc 12 def abc abc add", "24");
+    assert_eval("/abc 12 def /abc 3 def abc", "3");
+}
+
+static void test_eval_exec_array() {
+    assert_eval("{1} {/abc} {1 {2} 3}", "{} {} {}");
+    assert_eval("/abc { 1 2 add } def abc", "3");
+    assert_eval("/ZZ {6} def /YY {4 ZZ 5} def /XX {1 2 YY 3} def XX", "1 2 4 6 5 3");
+    assert_eval("{3 4 mul} exec", "12");
+}
+
+static void test_eval_stack_ops() {
+    assert_eval("1 2 exch pop dup", "2 2");
+    assert_eval("1 2 3 4 5 2 index", "1 2 3 4 5 3");
+    assert_eval("1 2 3 4 5 6 7 4 3 roll", "1 2 3 5 6 7 4");
+    assert_eval("1 2 3 3 -1 roll", "2 3 1");
+    assert_eval("1 3 lt 1 3 gt 2 2 eq 2 2 neq 2 3 le 3 3 ge", "1 0 1 0 1 1");
+}
+
+static void test_eval_control() {
+    assert_eval("5 1 {1 add} {2 add} ifelse", "6");
+    assert_eval("5 0 {1 add} {2 add} ifelse", "7");
+    assert_eval("5 1 {1 add} if 0 {1 add} if", "6");
+    assert_eval("3 {1 2} repeat", "1 2 1 2 1 2");
+    assert_eval("0 {1 2} repeat", "");
+    assert_eval("0 {dup 5 lt} {1 add} while", "5");
+    /* 4+3+2+1, "sum n" on the stack */
+    assert_eval("/f { 0 exch {dup 0 gt} {dup 3 -1 roll add exch 1 sub} while pop } def 4 f", "10");
+    /* ifelse in a loop in a loop */
+    assert_eval("2 { 3 { 0 {1} {2} ifelse } repeat } repeat", "2 2 2 2 2 2");
+    assert_eval("/g { dup 2 lt {pop 1} {dup 1 sub g mul} ifelse } def 5 g", "120");
+}
+
+static void test_eval_factorial() {
+    assert_eval(
+        "/factorial {\n"
+        "  dup\n"
+        "  % keep \"product, j\" on the stack\n"
+        "  {dup 1 gt}\n"
+        "  {\n"
+        "    1 sub\n"
+        "    exch\n"
+        "    1 index\n"
+        "    mul\n"
+        "    exch\n"
+        "  } while\n"
+        "  pop\n"
+        "} def\n"
+        "\n"
+        "10 factorial", "3628800");
+}
+
+static void test_eval_tail_call() {
+    /* 10000 nested calls would overflow co_stack without the tail call */
+    assert_eval("/down { dup 0 gt { 1 sub down } if } def 10000 down", "0");
+}
+
+static void test_primitive_lookup() {
+    assert(primitive_lookup("add") == PRIM_ADD);
+    assert(primitive_lookup("=") == PRIM_PRINT);
+    assert(primitive_lookup("ifelse") == PRIM_IFELSE);
+    assert(primitive_lookup("repeat") == PRIM_REPEAT);
+    assert(primitive_lookup("addx") == PRIM_NONE);
+    assert(primitive_lookup("ad") == PRIM_NONE);
+    assert(primitive_lookup("foo") == PRIM_NONE);
+    assert(builtin_get("while")->compile == while_compile);
+    assert(builtin_get("dup")->cfunc == dup_op);
+}
+
+static void test_eval_override_builtin() {
+    struct PsInterp *ps = ps_new(NULL);
+    struct PsInterp *other = ps_new(NULL);
+
+    assert(ps_eval(ps, "/add { mul } def 3 4 add") == 0);
+    assert(strcmp("12", stack_str(ps)) == 0);
+    /* ifelse compiled after its override calls the user definition */
+    assert(ps_eval(ps, "/ifelse { pop pop pop 99 } def 1 {1} {2} ifelse {0 {1} {2} ifelse} exec") == 0);
+    assert(strcmp("12 99 99", stack_str(ps)) == 0);
+    /* generated code calls the primitives, not the overrides */
+    assert(ps_eval(ps, "/sub { pop pop 0 } def /gt { pop pop 1 } def 2 {7} repeat") == 0);
+    assert(strcmp("12 99 99 7 7", stack_str(ps)) == 0);
+
+    /* definitions belong to one instance */
+    assert(ps_eval(other, "3 4 add 1 {5} {6} ifelse") == 0);
+    assert(strcmp("7 5", stack_str(other)) == 0);
+    ps_free(ps);
+    ps_free(other);
+}
+
+static void test_eval_print() {
+    char *text = NULL;
+    size_t len = 0;
+    FILE *out = open_memstream(&text, &len);
+    struct PsInterp *ps = ps_new(out);
+
+    assert(ps_eval(ps, "1 2 = /abc = 3 4 pstack") == 0);
+    fclose(out);
+    assert(strcmp("2\n/abc\n4\n3\n1\n", text) == 0);
+    free(text);
+    ps_free(ps);
+}
+
+static void test_eval_errors() {
+    assert_eval_error("1 add", "stack underflow");
+    assert_eval_error("foo", "undefined name foo");
+    assert_eval_error("{1 2", "unmatched {");
+    assert_eval_error("1 }", "unmatched }");
+    assert_eval_error("1 0 div", "div: undefined result");
+    assert_eval_error("/a {1} add", "number expected");
+    assert_eval_error("1 2 def", "def: literal name expected");
+    assert_eval_error("1 #", "unknown character '#'");
+    assert_eval_error("/r { r 1 } def r", "co_stack overflow");
+}
+
+static void test_eval_step_limit() {
+    struct PsInterp *ps = ps_new(NULL);
+
+    ps->max_steps = 1000;
+    assert(ps_eval(ps, "{1} {} while") == -1);
+    assert(strcmp("step limit 1000 exceeded", ps->error) == 0);
+    /* an instance stays failed */
+    assert(ps_eval(ps, "1") == -1);
+    ps_free(ps);
+}
+
+static void test_eval_keeps_state_between_calls() {
+    struct PsInterp *ps = ps_new(NULL);
+
+    assert(ps_eval(ps, "/sq { dup mul } def 3") == 0);
+    assert(ps_eval(ps, "sq") == 0);
+    assert(strcmp("9", stack_str(ps)) == 0);
+    ps_free(ps);
+}
+
+static void *thread_eval(void *arg) {
+    int n = *(int*)arg;
+    char input[128];
+    int i;
+
+    snprintf(input, sizeof(input), "/f { dup 1 gt { dup 1 sub f mul } if } def %d f", n);
+    for(i = 0; i < 200; i++) {
+        struct PsInterp *ps = ps_new(NULL);
+        assert(ps_eval(ps, input) == 0);
+        assert(ps->stack_pos == 1);
+        *(int*)arg = ps->stack[0].u.number;
+        ps_free(ps);
+    }
+    return NULL;
+}
+
+static void test_eval_threads() {
+    pthread_t threads[4];
+    int args[4] = {3, 5, 7, 10};
+    int i;
+
+    for(i = 0; i < 4; i++)
+        pthread_create(&threads[i], NULL, thread_eval, &args[i]);
+    for(i = 0; i < 4; i++)
+        pthread_join(threads[i], NULL);
+    assert(args[0] == 6 && args[1] == 120 && args[2] == 5040 && args[3] == 3628800);
+}
+
+static void run_unit_tests() {
+    test_eval_num_and_add();
+    test_eval_def();
+    test_eval_exec_array();
+    test_eval_stack_ops();
+    test_eval_control();
+    test_eval_factorial();
+    test_eval_tail_call();
+    test_primitive_lookup();
+    test_eval_override_builtin();
+    test_eval_print();
+    test_eval_errors();
+    test_eval_step_limit();
+    test_eval_keeps_state_between_calls();
+    test_eval_threads();
+
+    printf("all test done\n");
+}
+
+static char *read_all(FILE *fp) {
+    char *buf = NULL;
+    size_t len = 0, capacity = 0, n;
+
+    do {
+        if(len + 4096 + 1 > capacity) {
+            capacity = capacity ? capacity*2 : 8192;
+            buf = realloc(buf, capacity);
+        }
+        n = fread(buf + len, 1, capacity - len - 1, fp);
+        len += n;
+    } while(n > 0);
+    buf[len] = '\0';
+    return buf;
+}
+
+int main(int argc, char **argv) {
+    struct PsInterp *ps;
+    FILE *fp;
+    char *input;
+    int res;
+
+    if(argc < 2) {
+        run_unit_tests();
+        return 0;
+    }
+    fp = fopen(argv[1], "r");
+    if(fp == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+    input = read_all(fp);
+    fclose(fp);
+
+    ps = ps_new(stdout);
+    res = ps_eval(ps, input);
+    if(res != 0)
+        fprintf(stderr, "%s: %s\n", argv[1], ps->error);
+    ps_print_stack(ps, stdout);
+    ps_free(ps);
+    free(input);
+    return res != 0;
+}
+
+#endif
@@ -0,0 +1,168 @@
+/*
+The interpreter of chapter 14 as an instance object.
+
+Everything a program touches (input, operand stack, co_stack, user dictionary
+and the memory of exec arrays and names) lives in struct PsInterp,
+so each thread can run its own program.
+Built-in primitives are shared read-only by all instances.
+*/
+#include <stdio.h>
+
+#include "clesson.h"
+
+#define STACK_SIZE 1024
+#define CO_STACK_SIZE 1024
+#define DICT_SIZE 256
+#define NAME_SIZE 256
+#define PS_ERROR_SIZE 256
+
+struct PsInterp;
+
+enum ElementType {
+    ELEMENT_NUMBER,
+    ELEMENT_LITERAL_NAME,
+    ELEMENT_EXECUTABLE_NAME,
+    ELEMENT_C_FUNC,
+    ELEMENT_EXEC_ARRAY,
+    /* operations only the VM runs, u.op is one of OP_XXX */
+    ELEMENT_OP
+};
+
+enum {
+    OP_EXEC,
+    OP_JMP,
+    OP_JMP_NOT_IF,
+    OP_STORE,
+    OP_LOAD,
+    OP_LPOP
+};
+
+struct ElementArray;
+
+struct Element {
+    enum ElementType etype;
+    union {
+        int number;
+        char *name;
+        void (*cfunc)(struct PsInterp *ps);
+        struct ElementArray *byte_codes;
+        int op;
+    } u;
+};
+
+struct ElementArray {
+    int len;
+    struct Element elements[];
+};
+
+/*
+One entry of co_stack, a continuation or a local variable.
+*/
+struct CoEntry {
+    int is_cont;
+    union {
+        struct {
+            struct ElementArray *exec_array;
+            int pc;
+            /* index of the continuation below, -1 for none */
+            int prev;
+        } cont;
+        struct Element local;
+    } u;
+};
+
+struct KeyValue {
+    char *key;
+    struct Element value;
+    struct KeyValue *next;
+};
+
+/*
+Memory of an instance. Exec arrays, names and dictionary entries are only
+freed all at once by ps_free, so allocation is just a bump of the pointer.
+*/
+struct ArenaBlock {
+    struct ArenaBlock *next;
+    int used;
+    int size;
+    char buf[];
+};
+
+struct PsInterp {
+    /* small fields first, the code of ps_jit.c reaches them with an immediate offset */
+    int stack_pos;
+    int co_pos;
+    /* incremented when a name is added to dict, so that JIT code can tell a built-in is overridden */
+    int dict_version;
+    /* the first error, "" while none */
+    char error[PS_ERROR_SIZE];
+
+    struct ClGetcSource src;
+    FILE *out;
+
+    struct Element stack[STACK_SIZE];
+    struct CoEntry co_stack[CO_STACK_SIZE];
+
+    /* user definitions only, built-ins are looked up in the shared table. */
+    struct KeyValue *dict[DICT_SIZE];
+
+    struct ArenaBlock *arena;
+
+    /* executed elements, and the limit of them (0 for none). */
+    long long steps;
+    long long max_steps;
+
+    /*
+    Set by ps_jit_enable of ps_jit.c, NULL while only the interpreter runs.
+    jit_run is tried when the continuation at frame starts its exec array,
+    it returns 0 to leave the array to the interpreter.
+    */
+    void *jit;
+    int (*jit_run)(struct PsInterp *ps, struct CoEntry *cont, int frame);
+    void (*jit_free)(struct PsInterp *ps);
+};
+
+/*
+out receives the output of "=" and "pstack", it may be NULL to discard it.
+*/
+struct PsInterp *ps_new(FILE *out);
+void ps_free(struct PsInterp *ps);
+
+/*
+Run the program in input. Definitions and the stack are kept for the next call.
+Return 0, or -1 with the reason in ps->error. An instance stays unusable after an error.
+*/
+int ps_eval(struct PsInterp *ps, char *input);
+
+/*
+The error of the first failing operation, ps->error is set only by this.
+*/
+void ps_fail(struct PsInterp *ps, const char *fmt, ...);
+
+/* print the stack from the top, one element a line, like pstack */
+void ps_print_stack(struct PsInterp *ps, FILE *out);
+
+
+/*
+For the JIT of ps_jit.c, which calls back into the interpreter
+for what it doesn't compile.
+*/
+
+/* Run name to its end, an exec array on a nested VM loop. */
+void ps_exec_name(struct PsInterp *ps, char *name);
+/* Same as ps_exec_name, but return an exec array for the caller to run in its own frame. */
+struct ElementArray *ps_exec_name_tail(struct PsInterp *ps, char *name);
+/* OP_EXEC on a nested VM loop, and its tail version. */
+void ps_exec_top(struct PsInterp *ps);
+struct ElementArray *ps_exec_top_tail(struct PsInterp *ps);
+
+/*
+If name runs a built-in primitive now, set out_elem to its C_FUNC element and return 1.
+Return 0 for user definitions, compile only words and unknown names.
+*/
+int ps_resolve_primitive(struct PsInterp *ps, char *name, struct Element *out_elem);
+/* PrimitiveId of primitive.h for cfunc, PRIM_NONE if it is not a built-in. */
+int ps_cfunc_primitive(void (*cfunc)(struct PsInterp *ps));
+
+/* Whether the code of exec_array from pc only returns, see call_exec_array. */
+int ps_returns_from(struct ElementArray *exec_array, int pc);
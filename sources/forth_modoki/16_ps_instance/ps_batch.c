@@ -0,0 +1,325 @@
+/*
+Run many .ps jobs on a fixed pool of threads, one interpreter instance for each job.
+
+gcc -O2 -pthread -DPS_NO_MAIN ps_batch.c ps.c cl_getc.c -o ps_batch
+./ps_batch                                  # run unit tests
+./ps_batch [-jN] [-steps N] [-q] dir a.ps ...
+
+A directory means all of its .ps files, in the order of the names.
+The output of x.ps, its error if any and the stack left are written to x.out.
+Timings are printed in the order of the jobs, whatever order the threads finish in.
+-steps limits the elements each job executes, so a job which loops forever fails
+instead of holding its thread.
+*/
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ps.h"
+
+#define BATCH_PATH_MAX 4096
+
+struct BatchJob {
+    char *src;
+    char out[BATCH_PATH_MAX];
+    int ok;
+    double elapsed;
+};
+
+struct Batch {
+    struct BatchJob *jobs;
+    int job_num;
+    int next_job;
+    long long max_steps;
+};
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+/*
+Whole file, NUL terminated. NULL if it can't be read.
+*/
+static char *read_file(char *path, size_t *out_len) {
+    FILE *fp = fopen(path, "rb");
+    char *buf = NULL;
+    size_t len = 0, capacity = 0, n;
+
+    if(fp == NULL)
+        return NULL;
+    do {
+        if(len + 4096 + 1 > capacity) {
+            capacity = capacity ? capacity*2 : 8192;
+            buf = realloc(buf, capacity);
+        }
+        n = fread(buf + len, 1, capacity - len - 1, fp);
+        len += n;
+    } while(n > 0);
+    fclose(fp);
+    buf[len] = '\0';
+    *out_len = len;
+    return buf;
+}
+
+static void set_out_path(struct BatchJob *job) {
+    int len = strlen(job->src);
+
+    if(len >= 3 && strcmp(job->src + len - 3, ".ps") == 0)
+        len -= 3;
+    snprintf(job->out, sizeof(job->out), "%.*s.out", len, job->src);
+}
+
+static void run_job(struct Batch *batch, struct BatchJob *job) {
+    FILE *out = fopen(job->out, "w");
+    struct PsInterp *ps;
+    size_t len;
+    char *input;
+
+    if(out == NULL)
+        return;
+    input = read_file(job->src, &len);
+    if(input == NULL) {
+        fprintf(out, "error: %s\n", strerror(errno));
+        fclose(out);
+        return;
+    }
+
+    ps = ps_new(out);
+    ps->max_steps = batch->max_steps;
+    job->ok = ps_eval(ps, input) == 0;
+    if(!job->ok)
+        fprintf(out, "error: %s\n", ps->error);
+    ps_print_stack(ps, out);
+    ps_free(ps);
+    free(input);
+    job->ok &= fclose(out) == 0;
+}
+
+static void *batch_worker(void *arg) {
+    struct Batch *batch = arg;
+
+    while(1) {
+        int idx = __sync_fetch_and_add(&batch->next_job, 1);
+        struct BatchJob *job;
+        double begin;
+
+        if(idx >= batch->job_num)
+            break;
+        job = &batch->jobs[idx];
+        begin = now_sec();
+        run_job(batch, job);
+        job->elapsed = now_sec() - begin;
+    }
+    return NULL;
+}
+
+/*
+Run all sources with thread_num threads (0 for the number of cpus).
+Timings go to stdout if verbose.
+Return the number of failed jobs.
+*/
+static int batch_run(char **sources, int source_num, long long max_steps, int thread_num, int verbose) {
+    struct Batch batch;
+    pthread_t *threads;
+    double begin = now_sec(), wall, total = 0;
+    int i, failed = 0;
+
+    if(thread_num <= 0)
+        thread_num = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if(thread_num > source_num)
+        thread_num = source_num > 0 ? source_num : 1;
+
+    batch.jobs = calloc(source_num > 0 ? source_num : 1, sizeof(struct BatchJob));
+    batch.job_num = source_num;
+    batch.next_job = 0;
+    batch.max_steps = max_steps;
+    for(i = 0; i < source_num; i++) {
+        batch.jobs[i].src = sources[i];
+        set_out_path(&batch.jobs[i]);
+    }
+
+    threads = malloc(sizeof(pthread_t)*thread_num);
+    for(i = 0; i < thread_num; i++)
+        pthread_create(&threads[i], NULL, batch_worker, &batch);
+    for(i = 0; i < thread_num; i++)
+        pthread_join(threads[i], NULL);
+    free(threads);
+    wall = now_sec() - begin;
+
+    for(i = 0; i < source_num; i++) {
+        struct BatchJob *job = &batch.jobs[i];
+
+        if(verbose)
+            printf("%8.3f ms  %s%s\n", job->elapsed*1e3, job->src, job->ok ? "" : " (failed)");
+        failed += !job->ok;
+        total += job->elapsed;
+    }
+    if(verbose)
+        printf("%d jobs, %d failed, %.3f ms with %d threads (%.3f ms of jobs)\n",
+               source_num, failed, wall*1e3, thread_num, total*1e3);
+    free(batch.jobs);
+    return failed;
+}
+
+static void add_source(char ***sources, int *source_num, int *capacity, char *path) {
+    if(*source_num == *capacity) {
+        *capacity = *capacity ? *capacity*2 : 64;
+        *sources = realloc(*sources, sizeof(char*)*(*capacity));
+    }
+    (*sources)[(*source_num)++] = path;
+}
+
+static int compare_str(const void *a, const void *b) {
+    return strcmp(*(char**)a, *(char**)b);
+}
+
+/*
+The .ps files of dir appended to *sources, sorted by name.
+Return 0 if path is not a directory.
+*/
+static int add_dir(char ***sources, int *source_num, int *capacity, char *path) {
+    DIR *dir = opendir(path);
+    struct dirent *ent;
+    int first = *source_num;
+
+    if(dir == NULL)
+        return 0;
+    while((ent = readdir(dir)) != NULL) {
+        int len = strlen(ent->d_name);
+        char *src;
+
+        if(len < 3 || strcmp(ent->d_name + len - 3, ".ps") != 0)
+            continue;
+        src = malloc(strlen(path) + 1 + len + 1);
+        sprintf(src, "%s/%s", path, ent->d_name);
+        add_source(sources, source_num, capacity, src);
+    }
+    closedir(dir);
+    qsort(*sources + first, *source_num - first, sizeof(char*), compare_str);
+    return 1;
+}
+
+
+/*
+test code
+*/
+
+static void assert_true(int boolflag) {
+    if(!boolflag) {
+        printf("assert fail\n");
+    }
+}
+
+/*
+The file begins with expect, and has nothing else if whole.
+*/
+static void assert_file_str(char *path, char *expect, int whole) {
+    size_t len;
+    char *actual = read_file(path, &len);
+
+    if(actual == NULL || strncmp(expect, actual, whole ? len + 1 : strlen(expect)) != 0)
+        printf("assert fail, %s is\n%s\nexpect\n%s\n", path, actual ? actual : "(none)", expect);
+    free(actual);
+}
+
+static void write_str(char *path, char *str) {
+    FILE *fp = fopen(path, "w");
+    fputs(str, fp);
+    fclose(fp);
+}
+
+static void test_set_out_path() {
+    struct BatchJob job;
+
+    job.src = "dir/fact.ps";
+    set_out_path(&job);
+    assert_true(strcmp(job.out, "dir/fact.out") == 0);
+    job.src = "fact.txt";
+    set_out_path(&job);
+    assert_true(strcmp(job.out, "fact.txt.out") == 0);
+}
+
+static void test_batch_run() {
+    char dir[] = "/tmp/ps_batch_testXXXXXX";
+    char path[128];
+    char **sources = NULL;
+    int source_num = 0, capacity = 0;
+    int i;
+
+    assert_true(mkdtemp(dir) != NULL);
+    snprintf(path, sizeof(path), "%s/b_fact.ps", dir);
+    write_str(path, "/f { dup 1 gt { dup 1 sub f mul } if } def 10 f dup = 1");
+    snprintf(path, sizeof(path), "%s/a_error.ps", dir);
+    write_str(path, "1 2 = foo");
+    snprintf(path, sizeof(path), "%s/c_loop.ps", dir);
+    write_str(path, "{1} {} while");
+    snprintf(path, sizeof(path), "%s/not_a_job.txt", dir);
+    write_str(path, "1");
+
+    assert_true(add_dir(&sources, &source_num, &capacity, dir));
+    assert_true(source_num == 3);
+    assert_true(strstr(sources[0], "a_error.ps") != NULL);
+    assert_true(strstr(sources[2], "c_loop.ps") != NULL);
+
+    assert_true(batch_run(sources, source_num, 100000, 2, 0) == 2);
+    snprintf(path, sizeof(path), "%s/b_fact.out", dir);
+    assert_file_str(path, "3628800\n1\n3628800\n", 1);
+    snprintf(path, sizeof(path), "%s/a_error.out", dir);
+    assert_file_str(path, "2\nerror: undefined name foo\n1\n", 1);
+    snprintf(path, sizeof(path), "%s/c_loop.out", dir);
+    /* and the stack at the stop */
+    assert_file_str(path, "error: step limit 100000 exceeded\n", 0);
+
+    for(i = 0; i < source_num; i++)
+        free(sources[i]);
+    free(sources);
+    {
+        char cmd[128];
+        snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+        assert_true(system(cmd) == 0);
+    }
+}
+
+static void run_unit_tests() {
+    test_set_out_path();
+    test_batch_run();
+
+    printf("all test done\n");
+}
+
+int main(int argc, char **argv) {
+    char **sources = NULL;
+    int source_num = 0, capacity = 0;
+    int thread_num = 0, verbose = 1;
+    long long max_steps = 0;
+    int i;
+
+    if(argc < 2) {
+        run_unit_tests();
+        return 0;
+    }
+
+    for(i = 1; i < argc; i++) {
+        if(strncmp(argv[i], "-j", 2) == 0) {
+            thread_num = atoi(argv[i] + 2);
+        } else if(strcmp(argv[i], "-steps") == 0 && i + 1 < argc) {
+            max_steps = atoll(argv[++i]);
+        } else if(strcmp(argv[i], "-q") == 0) {
+            verbose = 0;
+        } else if(!add_dir(&sources, &source_num, &capacity, argv[i])) {
+            add_source(&sources, &source_num, &capacity, strdup(argv[i]));
+        }
+    }
+
+    i = batch_run(sources, source_num, max_steps, thread_num, verbose);
+    while(source_num > 0)
+        free(sources[--source_num]);
+    free(sources);
+    return i > 0 ? 1 : 0;
+}
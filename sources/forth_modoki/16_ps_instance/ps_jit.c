@@ -0,0 +1,1058 @@
+/*
+JIT of exec arrays to ARM code, option 4 of forth_modoki.md chapter 09.
+
+gcc -O2 -DPS_NO_MAIN ps_jit.c ps.c cl_getc.c ../../casm_link/arm_emit/arm_emit.c -o ps_jit
+./ps_jit                    # run unit tests
+./ps_jit ../ps/factorial.ps # run a file with the JIT and print the stack left
+
+On other hosts the code can't be called, so the tests run it on the emulator
+of arm_asm/06_emu, and files run on the interpreter only:
+
+gcc -O2 -DPS_NO_MAIN -DEMU_NO_MAIN ps_jit.c ps.c cl_getc.c ../../casm_link/arm_emit/arm_emit.c ../../arm_asm/06_emu/emu.c -o ps_jit
+
+An exec array is compiled when it is started the JIT_HOT_STARTS-th time,
+into a function which runs the whole array:
+
+    struct ElementArray *code(struct PsInterp *ps, int frame);
+
+- numbers, add, sub, mul, the comparisons, pop, dup and exch are inlined.
+  The fast path checks the stack and the types, and calls the primitive otherwise.
+- other primitives are called directly.
+- "n jmp" and "n jmp_not_if" of chapter 13 become branches, and the locals
+  of chapter 14 (store, "n load", lpop) are accessed in co_stack at fixed offsets,
+  so while and repeat loops run without the VM loop.
+- user names and exec go back to the interpreter through ps_exec_name and ps_exec_top.
+  In tail position the exec array is returned instead, and the VM replaces the frame with it.
+
+Arrays with anything else, like a jmp whose offset is computed, are left to the interpreter,
+and so are instances with a step limit, as only the interpreter counts steps.
+A built-in name is bound at compile time and checked against ps->dict_version,
+a def of a new name since then sends it to ps_exec_name, and the array is compiled again.
+*/
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ps.h"
+#include "ps_jit.h"
+#include "primitive.h"
+#include "../../casm_link/arm_emit/arm_emit.h"
+
+#define JIT_HOT_STARTS 2
+#define JIT_CACHE_SIZE 256
+
+/*
+Registers of the generated code. r0-r3 and ip are scratch.
+stack_pos is kept in R_POS and written back around each call to C.
+*/
+#define R_PS 4
+#define R_STACK 5       /* &ps->stack[0] */
+#define R_POS 6         /* ps->stack_pos */
+#define R_LOCALS 7      /* &ps->co_stack[frame + 1], the first local of the frame */
+
+/* r4-r8, r14. r8 is not used, six registers keep sp 8 byte aligned at calls. */
+#define SAVED_REGS 0x41f0
+
+#define ELEM_SIZE ((int)sizeof(struct Element))
+#define ETYPE_OFF ((int)offsetof(struct Element, etype))
+#define NUMBER_OFF ((int)offsetof(struct Element, u.number))
+#define CO_ENTRY_SIZE ((int)sizeof(struct CoEntry))
+#define IS_CONT_OFF ((int)offsetof(struct CoEntry, is_cont))
+#define LOCAL_OFF ((int)offsetof(struct CoEntry, u.local))
+#define PS_OFF(field) ((int)offsetof(struct PsInterp, field))
+
+
+/*
+errors of the inlined code, the same as the interpreter
+*/
+
+static void jit_stack_underflow(struct PsInterp *ps) {
+    ps_fail(ps, "stack underflow");
+}
+
+static void jit_stack_overflow(struct PsInterp *ps) {
+    ps_fail(ps, "stack overflow");
+}
+
+static void jit_number_expected(struct PsInterp *ps) {
+    ps_fail(ps, "number expected");
+}
+
+static void jit_co_stack_overflow(struct PsInterp *ps) {
+    ps_fail(ps, "co_stack overflow");
+}
+
+
+/*
+compiler
+*/
+
+struct JitCompiler {
+    struct PsInterp *ps;
+    struct Emitter *e;
+    struct ElementArray *exec_array;
+    /* locals of the frame before each element, -1 while not known */
+    int *depth;
+    /* 1 for the op of "number op", which is compiled with its number */
+    char *fused;
+    /* 1 for the elements some jmp goes to */
+    char *target;
+    /* label of each element, labels[len] is the end */
+    int *labels;
+    int leave;
+    int fail_underflow, fail_overflow, fail_number, fail_co_overflow;
+};
+
+static int elem_shift() {
+    int shift = 0;
+
+    while((1 << shift) < ELEM_SIZE)
+        shift++;
+    return shift;
+}
+
+/*
+OP_JMP, OP_JMP_NOT_IF or OP_LOAD if element i is a number followed by it, -1 otherwise.
+*/
+static int fused_op(struct ElementArray *exec_array, int i) {
+    struct Element *elems = exec_array->elements;
+
+    if(elems[i].etype != ELEMENT_NUMBER || i + 1 >= exec_array->len || elems[i+1].etype != ELEMENT_OP)
+        return -1;
+    switch(elems[i+1].u.op) {
+        case OP_JMP:
+        case OP_JMP_NOT_IF:
+        case OP_LOAD:
+            return elems[i+1].u.op;
+    }
+    return -1;
+}
+
+/*
+Follow the jumps and count the locals before each element.
+Return 0 for arrays the interpreter has to run: a jmp or load whose operand
+is not a number just before it, a jmp out of the array or onto such an op,
+unreachable elements, and locals which don't exist.
+*/
+static int jit_analyze(struct JitCompiler *c) {
+    struct ElementArray *exec_array = c->exec_array;
+    int len = exec_array->len;
+    int i, d = 0;
+
+    for(i = 0; i <= len; i++)
+        c->depth[i] = -1;
+    c->depth[0] = 0;
+
+    for(i = 0; i < len; i++) {
+        struct Element *elem = &exec_array->elements[i];
+        int op = fused_op(exec_array, i);
+
+        if(c->depth[i] >= 0) {
+            if(d >= 0 && d != c->depth[i])
+                return 0;
+            d = c->depth[i];
+        }
+        if(d < 0)
+            return 0;
+        c->depth[i] = d;
+
+        if(op == OP_LOAD) {
+            if(elem->u.number < 0 || elem->u.number >= d)
+                return 0;
+        } else if(op >= 0) {
+            int n = elem->u.number, t;
+
+            if(n < -(i + 1) || n > len - (i + 1))
+                return 0;
+            t = i + 1 + n;
+            c->target[t] = 1;
+            if(t <= i + 1) {
+                if(c->depth[t] != d)
+                    return 0;
+            } else if(t < len) {
+                if(c->depth[t] >= 0 && c->depth[t] != d)
+                    return 0;
+                c->depth[t] = d;
+            }
+            if(op == OP_JMP)
+                d = -1;
+        }
+        if(op >= 0) {
+            c->fused[++i] = 1;
+            continue;
+        }
+
+        if(elem->etype == ELEMENT_OP) {
+            switch(elem->u.op) {
+                case OP_EXEC:
+                    break;
+                case OP_STORE:
+                    d++;
+                    break;
+                case OP_LPOP:
+                    if(d == 0)
+                        return 0;
+                    d--;
+                    break;
+                default:
+                    return 0;
+            }
+        }
+    }
+
+    for(i = 0; i < len; i++) {
+        if(c->target[i] && c->fused[i])
+            return 0;
+    }
+    return 1;
+}
+
+/* rd = &ps->stack[stack_pos] */
+static void emit_slot_addr(struct JitCompiler *c, int rd) {
+    emit_dp_reg(c->e, COND_AL, DP_ADD, rd, R_STACK, R_POS, SHIFT_LSL, elem_shift());
+}
+
+/* copy an element word by word through r3 */
+static void emit_copy_elem(struct Emitter *e, int dst, int dst_off, int src, int src_off) {
+    int i;
+
+    for(i = 0; i < ELEM_SIZE/4; i++) {
+        emit_ldr(e, 3, src, src_off + i*4);
+        emit_str(e, 3, dst, dst_off + i*4);
+    }
+}
+
+/*
+Call fn(ps, r1) with stack_pos written back, and return on an error.
+The result is left in r0.
+*/
+static void emit_call(struct JitCompiler *c, intptr_t fn) {
+    struct Emitter *e = c->e;
+
+    emit_str(e, R_POS, R_PS, PS_OFF(stack_pos));
+    emit_mov(e, 0, R_PS);
+    emit_mov_imm(e, REG_IP, (int)fn);
+    emit_blx(e, REG_IP);
+    emit_ldr(e, R_POS, R_PS, PS_OFF(stack_pos));
+    emit_ldrb(e, 1, R_PS, PS_OFF(error));
+    emit_cmp_imm(e, 1, 0);
+    emit_b_cond(e, COND_NE, c->labels[c->exec_array->len]);
+}
+
+static void emit_check_room(struct JitCompiler *c) {
+    emit_cmp_const(c->e, R_POS, STACK_SIZE, 0);
+    emit_b_cond(c->e, COND_GE, c->fail_overflow);
+}
+
+static void emit_push_number(struct JitCompiler *c, int number) {
+    struct Emitter *e = c->e;
+
+    emit_check_room(c);
+    emit_slot_addr(c, 0);
+    emit_mov_imm(e, 1, ELEMENT_NUMBER);
+    emit_str(e, 1, 0, ETYPE_OFF);
+    emit_mov_imm(e, 1, number);
+    emit_str(e, 1, 0, NUMBER_OFF);
+    emit_add_imm(e, R_POS, R_POS, 1);
+}
+
+/* push a copy of an element of the exec array, like a literal name */
+static void emit_push_elem(struct JitCompiler *c, struct Element *elem) {
+    emit_check_room(c);
+    emit_slot_addr(c, 0);
+    emit_mov_imm(c->e, 2, (int)(intptr_t)elem);
+    emit_copy_elem(c->e, 0, 0, 2, 0);
+    emit_add_imm(c->e, R_POS, R_POS, 1);
+}
+
+static int compare_cond(int id) {
+    switch(id) {
+        case PRIM_EQ:
+            return COND_EQ;
+        case PRIM_NEQ:
+            return COND_NE;
+        case PRIM_GT:
+            return COND_GT;
+        case PRIM_GE:
+            return COND_GE;
+        case PRIM_LT:
+            return COND_LT;
+        case PRIM_LE:
+            return COND_LE;
+    }
+    return -1;
+}
+
+/*
+Inline the fast path of primitive id, calling cfunc when it doesn't apply.
+Return 0 if id has no fast path.
+*/
+static int emit_inline_primitive(struct JitCompiler *c, int id, void (*cfunc)(struct PsInterp *ps)) {
+    struct Emitter *e = c->e;
+    int slow, next, i;
+
+    switch(id) {
+        case PRIM_ADD: case PRIM_SUB: case PRIM_MUL:
+        case PRIM_EQ: case PRIM_NEQ: case PRIM_GT: case PRIM_GE: case PRIM_LT: case PRIM_LE:
+        case PRIM_POP: case PRIM_DUP: case PRIM_EXCH:
+            break;
+        default:
+            return 0;
+    }
+    slow = emit_new_label(e);
+    next = emit_new_label(e);
+
+    switch(id) {
+        case PRIM_POP:
+            emit_cmp_imm(e, R_POS, 1);
+            emit_b_cond(e, COND_LT, slow);
+            emit_sub_imm(e, R_POS, R_POS, 1);
+            break;
+        case PRIM_DUP:
+            emit_cmp_imm(e, R_POS, 1);
+            emit_b_cond(e, COND_LT, slow);
+            emit_cmp_const(e, R_POS, STACK_SIZE, 0);
+            emit_b_cond(e, COND_GE, slow);
+            emit_slot_addr(c, 0);
+            emit_copy_elem(e, 0, 0, 0, -ELEM_SIZE);
+            emit_add_imm(e, R_POS, R_POS, 1);
+            break;
+        case PRIM_EXCH:
+            emit_cmp_imm(e, R_POS, 2);
+            emit_b_cond(e, COND_LT, slow);
+            emit_slot_addr(c, 0);
+            for(i = 0; i < ELEM_SIZE/4; i++) {
+                emit_ldr(e, 1, 0, -2*ELEM_SIZE + i*4);
+                emit_ldr(e, 2, 0, -ELEM_SIZE + i*4);
+                emit_str(e, 2, 0, -2*ELEM_SIZE + i*4);
+                emit_str(e, 1, 0, -ELEM_SIZE + i*4);
+            }
+            break;
+        default:
+            /* binary operation on two numbers, r1 op r2 */
+            emit_cmp_imm(e, R_POS, 2);
+            emit_b_cond(e, COND_LT, slow);
+            emit_slot_addr(c, 0);
+            emit_ldr(e, 1, 0, -2*ELEM_SIZE + ETYPE_OFF);
+            emit_cmp_imm(e, 1, ELEMENT_NUMBER);
+            emit_b_cond(e, COND_NE, slow);
+            emit_ldr(e, 2, 0, -ELEM_SIZE + ETYPE_OFF);
+            emit_cmp_imm(e, 2, ELEMENT_NUMBER);
+            emit_b_cond(e, COND_NE, slow);
+            emit_ldr(e, 1, 0, -2*ELEM_SIZE + NUMBER_OFF);
+            emit_ldr(e, 2, 0, -ELEM_SIZE + NUMBER_OFF);
+            if(id == PRIM_ADD) {
+                emit_add(e, 1, 1, 2);
+            } else if(id == PRIM_SUB) {
+                emit_sub(e, 1, 1, 2);
+            } else if(id == PRIM_MUL) {
+                emit_mul(e, 3, 1, 2);
+                emit_mov(e, 1, 3);
+            } else {
+                emit_cmp(e, 1, 2);
+                emit_mov_imm(e, 1, 0);
+                emit_dp_imm(e, compare_cond(id), DP_MOV, 1, 0, 1);
+            }
+            emit_str(e, 1, 0, -2*ELEM_SIZE + NUMBER_OFF);
+            emit_sub_imm(e, R_POS, R_POS, 1);
+            break;
+    }
+    emit_b(e, next);
+    emit_bind_label(e, slow);
+    emit_call(c, (intptr_t)cfunc);
+    emit_bind_label(e, next);
+    return 1;
+}
+
+static void emit_cfunc(struct JitCompiler *c, void (*cfunc)(struct PsInterp *ps)) {
+    if(!emit_inline_primitive(c, ps_cfunc_primitive(cfunc), cfunc))
+        emit_call(c, (intptr_t)cfunc);
+}
+
+/*
+Names and exec are run by the interpreter.
+At the end of the array without locals, the exec array is returned
+for the VM to run in place of this frame.
+*/
+static void emit_exec(struct JitCompiler *c, int i, char *name) {
+    int tail = c->depth[i] == 0 && ps_returns_from(c->exec_array, i + 1);
+
+    if(name != NULL) {
+        emit_mov_imm(c->e, 1, (int)(intptr_t)name);
+        emit_call(c, tail ? (intptr_t)ps_exec_name_tail : (intptr_t)ps_exec_name);
+    } else {
+        emit_call(c, tail ? (intptr_t)ps_exec_top_tail : (intptr_t)ps_exec_top);
+    }
+    if(tail)
+        emit_b(c->e, c->leave);
+}
+
+/*
+A built-in name runs inline while dict has got no new name since the compile,
+and through the interpreter after that.
+*/
+static void emit_name(struct JitCompiler *c, int i, char *name) {
+    struct Emitter *e = c->e;
+    struct Element prim;
+    int dynamic, next;
+
+    if(!ps_resolve_primitive(c->ps, name, &prim)) {
+        emit_exec(c, i, name);
+        return;
+    }
+    dynamic = emit_new_label(e);
+    next = emit_new_label(e);
+    emit_ldr(e, 0, R_PS, PS_OFF(dict_version));
+    emit_cmp_const(e, 0, c->ps->dict_version, 1);
+    emit_b_cond(e, COND_NE, dynamic);
+    emit_cfunc(c, prim.u.cfunc);
+    emit_b(e, next);
+    emit_bind_label(e, dynamic);
+    emit_exec(c, i, name);
+    emit_bind_label(e, next);
+}
+
+static void emit_fused(struct JitCompiler *c, int i, int op) {
+    struct Emitter *e = c->e;
+    int n = c->exec_array->elements[i].u.number;
+    int d = c->depth[i];
+
+    switch(op) {
+        case OP_JMP:
+            emit_b(e, c->labels[i + 1 + n]);
+            break;
+        case OP_JMP_NOT_IF:
+            emit_cmp_imm(e, R_POS, 1);
+            emit_b_cond(e, COND_LT, c->fail_underflow);
+            emit_sub_imm(e, R_POS, R_POS, 1);
+            emit_slot_addr(c, 0);
+            emit_ldr(e, 1, 0, ETYPE_OFF);
+            emit_cmp_imm(e, 1, ELEMENT_NUMBER);
+            emit_b_cond(e, COND_NE, c->fail_number);
+            emit_ldr(e, 1, 0, NUMBER_OFF);
+            emit_cmp_imm(e, 1, 0);
+            emit_b_cond(e, COND_EQ, c->labels[i + 1 + n]);
+            break;
+        case OP_LOAD:
+            emit_check_room(c);
+            emit_slot_addr(c, 0);
+            emit_copy_elem(e, 0, 0, R_LOCALS, (d - 1 - n)*CO_ENTRY_SIZE + LOCAL_OFF);
+            emit_add_imm(e, R_POS, R_POS, 1);
+            break;
+    }
+}
+
+static void emit_op(struct JitCompiler *c, int i, int op) {
+    struct Emitter *e = c->e;
+    int d = c->depth[i];
+
+    switch(op) {
+        case OP_EXEC:
+            emit_exec(c, i, NULL);
+            break;
+        case OP_STORE:
+            emit_cmp_imm(e, R_POS, 1);
+            emit_b_cond(e, COND_LT, c->fail_underflow);
+            emit_sub_imm(e, R_POS, R_POS, 1);
+            emit_ldr(e, 1, R_PS, PS_OFF(co_pos));
+            emit_cmp_const(e, 1, CO_STACK_SIZE, 2);
+            emit_b_cond(e, COND_GE, c->fail_co_overflow);
+            emit_add_imm(e, 1, 1, 1);
+            emit_str(e, 1, R_PS, PS_OFF(co_pos));
+            emit_mov_imm(e, 1, 0);
+            emit_str(e, 1, R_LOCALS, d*CO_ENTRY_SIZE + IS_CONT_OFF);
+            emit_slot_addr(c, 0);
+            emit_copy_elem(e, R_LOCALS, d*CO_ENTRY_SIZE + LOCAL_OFF, 0, 0);
+            break;
+        case OP_LPOP:
+            emit_ldr(e, 1, R_PS, PS_OFF(co_pos));
+            emit_sub_imm(e, 1, 1, 1);
+            emit_str(e, 1, R_PS, PS_OFF(co_pos));
+            break;
+    }
+}
+
+static void emit_fail(struct JitCompiler *c, int label, void (*fail)(struct PsInterp *ps)) {
+    emit_bind_label(c->e, label);
+    emit_call(c, (intptr_t)fail);
+}
+
+static void jit_emit(struct JitCompiler *c) {
+    struct Emitter *e = c->e;
+    struct ElementArray *exec_array = c->exec_array;
+    int len = exec_array->len;
+    int i;
+
+    for(i = 0; i <= len; i++)
+        c->labels[i] = emit_new_label(e);
+    c->leave = emit_new_label(e);
+    c->fail_underflow = emit_new_label(e);
+    c->fail_overflow = emit_new_label(e);
+    c->fail_number = emit_new_label(e);
+    c->fail_co_overflow = emit_new_label(e);
+
+    emit_push(e, SAVED_REGS);
+    emit_mov(e, R_PS, 0);
+    emit_mov_imm(e, REG_IP, PS_OFF(stack));
+    emit_add(e, R_STACK, R_PS, REG_IP);
+    emit_ldr(e, R_POS, R_PS, PS_OFF(stack_pos));
+    emit_add_imm(e, 1, 1, 1);
+    emit_mov_imm(e, REG_IP, CO_ENTRY_SIZE);
+    emit_mul(e, 2, 1, REG_IP);
+    emit_add(e, 2, 2, R_PS);
+    emit_mov_imm(e, REG_IP, PS_OFF(co_stack));
+    emit_add(e, R_LOCALS, 2, REG_IP);
+
+    for(i = 0; i < len; i++) {
+        struct Element *elem = &exec_array->elements[i];
+        int op = fused_op(exec_array, i);
+
+        emit_bind_label(e, c->labels[i]);
+        if(op >= 0) {
+            emit_fused(c, i, op);
+            emit_bind_label(e, c->labels[++i]);
+            continue;
+        }
+        switch(elem->etype) {
+            case ELEMENT_NUMBER:
+                emit_push_number(c, elem->u.number);
+                break;
+            case ELEMENT_EXECUTABLE_NAME:
+                emit_name(c, i, elem->u.name);
+                break;
+            case ELEMENT_C_FUNC:
+                emit_cfunc(c, elem->u.cfunc);
+                break;
+            case ELEMENT_OP:
+                emit_op(c, i, elem->u.op);
+                break;
+            default:
+                emit_push_elem(c, elem);
+                break;
+        }
+    }
+
+    /* the end, and the return after an error */
+    emit_bind_label(e, c->labels[len]);
+    emit_mov_imm(e, 0, 0);
+    emit_bind_label(e, c->leave);
+    emit_str(e, R_POS, R_PS, PS_OFF(stack_pos));
+    emit_pop(e, (SAVED_REGS & ~(1 << REG_LR)) | (1 << REG_PC));
+
+    emit_fail(c, c->fail_underflow, jit_stack_underflow);
+    emit_fail(c, c->fail_overflow, jit_stack_overflow);
+    emit_fail(c, c->fail_number, jit_number_expected);
+    emit_fail(c, c->fail_co_overflow, jit_co_stack_overflow);
+}
+
+/*
+Compile exec_array into e, which is reset first.
+Return the code, or NULL if the interpreter has to run the array.
+*/
+static int *jit_compile(struct Emitter *e, struct PsInterp *ps, struct ElementArray *exec_array) {
+    struct JitCompiler c;
+    int len = exec_array->len;
+    int ok;
+
+    if((1 << elem_shift()) != ELEM_SIZE)
+        return NULL;
+    c.ps = ps;
+    c.e = e;
+    c.exec_array = exec_array;
+    c.depth = malloc(sizeof(int)*(len + 1));
+    c.fused = calloc(len + 1, 1);
+    c.target = calloc(len + 1, 1);
+    c.labels = malloc(sizeof(int)*(len + 1));
+
+    emitter_reset(e);
+    ok = jit_analyze(&c);
+    if(ok)
+        jit_emit(&c);
+
+    free(c.depth);
+    free(c.fused);
+    free(c.target);
+    free(c.labels);
+    return ok ? emitter_finish(e) : NULL;
+}
+
+
+/*
+instances
+
+Each instance keeps the code of its arrays in a hash table by address,
+exec arrays live as long as the instance so the address is never reused.
+*/
+
+#ifdef __arm__
+
+struct JitEntry {
+    struct ElementArray *exec_array;
+    int starts;
+    /* the array can't be compiled, the interpreter always runs it */
+    int failed;
+    /* ps->dict_version at the compile */
+    int version;
+    struct Emitter code;
+    int *entry;
+    struct JitEntry *next;
+};
+
+/*
+Code compiled again for a newer dict_version may still be running
+in an outer call of the same array, so the old one is kept until ps_free.
+*/
+struct JitRetired {
+    struct Emitter code;
+    struct JitRetired *next;
+};
+
+struct PsJit {
+    struct JitEntry *entries[JIT_CACHE_SIZE];
+    struct JitRetired *retired;
+};
+
+static struct JitEntry *jit_entry(struct PsJit *jit, struct ElementArray *exec_array) {
+    unsigned int idx = ((uintptr_t)exec_array >> 3) % JIT_CACHE_SIZE;
+    struct JitEntry *entry;
+
+    for(entry = jit->entries[idx]; entry != NULL; entry = entry->next) {
+        if(entry->exec_array == exec_array)
+            return entry;
+    }
+    entry = calloc(1, sizeof(struct JitEntry));
+    entry->exec_array = exec_array;
+    entry->next = jit->entries[idx];
+    jit->entries[idx] = entry;
+    return entry;
+}
+
+static int jit_compile_entry(struct PsJit *jit, struct JitEntry *entry, struct PsInterp *ps) {
+    if(entry->entry != NULL) {
+        struct JitRetired *old = malloc(sizeof(struct JitRetired));
+        old->code = entry->code;
+        old->next = jit->retired;
+        jit->retired = old;
+    }
+    emitter_init(&entry->code, 256);
+    entry->version = ps->dict_version;
+    entry->entry = jit_compile(&entry->code, ps, entry->exec_array);
+    if(entry->entry == NULL) {
+        emitter_free(&entry->code);
+        entry->failed = 1;
+        return 0;
+    }
+    return 1;
+}
+
+static int jit_run(struct PsInterp *ps, struct CoEntry *cont, int frame) {
+    struct ElementArray *exec_array = cont->u.cont.exec_array;
+    struct ElementArray *(*code)(struct PsInterp *ps, int frame);
+    struct ElementArray *next;
+    struct JitEntry *entry;
+
+    /* only the interpreter counts steps, and the code starts without locals */
+    if(ps->max_steps > 0 || ps->co_pos != frame + 1)
+        return 0;
+    entry = jit_entry(ps->jit, exec_array);
+    if(entry->failed)
+        return 0;
+    if(entry->entry == NULL && ++entry->starts < JIT_HOT_STARTS)
+        return 0;
+    if((entry->entry == NULL || entry->version != ps->dict_version) && !jit_compile_entry(ps->jit, entry, ps))
+        return 0;
+
+    code = (struct ElementArray *(*)(struct PsInterp*, int))entry->entry;
+    next = code(ps, frame);
+    if(next != NULL) {
+        cont->u.cont.exec_array = next;
+        cont->u.cont.pc = 0;
+    } else {
+        cont->u.cont.pc = exec_array->len;
+    }
+    return 1;
+}
+
+static void jit_free(struct PsInterp *ps) {
+    struct PsJit *jit = ps->jit;
+    int i;
+
+    for(i = 0; i < JIT_CACHE_SIZE; i++) {
+        while(jit->entries[i] != NULL) {
+            struct JitEntry *next = jit->entries[i]->next;
+            if(jit->entries[i]->entry != NULL)
+                emitter_free(&jit->entries[i]->code);
+            free(jit->entries[i]);
+            jit->entries[i] = next;
+        }
+    }
+    while(jit->retired != NULL) {
+        struct JitRetired *next = jit->retired->next;
+        emitter_free(&jit->retired->code);
+        free(jit->retired);
+        jit->retired = next;
+    }
+    free(jit);
+    ps->jit = NULL;
+}
+
+int ps_jit_enable(struct PsInterp *ps) {
+    if(ps->jit == NULL)
+        ps->jit = calloc(1, sizeof(struct PsJit));
+    ps->jit_run = jit_run;
+    ps->jit_free = jit_free;
+    return 1;
+}
+
+#else
+
+int ps_jit_enable(struct PsInterp *ps) {
+    (void)ps;
+    return 0;
+}
+
+#endif
+
+
+#ifndef PS_JIT_NO_MAIN
+
+/*
+test code
+*/
+
+#ifndef __arm__
+#include "../../arm_asm/06_emu/emu.h"
+
+#define EMU_PS_ADDR 0x00200000
+#endif
+
+static void assert_true(int boolflag) {
+    if(!boolflag) {
+        printf("assert fail\n");
+    }
+}
+
+static char *stack_str(struct PsInterp *ps) {
+    static char buf[4096];
+    FILE *fp = fmemopen(buf, sizeof(buf), "w");
+
+    ps_print_stack(ps, fp);
+    fclose(fp);
+    return buf;
+}
+
+static struct Element number_elem(int number) {
+    struct Element elem;
+    elem.etype = ELEMENT_NUMBER;
+    elem.u.number = number;
+    return elem;
+}
+
+static struct Element op_elem(int op) {
+    struct Element elem;
+    elem.etype = ELEMENT_OP;
+    elem.u.op = op;
+    return elem;
+}
+
+static struct Element name_elem(char *name) {
+    struct Element elem;
+    elem.etype = ELEMENT_EXECUTABLE_NAME;
+    elem.u.name = name;
+    return elem;
+}
+
+static struct ElementArray *new_array(struct Element *elems, int len) {
+    struct ElementArray *res = malloc(sizeof(struct ElementArray) + sizeof(struct Element)*len);
+    res->len = len;
+    memcpy(res->elements, elems, sizeof(struct Element)*len);
+    return res;
+}
+
+/* the exec array of input "{ ... }", compiled by ps */
+static struct ElementArray *compile_str(struct PsInterp *ps, char *input) {
+    assert(ps_eval(ps, input) == 0);
+    assert(ps->stack_pos > 0 && ps->stack[ps->stack_pos - 1].etype == ELEMENT_EXEC_ARRAY);
+    return ps->stack[--ps->stack_pos].u.byte_codes;
+}
+
+/*
+Call code as the array of frame 0, natively on ARM and on the emulator elsewhere.
+On the emulator the addresses of C functions mean nothing,
+so only code which stays on the inline paths can run.
+Return r0.
+*/
+static int call_code(struct Emitter *e, int *code, struct PsInterp *ps) {
+    ps->co_stack[0].is_cont = 1;
+    ps->co_pos = 1;
+#ifdef __arm__
+    (void)e;
+    return (int)(intptr_t)((struct ElementArray *(*)(struct PsInterp*, int))code)(ps, 0);
+#else
+    {
+        static struct Emu emu;
+        unsigned int halt = EMU_LOAD_ADDR + e->pos*4;
+        int *image = malloc((e->pos + 1)*4);
+        int status;
+
+        memcpy(image, code, e->pos*4);
+        image[e->pos] = 0xeafffffe; /* b . */
+        emu_init(&emu);
+        emu_load(&emu, (unsigned char*)image, (e->pos + 1)*4);
+        memcpy(emu.ram + EMU_PS_ADDR, ps, sizeof(struct PsInterp));
+        emu.r[0] = EMU_PS_ADDR;
+        emu.r[1] = 0;
+        emu.r[13] = EMU_RAM_SIZE;
+        emu.r[14] = halt;
+        status = emu_run(&emu, 10000000);
+        if(status != EMU_HALTED || emu.r[15] != halt)
+            printf("emu %s at %08x\n", emu_status_name(status), emu.r[15]);
+        assert_true(status == EMU_HALTED && emu.r[15] == halt);
+        memcpy(ps, emu.ram + EMU_PS_ADDR, sizeof(struct PsInterp));
+        emu_free(&emu);
+        free(image);
+        return emu.r[0];
+    }
+#endif
+}
+
+/*
+Run exec_array with the stack made by init on the interpreter,
+and as JIT code on another instance, and compare the stacks.
+*/
+static void assert_same_as_interp(char *init, struct ElementArray *exec_array, char *expect) {
+    struct PsInterp *interp = ps_new(NULL);
+    struct PsInterp *jit = ps_new(NULL);
+    struct Emitter e;
+    int *code;
+    char actual[4096];
+
+    assert(ps_eval(interp, init) == 0);
+    interp->stack[interp->stack_pos].etype = ELEMENT_EXEC_ARRAY;
+    interp->stack[interp->stack_pos++].u.byte_codes = exec_array;
+    assert(ps_eval(interp, "exec") == 0);
+    if(strcmp(expect, stack_str(interp)) != 0)
+        printf("assert fail, interpreter stack is\n%s\nexpect\n%s\n", stack_str(interp), expect);
+
+    emitter_init(&e, 64);
+    assert(ps_eval(jit, init) == 0);
+    code = jit_compile(&e, jit, exec_array);
+    assert_true(code != NULL);
+    if(code != NULL) {
+        assert_true(call_code(&e, code, jit) == 0);
+        assert_true(jit->error[0] == '\0');
+        assert_true(jit->co_pos == 1);
+        strcpy(actual, stack_str(jit));
+        if(strcmp(expect, actual) != 0)
+            printf("assert fail, jit stack is\n%s\nexpect\n%s\n", actual, expect);
+    }
+    emitter_free(&e);
+    ps_free(interp);
+    ps_free(jit);
+}
+
+static void test_jit_arith() {
+    struct PsInterp *ps = ps_new(NULL);
+
+    assert_same_as_interp("", compile_str(ps, "{1 2 add 3 mul 4 sub}"), "5\n");
+    assert_same_as_interp("", compile_str(ps, "{2147483647 1 add -5 3 mul 7 -9 sub}"),
+                          "16\n-15\n-2147483648\n");
+    assert_same_as_interp("", compile_str(ps, "{3 4 lt 4 3 lt 5 5 eq 5 5 neq 2 1 ge 1 2 le 7 -2 gt -2 7 gt}"),
+                          "0\n1\n1\n1\n0\n1\n0\n1\n");
+    ps_free(ps);
+}
+
+static void test_jit_stack_ops() {
+    struct PsInterp *ps = ps_new(NULL);
+
+    assert_same_as_interp("", compile_str(ps, "{1 2 exch dup pop dup}"), "1\n1\n2\n");
+    /* the cond of factorial.ps */
+    assert_same_as_interp("10", compile_str(ps, "{dup 1 gt}"), "1\n10\n");
+    assert_same_as_interp("1", compile_str(ps, "{dup 1 gt}"), "0\n1\n");
+    ps_free(ps);
+}
+
+/*
+sum of 1 to 10 with two locals, like the code of while:
+store the sum and n, loop while n > 0, and load the sum.
+*/
+static void test_jit_locals_and_jumps() {
+    struct Element elems[] = {
+        number_elem(0), op_elem(OP_STORE),
+        number_elem(10), op_elem(OP_STORE),
+        /* 4: loop */
+        number_elem(0), op_elem(OP_LOAD),
+        number_elem(0), name_elem("gt"),
+        number_elem(17), op_elem(OP_JMP_NOT_IF),
+        number_elem(1), op_elem(OP_LOAD),
+        number_elem(0), op_elem(OP_LOAD),
+        name_elem("add"),
+        number_elem(0), op_elem(OP_LOAD),
+        number_elem(1), name_elem("sub"),
+        op_elem(OP_LPOP), op_elem(OP_LPOP),
+        name_elem("exch"),
+        op_elem(OP_STORE), op_elem(OP_STORE),
+        number_elem(-21), op_elem(OP_JMP),
+        /* 26: end */
+        number_elem(1), op_elem(OP_LOAD),
+        op_elem(OP_LPOP), op_elem(OP_LPOP)
+    };
+    struct Element skip[] = {
+        number_elem(1), number_elem(0), number_elem(3), op_elem(OP_JMP_NOT_IF), number_elem(2), number_elem(3)
+    };
+    struct ElementArray *sum = new_array(elems, sizeof(elems)/sizeof(elems[0]));
+    struct ElementArray *jmp_end = new_array(skip, sizeof(skip)/sizeof(skip[0]));
+
+    assert_same_as_interp("", sum, "55\n");
+    assert_same_as_interp("", jmp_end, "1\n");
+    jmp_end->elements[1] = number_elem(-1);
+    assert_same_as_interp("", jmp_end, "3\n2\n1\n");
+    free(sum);
+    free(jmp_end);
+}
+
+static int compiles(struct Element *elems, int len) {
+    struct ElementArray *exec_array = new_array(elems, len);
+    struct PsInterp *ps = ps_new(NULL);
+    struct Emitter e;
+    int *code;
+
+    emitter_init(&e, 64);
+    code = jit_compile(&e, ps, exec_array);
+    emitter_free(&e);
+    ps_free(ps);
+    free(exec_array);
+    return code != NULL;
+}
+
+static void test_jit_left_to_interp() {
+    struct Element computed_jmp[] = {number_elem(1), name_elem("dup"), op_elem(OP_JMP)};
+    struct Element out_of_array[] = {number_elem(5), op_elem(OP_JMP)};
+    struct Element onto_op[] = {number_elem(0), op_elem(OP_JMP)};
+    struct Element no_local[] = {number_elem(0), op_elem(OP_LOAD)};
+    struct Element no_lpop[] = {op_elem(OP_LPOP)};
+    struct Element unreachable[] = {number_elem(3), op_elem(OP_JMP), number_elem(7), number_elem(1)};
+    struct Element to_end[] = {number_elem(1), op_elem(OP_JMP)};
+    struct PsInterp *ps = ps_new(NULL);
+    struct Emitter e;
+    char *sources[] = {
+        "{1 {2} if}", "{1 {2} {3} ifelse}", "{{dup 1 gt} {1 sub} while}", "{3 {1} repeat}",
+        "{/x 1 def x {x} exec roll index =}"
+    };
+    int i;
+
+    assert_true(!compiles(computed_jmp, 3));
+    assert_true(!compiles(out_of_array, 2));
+    assert_true(!compiles(onto_op, 2));
+    assert_true(!compiles(no_local, 2));
+    assert_true(!compiles(no_lpop, 1));
+    assert_true(!compiles(unreachable, 4));
+    assert_true(compiles(to_end, 2));
+
+    /* everything the compiler of ps.c generates is compiled */
+    emitter_init(&e, 64);
+    for(i = 0; i < (int)(sizeof(sources)/sizeof(sources[0])); i++)
+        assert_true(jit_compile(&e, ps, compile_str(ps, sources[i])) != NULL);
+    emitter_free(&e);
+    ps_free(ps);
+}
+
+#ifdef __arm__
+
+static char *factorial_ps =
+    "/factorial { dup {dup 1 gt} { 1 sub exch 1 index mul exch } while pop } def 10 factorial";
+
+/*
+Programs run on an instance with the JIT and one without give the same stack and error.
+*/
+static void assert_same_program(char *input) {
+    struct PsInterp *interp = ps_new(NULL);
+    struct PsInterp *jit = ps_new(NULL);
+    char expect[4096];
+
+    assert(ps_jit_enable(jit));
+    ps_eval(interp, input);
+    ps_eval(jit, input);
+    strcpy(expect, stack_str(interp));
+    if(strcmp(interp->error, jit->error) != 0 || strcmp(expect, stack_str(jit)) != 0)
+        printf("assert fail, %s\njit: %s\n%s\ninterpreter: %s\n%s\n",
+               input, jit->error, stack_str(jit), interp->error, expect);
+    ps_free(interp);
+    ps_free(jit);
+}
+
+static void test_jit_programs() {
+    assert_same_program(factorial_ps);
+    assert_same_program("/f { dup 1 gt { dup 1 sub f mul } if } def 10 f 5 f");
+    assert_same_program("/down { dup 0 gt { 1 sub down } if } def 10000 down");
+    assert_same_program("0 10 { 1 add } repeat 3 { 5 { 2 mul } repeat } repeat");
+    assert_same_program("0 10 {dup 0 gt} {dup 3 -1 roll add exch 1 sub} while pop");
+    assert_same_program("/f { 3 4 add } def f f f /add { mul } def f f");
+    assert_same_program("/g { pop } def 1 g 2 g g");
+    assert_same_program("/h { 1 add } def 1 h h /x h");
+    assert_same_program("/z { div } def 8 2 z 4 2 z 1 0 z");
+}
+
+#endif
+
+static void run_unit_tests() {
+    test_jit_arith();
+    test_jit_stack_ops();
+    test_jit_locals_and_jumps();
+    test_jit_left_to_interp();
+#ifdef __arm__
+    test_jit_programs();
+#endif
+
+    printf("all test done\n");
+}
+
+static char *read_all(FILE *fp) {
+    char *buf = NULL;
+    size_t len = 0, capacity = 0, n;
+
+    do {
+        if(len + 4096 + 1 > capacity) {
+            capacity = capacity ? capacity*2 : 8192;
+            buf = realloc(buf, capacity);
+        }
+        n = fread(buf + len, 1, capacity - len - 1, fp);
+        len += n;
+    } while(n > 0);
+    buf[len] = '\0';
+    return buf;
+}
+
+int main(int argc, char **argv) {
+    struct PsInterp *ps;
+    FILE *fp;
+    char *input;
+    int res;
+
+    if(argc < 2) {
+        run_unit_tests();
+        return 0;
+    }
+    fp = fopen(argv[1], "r");
+    if(fp == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+    input = read_all(fp);
+    fclose(fp);
+
+    ps = ps_new(stdout);
+    if(!ps_jit_enable(ps))
+        fprintf(stderr, "no JIT on this host, running on the interpreter\n");
+    res = ps_eval(ps, input);
+    if(res != 0)
+        fprintf(stderr, "%s: %s\n", argv[1], ps->error);
+    ps_print_stack(ps, stdout);
+    ps_free(ps);
+    free(input);
+    return res != 0;
+}
+
+#endif
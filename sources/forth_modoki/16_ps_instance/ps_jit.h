@@ -0,0 +1,9 @@
+/*
+JIT of hot exec arrays to ARM code, see ps_jit.c.
+*/
+
+/*
+From now on, compile exec arrays of ps to native code once they are hot.
+Return 0 and leave ps to the interpreter on a host other than ARM.
+*/
+int ps_jit_enable(struct PsInterp *ps);